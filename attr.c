@@ -434,12 +434,16 @@ struct attr_stack {
 	unsigned num_matches;
 	unsigned alloc;
 	struct match_attr **attrs;
+	struct attr_index *index;
 };
 
+static void attr_index_free(struct attr_index *index);
+
 static void attr_stack_free(struct attr_stack *e)
 {
 	unsigned i;
 	free(e->origin);
+	attr_index_free(e->index);
 	for (i = 0; i < e->num_matches; i++) {
 		struct match_attr *a = e->attrs[i];
 		size_t j;
@@ -1114,14 +1118,311 @@ static int fill_one(struct all_attrs_item *all_attrs,
 	return rem;
 }
 
+/*
+ * The rules of a large attribute stack frame, indexed so that a path
+ * does not have to be compared to each of them. Rules matching the
+ * basename without wildcards, or with just a leading "*", are found by
+ * the basename or its suffix (see match_basename()); rules matching
+ * the pathname are found by the leading directory their pattern
+ * requires (see match_pathname()). All other rules are in "others".
+ * The lists hold positions in the frame's attrs[], in increasing order.
+ */
+struct attr_index_entry {
+	struct hashmap_entry ent;
+	unsigned *rules;
+	size_t nr, alloc;
+	size_t len;
+	char key[FLEX_ARRAY];
+};
+
+struct attr_index {
+	unsigned nr;
+	int ignore_case;
+	struct hashmap basenames;
+	struct hashmap suffixes;
+	struct hashmap leading_dirs;
+	size_t *suffix_lens;
+	size_t suffix_lens_nr, suffix_lens_alloc;
+	unsigned *others;
+	size_t others_nr, others_alloc;
+	unsigned *macros;
+	size_t macros_nr, macros_alloc;
+
+	/* scratch space for the rules matching one path */
+	unsigned *matched;
+	size_t matched_nr, matched_alloc;
+};
+
+/*
+ * Below this many rules in a frame, comparing a path to each of them is
+ * cheaper than looking them up.
+ */
+#define ATTR_INDEX_MIN_RULES 16
+
+struct attr_index_key {
+	const char *key;
+	size_t len;
+};
+
+static int attr_index_entry_cmp(const void *cmp_data UNUSED,
+				const struct hashmap_entry *a,
+				const struct hashmap_entry *b,
+				const void *keydata)
+{
+	const struct attr_index_entry *e1 =
+		container_of(a, const struct attr_index_entry, ent);
+	const struct attr_index_key *k = keydata;
+	struct attr_index_key k2;
+
+	if (!k) {
+		const struct attr_index_entry *e2 =
+			container_of(b, const struct attr_index_entry, ent);
+		k2.key = e2->key;
+		k2.len = e2->len;
+		k = &k2;
+	}
+	return e1->len != k->len || fspathncmp(e1->key, k->key, k->len);
+}
+
+static unsigned int attr_index_hash(const struct attr_index *index,
+				    const char *key, size_t len)
+{
+	return index->ignore_case ? memihash(key, len) : memhash(key, len);
+}
+
+static struct attr_index_entry *attr_index_lookup(const struct attr_index *index,
+						  const struct hashmap *map,
+						  const char *key, size_t len)
+{
+	struct attr_index_key k = { .key = key, .len = len };
+
+	return hashmap_get_entry_from_hash(map, attr_index_hash(index, key, len),
+					   &k, struct attr_index_entry, ent);
+}
+
+static void attr_index_add(struct attr_index *index, struct hashmap *map,
+			   const char *key, size_t len, unsigned pos)
+{
+	struct attr_index_entry *e = attr_index_lookup(index, map, key, len);
+
+	if (!e) {
+		FLEX_ALLOC_MEM(e, key, key, len);
+		e->len = len;
+		hashmap_entry_init(&e->ent, attr_index_hash(index, key, len));
+		hashmap_add(map, &e->ent);
+	}
+	ALLOC_GROW(e->rules, e->nr + 1, e->alloc);
+	e->rules[e->nr++] = pos;
+}
+
+static void attr_index_clear_map(struct hashmap *map)
+{
+	struct hashmap_iter iter;
+	struct attr_index_entry *e;
+
+	hashmap_for_each_entry(map, &iter, e, ent)
+		free(e->rules);
+	hashmap_clear_and_free(map, struct attr_index_entry, ent);
+}
+
+static void attr_index_free(struct attr_index *index)
+{
+	if (!index)
+		return;
+	attr_index_clear_map(&index->basenames);
+	attr_index_clear_map(&index->suffixes);
+	attr_index_clear_map(&index->leading_dirs);
+	free(index->suffix_lens);
+	free(index->others);
+	free(index->macros);
+	free(index->matched);
+	free(index);
+}
+
+static struct attr_index *build_attr_index(const struct attr_stack *stack)
+{
+	struct attr_index *index;
+	unsigned i;
+
+	CALLOC_ARRAY(index, 1);
+	index->nr = stack->num_matches;
+	index->ignore_case = repo_ignore_case(the_repository);
+	hashmap_init(&index->basenames, attr_index_entry_cmp, NULL, 0);
+	hashmap_init(&index->suffixes, attr_index_entry_cmp, NULL, 0);
+	hashmap_init(&index->leading_dirs, attr_index_entry_cmp, NULL, 0);
+
+	for (i = 0; i < stack->num_matches; i++) {
+		const struct match_attr *a = stack->attrs[i];
+		const struct pattern *pat = &a->u.pat;
+		const char *p = pat->pattern;
+		int prefix = pat->nowildcardlen;
+
+		if (a->is_macro) {
+			ALLOC_GROW(index->macros, index->macros_nr + 1,
+				   index->macros_alloc);
+			index->macros[index->macros_nr++] = i;
+			continue;
+		}
+
+		if (pat->flags & PATTERN_FLAG_NODIR) {
+			if (prefix == pat->patternlen) {
+				attr_index_add(index, &index->basenames,
+					       p, prefix, i);
+				continue;
+			}
+			if (pat->flags & PATTERN_FLAG_ENDSWITH) {
+				size_t len = pat->patternlen - 1, j;
+
+				attr_index_add(index, &index->suffixes,
+					       p + 1, len, i);
+				for (j = 0; j < index->suffix_lens_nr; j++)
+					if (index->suffix_lens[j] == len)
+						break;
+				if (j == index->suffix_lens_nr) {
+					ALLOC_GROW(index->suffix_lens,
+						   index->suffix_lens_nr + 1,
+						   index->suffix_lens_alloc);
+					index->suffix_lens[index->suffix_lens_nr++] = len;
+				}
+				continue;
+			}
+		} else {
+			const char *slash;
+
+			if (*p == '/') {
+				p++;
+				prefix--;
+			}
+			slash = memchr(p, '/', prefix);
+			if (slash) {
+				attr_index_add(index, &index->leading_dirs,
+					       p, slash - p, i);
+				continue;
+			}
+		}
+
+		ALLOC_GROW(index->others, index->others_nr + 1,
+			   index->others_alloc);
+		index->others[index->others_nr++] = i;
+	}
+
+	return index;
+}
+
+static struct attr_index *attr_stack_index(struct attr_stack *stack)
+{
+	if (stack->index &&
+	    (stack->index->nr != stack->num_matches ||
+	     stack->index->ignore_case != repo_ignore_case(the_repository))) {
+		attr_index_free(stack->index);
+		stack->index = NULL;
+	}
+	if (!stack->index)
+		stack->index = build_attr_index(stack);
+	return stack->index;
+}
+
+static void attr_index_match(struct attr_index *index,
+			     const struct attr_stack *stack,
+			     const unsigned *rules, size_t nr,
+			     const char *path, int pathlen,
+			     int basename_offset)
+{
+	const char *base = stack->origin ? stack->origin : "";
+	size_t i;
+
+	for (i = 0; i < nr; i++) {
+		const struct match_attr *a = stack->attrs[rules[i]];
+
+		if (path_matches(path, pathlen, basename_offset,
+				 &a->u.pat, base, stack->originlen)) {
+			ALLOC_GROW(index->matched, index->matched_nr + 1,
+				   index->matched_alloc);
+			index->matched[index->matched_nr++] = rules[i];
+		}
+	}
+}
+
+static void attr_index_match_key(struct attr_index *index,
+				 const struct attr_stack *stack,
+				 const struct hashmap *map,
+				 const char *key, size_t len,
+				 const char *path, int pathlen,
+				 int basename_offset)
+{
+	struct attr_index_entry *e = attr_index_lookup(index, map, key, len);
+
+	if (e)
+		attr_index_match(index, stack, e->rules, e->nr,
+				 path, pathlen, basename_offset);
+}
+
+static int unsigned_cmp(const void *a_, const void *b_)
+{
+	unsigned a = *(const unsigned *)a_, b = *(const unsigned *)b_;
+
+	return a < b ? -1 : a > b;
+}
+
+/*
+ * Like the loop in fill() over the rules of one frame, but only trying
+ * those that the index of the frame says may match.
+ */
+static int fill_from_index(const char *path, int pathlen, int basename_offset,
+			   struct attr_stack *stack,
+			   struct all_attrs_item *all_attrs, int rem)
+{
+	struct attr_index *index = attr_stack_index(stack);
+	int isdir = (pathlen && path[pathlen - 1] == '/');
+	const char *basename = path + basename_offset;
+	size_t basenamelen = pathlen - basename_offset - isdir;
+	const char *name = path, *slash;
+	size_t i;
+
+	index->matched_nr = 0;
+	attr_index_match_key(index, stack, &index->basenames,
+			     basename, basenamelen,
+			     path, pathlen, basename_offset);
+	for (i = 0; i < index->suffix_lens_nr; i++) {
+		size_t len = index->suffix_lens[i];
+
+		if (len > basenamelen)
+			continue;
+		attr_index_match_key(index, stack, &index->suffixes,
+				     basename + basenamelen - len, len,
+				     path, pathlen, basename_offset);
+	}
+	if (stack->originlen)
+		name = path + stack->originlen + 1;
+	if (name <= path + pathlen - isdir &&
+	    (slash = memchr(name, '/', path + pathlen - isdir - name)))
+		attr_index_match_key(index, stack, &index->leading_dirs,
+				     name, slash - name,
+				     path, pathlen, basename_offset);
+	attr_index_match(index, stack, index->others, index->others_nr,
+			 path, pathlen, basename_offset);
+
+	QSORT(index->matched, index->matched_nr, unsigned_cmp);
+	for (i = index->matched_nr; rem > 0 && i > 0; i--)
+		rem = fill_one(all_attrs, stack->attrs[index->matched[i - 1]], rem);
+
+	return rem;
+}
+
 static int fill(const char *path, int pathlen, int basename_offset,
-		const struct attr_stack *stack,
+		struct attr_stack *stack,
 		struct all_attrs_item *all_attrs, int rem)
 {
 	for (; rem > 0 && stack; stack = stack->prev) {
 		unsigned i;
 		const char *base = stack->origin ? stack->origin : "";
 
+		if (stack->num_matches >= ATTR_INDEX_MIN_RULES) {
+			rem = fill_from_index(path, pathlen, basename_offset,
+					      stack, all_attrs, rem);
+			continue;
+		}
+
 		for (i = stack->num_matches; 0 < rem && 0 < i; i--) {
 			const struct match_attr *a = stack->attrs[i - 1];
 			if (a->is_macro)
@@ -1141,10 +1442,24 @@ static int fill(const char *path, int pathlen, int basename_offset,
  * a macro needs to be expanded during the fill stage.
  */
 static void determine_macros(struct all_attrs_item *all_attrs,
-			     const struct attr_stack *stack)
+			     struct attr_stack *stack)
 {
 	for (; stack; stack = stack->prev) {
 		unsigned i;
+
+		if (stack->num_matches >= ATTR_INDEX_MIN_RULES) {
+			struct attr_index *index = attr_stack_index(stack);
+			size_t j;
+
+			for (j = index->macros_nr; j > 0; j--) {
+				const struct match_attr *ma =
+					stack->attrs[index->macros[j - 1]];
+				unsigned int n = ma->u.attr->attr_nr;
+				if (!all_attrs[n].macro)
+					all_attrs[n].macro = ma;
+			}
+			continue;
+		}
 		for (i = stack->num_matches; i > 0; i--) {
 			const struct match_attr *ma = stack->attrs[i - 1];
 			if (ma->is_macro) {
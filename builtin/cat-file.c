@@ -31,6 +31,7 @@
 #include "alias.h"
 #include "remote.h"
 #include "transport.h"
+#include "thread-utils.h"
 
 /*
  * Maximum length for a remote URL. While no universal standard exists,
@@ -63,6 +64,7 @@ struct batch_options {
 	char input_delim;
 	char output_delim;
 	const char *format;
+	int nr_threads;
 };
 
 static const char *force_path;
@@ -333,6 +335,16 @@ struct expand_data {
 	 */
 	unsigned skip_object_info : 1;
 
+	/*
+	 * With --threads, a worker thread has already looked up the object
+	 * info (with the result in "info_ret"), and may also have read the
+	 * object contents into "contents" for the output code to consume.
+	 */
+	unsigned prefetched : 1;
+	int info_ret;
+	void *contents;
+	size_t contents_size;
+
 	/*
 	 * Flags about when an object info is being fetched from remote.
 	 */
@@ -433,6 +445,40 @@ static void batch_write(struct batch_options *opt, const void *data, int len)
 		write_or_die(1, data, len);
 }
 
+/*
+ * Like stream_blob(), but hold the object read lock only while reading
+ * from the stream, not while writing to stdout, so that the --threads
+ * consumers are not held up by our output.
+ */
+static void batch_stream_blob(const struct object_id *oid)
+{
+	struct odb_read_stream *st;
+
+	obj_read_lock();
+	st = odb_read_stream_open(the_repository->objects, oid, NULL);
+	obj_read_unlock();
+	if (!st || st->type != OBJ_BLOB)
+		die("unable to stream %s to stdout", oid_to_hex(oid));
+
+	for (;;) {
+		char buf[1024 * 16];
+		ssize_t readlen;
+
+		obj_read_lock();
+		readlen = odb_read_stream_read(st, buf, sizeof(buf));
+		obj_read_unlock();
+		if (readlen < 0)
+			die("unable to stream %s to stdout", oid_to_hex(oid));
+		if (!readlen)
+			break;
+		write_or_die(1, buf, readlen);
+	}
+
+	obj_read_lock();
+	odb_read_stream_close(st);
+	obj_read_unlock();
+}
+
 static void print_object_or_die(struct batch_options *opt, struct expand_data *data)
 {
 	const struct object_id *oid = &data->oid;
@@ -442,13 +488,17 @@ static void print_object_or_die(struct batch_options *opt, struct expand_data *d
 	if (data->type == OBJ_BLOB) {
 		if (opt->buffer_output)
 			fflush(stdout);
-		if (opt->transform_mode) {
+		if (data->contents) {
+			batch_write(opt, data->contents, data->contents_size);
+			FREE_AND_NULL(data->contents);
+		} else if (opt->transform_mode) {
 			char *contents;
 			size_t size;
 
 			if (!data->rest)
 				die("missing path for '%s'", oid_to_hex(oid));
 
+			obj_read_lock();
 			if (opt->transform_mode == 'w') {
 				if (filter_object(data->rest, 0100644, oid,
 						  &contents, &size))
@@ -469,10 +519,11 @@ static void print_object_or_die(struct batch_options *opt, struct expand_data *d
 					    oid_to_hex(oid), data->rest);
 			} else
 				BUG("invalid transform_mode: %c", opt->transform_mode);
+			obj_read_unlock();
 			batch_write(opt, contents, size);
 			free(contents);
 		} else {
-			stream_blob(oid);
+			batch_stream_blob(oid);
 		}
 	}
 	else {
@@ -480,8 +531,15 @@ static void print_object_or_die(struct batch_options *opt, struct expand_data *d
 		size_t size;
 		void *contents;
 
-		contents = odb_read_object(the_repository->objects, oid,
-					   &type, &size);
+		if (data->contents) {
+			contents = data->contents;
+			type = data->type;
+			size = data->contents_size;
+			data->contents = NULL;
+		} else {
+			contents = odb_read_object(the_repository->objects, oid,
+						   &type, &size);
+		}
 		if (!contents)
 			die("object %s disappeared", oid_to_hex(oid));
 
@@ -524,6 +582,37 @@ static void report_object_status(struct batch_options *opt,
  * which the object may be accessed (though note that we may also rely on
  * data->oid, too). If "pack" is NULL, then offset is ignored.
  */
+static int batch_object_info(struct batch_options *opt,
+			     struct expand_data *data,
+			     struct packed_git *pack,
+			     off_t offset)
+{
+	int ret;
+
+	if (use_mailmap ||
+	    opt->objects_filter.choice == LOFC_BLOB_NONE ||
+	    opt->objects_filter.choice == LOFC_BLOB_LIMIT ||
+	    opt->objects_filter.choice == LOFC_OBJECT_TYPE)
+		data->info.typep = &data->type;
+	if (opt->objects_filter.choice == LOFC_BLOB_LIMIT)
+		data->info.sizep = &data->size;
+
+	if (pack) {
+		/* unlike the odb functions, this does not lock by itself */
+		obj_read_lock();
+		ret = packed_object_info(NULL, pack, offset, &data->info);
+		obj_read_unlock();
+	} else {
+		ret = odb_read_object_info_extended(the_repository->objects,
+						    &data->oid, &data->info,
+						    OBJECT_INFO_LOOKUP_REPLACE);
+	}
+	return ret;
+}
+
+/*
+ * See batch_object_info() for the meaning of "pack" and "offset".
+ */
 static void batch_object_write(const char *obj_name,
 			       struct strbuf *scratch,
 			       struct batch_options *opt,
@@ -534,20 +623,10 @@ static void batch_object_write(const char *obj_name,
 	if (!data->skip_object_info) {
 		int ret;
 
-		if (use_mailmap ||
-		    opt->objects_filter.choice == LOFC_BLOB_NONE ||
-		    opt->objects_filter.choice == LOFC_BLOB_LIMIT ||
-		    opt->objects_filter.choice == LOFC_OBJECT_TYPE)
-			data->info.typep = &data->type;
-		if (opt->objects_filter.choice == LOFC_BLOB_LIMIT)
-			data->info.sizep = &data->size;
-
-		if (pack)
-			ret = packed_object_info(NULL, pack, offset, &data->info);
+		if (data->prefetched)
+			ret = data->info_ret;
 		else
-			ret = odb_read_object_info_extended(the_repository->objects,
-							    &data->oid, &data->info,
-							    OBJECT_INFO_LOOKUP_REPLACE);
+			ret = batch_object_info(opt, data, pack, offset);
 		if (ret < 0) {
 			if (data->mode == S_IFGITLINK)
 				report_object_status(opt, NULL, &data->oid, "submodule");
@@ -618,19 +697,34 @@ static void batch_object_write(const char *obj_name,
 	}
 }
 
-static void batch_one_object(const char *obj_name,
-			     struct strbuf *scratch,
-			     struct batch_options *opt,
-			     struct expand_data *data)
+static enum get_oid_result batch_resolve_object(const char *obj_name,
+						struct batch_options *opt,
+						struct object_id *oid,
+						struct object_context *ctx)
 {
-	struct object_context ctx = {0};
 	int flags =
 		GET_OID_HASH_ANY |
 		(opt->follow_symlinks ? GET_OID_FOLLOW_SYMLINKS : 0);
 	enum get_oid_result result;
 
+	/*
+	 * Name resolution may look at packs directly, so it must not run
+	 * concurrently with the --threads workers reading objects.
+	 */
+	obj_read_lock();
 	result = get_oid_with_context(the_repository, obj_name,
-				      flags, &data->oid, &ctx);
+				      flags, oid, ctx);
+	obj_read_unlock();
+	return result;
+}
+
+static void batch_one_object_resolved(const char *obj_name,
+				      struct strbuf *scratch,
+				      struct batch_options *opt,
+				      struct expand_data *data,
+				      enum get_oid_result result,
+				      struct object_context *ctx)
+{
 	if (result != FOUND) {
 		switch (result) {
 		case MISSING_OBJECT:
@@ -660,22 +754,336 @@ static void batch_one_object(const char *obj_name,
 			break;
 		}
 		fflush(stdout);
-
-		goto out;
+		return;
 	}
 
-	if (ctx.mode == 0) {
+	if (ctx->mode == 0) {
 		printf("symlink %"PRIuMAX"%c%s%c",
-		       (uintmax_t)ctx.symlink_path.len,
-		       opt->output_delim, ctx.symlink_path.buf, opt->output_delim);
+		       (uintmax_t)ctx->symlink_path.len,
+		       opt->output_delim, ctx->symlink_path.buf, opt->output_delim);
 		fflush(stdout);
-		goto out;
+		return;
 	}
 
-	data->mode = ctx.mode;
+	data->mode = ctx->mode;
 	batch_object_write(obj_name, scratch, opt, data, NULL, 0);
+}
 
-out:
+/*
+ * With --threads, we use one producer thread and nr_threads consumer
+ * threads, much like "git grep" does. The main thread resolves object
+ * names and adds work_items to 'todo', the consumers look up and read
+ * the objects, and the main thread then writes out the results in the
+ * order in which they were added.
+ */
+struct batch_work_item {
+	/* NULL for objects coming from --batch-all-objects */
+	char *obj_name;
+	char *rest;
+	enum get_oid_result result;
+	struct object_context ctx;
+	struct packed_git *pack;
+	off_t offset;
+	enum batch_mode batch_mode;
+
+	struct expand_data data;
+	size_t reserved;
+	char done;
+};
+
+/*
+ * In the range [todo_done, todo_start) in 'todo' we have work_items
+ * that have been or are processed by a consumer thread. We haven't
+ * written the result for these to stdout yet.
+ *
+ * The work_items in [todo_start, todo_end) are waiting to be picked
+ * up by a consumer thread.
+ *
+ * The ranges are modulo TODO_SIZE.
+ */
+#define TODO_SIZE 128
+static struct batch_work_item todo[TODO_SIZE];
+static int todo_start;
+static int todo_end;
+static int todo_done;
+
+/* Has all work items been added? */
+static int all_work_added;
+
+/*
+ * Total size of object contents read ahead by the consumers, which is
+ * capped so that memory use stays flat even when the queue holds many
+ * large objects. Objects that do not fit are read by the main thread.
+ */
+#define PREFETCH_LIMIT (64 * 1024 * 1024)
+static size_t prefetched_bytes;
+
+/* This lock protects all the variables above. */
+static pthread_mutex_t batch_mutex;
+
+/* Signalled when a new work_item is added to todo. */
+static pthread_cond_t cond_add;
+
+/* Signalled when a consumer is done with a work_item. */
+static pthread_cond_t cond_result;
+
+static pthread_t *threads;
+static int nr_threads;
+
+static inline void batch_lock(void)
+{
+	pthread_mutex_lock(&batch_mutex);
+}
+
+static inline void batch_unlock(void)
+{
+	pthread_mutex_unlock(&batch_mutex);
+}
+
+static void copy_expand_data(struct expand_data *dst,
+			     const struct expand_data *src)
+{
+	*dst = *src;
+
+	/* point the object_info at our own copy */
+	if (src->info.typep)
+		dst->info.typep = &dst->type;
+	if (src->info.sizep)
+		dst->info.sizep = &dst->size;
+	if (src->info.disk_sizep)
+		dst->info.disk_sizep = &dst->disk_size;
+	if (src->info.delta_base_oid)
+		dst->info.delta_base_oid = &dst->delta_base_oid;
+}
+
+static struct batch_work_item *get_work(void)
+{
+	struct batch_work_item *ret;
+
+	batch_lock();
+	while (todo_start == todo_end && !all_work_added)
+		pthread_cond_wait(&cond_add, &batch_mutex);
+
+	if (todo_start == todo_end && all_work_added) {
+		ret = NULL;
+	} else {
+		ret = &todo[todo_start];
+		todo_start = (todo_start + 1) % ARRAY_SIZE(todo);
+	}
+	batch_unlock();
+	return ret;
+}
+
+static void prefetch_object(struct batch_options *opt,
+			    struct batch_work_item *w)
+{
+	struct expand_data *data = &w->data;
+	enum object_type type;
+	int fits;
+
+	if (data->skip_object_info)
+		return;
+	if (w->obj_name && (w->result != FOUND || !w->ctx.mode))
+		return;
+
+	data->info_ret = batch_object_info(opt, data, w->pack, w->offset);
+	data->prefetched = 1;
+
+	if (data->info_ret < 0 || w->batch_mode != BATCH_MODE_CONTENTS ||
+	    opt->transform_mode)
+		return;
+
+	batch_lock();
+	fits = prefetched_bytes + data->size <= PREFETCH_LIMIT;
+	if (fits) {
+		prefetched_bytes += data->size;
+		w->reserved = data->size;
+	}
+	batch_unlock();
+	if (!fits)
+		return;
+
+	data->contents = odb_read_object(the_repository->objects, &data->oid,
+					 &type, &data->contents_size);
+	if (data->contents && type != data->type) {
+		/* let the main thread notice and complain */
+		FREE_AND_NULL(data->contents);
+	}
+}
+
+static void *run(void *arg)
+{
+	struct batch_options *opt = arg;
+
+	while (1) {
+		struct batch_work_item *w = get_work();
+		if (!w)
+			break;
+
+		prefetch_object(opt, w);
+
+		batch_lock();
+		w->done = 1;
+		pthread_cond_signal(&cond_result);
+		batch_unlock();
+	}
+
+	return NULL;
+}
+
+static void start_threads(struct batch_options *opt)
+{
+	int i;
+
+	pthread_mutex_init(&batch_mutex, NULL);
+	pthread_cond_init(&cond_add, NULL);
+	pthread_cond_init(&cond_result, NULL);
+	enable_obj_read_lock();
+
+	nr_threads = opt->nr_threads;
+	CALLOC_ARRAY(threads, nr_threads);
+	for (i = 0; i < nr_threads; i++) {
+		int err = pthread_create(&threads[i], NULL, run, opt);
+		if (err)
+			die(_("cat-file: failed to create thread: %s"),
+			    strerror(err));
+	}
+}
+
+/*
+ * Write out the result of the oldest work_item, if it is done, or if
+ * "wait" is set, after waiting for it. Returns 0 if there was nothing
+ * to write.
+ */
+static int write_one_result(struct batch_options *opt, struct strbuf *scratch,
+			    int wait)
+{
+	struct batch_work_item *w;
+	int done;
+
+	batch_lock();
+	if (todo_done == todo_end) {
+		batch_unlock();
+		return 0;
+	}
+	w = &todo[todo_done];
+	while (wait && !w->done)
+		pthread_cond_wait(&cond_result, &batch_mutex);
+	done = w->done;
+	batch_unlock();
+	if (!done)
+		return 0;
+
+	/*
+	 * The item cannot be reused until we advance todo_done below, so we
+	 * can work on it without holding the lock. Writing it out may read
+	 * objects itself (e.g. when streaming large blobs); those reads take
+	 * the object read lock, but writing to stdout does not.
+	 */
+	opt->batch_mode = w->batch_mode;
+	if (w->obj_name)
+		batch_one_object_resolved(w->obj_name, scratch, opt, &w->data,
+					  w->result, &w->ctx);
+	else
+		batch_object_write(NULL, scratch, opt, &w->data,
+				   w->pack, w->offset);
+
+	free(w->data.contents);
+	FREE_AND_NULL(w->obj_name);
+	FREE_AND_NULL(w->rest);
+	object_context_release(&w->ctx);
+
+	batch_lock();
+	prefetched_bytes -= w->reserved;
+	todo_done = (todo_done + 1) % ARRAY_SIZE(todo);
+	batch_unlock();
+	return 1;
+}
+
+static void write_all_results(struct batch_options *opt, struct strbuf *scratch)
+{
+	while (write_one_result(opt, scratch, 1))
+		; /* nothing */
+}
+
+static void add_work(struct batch_options *opt, struct strbuf *scratch,
+		     const struct expand_data *data, const char *obj_name,
+		     enum get_oid_result result, struct object_context *ctx,
+		     struct packed_git *pack, off_t offset)
+{
+	struct batch_work_item *w;
+
+	while ((todo_end + 1) % ARRAY_SIZE(todo) == todo_done)
+		write_one_result(opt, scratch, 1);
+
+	w = &todo[todo_end];
+	w->obj_name = xstrdup_or_null(obj_name);
+	w->rest = xstrdup_or_null(data->rest);
+	w->result = result;
+	if (ctx) {
+		w->ctx = *ctx;
+		memset(ctx, 0, sizeof(*ctx));
+	} else {
+		memset(&w->ctx, 0, sizeof(w->ctx));
+	}
+	w->pack = pack;
+	w->offset = offset;
+	w->batch_mode = opt->batch_mode;
+	w->reserved = 0;
+	w->done = 0;
+
+	copy_expand_data(&w->data, data);
+	w->data.rest = w->rest;
+	if (w->obj_name && result == FOUND)
+		w->data.mode = w->ctx.mode;
+	if (w->batch_mode == BATCH_MODE_CONTENTS)
+		w->data.info.sizep = &w->data.size;
+
+	batch_lock();
+	todo_end = (todo_end + 1) % ARRAY_SIZE(todo);
+	pthread_cond_signal(&cond_add);
+	batch_unlock();
+
+	while (write_one_result(opt, scratch, 0))
+		; /* nothing */
+}
+
+static void finish_threads(struct batch_options *opt, struct strbuf *scratch)
+{
+	int i;
+
+	write_all_results(opt, scratch);
+
+	batch_lock();
+	all_work_added = 1;
+	pthread_cond_broadcast(&cond_add);
+	batch_unlock();
+
+	for (i = 0; i < nr_threads; i++)
+		pthread_join(threads[i], NULL);
+	FREE_AND_NULL(threads);
+	nr_threads = 0;
+
+	disable_obj_read_lock();
+	pthread_mutex_destroy(&batch_mutex);
+	pthread_cond_destroy(&cond_add);
+	pthread_cond_destroy(&cond_result);
+}
+
+static void batch_one_object(const char *obj_name,
+			     struct strbuf *scratch,
+			     struct batch_options *opt,
+			     struct expand_data *data)
+{
+	struct object_context ctx = {0};
+	enum get_oid_result result;
+
+	result = batch_resolve_object(obj_name, opt, &data->oid, &ctx);
+	if (nr_threads)
+		add_work(opt, scratch, data, obj_name, result, &ctx, NULL, 0);
+	else
+		batch_one_object_resolved(obj_name, scratch, opt, data,
+					  result, &ctx);
 	object_context_release(&ctx);
 }
 
@@ -746,8 +1154,12 @@ static int batch_object_cb(const struct object_id *oid, void *vdata)
 {
 	struct object_cb_data *data = vdata;
 	oidcpy(&data->expand->oid, oid);
-	batch_object_write(NULL, data->scratch, data->opt, data->expand,
-			   NULL, 0);
+	if (nr_threads)
+		add_work(data->opt, data->scratch, data->expand, NULL,
+			 FOUND, NULL, NULL, 0);
+	else
+		batch_object_write(NULL, data->scratch, data->opt, data->expand,
+				   NULL, 0);
 	return 0;
 }
 
@@ -771,8 +1183,12 @@ static int batch_unordered_object(const struct object_id *oid,
 		return 0;
 
 	oidcpy(&data->expand->oid, oid);
-	batch_object_write(NULL, data->scratch, data->opt, data->expand,
-			   pack, offset);
+	if (nr_threads)
+		add_work(data->opt, data->scratch, data->expand, NULL,
+			 FOUND, NULL, pack, offset);
+	else
+		batch_object_write(NULL, data->scratch, data->opt, data->expand,
+				   pack, offset);
 	return 0;
 }
 
@@ -927,9 +1343,19 @@ static void dispatch_calls(struct batch_options *opt,
 	if (!opt->buffer_output)
 		die(_("flush is only for --buffer mode"));
 
-	for (size_t i = 0; i < nr; i++)
+	for (size_t i = 0; i < nr; i++) {
+		/*
+		 * Only "contents" and "info" go through the --threads
+		 * workers; anything else must see their results first.
+		 */
+		if (nr_threads &&
+		    cmd[i].fn != parse_cmd_contents && cmd[i].fn != parse_cmd_info)
+			write_all_results(opt, output);
 		cmd[i].fn(opt, cmd[i].line, output, data);
+	}
 
+	if (nr_threads)
+		write_all_results(opt, output);
 	fflush(stdout);
 }
 
@@ -1095,6 +1521,9 @@ static int batch_objects(struct batch_options *opt)
 	if (opt->batch_mode == BATCH_MODE_CONTENTS)
 		data.info.typep = &data.type;
 
+	if (opt->nr_threads > 1)
+		start_threads(opt);
+
 	if (opt->all_objects) {
 		struct object_cb_data cb;
 		struct object_info empty = OBJECT_INFO_INIT;
@@ -1130,6 +1559,8 @@ static int batch_objects(struct batch_options *opt)
 			oid_array_clear(&sa);
 		}
 
+		if (nr_threads)
+			finish_threads(opt, &output);
 		strbuf_release(&output);
 		return 0;
 	}
@@ -1168,6 +1599,8 @@ static int batch_objects(struct batch_options *opt)
 	}
 
  cleanup:
+	if (nr_threads)
+		finish_threads(opt, &output);
 	strbuf_release(&input);
 	strbuf_release(&output);
 	string_list_clear(&data.remote_allowed_atoms, 0);
@@ -1236,7 +1669,7 @@ int cmd_cat_file(int argc,
 		   "             [<rev>:<path|tree-ish> | --path=<path|tree-ish> <rev>]"),
 		N_("git cat-file (--batch | --batch-check | --batch-command) [--batch-all-objects]\n"
 		   "             [--buffer] [--follow-symlinks] [--unordered]\n"
-		   "             [--textconv | --filters] [-Z]"),
+		   "             [--textconv | --filters] [--threads=<n>] [-Z]"),
 		NULL
 	};
 	const struct option options[] = {
@@ -1279,6 +1712,8 @@ int cmd_cat_file(int argc,
 			 N_("follow in-tree symlinks")),
 		OPT_BOOL(0, "unordered", &batch.unordered,
 			 N_("do not order objects before emitting them")),
+		OPT_INTEGER(0, "threads", &batch.nr_threads,
+			    N_("use <n> threads to look up objects")),
 		/* Textconv options, stand-ole*/
 		OPT_GROUP(N_("Emit object (blob or tree) with conversion or filter (stand-alone, or with batch)")),
 		OPT_CMDMODE(0, "textconv", &opt,
@@ -1294,6 +1729,7 @@ int cmd_cat_file(int argc,
 	repo_config(the_repository, git_cat_file_config, NULL);
 
 	batch.buffer_output = -1;
+	batch.nr_threads = 1;
 
 	argc = parse_options(argc, argv, prefix, options, builtin_catfile_usage, 0);
 	opt_cw = (opt == 'c' || opt == 'w');
@@ -1345,6 +1781,9 @@ int cmd_cat_file(int argc,
 	else if (nul_terminated)
 		usage_msg_optf(_("'%s' requires a batch mode"), builtin_catfile_usage,
 			       options, "-Z");
+	else if (batch.nr_threads != 1)
+		usage_msg_optf(_("'%s' requires a batch mode"), builtin_catfile_usage,
+			       options, "--threads");
 
 	batch.input_delim = batch.output_delim = '\n';
 	if (input_nul_terminated)
@@ -1356,6 +1795,22 @@ int cmd_cat_file(int argc,
 	if (batch.buffer_output < 0)
 		batch.buffer_output = batch.all_objects;
 
+	if (batch.nr_threads < 0)
+		die(_("invalid number of threads specified (%d)"), batch.nr_threads);
+	else if (!HAVE_THREADS && batch.nr_threads != 1) {
+		warning(_("no threads support, ignoring %s"), "--threads");
+		batch.nr_threads = 1;
+	} else if (!batch.nr_threads)
+		batch.nr_threads = online_cpus();
+	/*
+	 * Results are held back until all earlier ones are written, which
+	 * would deadlock a caller that waits for each answer before asking
+	 * the next question.
+	 */
+	if (batch.nr_threads > 1 && !batch.buffer_output)
+		usage_msg_optf(_("'%s' requires '%s'"), builtin_catfile_usage,
+			       options, "--threads", "--buffer");
+
 	prepare_repo_settings(the_repository);
 	the_repository->settings.command_requires_full_index = 0;
 
@@ -23,6 +23,8 @@
 #include "resolve-undo.h"
 #include "run-command.h"
 #include "sparse-index.h"
+#include "thread-utils.h"
+#include "trace2.h"
 #include "worktree.h"
 #include "pack-revindex.h"
 #include "pack-bitmap.h"
@@ -47,6 +49,7 @@ static int errors_found;
 static int write_lost_and_found;
 static int verbose;
 static int show_progress = -1;
+static int nr_threads = 1;
 static int show_dangling = 1;
 static int name_objects;
 static int check_references = 1;
@@ -982,7 +985,8 @@ static char const * const fsck_usage[] = {
 	N_("git fsck [--tags] [--root] [--unreachable] [--cache] [--no-reflogs]\n"
 	   "         [--[no-]full] [--strict] [--verbose] [--lost-found]\n"
 	   "         [--[no-]dangling] [--[no-]progress] [--connectivity-only]\n"
-	   "         [--[no-]name-objects] [--[no-]references] [<object>...]"),
+	   "         [--[no-]name-objects] [--[no-]references] [--threads=<n>]\n"
+	   "         [<object>...]"),
 	NULL
 };
 
@@ -1002,6 +1006,7 @@ static struct option fsck_opts[] = {
 	OPT_BOOL(0, "progress", &show_progress, N_("show progress")),
 	OPT_BOOL(0, "name-objects", &name_objects, N_("show verbose names for reachable objects")),
 	OPT_BOOL(0, "references", &check_references, N_("check reference database consistency")),
+	OPT_INTEGER(0, "threads", &nr_threads, N_("use <n> threads to verify packed objects")),
 	OPT_END(),
 };
 
@@ -1040,6 +1045,15 @@ int cmd_fsck(int argc,
 	if (verbose)
 		show_progress = 0;
 
+	if (nr_threads < 0)
+		die(_("invalid number of threads specified (%d)"), nr_threads);
+	if (!nr_threads)
+		nr_threads = online_cpus();
+	if (!HAVE_THREADS && nr_threads != 1) {
+		warning(_("no threads support, ignoring --threads"));
+		nr_threads = 1;
+	}
+
 	if (write_lost_and_found) {
 		check_full = 1;
 		include_reflogs = 0;
@@ -1065,6 +1079,7 @@ int cmd_fsck(int argc,
 	/* Ensure we get a "fresh" view of the odb */
 	odb_reprepare(repo->objects);
 
+	trace2_region_enter("fsck", "objects", repo);
 	if (connectivity_only) {
 		odb_for_each_object(repo->objects, NULL,
 				    mark_object_for_connectivity, repo, 0);
@@ -1093,7 +1108,7 @@ int cmd_fsck(int argc,
 				/* verify gives error messages itself */
 				if (verify_pack(repo,
 						p, fsck_obj_buffer, repo,
-						progress, count))
+						progress, count, nr_threads))
 					errors_found |= ERROR_PACK;
 				count += p->num_objects;
 			}
@@ -1103,9 +1118,12 @@ int cmd_fsck(int argc,
 		if (fsck_finish(&fsck_obj_options))
 			errors_found |= ERROR_OBJECT;
 	}
+	trace2_region_leave("fsck", "objects", repo);
 
 	/* Process the snapshotted refs and the reflogs. */
+	trace2_region_enter("fsck", "refs", repo);
 	process_refs(repo, &snap);
+	trace2_region_leave("fsck", "refs", repo);
 
 	/* If not given any explicit objects, process index files too. */
 	if (!argc)
@@ -1150,7 +1168,9 @@ int cmd_fsck(int argc,
 	if (verify_bitmap_files(repo))
 		errors_found |= ERROR_BITMAP;
 
+	trace2_region_enter("fsck", "connectivity", repo);
 	check_connectivity(repo);
+	trace2_region_leave("fsck", "connectivity", repo);
 
 	if (repo->settings.core_commit_graph) {
 		struct child_process commit_graph_verify = CHILD_PROCESS_INIT;
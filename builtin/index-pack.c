@@ -102,6 +102,29 @@ static LIST_HEAD(done_head);
 static size_t base_cache_used;
 static size_t base_cache_limit;
 
+/*
+ * Queue of inflated non-delta objects, filled by the thread reading
+ * the pack in the first pass and drained by threads that hash and check
+ * them. Bounded both in entries and in bytes of queued data.
+ *
+ * Guarded by work_mutex.
+ */
+#define HASH_QUEUE_SIZE 256
+#define HASH_QUEUE_BYTES (64 * 1024 * 1024)
+
+struct hash_work {
+	struct object_entry *obj;
+	void *data;
+};
+static struct hash_work hash_queue[HASH_QUEUE_SIZE];
+static unsigned int hash_queue_start, hash_queue_nr;
+static size_t hash_queue_bytes;
+static int hash_queue_done;
+static pthread_cond_t hash_queue_avail, hash_queue_room;
+
+/* Number of threads hashing objects in the first pass, if any */
+static int nr_hash_threads;
+
 struct thread_local_data {
 	pthread_t thread;
 	int pack_fd;
@@ -479,18 +502,23 @@ static void *unpack_entry_data(off_t offset, size_t size,
 	char hdr[32];
 	int hdrlen;
 
-	if (!is_delta_type(type)) {
-		hdrlen = format_object_header(hdr, sizeof(hdr), type, size);
-		git_hash_init(&c, the_hash_algo);
-		git_hash_update(&c, hdr, hdrlen);
-	} else
-		oid = NULL;
 	if (type == OBJ_BLOB &&
 	    size > repo_settings_get_big_file_threshold(the_repository))
 		buf = fixed_buf;
 	else
 		buf = xmallocz(size);
 
+	/*
+	 * When hashing threads are running, they hash what we return;
+	 * only the large blobs we do not keep in memory are hashed here.
+	 */
+	if (!is_delta_type(type) && (!nr_hash_threads || buf == fixed_buf)) {
+		hdrlen = format_object_header(hdr, sizeof(hdr), type, size);
+		git_hash_init(&c, the_hash_algo);
+		git_hash_update(&c, hdr, hdrlen);
+	} else
+		oid = NULL;
+
 	memset(&stream, 0, sizeof(stream));
 	git_inflate_init(&stream);
 	stream.next_out = buf;
@@ -1241,6 +1269,109 @@ static void *threaded_second_pass(void *data)
 	return NULL;
 }
 
+/* How many queued objects a thread takes to hash at once */
+#define HASH_BATCH 8
+
+static void *hash_objects_thread(void *data)
+{
+	set_thread_data(data);
+	for (;;) {
+		struct hash_work work[HASH_BATCH];
+		struct hash_object_request req[HASH_BATCH];
+		unsigned int i, nr = 0;
+
+		work_lock();
+		while (!hash_queue_nr && !hash_queue_done)
+			pthread_cond_wait(&hash_queue_avail, &work_mutex);
+		while (hash_queue_nr && nr < HASH_BATCH) {
+			work[nr] = hash_queue[hash_queue_start];
+			hash_queue_start = (hash_queue_start + 1) % HASH_QUEUE_SIZE;
+			hash_queue_nr--;
+			hash_queue_bytes -= work[nr].obj->size;
+			nr++;
+		}
+		pthread_cond_signal(&hash_queue_room);
+		work_unlock();
+		if (!nr)
+			break;
+
+		for (i = 0; i < nr; i++) {
+			req[i].buf = work[i].data;
+			req[i].len = work[i].obj->size;
+			req[i].type = work[i].obj->type;
+			req[i].oid = &work[i].obj->idx.oid;
+		}
+		hash_object_file_batch(the_hash_algo, req, nr);
+
+		for (i = 0; i < nr; i++) {
+			sha1_object(work[i].data, NULL, work[i].obj->size,
+				    work[i].obj->type, &work[i].obj->idx.oid);
+			free(work[i].data);
+		}
+	}
+	return NULL;
+}
+
+static void queue_hash_work(struct object_entry *obj, void *data)
+{
+	work_lock();
+	while (hash_queue_nr == HASH_QUEUE_SIZE ||
+	       (hash_queue_nr && hash_queue_bytes + obj->size > HASH_QUEUE_BYTES))
+		pthread_cond_wait(&hash_queue_room, &work_mutex);
+	hash_queue[(hash_queue_start + hash_queue_nr) % HASH_QUEUE_SIZE].obj = obj;
+	hash_queue[(hash_queue_start + hash_queue_nr) % HASH_QUEUE_SIZE].data = data;
+	hash_queue_nr++;
+	hash_queue_bytes += obj->size;
+	pthread_cond_signal(&hash_queue_avail);
+	work_unlock();
+}
+
+/*
+ * Finding where one object ends and the next one starts requires
+ * inflating the stream, so that stays with the reading thread; hashing
+ * and checking the inflated objects is handed to other threads.
+ */
+static void start_hash_threads(void)
+{
+	int i;
+
+	if (nr_threads <= 1 && !getenv("GIT_FORCE_THREADS"))
+		return;
+
+	init_thread();
+	pthread_cond_init(&hash_queue_avail, NULL);
+	pthread_cond_init(&hash_queue_room, NULL);
+	hash_queue_done = 0;
+	nr_hash_threads = nr_threads > 1 ? nr_threads - 1 : 1;
+	for (i = 0; i < nr_hash_threads; i++) {
+		int ret = pthread_create(&thread_data[i].thread, NULL,
+					 hash_objects_thread, thread_data + i);
+		if (ret)
+			die(_("unable to create thread: %s"),
+			    strerror(ret));
+	}
+}
+
+static void finish_hash_threads(void)
+{
+	int i;
+
+	if (!nr_hash_threads)
+		return;
+
+	work_lock();
+	hash_queue_done = 1;
+	pthread_cond_broadcast(&hash_queue_avail);
+	work_unlock();
+
+	for (i = 0; i < nr_hash_threads; i++)
+		pthread_join(thread_data[i].thread, NULL);
+	pthread_cond_destroy(&hash_queue_avail);
+	pthread_cond_destroy(&hash_queue_room);
+	cleanup_thread();
+	nr_hash_threads = 0;
+}
+
 /*
  * First pass:
  * - find locations of all objects;
@@ -1261,6 +1392,7 @@ static void parse_pack_objects(unsigned char *hash)
 				progress_title ? progress_title :
 				from_stdin ? _("Receiving objects") : _("Indexing objects"),
 				nr_objects);
+	start_hash_threads();
 	for (i = 0; i < nr_objects; i++) {
 		struct object_entry *obj = &objects[i];
 		void *data = unpack_raw_entry(obj, &ofs_delta->offset,
@@ -1280,6 +1412,9 @@ static void parse_pack_objects(unsigned char *hash)
 			/* large blobs, check later */
 			obj->real_type = OBJ_BAD;
 			nr_delays++;
+		} else if (nr_hash_threads) {
+			queue_hash_work(obj, data);
+			data = NULL;
 		} else
 			sha1_object(data, NULL, obj->size, obj->type,
 				    &obj->idx.oid);
@@ -1287,6 +1422,7 @@ static void parse_pack_objects(unsigned char *hash)
 		display_progress(progress, i+1);
 	}
 	objects[i].idx.offset = consumed_bytes;
+	finish_hash_threads();
 	stop_progress(&progress);
 
 	/* Check pack integrity */
@@ -38,10 +38,12 @@
 #include "replace-object.h"
 #include "dir.h"
 #include "midx.h"
+#include "trace.h"
 #include "trace2.h"
 #include "shallow.h"
 #include "promisor-remote.h"
 #include "pack-mtimes.h"
+#include "pack-delta-attempts.h"
 #include "parse-options.h"
 #include "pkt-line.h"
 #include "blob.h"
@@ -260,6 +262,8 @@ static int exclude_promisor_objects;
 static int exclude_promisor_objects_best_effort;
 
 static int use_delta_islands;
+static int use_delta_attempts;
+static struct delta_attempts *delta_attempts;
 
 static unsigned long delta_cache_size = 0;
 static unsigned long max_delta_cache_size = DEFAULT_DELTA_CACHE_SIZE;
@@ -1337,6 +1341,7 @@ static void write_pack_file(void)
 	uint32_t nr_remaining = nr_result;
 	time_t last_mtime = 0;
 	struct object_entry **write_order;
+	int delta_attempts_written = 0;
 
 	if (progress > pack_to_stdout)
 		progress_state = start_progress(the_repository,
@@ -1487,6 +1492,21 @@ static void write_pack_file(void)
 				strbuf_setlen(&tmpname, tmpname_len);
 			}
 
+			/*
+			 * The cache covers the whole delta search, so
+			 * it only needs to go alongside the first pack.
+			 */
+			if (delta_attempts && !delta_attempts_written) {
+				size_t tmpname_len = tmpname.len;
+
+				strbuf_addstr(&tmpname, "dac");
+				delta_attempts_write(delta_attempts,
+						     the_repository,
+						     tmpname.buf, hash);
+				strbuf_setlen(&tmpname, tmpname_len);
+				delta_attempts_written = 1;
+			}
+
 			rename_tmp_packfile_idx(the_repository, &tmpname, &idx_tmp_name);
 
 			free(idx_tmp_name);
@@ -2804,7 +2824,8 @@ size_t oe_get_size_slow(struct packing_data *pack,
 }
 
 static int try_delta(struct unpacked *trg, struct unpacked *src,
-		     unsigned max_depth, unsigned long *mem_usage)
+		     unsigned max_depth, unsigned long *mem_usage,
+		     struct delta_attempts_log *attempts)
 {
 	struct object_entry *trg_entry = trg->entry;
 	struct object_entry *src_entry = src->entry;
@@ -2859,6 +2880,11 @@ static int try_delta(struct unpacked *trg, struct unpacked *src,
 	if (!in_same_island(&trg->entry->idx.oid, &src->entry->idx.oid))
 		return 0;
 
+	if (delta_attempts &&
+	    delta_attempts_known_bad(delta_attempts, &trg_entry->idx.oid,
+				     &src_entry->idx.oid, max_size))
+		return 0;
+
 	/* Load data if not already done */
 	if (!trg->data) {
 		size_t sz_st = 0;
@@ -2920,8 +2946,12 @@ static int try_delta(struct unpacked *trg, struct unpacked *src,
 	}
 
 	delta_buf = create_delta(src->index, trg->data, trg_size, &delta_size, max_size);
-	if (!delta_buf)
+	if (!delta_buf) {
+		if (attempts)
+			delta_attempts_log_record(attempts, &trg_entry->idx.oid,
+						  &src_entry->idx.oid, max_size);
 		return 0;
+	}
 
 	if (DELTA(trg_entry)) {
 		/* Prefer only shallower same-sized deltas. */
@@ -2992,8 +3022,11 @@ static void find_deltas(struct object_entry **list, unsigned *list_size,
 	uint32_t i, idx = 0, count = 0;
 	struct unpacked *array;
 	unsigned long mem_usage = 0;
+	struct delta_attempts_log attempts;
 
 	CALLOC_ARRAY(array, window);
+	if (delta_attempts)
+		delta_attempts_log_init(&attempts, delta_attempts);
 
 	for (;;) {
 		struct object_entry *entry;
@@ -3052,7 +3085,8 @@ static void find_deltas(struct object_entry **list, unsigned *list_size,
 			m = array + other_idx;
 			if (!m->entry)
 				break;
-			ret = try_delta(n, m, max_depth, &mem_usage);
+			ret = try_delta(n, m, max_depth, &mem_usage,
+					delta_attempts ? &attempts : NULL);
 			if (ret < 0)
 				break;
 			else if (ret > 0)
@@ -3126,15 +3160,17 @@ static void find_deltas(struct object_entry **list, unsigned *list_size,
 		free(array[i].data);
 	}
 	free(array);
+	if (delta_attempts)
+		delta_attempts_log_flush(&attempts);
 }
 
 /*
  * The main object list is split into smaller lists, each is handed to
  * one worker.
  *
- * The main thread waits on the condition that (at least) one of the workers
- * has stopped working (which is indicated in the .working member of
- * struct thread_params).
+ * For path-based delta compression, the main thread waits on the
+ * condition that (at least) one of the workers has stopped working (which
+ * is indicated in the .working member of struct thread_params).
  *
  * When a work thread has completed its work, it sets .working to 0 and
  * signals the main thread and waits on the condition that .data_ready
@@ -3142,6 +3178,9 @@ static void find_deltas(struct object_entry **list, unsigned *list_size,
  *
  * The main thread steals half of the work from the worker that has
  * most work left to hand it to the idle worker.
+ *
+ * For the regular delta search, idle workers instead steal work
+ * themselves, see steal_delta_work().
  */
 
 struct thread_params {
@@ -3157,6 +3196,10 @@ struct thread_params {
 	pthread_mutex_t mutex;
 	pthread_cond_t cond;
 	unsigned *processed;
+
+	/* statistics for trace2, only used by ll_find_deltas() */
+	uint64_t busy_ns;
+	unsigned steals;
 };
 
 static pthread_cond_t progress_cond;
@@ -3178,48 +3221,140 @@ static void cleanup_threaded_search(void)
 	pthread_mutex_destroy(&progress_mutex);
 }
 
+/*
+ * State shared by the workers of ll_find_deltas(), protected by
+ * progress_mutex. "delta_search_cost" holds the running total of the
+ * sizes of the objects in "delta_search_list", so that the amount of work
+ * left in any part of the list can be estimated in constant time.
+ */
+static struct thread_params *delta_search_params;
+static struct object_entry **delta_search_list;
+static uint64_t *delta_search_cost;
+
+/*
+ * Called by an idle worker with progress_mutex held. Find the thread
+ * with the most work left to do, measured in bytes rather than objects
+ * so that a handful of huge blobs is not mistaken for little work, and
+ * take over the tail half of it. Returns 1 if any work was stolen.
+ *
+ * Both halves keep at least a window's worth of objects and we try to
+ * split on a "path" boundary, as objects with the same name hash are
+ * likely to delta against each other.
+ */
+static int steal_delta_work(struct thread_params *me)
+{
+	struct thread_params *victim = NULL;
+	uint64_t victim_cost = 0;
+	size_t cur, end, lo, hi, split;
+	uint64_t target;
+	int i;
+
+	for (i = 0; i < delta_search_threads; i++) {
+		struct thread_params *p = &delta_search_params[i];
+		uint64_t cost;
+
+		if (p == me || p->remaining <= 2 * p->window)
+			continue;
+		end = p->list + p->list_size - delta_search_list;
+		cur = end - p->remaining;
+		cost = delta_search_cost[end] - delta_search_cost[cur];
+		if (!victim || victim_cost < cost) {
+			victim = p;
+			victim_cost = cost;
+		}
+	}
+	if (!victim)
+		return 0;
+
+	end = victim->list + victim->list_size - delta_search_list;
+	cur = end - victim->remaining;
+
+	/* find where the remaining cost splits in half */
+	target = delta_search_cost[cur] + victim_cost / 2;
+	lo = cur + victim->window;
+	hi = end - victim->window;
+	while (lo < hi) {
+		size_t mi = lo + (hi - lo) / 2;
+		if (delta_search_cost[mi] < target)
+			lo = mi + 1;
+		else
+			hi = mi;
+	}
+	split = lo;
+
+	while (split < end - victim->window &&
+	       delta_search_list[split]->hash &&
+	       delta_search_list[split]->hash == delta_search_list[split - 1]->hash)
+		split++;
+	if (split >= end - victim->window)
+		/*
+		 * It is possible for some "paths" to have so many objects
+		 * that no hash boundary might be found. Let's just split
+		 * where the cost says in that case.
+		 */
+		split = lo;
+
+	me->list = delta_search_list + split;
+	me->list_size = end - split;
+	me->remaining = me->list_size;
+	victim->list_size -= me->list_size;
+	victim->remaining -= me->list_size;
+	me->steals++;
+	return 1;
+}
+
 static void *threaded_find_deltas(void *arg)
 {
 	struct thread_params *me = arg;
+	uint64_t start = getnanotime();
 
 	progress_lock();
-	while (me->remaining) {
+	while (me->remaining || steal_delta_work(me)) {
 		progress_unlock();
 
 		find_deltas(me->list, &me->remaining,
 			    me->window, me->depth, me->processed);
 
-		progress_lock();
-		me->working = 0;
-		pthread_cond_signal(&progress_cond);
-		progress_unlock();
-
-		/*
-		 * We must not set ->data_ready before we wait on the
-		 * condition because the main thread may have set it to 1
-		 * before we get here. In order to be sure that new
-		 * work is available if we see 1 in ->data_ready, it
-		 * was initialized to 0 before this thread was spawned
-		 * and we reset it to 0 right away.
-		 */
-		pthread_mutex_lock(&me->mutex);
-		while (!me->data_ready)
-			pthread_cond_wait(&me->cond, &me->mutex);
-		me->data_ready = 0;
-		pthread_mutex_unlock(&me->mutex);
-
 		progress_lock();
 	}
+	me->busy_ns = getnanotime() - start;
 	progress_unlock();
-	/* leave ->working 1 so that this doesn't get more work assigned */
 	return NULL;
 }
 
+static void trace_delta_search(struct thread_params *p, uint64_t total_ns)
+{
+	struct strbuf key = STRBUF_INIT;
+	int i;
+
+	if (!trace2_is_enabled())
+		return;
+
+	for (i = 0; i < delta_search_threads; i++) {
+		strbuf_reset(&key);
+		strbuf_addf(&key, "delta-search/thread-%d/busy-ms", i);
+		trace2_data_intmax("pack-objects", the_repository, key.buf,
+				   p[i].busy_ns / 1000000);
+
+		strbuf_reset(&key);
+		strbuf_addf(&key, "delta-search/thread-%d/idle-ms", i);
+		trace2_data_intmax("pack-objects", the_repository, key.buf,
+				   (total_ns - p[i].busy_ns) / 1000000);
+
+		strbuf_reset(&key);
+		strbuf_addf(&key, "delta-search/thread-%d/steals", i);
+		trace2_data_intmax("pack-objects", the_repository, key.buf,
+				   p[i].steals);
+	}
+	strbuf_release(&key);
+}
+
 static void ll_find_deltas(struct object_entry **list, unsigned list_size,
 			   int window, int depth, unsigned *processed)
 {
 	struct thread_params *p;
-	int i, ret, active_threads = 0;
+	uint64_t start;
+	int i, ret;
 
 	init_threaded_search();
 
@@ -3233,6 +3368,13 @@ static void ll_find_deltas(struct object_entry **list, unsigned list_size,
 			   delta_search_threads);
 	CALLOC_ARRAY(p, delta_search_threads);
 
+	delta_search_params = p;
+	delta_search_list = list;
+	ALLOC_ARRAY(delta_search_cost, list_size + 1);
+	delta_search_cost[0] = 0;
+	for (i = 0; i < list_size; i++)
+		delta_search_cost[i + 1] = delta_search_cost[i] + SIZE(list[i]);
+
 	/* Partition the work amongst work threads. */
 	for (i = 0; i < delta_search_threads; i++) {
 		unsigned sub_size = list_size / (delta_search_threads - i);
@@ -3244,8 +3386,6 @@ static void ll_find_deltas(struct object_entry **list, unsigned list_size,
 		p[i].window = window;
 		p[i].depth = depth;
 		p[i].processed = processed;
-		p[i].working = 1;
-		p[i].data_ready = 0;
 
 		/* try to split chunks on "path" boundaries */
 		while (sub_size && sub_size < list_size &&
@@ -3261,86 +3401,28 @@ static void ll_find_deltas(struct object_entry **list, unsigned list_size,
 		list_size -= sub_size;
 	}
 
-	/* Start work threads. */
+	/*
+	 * Start work threads. Each of them works through its own segment
+	 * and then keeps stealing work from the others, until what is left
+	 * is simply too short to be worth splitting anymore. Threads that
+	 * start out without a segment go straight to stealing.
+	 */
+	start = getnanotime();
 	for (i = 0; i < delta_search_threads; i++) {
-		if (!p[i].list_size)
-			continue;
-		pthread_mutex_init(&p[i].mutex, NULL);
-		pthread_cond_init(&p[i].cond, NULL);
 		ret = pthread_create(&p[i].thread, NULL,
 				     threaded_find_deltas, &p[i]);
 		if (ret)
 			die(_("unable to create thread: %s"), strerror(ret));
-		active_threads++;
 	}
+	for (i = 0; i < delta_search_threads; i++)
+		pthread_join(p[i].thread, NULL);
 
-	/*
-	 * Now let's wait for work completion.  Each time a thread is done
-	 * with its work, we steal half of the remaining work from the
-	 * thread with the largest number of unprocessed objects and give
-	 * it to that newly idle thread.  This ensure good load balancing
-	 * until the remaining object list segments are simply too short
-	 * to be worth splitting anymore.
-	 */
-	while (active_threads) {
-		struct thread_params *target = NULL;
-		struct thread_params *victim = NULL;
-		unsigned sub_size = 0;
-
-		progress_lock();
-		for (;;) {
-			for (i = 0; !target && i < delta_search_threads; i++)
-				if (!p[i].working)
-					target = &p[i];
-			if (target)
-				break;
-			pthread_cond_wait(&progress_cond, &progress_mutex);
-		}
-
-		for (i = 0; i < delta_search_threads; i++)
-			if (p[i].remaining > 2*window &&
-			    (!victim || victim->remaining < p[i].remaining))
-				victim = &p[i];
-		if (victim) {
-			sub_size = victim->remaining / 2;
-			list = victim->list + victim->list_size - sub_size;
-			while (sub_size && list[0]->hash &&
-			       list[0]->hash == list[-1]->hash) {
-				list++;
-				sub_size--;
-			}
-			if (!sub_size) {
-				/*
-				 * It is possible for some "paths" to have
-				 * so many objects that no hash boundary
-				 * might be found.  Let's just steal the
-				 * exact half in that case.
-				 */
-				sub_size = victim->remaining / 2;
-				list -= sub_size;
-			}
-			target->list = list;
-			victim->list_size -= sub_size;
-			victim->remaining -= sub_size;
-		}
-		target->list_size = sub_size;
-		target->remaining = sub_size;
-		target->working = 1;
-		progress_unlock();
-
-		pthread_mutex_lock(&target->mutex);
-		target->data_ready = 1;
-		pthread_cond_signal(&target->cond);
-		pthread_mutex_unlock(&target->mutex);
+	trace_delta_search(p, getnanotime() - start);
 
-		if (!sub_size) {
-			pthread_join(target->thread, NULL);
-			pthread_cond_destroy(&target->cond);
-			pthread_mutex_destroy(&target->mutex);
-			active_threads--;
-		}
-	}
 	cleanup_threaded_search();
+	FREE_AND_NULL(delta_search_cost);
+	delta_search_params = NULL;
+	delta_search_list = NULL;
 	free(p);
 }
 
@@ -3650,6 +3732,11 @@ static void prepare_pack(int window, int depth)
 	if (!to_pack.nr_objects || !window || !depth)
 		return;
 
+	/* The cache is only written alongside a pack on disk. */
+	if (use_delta_attempts && !pack_to_stdout)
+		delta_attempts = delta_attempts_load(the_repository,
+						     window, depth);
+
 	if (path_walk)
 		ll_find_deltas_by_region(to_pack.objects, to_pack.regions,
 					 0, to_pack.nr_regions);
@@ -3708,6 +3795,10 @@ static int git_pack_config(const char *k, const char *v,
 		cache_max_small_delta_size = git_config_int(k, v, ctx->kvi);
 		return 0;
 	}
+	if (!strcmp(k, "pack.deltaattemptcache")) {
+		use_delta_attempts = git_config_bool(k, v);
+		return 0;
+	}
 	if (!strcmp(k, "pack.writebitmaphashcache")) {
 		if (git_config_bool(k, v))
 			write_bitmap_options |= BITMAP_OPT_HASH_CACHE;
@@ -5510,6 +5601,7 @@ int cmd_pack_objects(int argc,
 	write_excluded_by_configs();
 	write_pack_file();
 	trace2_region_leave("pack-objects", "write-pack-file", the_repository);
+	delta_attempts_free(delta_attempts);
 
 	if (progress)
 		fprintf_ln(stderr,
@@ -121,6 +121,7 @@ static char line_term = '\n';
 static char info_term = ' ';
 
 static int show_disk_usage;
+static int quiet_bitmap_traversal;
 static off_t total_disk_usage;
 static int human_readable;
 
@@ -478,14 +479,26 @@ static int show_bisect_vars(struct rev_list_info *info, int reaches, int all)
 
 static int show_object_fast(
 	const struct object_id *oid,
-	enum object_type type UNUSED,
+	enum object_type type,
 	int exclude UNUSED,
 	uint32_t name_hash UNUSED,
-	struct packed_git *found_pack UNUSED,
+	struct packed_git *found_pack,
 	off_t found_offset UNUSED,
 	void *payload UNUSED)
 {
-	fprintf(stdout, "%s\n", oid_to_hex(oid));
+	/*
+	 * Objects outside of the bitmapped pack were found by walking
+	 * commits and trees, which had to be read to do so. Blobs were
+	 * merely named by those trees, though, so make sure they exist
+	 * like the regular traversal does.
+	 */
+	if (!found_pack && type == OBJ_BLOB &&
+	    arg_missing_action == MA_ERROR &&
+	    !odb_has_object(the_repository->objects, oid, 0))
+		die("missing %s object '%s'", type_name(type), oid_to_hex(oid));
+
+	if (!quiet_bitmap_traversal)
+		fprintf(stdout, "%s\n", oid_to_hex(oid));
 	return 0;
 }
 
@@ -587,6 +600,7 @@ static int try_bitmap_count(struct rev_info *revs,
 }
 
 static int try_bitmap_traversal(struct rev_info *revs,
+				struct rev_list_info *info,
 				int filter_provided_objects)
 {
 	struct bitmap_index *bitmap_git;
@@ -609,6 +623,7 @@ static int try_bitmap_traversal(struct rev_info *revs,
 	if (!bitmap_git)
 		return -1;
 
+	quiet_bitmap_traversal = !!(info->flags & REV_LIST_QUIET);
 	traverse_bitmap_commit_list(bitmap_git, revs, &show_object_fast);
 	free_bitmap_index(bitmap_git);
 	return 0;
@@ -925,7 +940,7 @@ int cmd_rev_list(int argc,
 			goto cleanup;
 		if (!try_bitmap_disk_usage(&revs, filter_provided_objects))
 			goto cleanup;
-		if (!try_bitmap_traversal(&revs, filter_provided_objects))
+		if (!try_bitmap_traversal(&revs, &info, filter_provided_objects))
 			goto cleanup;
 	}
 
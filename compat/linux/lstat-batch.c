@@ -0,0 +1,261 @@
+#include "git-compat-util.h"
+#include "lstat-batch.h"
+#include "trace.h"
+
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+
+/*
+ * A minimal io_uring client: each lstat() becomes an IORING_OP_STATX
+ * request. Requests are handed to the kernel a quarter of the ring at
+ * a time, and we only wait for results when the ring is full, so that
+ * the kernel always has plenty of work it can do concurrently.
+ */
+
+struct lstat_request {
+	const char *path;
+	void *item;
+	struct statx stx;
+};
+
+struct lstat_batch {
+	int fd;
+	lstat_batch_fn fn;
+	void *cb_data;
+
+	void *sq_ring;
+	size_t sq_ring_size;
+	void *cq_ring;
+	size_t cq_ring_size;
+	struct io_uring_sqe *sqes;
+	size_t sqes_size;
+
+	unsigned int *sq_tail;
+	unsigned int *sq_mask;
+	unsigned int *sq_array;
+	unsigned int *cq_head;
+	unsigned int *cq_tail;
+	unsigned int *cq_mask;
+	struct io_uring_cqe *cqes;
+
+	struct lstat_request *requests;
+	unsigned int depth;
+	/* indices of the requests that are not in use */
+	unsigned int *idle;
+	unsigned int nr_idle;
+	/* requests in the ring that the kernel has not seen yet */
+	unsigned int queued;
+
+	struct lstat_batch_stats stats;
+};
+
+static void release_ring(struct lstat_batch *batch)
+{
+	if (batch->sqes && batch->sqes != MAP_FAILED)
+		munmap(batch->sqes, batch->sqes_size);
+	if (batch->cq_ring && batch->cq_ring != MAP_FAILED)
+		munmap(batch->cq_ring, batch->cq_ring_size);
+	if (batch->sq_ring && batch->sq_ring != MAP_FAILED)
+		munmap(batch->sq_ring, batch->sq_ring_size);
+	close(batch->fd);
+	free(batch->requests);
+	free(batch->idle);
+	free(batch);
+}
+
+struct lstat_batch *lstat_batch_init(unsigned int depth,
+				     lstat_batch_fn fn, void *cb_data)
+{
+	struct io_uring_params p;
+	struct lstat_batch *batch;
+	unsigned int i;
+	int fd;
+
+	memset(&p, 0, sizeof(p));
+	fd = syscall(__NR_io_uring_setup, depth, &p);
+	if (fd < 0)
+		return NULL;
+
+	CALLOC_ARRAY(batch, 1);
+	batch->fd = fd;
+	batch->fn = fn;
+	batch->cb_data = cb_data;
+
+	batch->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	batch->sq_ring = mmap(NULL, batch->sq_ring_size, PROT_READ | PROT_WRITE,
+			      MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	batch->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	batch->cq_ring = mmap(NULL, batch->cq_ring_size, PROT_READ | PROT_WRITE,
+			      MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+	batch->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	batch->sqes = mmap(NULL, batch->sqes_size, PROT_READ | PROT_WRITE,
+			   MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+	if (batch->sq_ring == MAP_FAILED || batch->cq_ring == MAP_FAILED ||
+	    batch->sqes == MAP_FAILED) {
+		release_ring(batch);
+		return NULL;
+	}
+
+	batch->sq_tail = (unsigned int *)((char *)batch->sq_ring + p.sq_off.tail);
+	batch->sq_mask = (unsigned int *)((char *)batch->sq_ring + p.sq_off.ring_mask);
+	batch->sq_array = (unsigned int *)((char *)batch->sq_ring + p.sq_off.array);
+	batch->cq_head = (unsigned int *)((char *)batch->cq_ring + p.cq_off.head);
+	batch->cq_tail = (unsigned int *)((char *)batch->cq_ring + p.cq_off.tail);
+	batch->cq_mask = (unsigned int *)((char *)batch->cq_ring + p.cq_off.ring_mask);
+	batch->cqes = (struct io_uring_cqe *)((char *)batch->cq_ring + p.cq_off.cqes);
+
+	/*
+	 * The completion ring is at least as large as the submission
+	 * ring, so it cannot overflow with at most "depth" requests.
+	 */
+	batch->depth = depth < p.sq_entries ? depth : p.sq_entries;
+	CALLOC_ARRAY(batch->requests, batch->depth);
+	ALLOC_ARRAY(batch->idle, batch->depth);
+	for (i = 0; i < batch->depth; i++)
+		batch->idle[i] = batch->depth - i - 1;
+	batch->nr_idle = batch->depth;
+
+	return batch;
+}
+
+static void statx_to_stat(const struct statx *stx, struct stat *st)
+{
+	memset(st, 0, sizeof(*st));
+	st->st_dev = makedev(stx->stx_dev_major, stx->stx_dev_minor);
+	st->st_ino = stx->stx_ino;
+	st->st_mode = stx->stx_mode;
+	st->st_nlink = stx->stx_nlink;
+	st->st_uid = stx->stx_uid;
+	st->st_gid = stx->stx_gid;
+	st->st_rdev = makedev(stx->stx_rdev_major, stx->stx_rdev_minor);
+	st->st_size = stx->stx_size;
+	st->st_blksize = stx->stx_blksize;
+	st->st_blocks = stx->stx_blocks;
+	st->st_atim.tv_sec = stx->stx_atime.tv_sec;
+	st->st_atim.tv_nsec = stx->stx_atime.tv_nsec;
+	st->st_mtim.tv_sec = stx->stx_mtime.tv_sec;
+	st->st_mtim.tv_nsec = stx->stx_mtime.tv_nsec;
+	st->st_ctim.tv_sec = stx->stx_ctime.tv_sec;
+	st->st_ctim.tv_nsec = stx->stx_ctime.tv_nsec;
+}
+
+static void complete_request(struct lstat_batch *batch,
+			     struct lstat_request *req, int res)
+{
+	struct stat st;
+
+	if (res == -EINVAL || res == -EOPNOTSUPP) {
+		/* the kernel does not know IORING_OP_STATX */
+		if (lstat(req->path, &st))
+			batch->fn(batch->cb_data, req->item, NULL, errno);
+		else
+			batch->fn(batch->cb_data, req->item, &st, 0);
+	} else if (res < 0) {
+		batch->fn(batch->cb_data, req->item, NULL, -res);
+	} else {
+		statx_to_stat(&req->stx, &st);
+		batch->fn(batch->cb_data, req->item, &st, 0);
+	}
+}
+
+static unsigned int reap_completions(struct lstat_batch *batch)
+{
+	unsigned int head = *batch->cq_head;
+	unsigned int tail = __atomic_load_n(batch->cq_tail, __ATOMIC_ACQUIRE);
+	unsigned int nr = 0;
+
+	while (head != tail) {
+		struct io_uring_cqe *cqe = &batch->cqes[head & *batch->cq_mask];
+		unsigned int i = cqe->user_data;
+
+		complete_request(batch, &batch->requests[i], cqe->res);
+		batch->idle[batch->nr_idle++] = i;
+		head++;
+		nr++;
+	}
+	__atomic_store_n(batch->cq_head, head, __ATOMIC_RELEASE);
+	return nr;
+}
+
+/*
+ * Hand the queued requests to the kernel, then wait until at least
+ * "wait_nr" of the requests in flight have completed.
+ */
+static void submit_and_wait(struct lstat_batch *batch, unsigned int wait_nr)
+{
+	uint64_t start = getnanotime();
+	unsigned int done = 0;
+
+	for (;;) {
+		unsigned int flags = 0, in_flight;
+		int ret;
+
+		done += reap_completions(batch);
+		if (!batch->queued && done >= wait_nr)
+			break;
+		if (done < wait_nr)
+			flags |= IORING_ENTER_GETEVENTS;
+
+		ret = syscall(__NR_io_uring_enter, batch->fd, batch->queued,
+			      flags ? wait_nr - done : 0, flags, NULL, 0);
+		if (ret < 0) {
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			die_errno("io_uring_enter");
+		}
+		if (!ret)
+			continue;
+
+		batch->queued -= ret;
+		batch->stats.batches++;
+		in_flight = batch->depth - batch->nr_idle - batch->queued;
+		if (batch->stats.max_depth < in_flight)
+			batch->stats.max_depth = in_flight;
+	}
+
+	if (wait_nr)
+		batch->stats.wait_ns += getnanotime() - start;
+}
+
+void lstat_batch_add(struct lstat_batch *batch, const char *path, void *item)
+{
+	struct lstat_request *req;
+	struct io_uring_sqe *sqe;
+	unsigned int i, tail, slot;
+
+	if (!batch->nr_idle)
+		submit_and_wait(batch, batch->depth / 4 ? batch->depth / 4 : 1);
+
+	i = batch->idle[--batch->nr_idle];
+	req = &batch->requests[i];
+	req->path = path;
+	req->item = item;
+
+	tail = *batch->sq_tail;
+	slot = tail & *batch->sq_mask;
+	sqe = &batch->sqes[slot];
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = IORING_OP_STATX;
+	sqe->fd = AT_FDCWD;
+	sqe->addr = (uintptr_t)path;
+	sqe->len = STATX_BASIC_STATS;
+	sqe->addr2 = (uintptr_t)&req->stx;
+	sqe->statx_flags = AT_SYMLINK_NOFOLLOW | AT_STATX_SYNC_AS_STAT;
+	sqe->user_data = i;
+	batch->sq_array[slot] = slot;
+	__atomic_store_n(batch->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+	batch->stats.nr++;
+	if (++batch->queued >= batch->depth / 4)
+		submit_and_wait(batch, 0);
+}
+
+void lstat_batch_finish(struct lstat_batch *batch,
+			struct lstat_batch_stats *stats)
+{
+	submit_and_wait(batch, batch->depth - batch->nr_idle);
+	if (stats)
+		*stats = batch->stats;
+	release_ring(batch);
+}
@@ -0,0 +1,8 @@
+NO_CURL=1
+NO_EXPAT=1
+NO_GETTEXT=1
+NO_TCLTK=1
+NO_PERL=1
+NO_PYTHON=1
+NO_RUST=1
+DEVELOPER=1
@@ -10,6 +10,8 @@
 #include "transport.h"
 #include "packfile.h"
 #include "promisor-remote.h"
+#include "repository.h"
+#include "shallow.h"
 
 static int promised_object_cb(const struct object_id *oid UNUSED,
 			      struct object_info *oi UNUSED,
@@ -130,6 +132,18 @@ int check_connected(oid_iterate_fn fn, void *cb_data,
 	}
 	strvec_push(&rev_list.args, "--quiet");
 	strvec_push(&rev_list.args, "--alternate-refs");
+	/*
+	 * With reachability bitmaps, everything reachable from our refs
+	 * can be excluded in bitmap space, so that only the new objects
+	 * are walked. rev-list falls back to a regular traversal when
+	 * there are no usable bitmaps.
+	 */
+	prepare_repo_settings(the_repository);
+	if (the_repository->settings.core_connectivity_bitmaps &&
+	    !opt->is_deepening_fetch && !opt->shallow_file &&
+	    !repo_has_promisor_remote(the_repository) &&
+	    !is_repository_shallow(the_repository))
+		strvec_push(&rev_list.args, "--use-bitmap-index");
 	if (opt->progress)
 		strvec_pushf(&rev_list.args, "--progress=%s",
 			     _("Checking connectivity"));
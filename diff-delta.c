@@ -310,6 +310,31 @@ unsigned long sizeof_delta_index(struct delta_index *index)
 		return 0;
 }
 
+/*
+ * Return how many leading bytes "a" and "b" have in common, looking at no
+ * more than "len" bytes. Matches between similar blobs tend to be long, so
+ * compare a word at a time and only go byte by byte to find the exact
+ * position of the first difference.
+ */
+static inline size_t common_prefix_len(const unsigned char *a,
+				       const unsigned char *b, size_t len)
+{
+	size_t n = 0;
+
+	while (len - n >= sizeof(uint64_t)) {
+		uint64_t wa, wb;
+
+		memcpy(&wa, a + n, sizeof(wa));
+		memcpy(&wb, b + n, sizeof(wb));
+		if (wa != wb)
+			break;
+		n += sizeof(uint64_t);
+	}
+	while (n < len && a[n] == b[n])
+		n++;
+	return n;
+}
+
 /*
  * The maximum size for any opcode sequence, including the initial header
  * plus Rabin window plus biggest copy.
@@ -388,8 +413,7 @@ create_delta(const struct delta_index *index,
 					ref_size = top - src;
 				if (ref_size <= msize)
 					break;
-				while (ref_size-- && *src++ == *ref)
-					ref++;
+				ref += common_prefix_len(src, ref, ref_size);
 				if (msize < ref - entry->ptr) {
 					/* this is our best match so far */
 					msize = ref - entry->ptr;
@@ -33,6 +33,7 @@
 #include "strbuf.h"
 #include "submodule-config.h"
 #include "symlinks.h"
+#include "thread-utils.h"
 #include "trace2.h"
 #include "tree.h"
 #include "hex.h"
@@ -56,11 +57,35 @@ enum path_treatment {
 	path_untracked
 };
 
+/*
+ * When many directories of the untracked cache are out of date (e.g. after
+ * switching branches), reading them one by one in read_directory_recursive()
+ * is slow. With core.untrackedCacheThreads, threads first lstat() every
+ * directory known to the cache and read those whose stat data changed. The
+ * traversal itself still runs serially, and takes the listings from there
+ * instead of calling opendir(), so the cache is updated exactly as before.
+ */
+struct untracked_listing {
+	struct stat st;
+	int lstat_errno;
+	/* whether the entries below were read */
+	unsigned read : 1;
+	size_t nr, alloc;
+	struct untracked_listing_entry {
+		size_t name; /* offset into "names" */
+		int d_type;
+	} *entries;
+	struct strbuf names;
+};
+
 /*
  * Support data structure for our opendir/readdir/closedir wrappers
  */
 struct cached_dir {
 	DIR *fdir;
+	/* read ahead instead of from fdir, see prefetch_untracked_dirs() */
+	struct untracked_listing *listing;
+	size_t listing_pos;
 	struct untracked_cache_dir *untracked;
 	int nr_files;
 	int nr_dirs;
@@ -77,6 +102,7 @@ static enum path_treatment read_directory_recursive(struct dir_struct *dir,
 	int check_only, int stop_at_first_file, const struct pathspec *pathspec);
 static int resolve_dtype(int dtype, struct index_state *istate,
 			 const char *path, int len);
+static void free_pattern_index(struct pattern_index *index);
 struct dirent *readdir_skip_dot_and_dotdot(DIR *dirp)
 {
 	struct dirent *e;
@@ -1022,6 +1048,7 @@ void clear_pattern_list(struct pattern_list *pl)
 	free(pl->patterns);
 	clear_pattern_entry_hashmap(&pl->recursive_hashmap);
 	clear_pattern_entry_hashmap(&pl->parent_hashmap);
+	free_pattern_index(pl->index);
 
 	memset(pl, 0, sizeof(*pl));
 }
@@ -1414,6 +1441,240 @@ int match_pathname(const char *pathname, int pathlen,
 				 WM_PATHNAME) == 0;
 }
 
+/*
+ * Return 1 if the pattern matches pathname, resolving *dtype if the
+ * pattern only matches directories.
+ */
+static int path_pattern_matches(struct path_pattern *pattern,
+				const char *pathname, int pathlen,
+				const char *basename, int *dtype,
+				struct index_state *istate)
+{
+	const char *exclude = pattern->pattern;
+	int prefix = pattern->nowildcardlen;
+
+	if (pattern->flags & PATTERN_FLAG_MUSTBEDIR) {
+		*dtype = resolve_dtype(*dtype, istate, pathname, pathlen);
+		if (*dtype != DT_DIR)
+			return 0;
+	}
+
+	if (pattern->flags & PATTERN_FLAG_NODIR)
+		return match_basename(basename,
+				      pathlen - (basename - pathname),
+				      exclude, prefix, pattern->patternlen,
+				      pattern->flags);
+
+	assert(pattern->baselen == 0 ||
+	       pattern->base[pattern->baselen - 1] == '/');
+	return match_pathname(pathname, pathlen,
+			      pattern->base,
+			      pattern->baselen ? pattern->baselen - 1 : 0,
+			      exclude, prefix, pattern->patternlen);
+}
+
+/*
+ * Large ignore files are mostly made of patterns without wildcards:
+ * names ("foo.o"), names after a leading star ("*.o"), and paths
+ * ("/build/out"). Instead of trying those one by one, we look them up
+ * by the basename, the suffixes of the basename, or the whole pathname
+ * of the path being matched. This gives the last of them that matches,
+ * and only the other patterns that come after it in the list still
+ * have to be tried in turn.
+ */
+#define PATTERN_INDEX_MIN_PATTERNS 16
+
+struct pattern_index_entry {
+	struct hashmap_entry ent;
+	/* the last pattern with this key */
+	int last;
+	/* the last one without PATTERN_FLAG_MUSTBEDIR, or -1 */
+	int last_nodir;
+	int len;
+	char key[FLEX_ARRAY];
+};
+
+struct pattern_index {
+	/* the number of patterns in the list when this was built */
+	int nr;
+	int ignore_case;
+	/* PATTERN_FLAG_NODIR patterns without wildcards */
+	struct hashmap basenames;
+	/* PATTERN_FLAG_ENDSWITH patterns, keyed by what follows the star */
+	struct hashmap suffixes;
+	int *suffix_lens;
+	size_t suffix_lens_nr, suffix_lens_alloc;
+	/* other patterns without wildcards, keyed by base and pattern */
+	struct hashmap pathnames;
+	/* the positions of all other patterns, in increasing order */
+	int *others;
+	size_t others_nr, others_alloc;
+};
+
+struct pattern_index_key {
+	const char *key;
+	int len;
+};
+
+static int pattern_index_entry_cmp(const void *cmp_data UNUSED,
+				   const struct hashmap_entry *a,
+				   const struct hashmap_entry *b,
+				   const void *keydata)
+{
+	const struct pattern_index_entry *e1 =
+		container_of(a, const struct pattern_index_entry, ent);
+	const struct pattern_index_key *k = keydata;
+	struct pattern_index_key k2;
+
+	if (!k) {
+		const struct pattern_index_entry *e2 =
+			container_of(b, const struct pattern_index_entry, ent);
+		k2.key = e2->key;
+		k2.len = e2->len;
+		k = &k2;
+	}
+	return e1->len != k->len || fspathncmp(e1->key, k->key, k->len);
+}
+
+static unsigned int pattern_index_hash(const char *key, int len)
+{
+	return repo_ignore_case(the_repository) ?
+		memihash(key, len) : memhash(key, len);
+}
+
+static struct pattern_index_entry *pattern_index_lookup(struct hashmap *map,
+							const char *key,
+							int len)
+{
+	struct pattern_index_key k = { .key = key, .len = len };
+
+	return hashmap_get_entry_from_hash(map, pattern_index_hash(key, len),
+					   &k, struct pattern_index_entry, ent);
+}
+
+static void pattern_index_add(struct hashmap *map,
+			      const char *base, int baselen,
+			      const char *key, int len,
+			      int pos, unsigned flags)
+{
+	struct pattern_index_entry *e;
+	struct strbuf buf = STRBUF_INIT;
+
+	strbuf_add(&buf, base, baselen);
+	strbuf_add(&buf, key, len);
+
+	e = pattern_index_lookup(map, buf.buf, buf.len);
+	if (!e) {
+		FLEX_ALLOC_MEM(e, key, buf.buf, buf.len);
+		e->len = buf.len;
+		e->last_nodir = -1;
+		hashmap_entry_init(&e->ent, pattern_index_hash(buf.buf, buf.len));
+		hashmap_add(map, &e->ent);
+	}
+	e->last = pos;
+	if (!(flags & PATTERN_FLAG_MUSTBEDIR))
+		e->last_nodir = pos;
+
+	strbuf_release(&buf);
+}
+
+static struct pattern_index *build_pattern_index(struct pattern_list *pl)
+{
+	struct pattern_index *index;
+	int i;
+
+	CALLOC_ARRAY(index, 1);
+	index->nr = pl->nr;
+	index->ignore_case = repo_ignore_case(the_repository);
+	hashmap_init(&index->basenames, pattern_index_entry_cmp, NULL, 0);
+	hashmap_init(&index->suffixes, pattern_index_entry_cmp, NULL, 0);
+	hashmap_init(&index->pathnames, pattern_index_entry_cmp, NULL, 0);
+
+	for (i = 0; i < pl->nr; i++) {
+		struct path_pattern *pattern = pl->patterns[i];
+		const char *p = pattern->pattern;
+		int len = pattern->patternlen;
+		int literal = pattern->nowildcardlen == len;
+
+		/* see match_basename() and match_pathname() */
+		if (pattern->flags & PATTERN_FLAG_NODIR) {
+			if (literal) {
+				pattern_index_add(&index->basenames, "", 0,
+						  p, len, i, pattern->flags);
+				continue;
+			}
+			if (pattern->flags & PATTERN_FLAG_ENDSWITH) {
+				size_t j;
+
+				pattern_index_add(&index->suffixes, "", 0,
+						  p + 1, len - 1, i, pattern->flags);
+				for (j = 0; j < index->suffix_lens_nr; j++)
+					if (index->suffix_lens[j] == len - 1)
+						break;
+				if (j == index->suffix_lens_nr) {
+					ALLOC_GROW(index->suffix_lens,
+						   index->suffix_lens_nr + 1,
+						   index->suffix_lens_alloc);
+					index->suffix_lens[index->suffix_lens_nr++] = len - 1;
+				}
+				continue;
+			}
+		} else if (literal) {
+			if (*p == '/') {
+				p++;
+				len--;
+			}
+			if (len) {
+				pattern_index_add(&index->pathnames,
+						  pattern->base, pattern->baselen,
+						  p, len, i, pattern->flags);
+				continue;
+			}
+		}
+
+		ALLOC_GROW(index->others, index->others_nr + 1,
+			   index->others_alloc);
+		index->others[index->others_nr++] = i;
+	}
+
+	return index;
+}
+
+static void free_pattern_index(struct pattern_index *index)
+{
+	if (!index)
+		return;
+	hashmap_clear_and_free(&index->basenames, struct pattern_index_entry, ent);
+	hashmap_clear_and_free(&index->suffixes, struct pattern_index_entry, ent);
+	hashmap_clear_and_free(&index->pathnames, struct pattern_index_entry, ent);
+	free(index->suffix_lens);
+	free(index->others);
+	free(index);
+}
+
+/*
+ * Raise *best to the position of the last pattern of "e" that matches,
+ * if that is later in the list.
+ */
+static void pattern_index_check(struct pattern_index_entry *e, int *best,
+				const char *pathname, int pathlen, int *dtype,
+				struct index_state *istate)
+{
+	int pos;
+
+	if (!e || e->last <= *best)
+		return;
+
+	pos = e->last;
+	if (pos != e->last_nodir) {
+		*dtype = resolve_dtype(*dtype, istate, pathname, pathlen);
+		if (*dtype != DT_DIR)
+			pos = e->last_nodir;
+	}
+	if (pos > *best)
+		*best = pos;
+}
+
 /*
  * Scan the given exclude list in reverse to see whether pathname
  * should be ignored.  The first match (i.e. the last on the list), if
@@ -1427,45 +1688,57 @@ static struct path_pattern *last_matching_pattern_from_list(const char *pathname
 						       struct pattern_list *pl,
 						       struct index_state *istate)
 {
-	struct path_pattern *res = NULL; /* undecided */
-	int i;
+	struct pattern_index *index;
+	int basenamelen = pathlen - (basename - pathname);
+	int best = -1;
+	size_t i;
 
 	if (!pl->nr)
 		return NULL;	/* undefined */
 
-	for (i = pl->nr - 1; 0 <= i; i--) {
-		struct path_pattern *pattern = pl->patterns[i];
-		const char *exclude = pattern->pattern;
-		int prefix = pattern->nowildcardlen;
+	if (pl->nr < PATTERN_INDEX_MIN_PATTERNS) {
+		for (best = pl->nr - 1; 0 <= best; best--)
+			if (path_pattern_matches(pl->patterns[best],
+						 pathname, pathlen,
+						 basename, dtype, istate))
+				return pl->patterns[best];
+		return NULL;
+	}
 
-		if (pattern->flags & PATTERN_FLAG_MUSTBEDIR) {
-			*dtype = resolve_dtype(*dtype, istate, pathname, pathlen);
-			if (*dtype != DT_DIR)
-				continue;
-		}
+	if (!pl->index || pl->index->nr != pl->nr ||
+	    pl->index->ignore_case != repo_ignore_case(the_repository)) {
+		free_pattern_index(pl->index);
+		pl->index = build_pattern_index(pl);
+	}
+	index = pl->index;
 
-		if (pattern->flags & PATTERN_FLAG_NODIR) {
-			if (match_basename(basename,
-					   pathlen - (basename - pathname),
-					   exclude, prefix, pattern->patternlen,
-					   pattern->flags)) {
-				res = pattern;
-				break;
-			}
-			continue;
-		}
+	pattern_index_check(pattern_index_lookup(&index->basenames,
+						 basename, basenamelen),
+			    &best, pathname, pathlen, dtype, istate);
+	for (i = 0; i < index->suffix_lens_nr; i++) {
+		int len = index->suffix_lens[i];
 
-		assert(pattern->baselen == 0 ||
-		       pattern->base[pattern->baselen - 1] == '/');
-		if (match_pathname(pathname, pathlen,
-				   pattern->base,
-				   pattern->baselen ? pattern->baselen - 1 : 0,
-				   exclude, prefix, pattern->patternlen)) {
-			res = pattern;
+		if (len > basenamelen)
+			continue;
+		pattern_index_check(pattern_index_lookup(&index->suffixes,
+							 basename + basenamelen - len,
+							 len),
+				    &best, pathname, pathlen, dtype, istate);
+	}
+	pattern_index_check(pattern_index_lookup(&index->pathnames,
+						 pathname, pathlen),
+			    &best, pathname, pathlen, dtype, istate);
+
+	for (i = index->others_nr; i-- > 0 && index->others[i] > best; ) {
+		if (path_pattern_matches(pl->patterns[index->others[i]],
+					 pathname, pathlen,
+					 basename, dtype, istate)) {
+			best = index->others[i];
 			break;
 		}
 	}
-	return res;
+
+	return best < 0 ? NULL : pl->patterns[best];
 }
 
 /*
@@ -2536,7 +2809,15 @@ static int valid_cached_dir(struct dir_struct *dir,
 	 */
 	refresh_fsmonitor(istate);
 	if (!(dir->untracked->use_fsmonitor && untracked->valid)) {
-		if (lstat(path->len ? path->buf : ".", &st)) {
+		int ret;
+
+		if (untracked->listing) {
+			st = untracked->listing->st;
+			ret = untracked->listing->lstat_errno ? -1 : 0;
+		} else {
+			ret = lstat(path->len ? path->buf : ".", &st);
+		}
+		if (ret) {
 			memset(&untracked->stat_data, 0, sizeof(untracked->stat_data));
 			return 0;
 		}
@@ -2581,15 +2862,19 @@ static int open_cached_dir(struct cached_dir *cdir,
 	cdir->untracked = untracked;
 	if (valid_cached_dir(dir, untracked, istate, path, check_only))
 		return 0;
-	c_path = path->len ? path->buf : ".";
-	cdir->fdir = opendir(c_path);
-	if (!cdir->fdir)
-		warning_errno(_("could not open directory '%s'"), c_path);
+	if (untracked && untracked->listing && untracked->listing->read) {
+		cdir->listing = untracked->listing;
+	} else {
+		c_path = path->len ? path->buf : ".";
+		cdir->fdir = opendir(c_path);
+		if (!cdir->fdir)
+			warning_errno(_("could not open directory '%s'"), c_path);
+	}
 	if (dir->untracked) {
 		invalidate_directory(dir->untracked, untracked);
 		dir->untracked->dir_opened++;
 	}
-	if (!cdir->fdir)
+	if (!cdir->fdir && !cdir->listing)
 		return -1;
 	return 0;
 }
@@ -2609,6 +2894,20 @@ static int read_cached_dir(struct cached_dir *cdir)
 		cdir->d_type = DTYPE(de);
 		return 0;
 	}
+	if (cdir->listing) {
+		struct untracked_listing *listing = cdir->listing;
+
+		if (cdir->listing_pos >= listing->nr) {
+			cdir->d_name = NULL;
+			cdir->d_type = DT_UNKNOWN;
+			return -1;
+		}
+		cdir->d_name = listing->names.buf +
+			listing->entries[cdir->listing_pos].name;
+		cdir->d_type = listing->entries[cdir->listing_pos].d_type;
+		cdir->listing_pos++;
+		return 0;
+	}
 	while (cdir->nr_dirs < cdir->untracked->dirs_nr) {
 		struct untracked_cache_dir *d = cdir->untracked->dirs[cdir->nr_dirs];
 		if (!d->recurse) {
@@ -2667,7 +2966,7 @@ static void add_path_to_appropriate_result_list(struct dir_struct *dir,
 		if (dir->flags & DIR_SHOW_IGNORED)
 			break;
 		dir_add_name(dir, istate, path->buf, path->len);
-		if (cdir->fdir)
+		if (cdir->fdir || cdir->listing)
 			add_untracked(untracked, path->buf + baselen);
 		break;
 
@@ -2773,7 +3072,7 @@ static enum path_treatment read_directory_recursive(struct dir_struct *dir,
 
 			/* abort early if maximum state has been reached */
 			if (dir_state == path_untracked) {
-				if (cdir.fdir)
+				if (cdir.fdir || cdir.listing)
 					add_untracked(untracked, path.buf + baselen);
 				break;
 			}
@@ -3096,6 +3395,185 @@ static struct untracked_cache_dir *validate_untracked_cache(struct dir_struct *d
 	return root;
 }
 
+struct untracked_prefetch {
+	struct index_state *istate;
+	int use_fsmonitor;
+	struct untracked_prefetch_job {
+		struct untracked_cache_dir *ucd;
+		char *path;
+	} *jobs;
+	size_t nr, alloc, next;
+	pthread_mutex_t mutex;
+};
+
+/* Minimum number of cached directories to make a thread worth it */
+#define UNTRACKED_PREFETCH_DIRS_PER_THREAD 50
+/* Number of directories a thread claims at a time */
+#define UNTRACKED_PREFETCH_BATCH_SIZE 8
+
+static void add_untracked_prefetch_jobs(struct untracked_prefetch *p,
+					struct untracked_cache_dir *ucd,
+					struct strbuf *path)
+{
+	size_t len = path->len;
+
+	ALLOC_GROW(p->jobs, p->nr + 1, p->alloc);
+	p->jobs[p->nr].ucd = ucd;
+	p->jobs[p->nr].path = xstrdup(path->len ? path->buf : ".");
+	p->nr++;
+
+	for (size_t i = 0; i < ucd->dirs_nr; i++) {
+		strbuf_addstr(path, ucd->dirs[i]->name);
+		strbuf_addch(path, '/');
+		add_untracked_prefetch_jobs(p, ucd->dirs[i], path);
+		strbuf_setlen(path, len);
+	}
+}
+
+/*
+ * Do what valid_cached_dir() and open_cached_dir() would do with the
+ * filesystem for this directory. Returns 1 if the directory was read.
+ */
+static int prefetch_untracked_dir(struct untracked_prefetch *p,
+				  struct untracked_prefetch_job *job)
+{
+	struct untracked_cache_dir *ucd = job->ucd;
+	struct untracked_listing *listing;
+	struct dirent *de;
+	DIR *fdir;
+
+	if (p->use_fsmonitor && ucd->valid)
+		return 0;
+
+	CALLOC_ARRAY(listing, 1);
+	strbuf_init(&listing->names, 0);
+	ucd->listing = listing;
+
+	if (lstat(job->path, &listing->st)) {
+		listing->lstat_errno = errno;
+		return 0;
+	}
+	if (ucd->valid &&
+	    !match_stat_data_racy(p->istate, &ucd->stat_data, &listing->st))
+		return 0;
+
+	/* leave reporting errors to open_cached_dir() */
+	fdir = opendir(job->path);
+	if (!fdir)
+		return 0;
+	while ((de = readdir_skip_dot_and_dotdot(fdir))) {
+		ALLOC_GROW(listing->entries, listing->nr + 1, listing->alloc);
+		listing->entries[listing->nr].name = listing->names.len;
+		listing->entries[listing->nr].d_type = DTYPE(de);
+		listing->nr++;
+		strbuf_add(&listing->names, de->d_name, strlen(de->d_name) + 1);
+	}
+	closedir(fdir);
+	listing->read = 1;
+	return 1;
+}
+
+static void *prefetch_untracked_thread(void *data)
+{
+	struct untracked_prefetch *p = data;
+	intmax_t checked = 0, scanned = 0;
+
+	trace2_thread_start("untracked_prefetch");
+
+	for (;;) {
+		size_t begin, end;
+
+		pthread_mutex_lock(&p->mutex);
+		begin = p->next;
+		end = begin + UNTRACKED_PREFETCH_BATCH_SIZE;
+		if (end > p->nr)
+			end = p->nr;
+		p->next = end;
+		pthread_mutex_unlock(&p->mutex);
+
+		if (begin == end)
+			break;
+		for (size_t i = begin; i < end; i++)
+			scanned += prefetch_untracked_dir(p, &p->jobs[i]);
+		checked += end - begin;
+	}
+
+	trace2_data_intmax("read_directory", NULL, "prefetch/checked", checked);
+	trace2_data_intmax("read_directory", NULL, "prefetch/scanned", scanned);
+	trace2_thread_exit();
+	return NULL;
+}
+
+static void prefetch_untracked_dirs(struct dir_struct *dir,
+				    struct index_state *istate,
+				    struct untracked_cache_dir *root,
+				    struct untracked_prefetch *p)
+{
+	struct strbuf path = STRBUF_INIT;
+	pthread_t *threads;
+	int nr_threads, max_threads, i;
+
+	memset(p, 0, sizeof(*p));
+	if (!HAVE_THREADS || !istate->repo)
+		return;
+	prepare_repo_settings(istate->repo);
+	nr_threads = istate->repo->settings.untracked_cache_threads;
+	if (nr_threads == 1)
+		return;
+	if (!nr_threads)
+		nr_threads = online_cpus();
+
+	add_untracked_prefetch_jobs(p, root, &path);
+	strbuf_release(&path);
+
+	max_threads = p->nr / UNTRACKED_PREFETCH_DIRS_PER_THREAD;
+	if (nr_threads > max_threads)
+		nr_threads = max_threads;
+	if (nr_threads < 2)
+		return;
+
+	/* as valid_cached_dir() would do before looking at "valid" */
+	refresh_fsmonitor(istate);
+	p->istate = istate;
+	p->use_fsmonitor = dir->untracked->use_fsmonitor;
+	pthread_mutex_init(&p->mutex, NULL);
+
+	trace2_region_enter("dir", "prefetch_untracked", istate->repo);
+	trace2_data_intmax("read_directory", istate->repo,
+			   "prefetch/threads", nr_threads);
+	CALLOC_ARRAY(threads, nr_threads);
+	for (i = 0; i < nr_threads; i++) {
+		int err = pthread_create(&threads[i], NULL,
+					 prefetch_untracked_thread, p);
+		if (err)
+			die(_("unable to create untracked cache thread: %s"),
+			    strerror(err));
+	}
+	for (i = 0; i < nr_threads; i++)
+		if (pthread_join(threads[i], NULL))
+			die("unable to join untracked cache thread");
+	free(threads);
+	trace2_region_leave("dir", "prefetch_untracked", istate->repo);
+
+	pthread_mutex_destroy(&p->mutex);
+}
+
+static void release_untracked_prefetch(struct untracked_prefetch *p)
+{
+	for (size_t i = 0; i < p->nr; i++) {
+		struct untracked_listing *listing = p->jobs[i].ucd->listing;
+
+		if (listing) {
+			free(listing->entries);
+			strbuf_release(&listing->names);
+			free(listing);
+			p->jobs[i].ucd->listing = NULL;
+		}
+		free(p->jobs[i].path);
+	}
+	free(p->jobs);
+}
+
 static void emit_traversal_statistics(struct dir_struct *dir,
 				      struct repository *repo,
 				      const char *path,
@@ -3153,8 +3631,14 @@ int read_directory(struct dir_struct *dir, struct index_state *istate,
 		 * e.g. prep_exclude()
 		 */
 		dir->untracked = NULL;
-	if (!len || treat_leading_path(dir, istate, path, len, pathspec))
+	if (!len || treat_leading_path(dir, istate, path, len, pathspec)) {
+		struct untracked_prefetch prefetch = { 0 };
+
+		if (untracked)
+			prefetch_untracked_dirs(dir, istate, untracked, &prefetch);
 		read_directory_recursive(dir, istate, path, len, untracked, 0, 0, pathspec);
+		release_untracked_prefetch(&prefetch);
+	}
 	QSORT(dir->entries, dir->nr, cmp_dir_entry);
 	QSORT(dir->ignored, dir->ignored_nr, cmp_dir_entry);
 
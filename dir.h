@@ -7,7 +7,9 @@
 #include "statinfo.h"
 #include "strbuf.h"
 
+struct pattern_index;
 struct repository;
+struct untracked_listing;
 
 /**
  * The directory listing API is used to enumerate paths in the work tree,
@@ -118,6 +120,12 @@ struct pattern_list {
 	 * Used to check single-level parents of blobs.
 	 */
 	struct hashmap parent_hashmap;
+
+	/*
+	 * Lookup tables for the patterns without wildcards, built when a
+	 * long list is first matched against.
+	 */
+	struct pattern_index *index;
 };
 
 /*
@@ -184,6 +192,11 @@ struct untracked_cache_dir {
 	unsigned int recurse : 1;
 	/* null object ID means this directory does not have .gitignore */
 	struct object_id exclude_oid;
+	/*
+	 * The directory as read ahead of the traversal by other threads
+	 * (see core.untrackedCacheThreads), only set within read_directory().
+	 */
+	struct untracked_listing *listing;
 	char name[FLEX_ARRAY];
 };
 
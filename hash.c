@@ -150,6 +150,29 @@ static void git_hash_sha256_discard(struct git_hash_ctx *ctx)
 	git_SHA256_Discard(&ctx->state.sha256);
 }
 
+#ifdef platform_SHA256_Batch
+static void git_hash_sha256_batch(const struct git_hash_batch_item *items,
+				  size_t nr)
+{
+	struct blk_SHA256_msg msgs[32];
+
+	while (nr) {
+		size_t i, n = nr < ARRAY_SIZE(msgs) ? nr : ARRAY_SIZE(msgs);
+
+		for (i = 0; i < n; i++) {
+			msgs[i].hdr = items[i].hdr;
+			msgs[i].hdrlen = items[i].hdrlen;
+			msgs[i].data = items[i].data;
+			msgs[i].len = items[i].len;
+			msgs[i].digest = items[i].out;
+		}
+		platform_SHA256_Batch(msgs, n);
+		items += n;
+		nr -= n;
+	}
+}
+#endif
+
 static void git_hash_unknown_init(struct git_hash_ctx *ctx UNUSED)
 {
 	BUG("trying to init unknown hash");
@@ -248,6 +271,9 @@ const struct git_hash_algo hash_algos[GIT_HASH_NALGOS] = {
 		.final_fn = git_hash_sha256_final,
 		.final_oid_fn = git_hash_sha256_final_oid,
 		.discard_fn = git_hash_sha256_discard,
+#ifdef platform_SHA256_Batch
+		.batch_fn = git_hash_sha256_batch,
+#endif
 		.empty_tree = &empty_tree_oid_sha256,
 		.empty_blob = &empty_blob_oid_sha256,
 		.null_oid = &null_oid_sha256,
@@ -328,6 +354,26 @@ void git_hash_discard(struct git_hash_ctx *ctx)
 	ctx->active = false;
 }
 
+void git_hash_batch(const struct git_hash_algo *algop,
+		    const struct git_hash_batch_item *items, size_t nr)
+{
+	struct git_hash_ctx ctx;
+	size_t i;
+
+	if (algop->batch_fn) {
+		algop->batch_fn(items, nr);
+		return;
+	}
+
+	for (i = 0; i < nr; i++) {
+		git_hash_init(&ctx, algop);
+		if (items[i].hdrlen)
+			git_hash_update(&ctx, items[i].hdr, items[i].hdrlen);
+		git_hash_update(&ctx, items[i].data, items[i].len);
+		git_hash_final(items[i].out, &ctx);
+	}
+}
+
 uint32_t hash_algo_by_name(const char *name)
 {
 	if (!name)
@@ -291,6 +291,20 @@ typedef void (*git_hash_final_fn)(unsigned char *hash, struct git_hash_ctx *ctx)
 typedef void (*git_hash_final_oid_fn)(struct object_id *oid, struct git_hash_ctx *ctx);
 typedef void (*git_hash_discard_fn)(struct git_hash_ctx *ctx);
 
+/*
+ * One message for git_hash_batch(): "hdrlen" bytes at "hdr" (which may
+ * be empty) followed by "len" bytes at "data". The hash is written to
+ * "out".
+ */
+struct git_hash_batch_item {
+	const void *hdr;
+	size_t hdrlen;
+	const void *data;
+	size_t len;
+	unsigned char *out;
+};
+typedef void (*git_hash_batch_fn)(const struct git_hash_batch_item *items, size_t nr);
+
 struct git_hash_algo {
 	/*
 	 * The name of the algorithm, as appears in the config file and in
@@ -321,6 +335,12 @@ struct git_hash_algo {
 	git_hash_final_oid_fn final_oid_fn;
 	git_hash_discard_fn discard_fn;
 
+	/*
+	 * Hashes several independent messages at once, if the
+	 * implementation can do better than one at a time. May be NULL.
+	 */
+	git_hash_batch_fn batch_fn;
+
 	/* The OID of the empty tree. */
 	const struct object_id *empty_tree;
 
@@ -369,6 +389,14 @@ void git_hash_final_oid(struct object_id *oid, struct git_hash_ctx *ctx);
  */
 void git_hash_discard(struct git_hash_ctx *ctx);
 
+/*
+ * Hash "nr" independent messages. This gives the same results as
+ * hashing each of them on its own, but may be faster when the
+ * implementation processes several messages in parallel.
+ */
+void git_hash_batch(const struct git_hash_algo *algop,
+		    const struct git_hash_batch_item *items, size_t nr);
+
 const struct git_hash_algo *hash_algo_ptr_by_number(uint32_t algo);
 struct git_hash_ctx *git_hash_alloc(void);
 void git_hash_free(struct git_hash_ctx *ctx);
@@ -0,0 +1,78 @@
+#ifndef LSTAT_BATCH_H
+#define LSTAT_BATCH_H
+
+/*
+ * Issue many lstat() calls at once, so that the operating system can
+ * work on them concurrently without the caller running one thread per
+ * pending call. This is only available on some platforms (currently
+ * Linux with io_uring); callers must be prepared to fall back to
+ * calling lstat() themselves.
+ */
+struct lstat_batch;
+
+/*
+ * Called once for each path given to lstat_batch_add(), in no particular
+ * order, with the result of lstat() on it: "st" when "err" is zero,
+ * otherwise "err" holds the errno value.
+ */
+typedef void (*lstat_batch_fn)(void *cb_data, void *item,
+			       struct stat *st, int err);
+
+struct lstat_batch_stats {
+	/* number of times requests were handed to the kernel */
+	unsigned long batches;
+	/* largest number of requests in flight at once */
+	unsigned long max_depth;
+	/* total number of requests */
+	unsigned long nr;
+	/* time spent waiting for results */
+	uint64_t wait_ns;
+};
+
+#ifdef HAVE_IO_URING
+
+/*
+ * Prepare to run up to "depth" lstat() calls at a time. Returns NULL
+ * when batching is not possible, e.g. when the kernel refuses it.
+ */
+struct lstat_batch *lstat_batch_init(unsigned int depth,
+				     lstat_batch_fn fn, void *cb_data);
+
+/*
+ * Queue an lstat() of "path", which must remain valid until "fn" has
+ * been called for it. "fn" may be called for earlier paths meanwhile.
+ */
+void lstat_batch_add(struct lstat_batch *batch, const char *path, void *item);
+
+/*
+ * Wait for all queued calls to complete, then release "batch". If
+ * "stats" is not NULL, it is filled in.
+ */
+void lstat_batch_finish(struct lstat_batch *batch,
+			struct lstat_batch_stats *stats);
+
+#else
+
+static inline struct lstat_batch *lstat_batch_init(unsigned int depth UNUSED,
+						   lstat_batch_fn fn UNUSED,
+						   void *cb_data UNUSED)
+{
+	return NULL;
+}
+
+static inline void lstat_batch_add(struct lstat_batch *batch UNUSED,
+				   const char *path UNUSED,
+				   void *item UNUSED)
+{
+	BUG("lstat_batch_add() without lstat_batch_init()");
+}
+
+static inline void lstat_batch_finish(struct lstat_batch *batch UNUSED,
+				      struct lstat_batch_stats *stats UNUSED)
+{
+	BUG("lstat_batch_finish() without lstat_batch_init()");
+}
+
+#endif
+
+#endif /* LSTAT_BATCH_H */
@@ -70,6 +70,13 @@ void mem_pool_init(struct mem_pool *pool, size_t initial_size)
 void mem_pool_discard(struct mem_pool *pool, int invalidate_memory)
 {
 	struct mp_block *block, *block_to_free;
+	struct mp_mapping *mapping;
+
+	while ((mapping = pool->mappings)) {
+		pool->mappings = mapping->next;
+		munmap(mapping->start, mapping->len);
+		free(mapping);
+	}
 
 	block = pool->mp_block;
 	while (block)
@@ -177,9 +184,20 @@ char *mem_pool_strndup(struct mem_pool *pool, const char *str, size_t len)
 	return memcpy(ret, str, actual_len);
 }
 
+void mem_pool_add_mapping(struct mem_pool *pool, void *start, size_t len)
+{
+	struct mp_mapping *mapping = xmalloc(sizeof(*mapping));
+
+	mapping->start = start;
+	mapping->len = len;
+	mapping->next = pool->mappings;
+	pool->mappings = mapping;
+}
+
 int mem_pool_contains(struct mem_pool *pool, void *mem)
 {
 	struct mp_block *p;
+	struct mp_mapping *m;
 
 	/* Check if memory is allocated in a block */
 	for (p = pool->mp_block; p; p = p->next_block)
@@ -187,6 +205,12 @@ int mem_pool_contains(struct mem_pool *pool, void *mem)
 		    (mem < ((void *)p->end)))
 			return 1;
 
+	/* ... or part of a mapped region */
+	for (m = pool->mappings; m; m = m->next)
+		if (mem >= m->start &&
+		    (char *)mem < (char *)m->start + m->len)
+			return 1;
+
 	return 0;
 }
 
@@ -214,6 +238,15 @@ void mem_pool_combine(struct mem_pool *dst, struct mem_pool *src)
 		/* src is empty, nothing to do. */
 	}
 
+	if (src->mappings) {
+		struct mp_mapping **tail = &dst->mappings;
+
+		while (*tail)
+			tail = &(*tail)->next;
+		*tail = src->mappings;
+		src->mappings = NULL;
+	}
+
 	dst->pool_alloc += src->pool_alloc;
 	src->pool_alloc = 0;
 	src->mp_block = NULL;
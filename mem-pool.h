@@ -8,8 +8,19 @@ struct mp_block {
 	uintmax_t space[FLEX_ARRAY]; /* more */
 };
 
+/*
+ * A region of memory obtained by xmmap() that a pool is responsible
+ * for, but never allocates from.
+ */
+struct mp_mapping {
+	struct mp_mapping *next;
+	void *start;
+	size_t len;
+};
+
 struct mem_pool {
 	struct mp_block *mp_block;
+	struct mp_mapping *mappings;
 
 	/*
 	 * The amount of available memory to grow the pool by.
@@ -60,6 +71,14 @@ char *mem_pool_strfmt(struct mem_pool *pool, const char *fmt, ...);
  */
 void mem_pool_combine(struct mem_pool *dst, struct mem_pool *src);
 
+/*
+ * Make the pool responsible for 'len' bytes at 'start' that were mapped
+ * with xmmap(). Callers may hand out pointers into that region as if
+ * they had been allocated from the pool; the region is unmapped when
+ * the pool is discarded.
+ */
+void mem_pool_add_mapping(struct mem_pool *pool, void *start, size_t len);
+
 /*
  * Check if a memory pointed at by 'mem' is part of the range of
  * memory managed by the specified mem_pool.
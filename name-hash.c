@@ -207,7 +207,7 @@ static int lookup_lazy_params(struct index_state *istate)
 	 * code to build the "istate->name_hash".  We don't
 	 * need the complexity here.
 	 */
-	if (!repo_ignore_case(the_repository))
+	if (!repo_ignore_case(istate->repo))
 		return 0;
 
 	nr_cpus = online_cpus();
@@ -640,12 +640,14 @@ int test_lazy_init_name_hash(struct index_state *istate, int try_threaded)
 
 void add_name_hash(struct index_state *istate, struct cache_entry *ce)
 {
+	discard_name_hash_table(istate);
 	if (istate->name_hash_initialized)
 		hash_index_entry(istate, ce);
 }
 
 void remove_name_hash(struct index_state *istate, struct cache_entry *ce)
 {
+	discard_name_hash_table(istate);
 	if (!istate->name_hash_initialized || !(ce->ce_flags & CE_HASHED))
 		return;
 	ce->ce_flags &= ~CE_HASHED;
@@ -691,11 +693,305 @@ static int same_name(const struct cache_entry *ce, const char *name, int namelen
 	return slow_same_name(name, namelen, ce->name, len);
 }
 
+/*
+ * The "NAMH" extension holds two open-addressing tables, probed
+ * linearly from "hash & (slots - 1)":
+ *
+ *   - 32-bit version (1)
+ *   - 32-bit number of index entries the tables were computed for
+ *   - 32-bit number of file slots, a power of two
+ *   - 32-bit number of directory slots, a power of two
+ *   - for each file slot, the 32-bit memihash() of the name and the
+ *     32-bit position of its entry plus one, or zero when empty
+ *   - for each directory slot, the same followed by the 32-bit length
+ *     of the directory name, which is a prefix of the entry's name
+ *
+ * Positions refer to the entries as they were written, so the tables
+ * can only be used until the index is modified.
+ */
+#define NAME_HASH_TABLE_VERSION (1)
+#define NAME_HASH_HEADER_SIZE (16)
+#define NAME_HASH_FILE_SLOT_SIZE (8)
+#define NAME_HASH_DIR_SLOT_SIZE (12)
+
+struct name_hash_table {
+	unsigned int nr;
+	uint32_t file_slots;
+	uint32_t dir_slots;
+	const unsigned char *files;
+	const unsigned char *dirs;
+	char *data;
+	size_t size;
+};
+
+static int is_table_size(uint32_t slots)
+{
+	return slots && !(slots & (slots - 1));
+}
+
+int read_name_hash_extension(struct index_state *istate, const void *data,
+			     unsigned long sz)
+{
+	const unsigned char *index = data;
+	struct name_hash_table *t;
+	uint32_t file_slots, dir_slots;
+
+	if (sz < NAME_HASH_HEADER_SIZE)
+		return error("corrupt name hash extension (too short)");
+	/* an unknown version is not fatal; the hash is rebuilt lazily */
+	if (get_be32(index) != NAME_HASH_TABLE_VERSION) {
+		warning("ignoring name hash version %"PRIu32, get_be32(index));
+		return 0;
+	}
+
+	file_slots = get_be32(index + 8);
+	dir_slots = get_be32(index + 12);
+	if (!is_table_size(file_slots) || !is_table_size(dir_slots) ||
+	    sz != NAME_HASH_HEADER_SIZE +
+		  (uint64_t)file_slots * NAME_HASH_FILE_SLOT_SIZE +
+		  (uint64_t)dir_slots * NAME_HASH_DIR_SLOT_SIZE)
+		return error("corrupt name hash extension (bad size)");
+
+	/*
+	 * The directory table matches what lazy_init_name_hash() builds
+	 * only when ignoring case.
+	 */
+	if (get_be32(index + 4) != istate->cache_nr ||
+	    istate->split_index || istate->sparse_index ||
+	    !repo_ignore_case(istate->repo))
+		return 0;
+
+	discard_name_hash_table(istate);
+	CALLOC_ARRAY(t, 1);
+	t->nr = istate->cache_nr;
+	t->file_slots = file_slots;
+	t->dir_slots = dir_slots;
+	t->data = xmemdupz(data, sz);
+	t->size = sz;
+	t->files = (const unsigned char *)t->data + NAME_HASH_HEADER_SIZE;
+	t->dirs = t->files + (size_t)file_slots * NAME_HASH_FILE_SLOT_SIZE;
+	istate->name_hash_table = t;
+
+	trace2_data_intmax("index", istate->repo, "read/name_hash_table", t->nr);
+	return 0;
+}
+
+void discard_name_hash_table(struct index_state *istate)
+{
+	if (!istate->name_hash_table)
+		return;
+	free(istate->name_hash_table->data);
+	FREE_AND_NULL(istate->name_hash_table);
+}
+
+/*
+ * Entries can also be dropped without going through remove_name_hash(),
+ * e.g. by "ls-files --with-tree"; never trust the table then.
+ */
+static struct name_hash_table *valid_name_hash_table(struct index_state *istate)
+{
+	struct name_hash_table *t = istate->name_hash_table;
+
+	if (!t || t->nr != istate->cache_nr || istate->sparse_index)
+		return NULL;
+	return t;
+}
+
+static struct cache_entry *table_file_find(struct name_hash_table *t,
+					   struct cache_entry **cache,
+					   unsigned int nr,
+					   const char *name, int namelen,
+					   unsigned int hash, int icase)
+{
+	uint32_t mask = t->file_slots - 1;
+	uint32_t i, probes;
+
+	for (i = hash & mask, probes = 0; probes < t->file_slots;
+	     i = (i + 1) & mask, probes++) {
+		const unsigned char *slot = t->files + (size_t)i * NAME_HASH_FILE_SLOT_SIZE;
+		uint32_t pos = get_be32(slot + 4);
+
+		if (!pos)
+			break;
+		if (get_be32(slot) != hash || pos > nr)
+			continue;
+		if (same_name(cache[pos - 1], name, namelen, icase))
+			return cache[pos - 1];
+	}
+	return NULL;
+}
+
+/* Returns the name of the entry that spells the directory, if any. */
+static const char *table_dir_find(struct name_hash_table *t,
+				  struct cache_entry **cache,
+				  unsigned int nr,
+				  const char *name, unsigned int namelen,
+				  unsigned int hash)
+{
+	uint32_t mask = t->dir_slots - 1;
+	uint32_t i, probes;
+
+	for (i = hash & mask, probes = 0; probes < t->dir_slots;
+	     i = (i + 1) & mask, probes++) {
+		const unsigned char *slot = t->dirs + (size_t)i * NAME_HASH_DIR_SLOT_SIZE;
+		uint32_t pos = get_be32(slot + 4);
+		const struct cache_entry *ce;
+
+		if (!pos)
+			break;
+		if (get_be32(slot) != hash || pos > nr ||
+		    get_be32(slot + 8) != namelen)
+			continue;
+		ce = cache[pos - 1];
+		if (namelen < ce_namelen(ce) && ce->name[namelen] == '/' &&
+		    !strncasecmp(ce->name, name, namelen))
+			return ce->name;
+	}
+	return NULL;
+}
+
+static uint32_t name_hash_table_slots(unsigned int nr)
+{
+	uint32_t slots = 1;
+
+	/* keep the tables at most half full */
+	while (slots < 2 * (uint64_t)nr)
+		slots <<= 1;
+	return slots;
+}
+
+static size_t common_name_prefix(const struct cache_entry *a,
+				 const struct cache_entry *b)
+{
+	size_t len = 0;
+
+	while (a->name[len] && a->name[len] == b->name[len])
+		len++;
+	return len;
+}
+
+static void table_add(unsigned char *table, uint32_t slots, size_t slot_size,
+		      unsigned int hash, uint32_t pos, int namelen)
+{
+	uint32_t i = hash & (slots - 1);
+	unsigned char *slot;
+
+	while (get_be32(table + (size_t)i * slot_size + 4))
+		i = (i + 1) & (slots - 1);
+	slot = table + (size_t)i * slot_size;
+	put_be32(slot, hash);
+	put_be32(slot + 4, pos);
+	if (namelen >= 0)
+		put_be32(slot + 8, namelen);
+}
+
+void write_name_hash_extension(struct strbuf *sb, struct index_state *istate)
+{
+	struct name_hash_table *t = valid_name_hash_table(istate);
+	struct name_hash_table new_table = { 0 };
+	struct cache_entry **cache;
+	unsigned char *files, *dirs;
+	unsigned int i, nr = 0, nr_dirs = 0;
+	size_t size;
+
+	ALLOC_ARRAY(cache, istate->cache_nr);
+	for (i = 0; i < istate->cache_nr; i++)
+		if (!(istate->cache[i]->ce_flags & CE_REMOVE))
+			cache[nr++] = istate->cache[i];
+
+	/* nothing changed since the table was read */
+	if (t && nr == t->nr) {
+		strbuf_add(sb, t->data, t->size);
+		free(cache);
+		return;
+	}
+
+	/*
+	 * As entries are sorted, a directory that the previous entry is
+	 * not in is seen for the first time. This may count directories
+	 * that differ only in case more than once, which is fine for
+	 * sizing the table.
+	 */
+	for (i = 0; i < nr; i++) {
+		const char *slash = cache[i]->name;
+
+		if (i)
+			slash += common_name_prefix(cache[i - 1], cache[i]);
+		while ((slash = strchr(slash, '/'))) {
+			nr_dirs++;
+			slash++;
+		}
+	}
+
+	new_table.file_slots = name_hash_table_slots(nr);
+	new_table.dir_slots = name_hash_table_slots(nr_dirs);
+	size = NAME_HASH_HEADER_SIZE +
+	       st_mult(new_table.file_slots, NAME_HASH_FILE_SLOT_SIZE) +
+	       st_mult(new_table.dir_slots, NAME_HASH_DIR_SLOT_SIZE);
+	strbuf_grow(sb, size);
+	files = (unsigned char *)sb->buf + sb->len;
+	memset(files, 0, size);
+	put_be32(files, NAME_HASH_TABLE_VERSION);
+	put_be32(files + 4, nr);
+	put_be32(files + 8, new_table.file_slots);
+	put_be32(files + 12, new_table.dir_slots);
+	strbuf_setlen(sb, sb->len + size);
+
+	files += NAME_HASH_HEADER_SIZE;
+	dirs = files + (size_t)new_table.file_slots * NAME_HASH_FILE_SLOT_SIZE;
+	new_table.files = files;
+	new_table.dirs = dirs;
+
+	for (i = 0; i < nr; i++) {
+		struct cache_entry *ce = cache[i];
+		unsigned int hash, len;
+		size_t known = i ? common_name_prefix(cache[i - 1], ce) : 0;
+
+		if (ce->ce_flags & CE_HASHED)
+			hash = ce->ent.hash;
+		else
+			hash = memihash(ce->name, ce_namelen(ce));
+		table_add(files, new_table.file_slots, NAME_HASH_FILE_SLOT_SIZE,
+			  hash, i + 1, -1);
+
+		/*
+		 * Like hash_dir_entry(), add the innermost directories first
+		 * and stop at the first one we already have, as its parents
+		 * are then known as well.
+		 */
+		for (len = ce_namelen(ce); len-- > known;) {
+			if (ce->name[len] != '/')
+				continue;
+			hash = memihash(ce->name, len);
+			if (table_dir_find(&new_table, cache, nr, ce->name, len, hash))
+				break;
+			table_add(dirs, new_table.dir_slots, NAME_HASH_DIR_SLOT_SIZE,
+				  hash, i + 1, len);
+		}
+	}
+
+	trace2_data_intmax("index", istate->repo, "write/name_hash_table", nr);
+	free(cache);
+}
+
 int index_dir_find(struct index_state *istate, const char *name, int namelen,
 		   struct strbuf *canonical_path)
 {
+	struct name_hash_table *t = valid_name_hash_table(istate);
 	struct dir_entry *dir;
 
+	if (t) {
+		const char *dirname = table_dir_find(t, istate->cache,
+						     istate->cache_nr, name,
+						     namelen, memihash(name, namelen));
+
+		if (canonical_path && dirname) {
+			strbuf_reset(canonical_path);
+			strbuf_add(canonical_path, dirname, namelen);
+		}
+		return !!dirname;
+	}
+
 	lazy_init_name_hash(istate);
 	expand_to_path(istate, name, namelen, 0);
 	dir = find_dir_entry(istate, name, namelen);
@@ -710,21 +1006,34 @@ int index_dir_find(struct index_state *istate, const char *name, int namelen,
 
 void adjust_dirname_case(struct index_state *istate, char *name)
 {
+	struct name_hash_table *t = valid_name_hash_table(istate);
 	const char *startPtr = name;
 	const char *ptr = startPtr;
 
-	lazy_init_name_hash(istate);
-	expand_to_path(istate, name, strlen(name), 0);
+	if (!t) {
+		lazy_init_name_hash(istate);
+		expand_to_path(istate, name, strlen(name), 0);
+	}
 	while (*ptr) {
 		while (*ptr && *ptr != '/')
 			ptr++;
 
 		if (*ptr == '/') {
-			struct dir_entry *dir;
-
-			dir = find_dir_entry(istate, name, ptr - name);
-			if (dir) {
-				memcpy((void *)startPtr, dir->name + (startPtr - name), ptr - startPtr);
+			const char *dirname;
+
+			if (t) {
+				dirname = table_dir_find(t, istate->cache,
+							 istate->cache_nr, name,
+							 ptr - name,
+							 memihash(name, ptr - name));
+			} else {
+				struct dir_entry *dir;
+
+				dir = find_dir_entry(istate, name, ptr - name);
+				dirname = dir ? dir->name : NULL;
+			}
+			if (dirname) {
+				memcpy((void *)startPtr, dirname + (startPtr - name), ptr - startPtr);
 				startPtr = ptr + 1;
 			}
 			ptr++;
@@ -734,9 +1043,14 @@ void adjust_dirname_case(struct index_state *istate, char *name)
 
 struct cache_entry *index_file_exists(struct index_state *istate, const char *name, int namelen, int icase)
 {
+	struct name_hash_table *t = valid_name_hash_table(istate);
 	struct cache_entry *ce;
 	unsigned int hash = memihash(name, namelen);
 
+	if (t)
+		return table_file_find(t, istate->cache, istate->cache_nr,
+				       name, namelen, hash, icase);
+
 	lazy_init_name_hash(istate);
 	expand_to_path(istate, name, namelen, icase);
 
@@ -751,6 +1065,7 @@ struct cache_entry *index_file_exists(struct index_state *istate, const char *na
 
 void free_name_hash(struct index_state *istate)
 {
+	discard_name_hash_table(istate);
 	if (!istate->name_hash_initialized)
 		return;
 	istate->name_hash_initialized = 0;
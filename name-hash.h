@@ -3,6 +3,7 @@
 
 struct cache_entry;
 struct index_state;
+struct strbuf;
 
 
 int index_dir_find(struct index_state *istate, const char *name, int namelen,
@@ -18,4 +19,14 @@ void add_name_hash(struct index_state *istate, struct cache_entry *ce);
 void remove_name_hash(struct index_state *istate, struct cache_entry *ce);
 void free_name_hash(struct index_state *istate);
 
+/*
+ * The "NAMH" index extension stores precomputed hash tables of the file
+ * and directory names in the index, so that lookups can be answered
+ * without building the name hash until the index is modified.
+ */
+int read_name_hash_extension(struct index_state *istate, const void *data,
+			     unsigned long sz);
+void write_name_hash_extension(struct strbuf *sb, struct index_state *istate);
+void discard_name_hash_table(struct index_state *istate);
+
 #endif /* NAME_HASH_H */
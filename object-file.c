@@ -138,7 +138,12 @@ int stream_object_signature(struct repository *r,
 	git_hash_update(&c, hdr, hdrlen);
 	for (;;) {
 		char buf[1024 * 16];
-		ssize_t readlen = odb_read_stream_read(st, buf, sizeof(buf));
+		ssize_t readlen;
+
+		/* only reading needs the lock, not hashing */
+		obj_read_lock();
+		readlen = odb_read_stream_read(st, buf, sizeof(buf));
+		obj_read_unlock();
 		if (readlen < 0)
 			return -1;
 		if (!readlen)
@@ -470,6 +475,36 @@ void hash_object_file(const struct git_hash_algo *algo, const void *buf,
 	git_hash_final_oid(oid, &c);
 }
 
+void hash_object_file_batch(const struct git_hash_algo *algo,
+			    const struct hash_object_request *reqs, size_t nr)
+{
+	struct git_hash_batch_item items[32];
+	char hdr[ARRAY_SIZE(items)][MAX_HEADER_LEN];
+	size_t i;
+
+	while (nr) {
+		size_t n = nr < ARRAY_SIZE(items) ? nr : ARRAY_SIZE(items);
+
+		for (i = 0; i < n; i++) {
+			items[i].hdr = hdr[i];
+			items[i].hdrlen = format_object_header(hdr[i], sizeof(hdr[i]),
+							       reqs[i].type,
+							       reqs[i].len);
+			items[i].data = reqs[i].buf;
+			items[i].len = reqs[i].len;
+			items[i].out = reqs[i].oid->hash;
+		}
+		git_hash_batch(algo, items, n);
+		for (i = 0; i < n; i++) {
+			memset(reqs[i].oid->hash + algo->rawsz, 0,
+			       GIT_MAX_RAWSZ - algo->rawsz);
+			reqs[i].oid->algo = hash_algo_by_ptr(algo);
+		}
+		reqs += n;
+		nr -= n;
+	}
+}
+
 struct transaction_packfile {
 	char *pack_tmp_name;
 	struct hashfile *f;
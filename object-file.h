@@ -118,6 +118,20 @@ void hash_object_file(const struct git_hash_algo *algo, const void *buf,
 		      size_t len, enum object_type type,
 		      struct object_id *oid);
 
+struct hash_object_request {
+	const void *buf;
+	size_t len;
+	enum object_type type;
+	struct object_id *oid;
+};
+
+/*
+ * Like hash_object_file(), but for "nr" objects at once, so that hash
+ * implementations that work on several messages in parallel can do so.
+ */
+void hash_object_file_batch(const struct git_hash_algo *algo,
+			    const struct hash_object_request *reqs, size_t nr);
+
 /* Helper to check and "touch" a file */
 int check_and_freshen_file(const char *fn, int freshen,
 			   const time_t *mtime);
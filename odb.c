@@ -1079,6 +1079,7 @@ void odb_close(struct object_database *o)
 	for (source = o->sources; source; source = source->next)
 		odb_source_close(source);
 	close_commit_graph(o);
+	close_delta_chain_pool(o);
 }
 
 static void odb_free_sources(struct object_database *o)
@@ -8,6 +8,7 @@
 #include "thread-utils.h"
 
 struct cached_object_entry;
+struct delta_chain_pool;
 struct list_objects_filter_options;
 struct odb_source_inmemory;
 struct packed_git;
@@ -98,6 +99,12 @@ struct object_database {
 	 * allow lookup of submodule objects via the main object database.
 	 */
 	struct string_list submodule_source_paths;
+
+	/*
+	 * Threads inflating deep delta chains in unpack_entry(), started
+	 * on first use and stopped when the database is closed.
+	 */
+	struct delta_chain_pool *delta_chain_pool;
 };
 
 enum odb_new_flags {
@@ -10,6 +10,7 @@
 #include "object-file.h"
 #include "odb.h"
 #include "odb/streaming.h"
+#include "thread-utils.h"
 
 struct idx_entry {
 	off_t                offset;
@@ -35,7 +36,12 @@ int check_pack_crc(struct packed_git *p, struct pack_window **w_curs,
 
 	do {
 		unsigned long avail;
-		void *data = use_pack(p, w_curs, offset, &avail);
+		void *data;
+
+		/* the window stays in use while we checksum it unlocked */
+		obj_read_lock();
+		data = use_pack(p, w_curs, offset, &avail);
+		obj_read_unlock();
 		if (avail > len)
 			avail = len;
 		data_crc = crc32(data_crc, data, avail);
@@ -49,134 +55,450 @@ int check_pack_crc(struct packed_git *p, struct pack_window **w_curs,
 	return data_crc != ntohl(*index_crc);
 }
 
-static int verify_packfile(struct repository *r,
-			   struct packed_git *p,
-			   struct pack_window **w_curs,
-			   verify_fn fn,
-			   void *fn_data,
-			   struct progress *progress, uint32_t base_count)
+/*
+ * Objects are verified in ranges of consecutive objects in pack order.
+ * Loading a range (unpacking, hashing and checking its objects) may
+ * happen on several threads at once, but ranges are always reported,
+ * and handed to the caller's callback, in order and on the calling
+ * thread. Hashing several objects at once also lets hash implementations
+ * that work on several messages at a time do so.
+ *
+ * A range holds at most VERIFY_RANGE_BYTES of object data (plus the
+ * object that crosses the limit). Once that much is loaded, the objects
+ * are handed over for reporting and the rest of the range is loaded
+ * only after they have been released.
+ */
+#define VERIFY_RANGE 16
+#define VERIFY_RANGE_BYTES (1024 * 1024)
 
-{
-	off_t index_size = p->index_size;
-	const unsigned char *index_base = p->index_data;
-	struct git_hash_ctx ctx;
-	unsigned char hash[GIT_MAX_RAWSZ], *pack_sig;
-	off_t offset = 0, pack_sig_ofs = 0;
-	uint32_t nr_objects, i;
-	int err = 0;
+struct verify_item {
+	struct object_id oid;
+	enum object_type type;
+	size_t size;
+	void *data;
+	unsigned data_valid:1,
+		 crc_bad:1,
+		 corrupt:1;
+};
+
+struct verify_range {
+	uint32_t start, nr;
+	/* items below "loaded" are ready, those below "reported" are done */
+	uint32_t loaded, reported;
+	struct verify_item items[VERIFY_RANGE];
+};
+
+struct verify_state {
+	struct repository *r;
+	struct packed_git *p;
 	struct idx_entry *entries;
+	uint32_t nr_objects;
+	uint32_t nr_ranges;
+	unsigned long big_file_threshold;
 
-	if (!is_pack_valid(p))
-		return error("packfile %s cannot be accessed", p->pack_name);
+	/* ring of ranges being loaded or waiting to be reported */
+	struct verify_range *slots;
+	uint32_t nr_slots;
 
-	git_hash_init(&ctx, r->hash_algo);
+	/* the fields below, and those of the slots, are guarded by mutex */
+	uint32_t next_range, reported;
+	pthread_mutex_t mutex;
+	pthread_cond_t loaded_cond, room_cond;
+
+	/* checksum of the pack data, computed alongside the objects */
+	unsigned char hash[GIT_MAX_RAWSZ];
+};
+
+static void hash_pack_data(struct verify_state *st, struct pack_window **w_curs)
+{
+	struct packed_git *p = st->p;
+	const struct git_hash_algo *algo = st->r->hash_algo;
+	off_t offset = 0, pack_sig_ofs = p->pack_size - algo->rawsz;
+	struct git_hash_ctx ctx;
+
+	git_hash_init(&ctx, algo);
 	do {
 		unsigned long remaining;
-		unsigned char *in = use_pack(p, w_curs, offset, &remaining);
+		unsigned char *in;
+
+		obj_read_lock();
+		in = use_pack(p, w_curs, offset, &remaining);
+		obj_read_unlock();
 		offset += remaining;
-		if (!pack_sig_ofs)
-			pack_sig_ofs = p->pack_size - r->hash_algo->rawsz;
 		if (offset > pack_sig_ofs)
 			remaining -= (unsigned int)(offset - pack_sig_ofs);
 		git_hash_update(&ctx, in, remaining);
 	} while (offset < pack_sig_ofs);
-	git_hash_final(hash, &ctx);
-	pack_sig = use_pack(p, w_curs, pack_sig_ofs, NULL);
-	if (!hasheq(hash, pack_sig, r->hash_algo))
+	git_hash_final(st->hash, &ctx);
+
+	obj_read_lock();
+	unuse_pack(w_curs);
+	obj_read_unlock();
+}
+
+static int check_pack_data_hash(struct verify_state *st,
+				struct pack_window **w_curs)
+{
+	struct packed_git *p = st->p;
+	const struct git_hash_algo *algo = st->r->hash_algo;
+	const unsigned char *pack_sig;
+	int err = 0;
+
+	pack_sig = use_pack(p, w_curs, p->pack_size - algo->rawsz, NULL);
+	if (!hasheq(st->hash, pack_sig, algo))
 		err = error("%s pack checksum mismatch",
 			    p->pack_name);
-	if (!hasheq(index_base + index_size - r->hash_algo->hexsz, pack_sig,
-		    r->hash_algo))
+	if (!hasheq((const unsigned char *)p->index_data + p->index_size - algo->hexsz,
+		    pack_sig, algo))
 		err = error("%s pack checksum does not match its index",
 			    p->pack_name);
 	unuse_pack(w_curs);
+	return err;
+}
 
-	/* Make sure everything reachable from idx is valid.  Since we
-	 * have verified that nr_objects matches between idx and pack,
-	 * we do not do scan-streaming check on the pack file.
-	 */
-	nr_objects = p->num_objects;
-	ALLOC_ARRAY(entries, nr_objects + 1);
-	entries[nr_objects].offset = pack_sig_ofs;
-	/* first sort entries by pack offset, since unpacking them is more efficient that way */
-	for (i = 0; i < nr_objects; i++) {
-		entries[i].offset = nth_packed_object_offset(p, i);
-		entries[i].nr = i;
-	}
-	QSORT(entries, nr_objects, compare_entries);
+static void init_range(struct verify_state *st, struct verify_range *range,
+		       uint32_t n)
+{
+	range->start = n * VERIFY_RANGE;
+	range->nr = st->nr_objects - range->start;
+	if (range->nr > VERIFY_RANGE)
+		range->nr = VERIFY_RANGE;
+	range->loaded = range->reported = 0;
+}
 
-	for (i = 0; i < nr_objects; i++) {
-		struct odb_read_stream *stream = NULL;
-		void *data;
-		struct object_id oid;
-		enum object_type type;
-		size_t size;
-		off_t curpos;
-		int data_valid;
+/*
+ * Load the items of "range" from "first" on, stopping early once
+ * VERIFY_RANGE_BYTES of object data are held. Returns the end of the
+ * loaded items.
+ */
+static uint32_t load_range(struct verify_state *st, struct verify_range *range,
+			   uint32_t first, struct pack_window **w_curs)
+{
+	struct repository *r = st->r;
+	struct packed_git *p = st->p;
+	struct hash_object_request req[VERIFY_RANGE];
+	struct object_id real_oid[VERIFY_RANGE];
+	uint32_t i, req_nr = 0;
+	size_t bytes = 0;
+
+	for (i = first; i < range->nr && bytes < VERIFY_RANGE_BYTES; i++) {
+		struct verify_item *item = &range->items[i];
+		struct idx_entry *entry = &st->entries[range->start + i];
+		off_t curpos = entry->offset;
 
-		if (nth_packed_object_id(&oid, p, entries[i].nr) < 0)
+		memset(item, 0, sizeof(*item));
+
+		/*
+		 * Hold the object read lock only while accessing the pack;
+		 * checksums are computed without it, and unpack_entry()
+		 * drops it while inflating and applying deltas.
+		 */
+		obj_read_lock();
+		if (nth_packed_object_id(&item->oid, p, entry->nr) < 0)
 			BUG("unable to get oid of object %lu from %s",
-			    (unsigned long)entries[i].nr, p->pack_name);
+			    (unsigned long)entry->nr, p->pack_name);
+		item->type = unpack_object_header(p, w_curs, &curpos, &item->size);
+		unuse_pack(w_curs);
+		obj_read_unlock();
 
 		if (p->index_version > 1) {
-			off_t offset = entries[i].offset;
-			off_t len = entries[i+1].offset - offset;
-			unsigned int nr = entries[i].nr;
-			if (check_pack_crc(p, w_curs, offset, len, nr))
-				err = error("index CRC mismatch for object %s "
-					    "from %s at offset %"PRIuMAX"",
-					    oid_to_hex(&oid),
-					    p->pack_name, (uintmax_t)offset);
+			if (check_pack_crc(p, w_curs, entry[0].offset,
+					   entry[1].offset - entry[0].offset,
+					   entry->nr))
+				item->crc_bad = 1;
+			obj_read_lock();
+			unuse_pack(w_curs);
+			obj_read_unlock();
 		}
 
-		curpos = entries[i].offset;
-		type = unpack_object_header(p, w_curs, &curpos, &size);
-		unuse_pack(w_curs);
-
-		if (type == OBJ_BLOB &&
-		    repo_settings_get_big_file_threshold(r) <= size) {
+		if (item->type == OBJ_BLOB &&
+		    st->big_file_threshold <= item->size) {
 			/*
 			 * Let stream_object_signature() check it with
 			 * the streaming interface; no point slurping
 			 * the data in-core only to discard.
 			 */
-			data = NULL;
-			data_valid = 0;
+			struct odb_read_stream *stream = NULL;
+			int ret;
+
+			obj_read_lock();
+			ret = packfile_read_object_stream(&stream, &item->oid, p,
+							  entry->offset);
+			obj_read_unlock();
+			if (ret < 0 ||
+			    stream_object_signature(r, stream, &item->oid) < 0)
+				item->corrupt = 1;
+			if (stream) {
+				obj_read_lock();
+				odb_read_stream_close(stream);
+				obj_read_unlock();
+			}
 		} else {
-			data = unpack_entry(r, p, entries[i].offset, &type,
-					    &size);
-			data_valid = 1;
+			obj_read_lock();
+			item->data = unpack_entry(r, p, entry->offset,
+						  &item->type, &item->size);
+			obj_read_unlock();
+			item->data_valid = 1;
+		}
+
+		if (item->data) {
+			req[req_nr].buf = item->data;
+			req[req_nr].len = item->size;
+			req[req_nr].type = item->type;
+			req[req_nr].oid = &real_oid[i];
+			req_nr++;
+			bytes += item->size;
 		}
+	}
+
+	/* all objects of a pack use the same hash */
+	if (req_nr)
+		hash_object_file_batch(range->items[first].oid.algo ?
+				       &hash_algos[range->items[first].oid.algo] :
+				       r->hash_algo, req, req_nr);
+
+	for (uint32_t j = first; j < i; j++) {
+		struct verify_item *item = &range->items[j];
+		if (item->data && !oideq(&item->oid, &real_oid[j]))
+			item->corrupt = 1;
+	}
+	return i;
+}
+
+static int report_range(struct verify_state *st, struct verify_range *range,
+			uint32_t first, uint32_t end,
+			verify_fn fn, void *fn_data,
+			struct progress *progress, uint32_t base_count)
+{
+	struct packed_git *p = st->p;
+	uint32_t i;
+	int err = 0;
+
+	for (i = first; i < end; i++) {
+		struct verify_item *item = &range->items[i];
+		uint32_t pos = range->start + i;
+		off_t offset = st->entries[pos].offset;
 
-		if (data_valid && !data)
+		if (item->crc_bad)
+			err = error("index CRC mismatch for object %s "
+				    "from %s at offset %"PRIuMAX"",
+				    oid_to_hex(&item->oid),
+				    p->pack_name, (uintmax_t)offset);
+
+		if (item->data_valid && !item->data)
 			err = error("cannot unpack %s from %s at offset %"PRIuMAX"",
-				    oid_to_hex(&oid), p->pack_name,
-				    (uintmax_t)entries[i].offset);
-		else if (data && check_object_signature(r, &oid, data, size,
-							type) < 0)
-			err = error("packed %s from %s is corrupt",
-				    oid_to_hex(&oid), p->pack_name);
-		else if (!data &&
-			 (packfile_read_object_stream(&stream, &oid, p, entries[i].offset) < 0 ||
-			  stream_object_signature(r, stream, &oid) < 0))
+				    oid_to_hex(&item->oid), p->pack_name,
+				    (uintmax_t)offset);
+		else if (item->corrupt)
 			err = error("packed %s from %s is corrupt",
-				    oid_to_hex(&oid), p->pack_name);
+				    oid_to_hex(&item->oid), p->pack_name);
 		else if (fn) {
 			int eaten = 0;
-			err |= fn(&oid, type, size, data, &eaten, fn_data);
+
+			/* other threads may still be reading objects */
+			obj_read_lock();
+			err |= fn(&item->oid, item->type, item->size, item->data,
+				  &eaten, fn_data);
+			obj_read_unlock();
 			if (eaten)
-				data = NULL;
+				item->data = NULL;
 		}
-		if (((base_count + i) & 1023) == 0)
-			display_progress(progress, base_count + i);
+		if (((base_count + pos) & 1023) == 0)
+			display_progress(progress, base_count + pos);
+
+		FREE_AND_NULL(item->data);
+	}
+
+	return err;
+}
+
+static void *verify_thread(void *data)
+{
+	struct verify_state *st = data;
+	struct pack_window *w_curs = NULL;
+
+	for (;;) {
+		struct verify_range *range;
+		uint32_t n, i = 0;
+
+		pthread_mutex_lock(&st->mutex);
+		while (st->next_range < st->nr_ranges &&
+		       st->next_range - st->reported >= st->nr_slots)
+			pthread_cond_wait(&st->room_cond, &st->mutex);
+		if (st->next_range >= st->nr_ranges) {
+			pthread_mutex_unlock(&st->mutex);
+			break;
+		}
+		n = st->next_range++;
+		range = &st->slots[n % st->nr_slots];
+		init_range(st, range, n);
+		pthread_mutex_unlock(&st->mutex);
+
+		while (i < range->nr) {
+			i = load_range(st, range, i, &w_curs);
+
+			pthread_mutex_lock(&st->mutex);
+			range->loaded = i;
+			pthread_cond_signal(&st->loaded_cond);
+			/* wait for the data to be released before loading more */
+			while (i < range->nr && range->reported < i)
+				pthread_cond_wait(&st->room_cond, &st->mutex);
+			pthread_mutex_unlock(&st->mutex);
+		}
+	}
+
+	obj_read_lock();
+	unuse_pack(&w_curs);
+	obj_read_unlock();
+	return NULL;
+}
+
+static void *hash_pack_thread(void *data)
+{
+	struct verify_state *st = data;
+	struct pack_window *w_curs = NULL;
+
+	hash_pack_data(st, &w_curs);
+	return NULL;
+}
+
+static int verify_objects_threaded(struct verify_state *st,
+				   struct pack_window **w_curs,
+				   verify_fn fn, void *fn_data,
+				   struct progress *progress, uint32_t base_count,
+				   int nr_threads)
+{
+	pthread_t *threads, hash_thread;
+	uint32_t n;
+	int i, ret, err = 0;
+
+	enable_obj_read_lock();
+	pthread_mutex_init(&st->mutex, NULL);
+	pthread_cond_init(&st->loaded_cond, NULL);
+	pthread_cond_init(&st->room_cond, NULL);
+	st->nr_slots = 2 * nr_threads;
+	CALLOC_ARRAY(st->slots, st->nr_slots);
+
+	ret = pthread_create(&hash_thread, NULL, hash_pack_thread, st);
+	if (ret)
+		die(_("unable to create thread: %s"), strerror(ret));
+	CALLOC_ARRAY(threads, nr_threads);
+	for (i = 0; i < nr_threads; i++) {
+		ret = pthread_create(&threads[i], NULL, verify_thread, st);
+		if (ret)
+			die(_("unable to create thread: %s"), strerror(ret));
+	}
+
+	/* Report problems with the pack as a whole first. */
+	pthread_join(hash_thread, NULL);
+	obj_read_lock();
+	err |= check_pack_data_hash(st, w_curs);
+	obj_read_unlock();
+
+	for (n = 0; n < st->nr_ranges; n++) {
+		struct verify_range *range = &st->slots[n % st->nr_slots];
+		uint32_t first = 0, end, nr;
+
+		do {
+			pthread_mutex_lock(&st->mutex);
+			while (st->next_range <= n || range->loaded <= first)
+				pthread_cond_wait(&st->loaded_cond, &st->mutex);
+			end = range->loaded;
+			nr = range->nr;
+			pthread_mutex_unlock(&st->mutex);
+
+			err |= report_range(st, range, first, end, fn, fn_data,
+					    progress, base_count);
 
-		if (stream)
-			odb_read_stream_close(stream);
-		free(data);
+			pthread_mutex_lock(&st->mutex);
+			range->reported = end;
+			if (end == nr)
+				st->reported++;
+			pthread_cond_broadcast(&st->room_cond);
+			pthread_mutex_unlock(&st->mutex);
+			first = end;
+		} while (end < nr);
+	}
+
+	for (i = 0; i < nr_threads; i++)
+		pthread_join(threads[i], NULL);
+	free(threads);
+	free(st->slots);
+	pthread_cond_destroy(&st->room_cond);
+	pthread_cond_destroy(&st->loaded_cond);
+	pthread_mutex_destroy(&st->mutex);
+	disable_obj_read_lock();
+	return err;
+}
+
+static int verify_packfile(struct repository *r,
+			   struct packed_git *p,
+			   struct pack_window **w_curs,
+			   verify_fn fn,
+			   void *fn_data,
+			   struct progress *progress, uint32_t base_count,
+			   int nr_threads)
+
+{
+	struct verify_state st = {
+		.r = r,
+		.p = p,
+	};
+	uint32_t nr_objects, i;
+	int err = 0;
+
+	if (!is_pack_valid(p))
+		return error("packfile %s cannot be accessed", p->pack_name);
+
+	/* Make sure everything reachable from idx is valid.  Since we
+	 * have verified that nr_objects matches between idx and pack,
+	 * we do not do scan-streaming check on the pack file.
+	 */
+	nr_objects = p->num_objects;
+	ALLOC_ARRAY(st.entries, nr_objects + 1);
+	st.entries[nr_objects].offset = p->pack_size - r->hash_algo->rawsz;
+	/* first sort entries by pack offset, since unpacking them is more efficient that way */
+	for (i = 0; i < nr_objects; i++) {
+		st.entries[i].offset = nth_packed_object_offset(p, i);
+		st.entries[i].nr = i;
+	}
+	QSORT(st.entries, nr_objects, compare_entries);
+	st.nr_objects = nr_objects;
+	st.nr_ranges = DIV_ROUND_UP(nr_objects, VERIFY_RANGE);
+
+	/*
+	 * Settings are loaded lazily on first use. Load everything the
+	 * workers (and the object reading code they call into) may look
+	 * at before there are any, so that they only ever read them.
+	 */
+	prepare_repo_settings(r);
+	st.big_file_threshold = repo_settings_get_big_file_threshold(r);
+
+	if (HAVE_THREADS && nr_threads > 1 && st.nr_ranges > 1) {
+		err |= verify_objects_threaded(&st, w_curs, fn, fn_data,
+					       progress, base_count, nr_threads);
+	} else {
+		struct verify_range *range = xcalloc(1, sizeof(*range));
+
+		hash_pack_data(&st, w_curs);
+		err |= check_pack_data_hash(&st, w_curs);
+		for (i = 0; i < st.nr_ranges; i++) {
+			uint32_t first = 0, end;
+
+			init_range(&st, range, i);
+			do {
+				end = load_range(&st, range, first, w_curs);
+				err |= report_range(&st, range, first, end,
+						    fn, fn_data, progress,
+						    base_count);
+				first = end;
+			} while (end < range->nr);
+		}
+		free(range);
 	}
 
-	display_progress(progress, base_count + i);
-	free(entries);
+	display_progress(progress, base_count + nr_objects);
+	free(st.entries);
 	return err;
 }
 
@@ -195,7 +517,7 @@ int verify_pack_index(struct packed_git *p)
 }
 
 int verify_pack(struct repository *r, struct packed_git *p, verify_fn fn, void *fn_data,
-		struct progress *progress, uint32_t base_count)
+		struct progress *progress, uint32_t base_count, int nr_threads)
 {
 	int err = 0;
 	struct pack_window *w_curs = NULL;
@@ -204,7 +526,8 @@ int verify_pack(struct repository *r, struct packed_git *p, verify_fn fn, void *
 	if (!p->index_data)
 		return -1;
 
-	err |= verify_packfile(r, p, &w_curs, fn, fn_data, progress, base_count);
+	err |= verify_packfile(r, p, &w_curs, fn, fn_data, progress, base_count,
+			       nr_threads);
 	unuse_pack(&w_curs);
 
 	return err;
@@ -0,0 +1,343 @@
+#include "git-compat-util.h"
+#include "chunk-format.h"
+#include "csum-file.h"
+#include "gettext.h"
+#include "hash.h"
+#include "odb.h"
+#include "pack-delta-attempts.h"
+#include "packfile.h"
+#include "path.h"
+#include "repository.h"
+#include "strbuf.h"
+#include "thread-utils.h"
+#include "trace2.h"
+#include "wrapper.h"
+
+#define DELTA_ATTEMPTS_HEADER_SIZE (20)
+#define DELTA_ATTEMPTS_RECORD_SIZE (20)
+
+/*
+ * Limit the memory a single run spends on recording pairs; the ones
+ * beyond that are simply tried again next time.
+ */
+#define DELTA_ATTEMPTS_MAX_RECORDED (1 << 20)
+#define DELTA_ATTEMPTS_LOG_BATCH 1024
+
+/*
+ * Objects are identified by the first 8 bytes of their name. A
+ * collision can only make us skip a pair that might have produced a
+ * delta, never produce a wrong one.
+ */
+struct delta_attempt {
+	uint64_t trg;
+	uint64_t base;
+	uint32_t max_size;
+};
+
+struct delta_attempts {
+	struct repository *repo;
+	uint32_t window, depth;
+
+	/* pairs loaded from disk, sorted; read-only once loaded */
+	struct delta_attempt *loaded;
+	size_t loaded_nr;
+	/* whether each loaded pair was consulted by this process */
+	unsigned char *used;
+
+	/* pairs recorded by this process */
+	struct delta_attempt *recorded;
+	size_t recorded_nr, recorded_alloc;
+	/* number of pairs that may still be reserved by a log */
+	size_t budget;
+	/* number of pairs that did not fit within the limit */
+	size_t dropped;
+
+	/* number of attempts we did not have to make */
+	size_t skipped;
+
+	pthread_mutex_t mutex;
+};
+
+static int delta_attempt_cmp(const void *va, const void *vb)
+{
+	const struct delta_attempt *a = va, *b = vb;
+
+	if (a->trg != b->trg)
+		return a->trg < b->trg ? -1 : 1;
+	if (a->base != b->base)
+		return a->base < b->base ? -1 : 1;
+	return 0;
+}
+
+/*
+ * Sort "list" and fold duplicate pairs into one, keeping the largest
+ * size that is known to fail. Returns the new number of entries.
+ */
+static size_t sort_and_fold(struct delta_attempt *list, size_t nr)
+{
+	size_t i, dst = 0;
+
+	QSORT(list, nr, delta_attempt_cmp);
+	for (i = 0; i < nr; i++) {
+		if (dst && !delta_attempt_cmp(&list[dst - 1], &list[i])) {
+			if (list[dst - 1].max_size < list[i].max_size)
+				list[dst - 1].max_size = list[i].max_size;
+			continue;
+		}
+		list[dst++] = list[i];
+	}
+	return dst;
+}
+
+static char *pack_delta_attempts_filename(struct packed_git *p)
+{
+	size_t len;
+	if (!strip_suffix(p->pack_name, ".pack", &len))
+		BUG("pack_name does not end in .pack");
+	return xstrfmt("%.*s.dac", (int)len, p->pack_name);
+}
+
+static int load_delta_attempts_file(struct repository *r,
+				    struct delta_attempts *da,
+				    const char *filename)
+{
+	int fd, ret = 0;
+	struct stat st;
+	unsigned char *data = NULL;
+	const unsigned char *rec;
+	size_t size, nr, i;
+	const size_t trailer = 2 * r->hash_algo->rawsz;
+
+	fd = git_open(filename);
+	if (fd < 0)
+		return -1;
+	if (fstat(fd, &st)) {
+		ret = -1;
+		goto cleanup;
+	}
+
+	size = xsize_t(st.st_size);
+	if (size < DELTA_ATTEMPTS_HEADER_SIZE + trailer ||
+	    (size - DELTA_ATTEMPTS_HEADER_SIZE - trailer) % DELTA_ATTEMPTS_RECORD_SIZE) {
+		ret = -1;
+		goto cleanup;
+	}
+
+	data = xmmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (get_be32(data) != DELTA_ATTEMPTS_SIGNATURE ||
+	    get_be32(data + 4) != DELTA_ATTEMPTS_VERSION ||
+	    get_be32(data + 8) != oid_version(r->hash_algo) ||
+	    get_be32(data + 12) != da->window ||
+	    get_be32(data + 16) != da->depth ||
+	    !hashfile_checksum_valid(r->hash_algo, data, size)) {
+		ret = -1;
+		goto cleanup;
+	}
+
+	nr = (size - DELTA_ATTEMPTS_HEADER_SIZE - trailer) / DELTA_ATTEMPTS_RECORD_SIZE;
+	REALLOC_ARRAY(da->loaded, st_add(da->loaded_nr, nr));
+	rec = data + DELTA_ATTEMPTS_HEADER_SIZE;
+	for (i = 0; i < nr; i++, rec += DELTA_ATTEMPTS_RECORD_SIZE) {
+		struct delta_attempt *a = &da->loaded[da->loaded_nr++];
+		a->trg = get_be64(rec);
+		a->base = get_be64(rec + 8);
+		a->max_size = get_be32(rec + 16);
+	}
+
+cleanup:
+	if (data)
+		munmap(data, size);
+	close(fd);
+	return ret;
+}
+
+struct delta_attempts *delta_attempts_load(struct repository *r,
+					   int window, int depth)
+{
+	struct delta_attempts *da = xcalloc(1, sizeof(*da));
+	struct packed_git *p;
+
+	da->repo = r;
+	da->window = window;
+	da->depth = depth;
+	da->budget = DELTA_ATTEMPTS_MAX_RECORDED;
+	pthread_mutex_init(&da->mutex, NULL);
+
+	repo_for_each_pack(r, p) {
+		char *filename;
+
+		if (!p->pack_local)
+			continue;
+		filename = pack_delta_attempts_filename(p);
+		load_delta_attempts_file(r, da, filename);
+		free(filename);
+	}
+
+	da->loaded_nr = sort_and_fold(da->loaded, da->loaded_nr);
+	CALLOC_ARRAY(da->used, da->loaded_nr);
+	return da;
+}
+
+static void delta_attempt_init(struct delta_attempt *a,
+			       const struct object_id *trg,
+			       const struct object_id *base,
+			       unsigned long max_size)
+{
+	a->trg = get_be64(trg->hash);
+	a->base = get_be64(base->hash);
+	/*
+	 * Clamping is conservative: a pair that fails at some size also
+	 * fails at any smaller one.
+	 */
+	a->max_size = max_size > UINT32_MAX ? UINT32_MAX : max_size;
+}
+
+int delta_attempts_known_bad(struct delta_attempts *da,
+			     const struct object_id *trg,
+			     const struct object_id *base,
+			     unsigned long max_size)
+{
+	struct delta_attempt key;
+	struct delta_attempt *found;
+
+	if (!da->loaded_nr)
+		return 0;
+
+	delta_attempt_init(&key, trg, base, 0);
+	found = bsearch(&key, da->loaded, da->loaded_nr, sizeof(key),
+			delta_attempt_cmp);
+	if (!found)
+		return 0;
+
+	/*
+	 * Keep the pair around even if it does not apply this time, as
+	 * the next run may ask for a smaller size again.
+	 */
+	pthread_mutex_lock(&da->mutex);
+	da->used[found - da->loaded] = 1;
+	if (max_size <= found->max_size)
+		da->skipped++;
+	pthread_mutex_unlock(&da->mutex);
+
+	return max_size <= found->max_size;
+}
+
+void delta_attempts_log_init(struct delta_attempts_log *log,
+			     struct delta_attempts *da)
+{
+	memset(log, 0, sizeof(*log));
+	log->da = da;
+}
+
+void delta_attempts_log_record(struct delta_attempts_log *log,
+			       const struct object_id *trg,
+			       const struct object_id *base,
+			       unsigned long max_size)
+{
+	struct delta_attempts *da = log->da;
+
+	if (log->dropped) {
+		log->dropped++;
+		return;
+	}
+
+	if (log->nr == log->reserved) {
+		size_t batch;
+
+		pthread_mutex_lock(&da->mutex);
+		batch = da->budget < DELTA_ATTEMPTS_LOG_BATCH ?
+			da->budget : DELTA_ATTEMPTS_LOG_BATCH;
+		da->budget -= batch;
+		pthread_mutex_unlock(&da->mutex);
+
+		if (!batch) {
+			log->dropped++;
+			return;
+		}
+		log->reserved += batch;
+		ALLOC_GROW(log->list, log->reserved, log->alloc);
+	}
+
+	delta_attempt_init(&log->list[log->nr++], trg, base, max_size);
+}
+
+void delta_attempts_log_flush(struct delta_attempts_log *log)
+{
+	struct delta_attempts *da = log->da;
+
+	pthread_mutex_lock(&da->mutex);
+	ALLOC_GROW(da->recorded, da->recorded_nr + log->nr, da->recorded_alloc);
+	COPY_ARRAY(da->recorded + da->recorded_nr, log->list, log->nr);
+	da->recorded_nr += log->nr;
+	da->budget += log->reserved - log->nr;
+	da->dropped += log->dropped;
+	pthread_mutex_unlock(&da->mutex);
+
+	free(log->list);
+	delta_attempts_log_init(log, da);
+}
+
+void delta_attempts_write(struct delta_attempts *da, struct repository *r,
+			  const char *filename, const unsigned char *pack_hash)
+{
+	struct strbuf tmp_file = STRBUF_INIT;
+	struct delta_attempt *list;
+	size_t nr = 0, i;
+	struct hashfile *f;
+	int fd;
+
+	ALLOC_ARRAY(list, st_add(da->recorded_nr, da->loaded_nr));
+	for (i = 0; i < da->loaded_nr; i++)
+		if (da->used[i])
+			list[nr++] = da->loaded[i];
+	COPY_ARRAY(list + nr, da->recorded, da->recorded_nr);
+	nr += da->recorded_nr;
+
+	if (!nr)
+		goto out;
+	nr = sort_and_fold(list, nr);
+
+	fd = odb_mkstemp(r->objects, &tmp_file, "pack/tmp_dac_XXXXXX");
+	f = hashfd(r->hash_algo, fd, tmp_file.buf);
+
+	hashwrite_be32(f, DELTA_ATTEMPTS_SIGNATURE);
+	hashwrite_be32(f, DELTA_ATTEMPTS_VERSION);
+	hashwrite_be32(f, oid_version(r->hash_algo));
+	hashwrite_be32(f, da->window);
+	hashwrite_be32(f, da->depth);
+	for (i = 0; i < nr; i++) {
+		hashwrite_be64(f, list[i].trg);
+		hashwrite_be64(f, list[i].base);
+		hashwrite_be32(f, list[i].max_size);
+	}
+	hashwrite(f, pack_hash, r->hash_algo->rawsz);
+
+	finalize_hashfile(f, NULL, FSYNC_COMPONENT_PACK_METADATA,
+			  CSUM_HASH_IN_STREAM | CSUM_FSYNC | CSUM_CLOSE);
+
+	if (adjust_shared_perm(r, tmp_file.buf))
+		die_errno(_("unable to make temporary delta attempt file readable"));
+	if (rename(tmp_file.buf, filename))
+		die_errno(_("unable to rename temporary delta attempt file to '%s'"),
+			  filename);
+
+out:
+	strbuf_release(&tmp_file);
+	free(list);
+}
+
+void delta_attempts_free(struct delta_attempts *da)
+{
+	if (!da)
+		return;
+	trace2_data_intmax("delta-attempts", da->repo, "loaded", da->loaded_nr);
+	trace2_data_intmax("delta-attempts", da->repo, "skipped", da->skipped);
+	trace2_data_intmax("delta-attempts", da->repo, "recorded",
+			   da->recorded_nr);
+	trace2_data_intmax("delta-attempts", da->repo, "dropped", da->dropped);
+	free(da->loaded);
+	free(da->used);
+	free(da->recorded);
+	pthread_mutex_destroy(&da->mutex);
+	free(da);
+}
@@ -0,0 +1,94 @@
+#ifndef PACK_DELTA_ATTEMPTS_H
+#define PACK_DELTA_ATTEMPTS_H
+
+#define DELTA_ATTEMPTS_SIGNATURE 0x44415454 /* "DATT" */
+#define DELTA_ATTEMPTS_VERSION 1
+
+struct object_id;
+struct repository;
+
+/*
+ * A "delta attempt" cache remembers (target, base) object pairs for
+ * which create_delta() failed to produce a delta no larger than a given
+ * size, so that a later pack-objects run can skip them without loading
+ * the objects or building a delta index.
+ *
+ * Since the outcome of create_delta() depends only on the contents of
+ * both objects and on the maximum delta size, and since a pair that
+ * fails for some size also fails for any smaller size, a pair is only
+ * skipped when the size we are about to ask for is no larger than the
+ * recorded one. Pairs are keyed on the first 8 bytes of both object
+ * names, so a pair whose prefixes collide with a recorded one may,
+ * rarely, be skipped even though it would yield a usable delta. That
+ * only costs pack size; losing the cache merely costs the time to try
+ * the pairs again.
+ *
+ * The cache is stored in "pack-<hash>.dac" files next to the packs.
+ * Each file records the window and depth of the run that wrote it, and
+ * is ignored by runs using other settings.
+ */
+struct delta_attempts;
+struct delta_attempt;
+
+/*
+ * Pairs recorded by one thread, collected without taking any lock
+ * until they are handed to the cache by delta_attempts_log_flush().
+ * Room for them is reserved from the limit on the total number of
+ * recorded pairs in batches.
+ */
+struct delta_attempts_log {
+	struct delta_attempts *da;
+	struct delta_attempt *list;
+	size_t nr, alloc;
+	size_t reserved;
+	size_t dropped;
+};
+
+/*
+ * Load the delta attempt caches of all local packs in "r" that were
+ * written with the same "window" and "depth". Files that are missing,
+ * unreadable or written with other settings are silently ignored.
+ */
+struct delta_attempts *delta_attempts_load(struct repository *r,
+					   int window, int depth);
+
+/*
+ * Returns 1 if delta "trg" against "base" is known to be larger than
+ * "max_size", 0 otherwise. Safe to call from multiple threads.
+ */
+int delta_attempts_known_bad(struct delta_attempts *da,
+			     const struct object_id *trg,
+			     const struct object_id *base,
+			     unsigned long max_size);
+
+void delta_attempts_log_init(struct delta_attempts_log *log,
+			     struct delta_attempts *da);
+
+/*
+ * Record in "log" that no delta of "trg" against "base" fits in
+ * "max_size". The pair is dropped once the limit on recorded pairs is
+ * reached.
+ */
+void delta_attempts_log_record(struct delta_attempts_log *log,
+			       const struct object_id *trg,
+			       const struct object_id *base,
+			       unsigned long max_size);
+
+/*
+ * Add the pairs of "log" to its cache and release it. Safe to call
+ * from multiple threads.
+ */
+void delta_attempts_log_flush(struct delta_attempts_log *log);
+
+/*
+ * Write the pairs recorded by this process, together with the loaded
+ * pairs that were consulted, to "filename". "pack_hash" is the checksum
+ * of the pack the file accompanies. Nothing is written if there is
+ * nothing to record.
+ */
+void delta_attempts_write(struct delta_attempts *da, struct repository *r,
+			  const char *filename, const unsigned char *pack_hash);
+
+void delta_attempts_free(struct delta_attempts *da);
+
+#endif
@@ -99,8 +99,13 @@ const char *write_idx_file(struct repository *repo,
 			   const unsigned char *sha1);
 int check_pack_crc(struct packed_git *p, struct pack_window **w_curs, off_t offset, off_t len, unsigned int nr);
 int verify_pack_index(struct packed_git *);
+/*
+ * Verify the pack and its index, calling "fn" for every object in pack
+ * order. Objects are unpacked and checked on "nr_threads" threads, but
+ * "fn" is always called from the calling thread.
+ */
 int verify_pack(struct repository *, struct packed_git *, verify_fn fn, void *fn_data,
-		struct progress *, uint32_t);
+		struct progress *, uint32_t, int nr_threads);
 off_t write_pack_header(struct hashfile *f, uint32_t);
 void fixup_pack_header_footer(const struct git_hash_algo *, int,
 			      unsigned char *, const char *, uint32_t,
@@ -15,6 +15,7 @@
 #include "object.h"
 #include "tag.h"
 #include "trace.h"
+#include "trace2.h"
 #include "tree-walk.h"
 #include "tree.h"
 #include "object-file.h"
@@ -25,6 +26,7 @@
 #include "pack-revindex.h"
 #include "promisor-remote.h"
 #include "pack-mtimes.h"
+#include "thread-utils.h"
 
 char *odb_pack_name(struct repository *r, struct strbuf *buf,
 		    const unsigned char *hash, const char *ext)
@@ -367,7 +369,7 @@ void close_pack(struct packed_git *p)
 
 void unlink_pack_path(const char *pack_name, int force_delete)
 {
-	static const char *exts[] = {".idx", ".pack", ".rev", ".keep", ".bitmap", ".promisor", ".mtimes"};
+	static const char *exts[] = {".idx", ".pack", ".rev", ".keep", ".bitmap", ".promisor", ".mtimes", ".dac"};
 	int i;
 	struct strbuf buf = STRBUF_INIT;
 	size_t plen;
@@ -1459,10 +1461,17 @@ int packed_object_info(struct odb_source_packed *source,
 	return packed_object_info_with_index_pos(source, p, obj_offset, NULL, oi);
 }
 
-static void *unpack_compressed_entry(struct packed_git *p,
-				    struct pack_window **w_curs,
-				    off_t curpos,
-				    size_t size)
+/*
+ * Inflate "size" bytes of zlib stream found at "curpos" in the pack. Access
+ * to the pack windows is serialized by "mutex", which must be held by the
+ * caller and is dropped during inflation; when it is NULL, the object-read
+ * lock is used instead.
+ */
+static void *unpack_compressed_entry_1(struct packed_git *p,
+				       struct pack_window **w_curs,
+				       off_t curpos,
+				       size_t size,
+				       pthread_mutex_t *mutex)
 {
 	int st;
 	git_zstream stream;
@@ -1485,9 +1494,15 @@ static void *unpack_compressed_entry(struct packed_git *p,
 		 * unlocked execution. Please refer to the comment at
 		 * get_size_from_delta() to see how this is done.
 		 */
-		obj_read_unlock();
+		if (mutex)
+			pthread_mutex_unlock(mutex);
+		else
+			obj_read_unlock();
 		st = git_inflate(&stream, Z_FINISH);
-		obj_read_lock();
+		if (mutex)
+			pthread_mutex_lock(mutex);
+		else
+			obj_read_lock();
 		if (!stream.avail_out)
 			break; /* the payload is larger than it should be */
 		curpos += stream.next_in - in;
@@ -1504,6 +1519,14 @@ static void *unpack_compressed_entry(struct packed_git *p,
 	return buffer;
 }
 
+static void *unpack_compressed_entry(struct packed_git *p,
+				    struct pack_window **w_curs,
+				    off_t curpos,
+				    size_t size)
+{
+	return unpack_compressed_entry_1(p, w_curs, curpos, size, NULL);
+}
+
 static void write_pack_access_log(struct packed_git *p, off_t obj_offset)
 {
 	static struct trace_key pack_access = TRACE_KEY_INIT(PACK_ACCESS);
@@ -1520,6 +1543,200 @@ struct unpack_entry_stack_ent {
 	size_t size;
 };
 
+/*
+ * Delta chains shorter than this are not worth handing to the threads.
+ */
+#define PARALLEL_DELTA_CHAIN_MIN_DEPTH 8
+
+struct delta_chain_prefetch {
+	struct packed_git *p;
+	struct unpack_entry_stack_ent *stack;
+	void **delta_data;
+	int next;
+	pthread_mutex_t mutex;
+};
+
+static void delta_chain_prefetch_work(struct delta_chain_prefetch *pf)
+{
+	struct pack_window *w_curs = NULL;
+
+	/*
+	 * Hand out the deltas closest to the base first, as those are the
+	 * ones phase III is going to need first.
+	 */
+	pthread_mutex_lock(&pf->mutex);
+	while (pf->next > 0) {
+		int i = --pf->next;
+		pf->delta_data[i] = unpack_compressed_entry_1(pf->p, &w_curs,
+							      pf->stack[i].curpos,
+							      pf->stack[i].size,
+							      &pf->mutex);
+	}
+	unuse_pack(&w_curs);
+	pthread_mutex_unlock(&pf->mutex);
+}
+
+/*
+ * The threads inflating delta chains are started on the first deep
+ * chain and then kept around until the object database is closed,
+ * waiting for the next chain; a command reading many objects would
+ * otherwise spend more time creating threads than inflating deltas.
+ * The calling thread works on each chain, too.
+ */
+struct delta_chain_pool {
+	pthread_mutex_t mutex;
+	pthread_cond_t work_cond, done_cond;
+	struct delta_chain_prefetch *job;
+	unsigned long generation;
+	pthread_t *threads;
+	int nr_workers, active;
+	int shutdown;
+};
+
+static void *delta_chain_pool_worker(void *data)
+{
+	struct delta_chain_pool *pool = data;
+	unsigned long seen = 0;
+
+	pthread_mutex_lock(&pool->mutex);
+	for (;;) {
+		struct delta_chain_prefetch *job;
+
+		while (pool->generation == seen && !pool->shutdown)
+			pthread_cond_wait(&pool->work_cond, &pool->mutex);
+		if (pool->shutdown)
+			break;
+		seen = pool->generation;
+		job = pool->job;
+		pthread_mutex_unlock(&pool->mutex);
+
+		delta_chain_prefetch_work(job);
+
+		pthread_mutex_lock(&pool->mutex);
+		if (!--pool->active)
+			pthread_cond_signal(&pool->done_cond);
+	}
+	pthread_mutex_unlock(&pool->mutex);
+	return NULL;
+}
+
+static struct delta_chain_pool *get_delta_chain_pool(struct object_database *odb,
+						     int nr_workers)
+{
+	struct delta_chain_pool *pool = odb->delta_chain_pool;
+	int i;
+
+	if (pool)
+		return pool;
+
+	CALLOC_ARRAY(pool, 1);
+	pthread_mutex_init(&pool->mutex, NULL);
+	pthread_cond_init(&pool->work_cond, NULL);
+	pthread_cond_init(&pool->done_cond, NULL);
+	CALLOC_ARRAY(pool->threads, nr_workers);
+	for (i = 0; i < nr_workers; i++) {
+		int err = pthread_create(&pool->threads[i], NULL,
+					 delta_chain_pool_worker, pool);
+		if (err)
+			die(_("unable to create thread: %s"), strerror(err));
+	}
+	pool->nr_workers = nr_workers;
+	odb->delta_chain_pool = pool;
+	return pool;
+}
+
+void close_delta_chain_pool(struct object_database *odb)
+{
+	struct delta_chain_pool *pool = odb->delta_chain_pool;
+	int i;
+
+	if (!pool)
+		return;
+
+	pthread_mutex_lock(&pool->mutex);
+	pool->shutdown = 1;
+	pthread_cond_broadcast(&pool->work_cond);
+	pthread_mutex_unlock(&pool->mutex);
+	for (i = 0; i < pool->nr_workers; i++)
+		pthread_join(pool->threads[i], NULL);
+
+	pthread_cond_destroy(&pool->done_cond);
+	pthread_cond_destroy(&pool->work_cond);
+	pthread_mutex_destroy(&pool->mutex);
+	free(pool->threads);
+	free(pool);
+	odb->delta_chain_pool = NULL;
+}
+
+/*
+ * Inflate all deltas of a chain concurrently, so that phase III of
+ * unpack_entry() only has to apply them. Returns an array holding the
+ * inflated delta for each stack entry (NULL where inflation failed), or
+ * NULL if the chain should be handled serially.
+ *
+ * This is only done when no other thread may be reading objects, as the
+ * workers serialize their pack window accesses on a private mutex
+ * rather than on the object-read lock, which our caller is holding.
+ */
+static void **prefetch_delta_chain(struct packed_git *p,
+				   struct unpack_entry_stack_ent *stack,
+				   int nr)
+{
+	struct delta_chain_prefetch pf = {
+		.p = p,
+		.stack = stack,
+		.next = nr,
+	};
+	int nr_threads = p->repo->settings.delta_chain_threads;
+	struct delta_chain_pool *pool;
+
+	if (!HAVE_THREADS || obj_read_use_lock ||
+	    nr < PARALLEL_DELTA_CHAIN_MIN_DEPTH)
+		return NULL;
+	if (!nr_threads)
+		nr_threads = online_cpus();
+	if (nr_threads <= 1)
+		return NULL;
+	pool = get_delta_chain_pool(p->repo->objects, nr_threads - 1);
+
+	CALLOC_ARRAY(pf.delta_data, nr);
+	pthread_mutex_init(&pf.mutex, NULL);
+
+	pthread_mutex_lock(&pool->mutex);
+	pool->job = &pf;
+	pool->active = pool->nr_workers;
+	pool->generation++;
+	pthread_cond_broadcast(&pool->work_cond);
+	pthread_mutex_unlock(&pool->mutex);
+
+	delta_chain_prefetch_work(&pf);
+
+	pthread_mutex_lock(&pool->mutex);
+	while (pool->active)
+		pthread_cond_wait(&pool->done_cond, &pool->mutex);
+	pool->job = NULL;
+	pthread_mutex_unlock(&pool->mutex);
+
+	pthread_mutex_destroy(&pf.mutex);
+	trace2_counter_add(TRACE2_COUNTER_ID_DELTA_CHAIN_PARALLEL, 1);
+	return pf.delta_data;
+}
+
+static void count_delta_chain_depth(int depth)
+{
+	enum trace2_counter_id cid;
+
+	if (!depth)
+		cid = TRACE2_COUNTER_ID_DELTA_CHAIN_DEPTH_0;
+	else if (depth < 8)
+		cid = TRACE2_COUNTER_ID_DELTA_CHAIN_DEPTH_1_7;
+	else if (depth < 32)
+		cid = TRACE2_COUNTER_ID_DELTA_CHAIN_DEPTH_8_31;
+	else
+		cid = TRACE2_COUNTER_ID_DELTA_CHAIN_DEPTH_32_PLUS;
+	trace2_counter_add(cid, 1);
+}
+
 void *unpack_entry(struct repository *r, struct packed_git *p, off_t obj_offset,
 		   enum object_type *final_type, size_t *final_size)
 {
@@ -1532,6 +1749,8 @@ void *unpack_entry(struct repository *r, struct packed_git *p, off_t obj_offset,
 	struct unpack_entry_stack_ent *delta_stack = small_delta_stack;
 	int delta_stack_nr = 0, delta_stack_alloc = UNPACK_ENTRY_STACK_PREALLOC;
 	int base_from_cache = 0;
+	void **prefetched = NULL;
+	int prefetched_nr = 0;
 
 	prepare_repo_settings(p->repo);
 
@@ -1629,6 +1848,12 @@ void *unpack_entry(struct repository *r, struct packed_git *p, off_t obj_offset,
 		      type, (uintmax_t)obj_offset, p->pack_name);
 	}
 
+	count_delta_chain_depth(delta_stack_nr);
+	if (data) {
+		prefetched = prefetch_delta_chain(p, delta_stack, delta_stack_nr);
+		prefetched_nr = delta_stack_nr;
+	}
+
 	/* PHASE 3: apply deltas in order */
 
 	/* invariants:
@@ -1683,7 +1908,13 @@ void *unpack_entry(struct repository *r, struct packed_git *p, off_t obj_offset,
 		if (!base)
 			continue;
 
-		delta_data = unpack_compressed_entry(p, &w_curs, curpos, delta_size);
+		if (prefetched) {
+			delta_data = prefetched[i];
+			prefetched[i] = NULL;
+		} else {
+			delta_data = unpack_compressed_entry(p, &w_curs, curpos,
+							     delta_size);
+		}
 
 		if (!delta_data) {
 			error("failed to unpack compressed delta "
@@ -1691,8 +1922,14 @@ void *unpack_entry(struct repository *r, struct packed_git *p, off_t obj_offset,
 			      (uintmax_t)curpos, p->pack_name);
 			data = NULL;
 		} else {
+			/*
+			 * Both buffers are owned by us at this point, so other
+			 * threads may read objects while we apply the delta.
+			 */
+			obj_read_unlock();
 			data = patch_delta(base, base_size, delta_data,
 					   delta_size, &size);
+			obj_read_lock();
 
 			/*
 			 * We could not apply the delta; warn the user, but
@@ -1732,6 +1969,14 @@ void *unpack_entry(struct repository *r, struct packed_git *p, off_t obj_offset,
 out:
 	unuse_pack(&w_curs);
 
+	if (prefetched) {
+		/* entries skipped due to a missing base were not consumed */
+		int i;
+		for (i = 0; i < prefetched_nr; i++)
+			free(prefetched[i]);
+		free(prefetched);
+	}
+
 	if (delta_stack != small_delta_stack)
 		free(delta_stack);
 
@@ -245,6 +245,13 @@ void close_pack_windows(struct packed_git *);
 void close_pack(struct packed_git *);
 void unuse_pack(struct pack_window **);
 void clear_delta_base_cache(void);
+
+/*
+ * Stop the threads that inflate delta chains for objects of `odb`, if
+ * any were started. They are started again, with the then configured
+ * number of threads, by the next deep delta chain read from `odb`.
+ */
+void close_delta_chain_pool(struct object_database *odb);
 struct packed_git *add_packed_git(struct repository *r, const char *path,
 				  size_t path_len, int local);
 
@@ -7,6 +7,7 @@
 #include "gettext.h"
 #include "hash.h"
 #include "hex.h"
+#include "odb.h"
 #include "parallel-checkout.h"
 #include "pkt-line.h"
 #include "progress.h"
@@ -120,7 +121,9 @@ static int is_eligible_for_parallel_checkout(const struct cache_entry *ce,
 		 * It would be safe to allow concurrent instances of
 		 * single-file smudge filters, like rot13, but we should not
 		 * assume that all filters are parallel-process safe. So we
-		 * don't allow this.
+		 * don't allow this. That holds for checkout.workerThreads,
+		 * too; running a filter from a thread would also race on the
+		 * process-wide SIGPIPE handling of apply_single_file_filter().
 		 */
 		return 0;
 
@@ -267,7 +270,7 @@ static int reset_fd(int fd, const char *path)
 }
 
 static int write_pc_item_to_fd(struct parallel_checkout_item *pc_item, int fd,
-			       const char *path)
+			       const char *path, int can_stream)
 {
 	int ret;
 	struct stream_filter *filter;
@@ -279,8 +282,12 @@ static int write_pc_item_to_fd(struct parallel_checkout_item *pc_item, int fd,
 	/* Sanity check */
 	ASSERT(is_eligible_for_parallel_checkout(pc_item->ce, &pc_item->ca));
 
-	filter = get_stream_filter_ca(&pc_item->ca, &pc_item->ce->oid);
-	if (filter) {
+	/*
+	 * The streaming interface does not take the object read lock, so
+	 * it is only used when we are the sole reader of the object store.
+	 */
+	if (can_stream &&
+	    (filter = get_stream_filter_ca(&pc_item->ca, &pc_item->ce->oid))) {
 		if (odb_stream_blob_to_fd(the_repository->objects, fd,
 					  &pc_item->ce->oid, filter, 1)) {
 			/* On error, reset fd to try writing without streaming */
@@ -292,9 +299,14 @@ static int write_pc_item_to_fd(struct parallel_checkout_item *pc_item, int fd,
 	}
 
 	blob = read_blob_entry(pc_item->ce, &size);
-	if (!blob)
+	if (!blob) {
+		char hex[GIT_MAX_HEXSZ + 1];
+
+		/* may run in a worker thread; avoid oid_to_hex()'s buffers */
 		return error("cannot read object %s '%s'",
-			     oid_to_hex(&pc_item->ce->oid), pc_item->ce->name);
+			     oid_to_hex_r(hex, &pc_item->ce->oid),
+			     pc_item->ce->name);
+	}
 
 	/*
 	 * checkout metadata is used to give context for external process
@@ -332,8 +344,13 @@ static int close_and_clear(int *fd)
 	return ret;
 }
 
-void write_pc_item(struct parallel_checkout_item *pc_item,
-		   struct checkout *state)
+/*
+ * Write the entry, checking its leading directories with "cache" if given.
+ * A NULL cache means we are the only writer, so the shared lstat cache and
+ * the streaming interface may be used.
+ */
+static void write_pc_item_1(struct parallel_checkout_item *pc_item,
+			    struct checkout *state, struct cache_def *cache)
 {
 	unsigned int mode = (pc_item->ce->ce_mode & 0100) ? 0777 : 0666;
 	int fd = -1, fstat_done = 0;
@@ -351,8 +368,12 @@ void write_pc_item(struct parallel_checkout_item *pc_item,
 	 * a symlink (checked out after we enqueued this entry for parallel
 	 * checkout). Thus, we must check the leading dirs again.
 	 */
-	if (dir_sep && !has_dirs_only_path(path.buf, dir_sep - path.buf,
-					   state->base_dir_len)) {
+	if (dir_sep &&
+	    !(cache ? threaded_has_dirs_only_path(cache, path.buf,
+						  dir_sep - path.buf,
+						  state->base_dir_len) :
+		      has_dirs_only_path(path.buf, dir_sep - path.buf,
+					 state->base_dir_len))) {
 		pc_item->status = PC_ITEM_COLLIDED;
 		trace2_data_string("pcheckout", NULL, "collision/dirname", path.buf);
 		goto out;
@@ -379,7 +400,7 @@ void write_pc_item(struct parallel_checkout_item *pc_item,
 		goto out;
 	}
 
-	if (write_pc_item_to_fd(pc_item, fd, path.buf)) {
+	if (write_pc_item_to_fd(pc_item, fd, path.buf, !cache)) {
 		/* Error was already reported. */
 		pc_item->status = PC_ITEM_FAILED;
 		close_and_clear(&fd);
@@ -407,6 +428,12 @@ void write_pc_item(struct parallel_checkout_item *pc_item,
 	strbuf_release(&path);
 }
 
+void write_pc_item(struct parallel_checkout_item *pc_item,
+		   struct checkout *state)
+{
+	write_pc_item_1(pc_item, state, NULL);
+}
+
 static void send_one_item(int fd, struct parallel_checkout_item *pc_item)
 {
 	size_t len_data;
@@ -648,6 +675,87 @@ static void write_items_sequentially(struct checkout *state)
 	}
 }
 
+/*
+ * Number of queue entries a worker thread claims at a time. The queue is
+ * sorted by path, so this keeps neighbouring entries on the same thread
+ * (and its lstat cache) while still balancing the load between threads.
+ */
+#define PC_THREAD_BATCH_SIZE 32
+
+static pthread_mutex_t pc_thread_mutex;
+static size_t pc_next_item;
+
+static void *write_items_thread(void *data)
+{
+	struct checkout *state = data;
+	struct cache_def cache = CACHE_DEF_INIT;
+	size_t begin = 0, end = 0;
+
+	trace2_thread_start("pcheckout");
+
+	for (;;) {
+		size_t i;
+
+		pthread_mutex_lock(&pc_thread_mutex);
+		for (i = begin; i < end; i++)
+			if (parallel_checkout.items[i].status != PC_ITEM_COLLIDED)
+				advance_progress_meter();
+		begin = pc_next_item;
+		end = begin + PC_THREAD_BATCH_SIZE;
+		if (end > parallel_checkout.nr)
+			end = parallel_checkout.nr;
+		pc_next_item = end;
+		pthread_mutex_unlock(&pc_thread_mutex);
+
+		if (begin == end)
+			break;
+
+		for (i = begin; i < end; i++)
+			write_pc_item_1(&parallel_checkout.items[i], state, &cache);
+	}
+
+	cache_def_clear(&cache);
+	trace2_thread_exit();
+	return NULL;
+}
+
+static void write_items_in_threads(struct checkout *state, int num_threads)
+{
+	pthread_t *threads;
+	int i;
+
+	ALLOC_ARRAY(threads, num_threads);
+	pthread_mutex_init(&pc_thread_mutex, NULL);
+	pc_next_item = 0;
+	enable_obj_read_lock();
+
+	for (i = 0; i < num_threads; i++) {
+		int err = pthread_create(&threads[i], NULL, write_items_thread,
+					 state);
+		if (err)
+			die(_("unable to create checkout thread: %s"),
+			    strerror(err));
+	}
+	for (i = 0; i < num_threads; i++)
+		if (pthread_join(threads[i], NULL))
+			die("unable to join checkout thread");
+
+	disable_obj_read_lock();
+	pthread_mutex_destroy(&pc_thread_mutex);
+	free(threads);
+}
+
+static int use_worker_threads(void)
+{
+	int value;
+
+	if (!HAVE_THREADS)
+		return 0;
+	if (repo_config_get_bool(the_repository, "checkout.workerThreads", &value))
+		return 0;
+	return value;
+}
+
 int run_parallel_checkout(struct checkout *state, int num_workers, int threshold,
 			  struct progress *progress, unsigned int *progress_cnt)
 {
@@ -665,6 +773,8 @@ int run_parallel_checkout(struct checkout *state, int num_workers, int threshold
 
 	if (num_workers <= 1 || parallel_checkout.nr < threshold) {
 		write_items_sequentially(state);
+	} else if (use_worker_threads()) {
+		write_items_in_threads(state, num_workers);
 	} else {
 		struct pc_worker *workers = setup_workers(state, num_workers);
 		gather_results_from_workers(workers, num_workers);
@@ -10,6 +10,7 @@
 #include "environment.h"
 #include "fsmonitor.h"
 #include "gettext.h"
+#include "lstat-batch.h"
 #include "parse.h"
 #include "preload-index.h"
 #include "progress.h"
@@ -29,6 +30,12 @@
 #define MAX_PARALLEL (20)
 #define THREAD_COST (500)
 
+/*
+ * How many lstat() calls to keep in flight when they can be batched
+ * (see core.ioUring).
+ */
+#define BATCH_DEPTH (256)
+
 struct progress_data {
 	unsigned long n;
 	struct progress *progress;
@@ -44,6 +51,39 @@ struct thread_data {
 	int t2_nr_lstat;
 };
 
+/*
+ * Whether "ce" is one of the entries preloading could mark up to date,
+ * i.e. whether it is worth an lstat().
+ */
+static int needs_lstat(struct index_state *index, struct cache_entry *ce,
+		       const struct pathspec *pathspec, struct cache_def *cache)
+{
+	if (ce_stage(ce))
+		return 0;
+	if (S_ISGITLINK(ce->ce_mode))
+		return 0;
+	if (ce_uptodate(ce))
+		return 0;
+	if (ce_skip_worktree(ce))
+		return 0;
+	if (ce->ce_flags & CE_FSMONITOR_VALID)
+		return 0;
+	if (pathspec && !ce_path_match(index, ce, pathspec, NULL))
+		return 0;
+	if (threaded_has_symlink_leading_path(cache, ce->name, ce_namelen(ce)))
+		return 0;
+	return 1;
+}
+
+static void preload_entry(struct index_state *index, struct cache_entry *ce,
+			  struct stat *st)
+{
+	if (ie_match_stat(index, ce, st, CE_MATCH_RACY_IS_DIRTY|CE_MATCH_IGNORE_FSMONITOR))
+		return;
+	ce_mark_uptodate(ce);
+	mark_fsmonitor_valid(index, ce);
+}
+
 static void *preload_thread(void *_data)
 {
 	int nr, last_nr;
@@ -61,16 +101,6 @@ static void *preload_thread(void *_data)
 		struct cache_entry *ce = *cep++;
 		struct stat st;
 
-		if (ce_stage(ce))
-			continue;
-		if (S_ISGITLINK(ce->ce_mode))
-			continue;
-		if (ce_uptodate(ce))
-			continue;
-		if (ce_skip_worktree(ce))
-			continue;
-		if (ce->ce_flags & CE_FSMONITOR_VALID)
-			continue;
 		if (p->progress && !(nr & 31)) {
 			struct progress_data *pd = p->progress;
 
@@ -80,17 +110,12 @@ static void *preload_thread(void *_data)
 			pthread_mutex_unlock(&pd->mutex);
 			last_nr = nr;
 		}
-		if (!ce_path_match(index, ce, &p->pathspec, NULL))
-			continue;
-		if (threaded_has_symlink_leading_path(&cache, ce->name, ce_namelen(ce)))
+		if (!needs_lstat(index, ce, &p->pathspec, &cache))
 			continue;
 		p->t2_nr_lstat++;
 		if (lstat(ce->name, &st))
 			continue;
-		if (ie_match_stat(index, ce, &st, CE_MATCH_RACY_IS_DIRTY|CE_MATCH_IGNORE_FSMONITOR))
-			continue;
-		ce_mark_uptodate(ce);
-		mark_fsmonitor_valid(index, ce);
+		preload_entry(index, ce, &st);
 	} while (--nr > 0);
 	if (p->progress) {
 		struct progress_data *pd = p->progress;
@@ -103,6 +128,51 @@ static void *preload_thread(void *_data)
 	return NULL;
 }
 
+static void preload_batched_entry(void *cb_data, void *item,
+				  struct stat *st, int err)
+{
+	if (!err)
+		preload_entry(cb_data, item, st);
+}
+
+/*
+ * Preload the index without threads, handing the lstat() calls to the
+ * kernel in batches instead. Returns -1 if that is not possible here.
+ */
+static int preload_index_batched(struct index_state *index,
+				 const struct pathspec *pathspec,
+				 struct progress *progress)
+{
+	struct cache_def cache = CACHE_DEF_INIT;
+	struct lstat_batch_stats stats;
+	struct lstat_batch *batch;
+	int i;
+
+	batch = lstat_batch_init(BATCH_DEPTH, preload_batched_entry, index);
+	if (!batch)
+		return -1;
+
+	for (i = 0; i < index->cache_nr; i++) {
+		struct cache_entry *ce = index->cache[i];
+
+		if (!(i & 31))
+			display_progress(progress, i);
+		if (needs_lstat(index, ce, pathspec, &cache))
+			lstat_batch_add(batch, ce->name, ce);
+	}
+	lstat_batch_finish(batch, &stats);
+	display_progress(progress, index->cache_nr);
+	cache_def_clear(&cache);
+
+	trace2_data_intmax("index", NULL, "preload/sum_lstat", stats.nr);
+	trace2_data_intmax("index", NULL, "preload/batches", stats.batches);
+	trace2_data_intmax("index", NULL, "preload/max_batch_depth",
+			   stats.max_depth);
+	trace2_data_intmax("index", NULL, "preload/batch_wait_us",
+			   stats.wait_ns / 1000);
+	return 0;
+}
+
 void preload_index(struct index_state *index,
 		   const struct pathspec *pathspec,
 		   unsigned int refresh_flags)
@@ -112,8 +182,10 @@ void preload_index(struct index_state *index,
 	struct progress_data pd;
 	int t2_sum_lstat = 0;
 	int core_preload_index = 1;
+	int core_io_uring = 0;
 
 	repo_config_get_bool(index->repo, "core.preloadindex", &core_preload_index);
+	repo_config_get_bool(index->repo, "core.iouring", &core_io_uring);
 
 	if (!HAVE_THREADS || !core_preload_index)
 		return;
@@ -127,11 +199,6 @@ void preload_index(struct index_state *index,
 	trace2_region_enter("index", "preload", NULL);
 
 	trace_performance_enter();
-	if (threads > MAX_PARALLEL)
-		threads = MAX_PARALLEL;
-	offset = 0;
-	work = DIV_ROUND_UP(index->cache_nr, threads);
-	memset(&data, 0, sizeof(data));
 
 	memset(&pd, 0, sizeof(pd));
 	if (refresh_flags & REFRESH_PROGRESS && isatty(2)) {
@@ -141,6 +208,20 @@ void preload_index(struct index_state *index,
 		pthread_mutex_init(&pd.mutex, NULL);
 	}
 
+	if (core_io_uring &&
+	    !preload_index_batched(index, pathspec, pd.progress)) {
+		stop_progress(&pd.progress);
+		trace_performance_leave("preload index");
+		trace2_region_leave("index", "preload", NULL);
+		return;
+	}
+
+	if (threads > MAX_PARALLEL)
+		threads = MAX_PARALLEL;
+	offset = 0;
+	work = DIV_ROUND_UP(index->cache_nr, threads);
+	memset(&data, 0, sizeof(data));
+
 	for (i = 0; i < threads; i++) {
 		struct thread_data *p = data+i;
 		int err;
@@ -139,6 +139,8 @@ struct split_index;
 struct untracked_cache;
 struct progress;
 struct pattern_list;
+struct index_write_base;
+struct name_hash_table;
 
 enum sparse_index_mode {
 	/*
@@ -180,6 +182,8 @@ struct index_state {
 	enum sparse_index_mode sparse_index;
 	struct hashmap name_hash;
 	struct hashmap dir_hash;
+	/* the "NAMH" extension, until the index is modified */
+	struct name_hash_table *name_hash_table;
 	struct object_id oid;
 	struct untracked_cache *untracked;
 	char *fsmonitor_last_update;
@@ -188,6 +192,8 @@ struct index_state {
 	struct progress *progress;
 	struct repository *repo;
 	struct pattern_list *sparse_checkout_patterns;
+	/* the file this index was read from, for index.incrementalWrite */
+	struct index_write_base *write_base;
 };
 
 /**
@@ -8,6 +8,7 @@
 #define DISABLE_SIGN_COMPARE_WARNINGS
 
 #include "git-compat-util.h"
+#include "abspath.h"
 #include "config.h"
 #include "date.h"
 #include "diff.h"
@@ -74,6 +75,8 @@
 #define CACHE_EXT_ENDOFINDEXENTRIES 0x454F4945	/* "EOIE" */
 #define CACHE_EXT_INDEXENTRYOFFSETTABLE 0x49454F54 /* "IEOT" */
 #define CACHE_EXT_SPARSE_DIRECTORIES 0x73646972 /* "sdir" */
+#define CACHE_EXT_BLOCKCHECKSUMS 0x49424353 /* "IBCS" */
+#define CACHE_EXT_NAMEHASH 0x4E414D48	  /* "NAMH" */
 
 /* changes that can be kept in $GIT_DIR/index (basically all extensions) */
 #define EXTMASK (RESOLVE_UNDO_CHANGED | CACHE_TREE_CHANGED | \
@@ -1765,6 +1768,8 @@ static int read_index_extension(struct index_state *istate,
 		break;
 	case CACHE_EXT_ENDOFINDEXENTRIES:
 	case CACHE_EXT_INDEXENTRYOFFSETTABLE:
+	case CACHE_EXT_BLOCKCHECKSUMS:
+	case CACHE_EXT_NAMEHASH:
 		/* already handled in do_read_index() */
 		break;
 	case CACHE_EXT_SPARSE_DIRECTORIES:
@@ -1995,12 +2000,40 @@ struct index_entry_offset_table
 	struct index_entry_offset entries[FLEX_ARRAY];
 };
 
+/*
+ * Returns the offset right past the entries of the "i"th block of "ieot",
+ * given the offset of the end of all entries.
+ */
+static size_t ieot_block_end(const struct index_entry_offset_table *ieot,
+			     int i, size_t entries_end)
+{
+	return i + 1 < ieot->nr ? ieot->entries[i + 1].offset : entries_end;
+}
+
 static struct index_entry_offset_table *read_ieot_extension(const char *mmap, size_t mmap_size, size_t offset);
 static void write_ieot_extension(struct strbuf *sb, struct index_entry_offset_table *ieot);
 
 static size_t read_eoie_extension(const char *mmap, size_t mmap_size);
 static void write_eoie_extension(struct strbuf *sb, struct git_hash_ctx *eoie_context, size_t offset);
 
+#define IBCS_VERSION (1)
+
+struct index_block_checksums {
+	int nr;
+	const unsigned char *hashes; /* one per IEOT block */
+	const unsigned char *root;
+	size_t offset; /* of the extension itself */
+};
+
+static int read_ibcs_extension(const char *mmap, size_t mmap_size, size_t offset,
+			       struct index_block_checksums *ibcs);
+static void hash_index_block(const char *mmap, size_t start, size_t end,
+			     unsigned char *hash);
+static int verify_block_checksums(const char *mmap, size_t mmap_size,
+				  size_t entries_end,
+				  struct index_entry_offset_table *ieot,
+				  const unsigned char *computed);
+
 struct load_index_extensions
 {
 	pthread_t pthread;
@@ -2008,6 +2041,9 @@ struct load_index_extensions
 	const char *mmap;
 	size_t mmap_size;
 	unsigned long src_offset;
+	/* only usable once all entries are loaded */
+	const char *name_hash;
+	unsigned long name_hash_size;
 };
 
 static void *load_index_extensions(void *_data)
@@ -2023,7 +2059,10 @@ static void *load_index_extensions(void *_data)
 		 * in 4-byte network byte order.
 		 */
 		uint32_t extsize = get_be32(p->mmap + src_offset + 4);
-		if (read_index_extension(p->istate,
+		if (CACHE_EXT((p->mmap + src_offset)) == CACHE_EXT_NAMEHASH) {
+			p->name_hash = p->mmap + src_offset + 8;
+			p->name_hash_size = extsize;
+		} else if (read_index_extension(p->istate,
 					 p->mmap + src_offset,
 					 p->mmap + src_offset + 8,
 					 extsize) < 0) {
@@ -2102,6 +2141,8 @@ struct load_cache_entries_thread_data
 	int ieot_start;		/* starting index into the ieot array */
 	int ieot_blocks;	/* count of ieot entries to process */
 	unsigned long consumed;	/* return # of bytes in index file processed */
+	unsigned char *block_hashes;	/* if not NULL, where to hash the blocks to */
+	size_t entries_end;
 };
 
 /*
@@ -2118,12 +2159,17 @@ static void *load_cache_entries_thread(void *_data)
 		p->consumed += load_cache_entry_block(p->istate, p->ce_mem_pool,
 			p->offset, p->ieot->entries[i].nr, p->mmap, p->ieot->entries[i].offset, NULL);
 		p->offset += p->ieot->entries[i].nr;
+		if (p->block_hashes)
+			hash_index_block(p->mmap, p->ieot->entries[i].offset,
+					 ieot_block_end(p->ieot, i, p->entries_end),
+					 p->block_hashes + st_mult(i, the_hash_algo->rawsz));
 	}
 	return NULL;
 }
 
 static unsigned long load_cache_entries_threaded(struct index_state *istate, const char *mmap, size_t mmap_size,
-						 int nr_threads, struct index_entry_offset_table *ieot)
+						 int nr_threads, struct index_entry_offset_table *ieot,
+						 unsigned char *block_hashes, size_t entries_end)
 {
 	int i, offset, ieot_blocks, ieot_start, err;
 	struct load_cache_entries_thread_data *data;
@@ -2156,6 +2202,8 @@ static unsigned long load_cache_entries_threaded(struct index_state *istate, con
 		p->ieot = ieot;
 		p->ieot_start = ieot_start;
 		p->ieot_blocks = ieot_blocks;
+		p->block_hashes = block_hashes;
+		p->entries_end = entries_end;
 
 		/* create a mem_pool for each thread */
 		nr = 0;
@@ -2208,6 +2256,344 @@ static void set_new_index_sparsity(struct index_state *istate)
 		istate->sparse_index = 1;
 }
 
+/*
+ * With index.mapEntries, a machine-local copy of the entries of the
+ * main index is kept in "<index>.entries", laid out exactly like the
+ * "struct cache_entry"s that reading the index would produce. Loading
+ * the index then maps that file and points istate->cache into it,
+ * instead of decoding every entry. The mapping is private and
+ * writable, so entries that are modified get their own copy of the
+ * page they live on, and it is owned by the index's memory pool like
+ * any other entry.
+ *
+ * The file is keyed by the checksum of the index it was derived from,
+ * and by a fingerprint of the layout of "struct cache_entry", and ends
+ * with a checksum of its own contents. It is written along with the
+ * index when it does not match the index being written, so commands
+ * that only read the index never touch it.
+ */
+#define INDEX_ENTRIES_SIGNATURE 0x49454e54 /* "IENT" */
+#define INDEX_ENTRIES_VERSION 3
+#define INDEX_ENTRIES_BYTE_ORDER 0x01020304
+#define INDEX_ENTRIES_ALIGN 8
+
+struct index_entries_header {
+	uint32_t signature;
+	uint32_t version;
+	uint32_t byte_order;
+	uint32_t entry_size;
+	uint32_t layout;
+	uint32_t hash_algo;
+	uint32_t nr;
+	uint64_t extension_offset;
+	unsigned char index_hash[GIT_MAX_RAWSZ];
+};
+
+/*
+ * The flags that reading an entry from the index file sets; all other
+ * flags only live in memory.
+ */
+#define INDEX_ENTRIES_FLAGS (CE_STAGEMASK | CE_EXTENDED | CE_VALID | \
+			     CE_EXTENDED_FLAGS)
+
+/*
+ * Fingerprint the layout of the entries, so that a build that places
+ * the fields of "struct cache_entry" or its flags differently does not
+ * use a copy written by another.
+ */
+static uint32_t index_entries_layout(void)
+{
+	static const uint32_t layout[] = {
+		sizeof(struct cache_entry),
+		offsetof(struct cache_entry, ce_stat_data),
+		offsetof(struct cache_entry, ce_mode),
+		offsetof(struct cache_entry, ce_flags),
+		offsetof(struct cache_entry, mem_pool_allocated),
+		offsetof(struct cache_entry, ce_namelen),
+		offsetof(struct cache_entry, index),
+		offsetof(struct cache_entry, oid),
+		offsetof(struct cache_entry, name),
+		sizeof(struct stat_data),
+		offsetof(struct stat_data, sd_ctime.sec),
+		offsetof(struct stat_data, sd_ctime.nsec),
+		offsetof(struct stat_data, sd_mtime.sec),
+		offsetof(struct stat_data, sd_mtime.nsec),
+		offsetof(struct stat_data, sd_dev),
+		offsetof(struct stat_data, sd_ino),
+		offsetof(struct stat_data, sd_uid),
+		offsetof(struct stat_data, sd_gid),
+		offsetof(struct stat_data, sd_size),
+		sizeof(struct object_id),
+		offsetof(struct object_id, algo),
+		CE_STAGEMASK,
+		CE_EXTENDED,
+		CE_VALID,
+		CE_INTENT_TO_ADD,
+		CE_SKIP_WORKTREE,
+	};
+
+	return memhash(layout, sizeof(layout));
+}
+
+static size_t mapped_entry_size(size_t namelen)
+{
+	size_t size = st_add(cache_entry_size(namelen), INDEX_ENTRIES_ALIGN - 1);
+	return size & ~(size_t)(INDEX_ENTRIES_ALIGN - 1);
+}
+
+/*
+ * Check that "hdr" describes entries in our layout that were derived
+ * from the index with the checksum istate->oid.
+ */
+static int index_entries_match(const struct index_entries_header *hdr,
+			       const struct index_state *istate)
+{
+	return hdr->signature == INDEX_ENTRIES_SIGNATURE &&
+		hdr->version == INDEX_ENTRIES_VERSION &&
+		hdr->byte_order == INDEX_ENTRIES_BYTE_ORDER &&
+		hdr->entry_size == sizeof(struct cache_entry) &&
+		hdr->layout == index_entries_layout() &&
+		hdr->hash_algo == hash_algo_by_ptr(the_hash_algo) &&
+		hasheq(hdr->index_hash, istate->oid.hash, the_hash_algo);
+}
+
+static int use_mapped_entries(struct index_state *istate, const char *path)
+{
+	prepare_repo_settings(istate->repo);
+	return istate->repo->settings.index_map_entries &&
+		!is_null_oid(&istate->oid) &&
+		!strcmp(path, repo_get_index_file(istate->repo));
+}
+
+/*
+ * Point istate->cache at the entries in "<path>.entries" if that file
+ * matches the index we are reading. Returns the offset of the index
+ * extensions in the index file, or 0 if the file cannot be used.
+ */
+static size_t map_index_entries(struct index_state *istate, const char *path,
+				size_t index_size)
+{
+	char *entries_path = xstrfmt("%s.entries", path);
+	const struct index_entries_header *hdr;
+	struct stat st;
+	char *map = NULL, *pos, *end;
+	size_t map_size = 0, ret = 0;
+	unsigned int i;
+	int fd;
+
+	fd = git_open(entries_path);
+	if (fd < 0)
+		goto out;
+	if (fstat(fd, &st) ||
+	    (size_t)st.st_size < sizeof(*hdr) + the_hash_algo->rawsz) {
+		close(fd);
+		goto out;
+	}
+	map_size = xsize_t(st.st_size);
+	map = xmmap_gently(NULL, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+			   fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		map = NULL;
+		goto out;
+	}
+
+	hdr = (const struct index_entries_header *)map;
+	if (!index_entries_match(hdr, istate) ||
+	    hdr->nr != istate->cache_nr ||
+	    hdr->extension_offset < sizeof(struct cache_header) ||
+	    hdr->extension_offset > index_size - the_hash_algo->rawsz ||
+	    !hashfile_checksum_valid(the_hash_algo,
+				     (unsigned char *)map, map_size))
+		goto out;
+
+	pos = map + sizeof(*hdr);
+	end = map + map_size - the_hash_algo->rawsz;
+	for (i = 0; i < istate->cache_nr; i++) {
+		struct cache_entry *ce = (struct cache_entry *)pos;
+		size_t size;
+
+		if ((size_t)(end - pos) < sizeof(*ce))
+			goto out;
+		size = mapped_entry_size(ce->ce_namelen);
+		if ((size_t)(end - pos) < size || ce->name[ce->ce_namelen] ||
+		    (ce->ce_flags & ~INDEX_ENTRIES_FLAGS))
+			goto out;
+		set_index_entry(istate, i, ce);
+		pos += size;
+	}
+	if (pos != end)
+		goto out;
+
+	istate->ce_mem_pool = xmalloc(sizeof(*istate->ce_mem_pool));
+	mem_pool_init(istate->ce_mem_pool, 0);
+	mem_pool_add_mapping(istate->ce_mem_pool, map, map_size);
+	ret = hdr->extension_offset;
+	map = NULL;
+
+out:
+	if (map) {
+		munmap(map, map_size);
+		memset(istate->cache, 0, istate->cache_nr * sizeof(*istate->cache));
+		istate->sparse_index = 0;
+	}
+	free(entries_path);
+	return ret;
+}
+
+/*
+ * Check whether "<path>.entries" already holds the entries of the index
+ * with the checksum istate->oid, and has the expected `size`, so that
+ * it need not be written again.
+ */
+static int index_entries_up_to_date(struct index_state *istate,
+				    const char *entries_path, size_t size)
+{
+	struct index_entries_header hdr;
+	struct stat st;
+	int fd, ret;
+
+	fd = git_open(entries_path);
+	if (fd < 0)
+		return 0;
+	ret = !fstat(fd, &st) && (size_t)st.st_size == size &&
+		read_in_full(fd, &hdr, sizeof(hdr)) == sizeof(hdr) &&
+		index_entries_match(&hdr, istate);
+	close(fd);
+	return ret;
+}
+
+/*
+ * Write "<path>.entries" for the index that was just written to
+ * "<path>.lock", whose entries end at `extension_offset`, unless it is
+ * up to date already. Entries marked CE_REMOVE were not written, so
+ * they are left out here, too.
+ */
+static void write_index_entries(struct index_state *istate, const char *path,
+				size_t extension_offset)
+{
+	char *entries_path = xstrfmt("%s.entries", path);
+	struct lock_file lk = LOCK_INIT;
+	struct git_hash_ctx c;
+	unsigned char hash[GIT_MAX_RAWSZ];
+	struct index_entries_header hdr = {
+		.signature = INDEX_ENTRIES_SIGNATURE,
+		.version = INDEX_ENTRIES_VERSION,
+		.byte_order = INDEX_ENTRIES_BYTE_ORDER,
+		.entry_size = sizeof(struct cache_entry),
+		.layout = index_entries_layout(),
+		.hash_algo = hash_algo_by_ptr(the_hash_algo),
+		.extension_offset = extension_offset,
+	};
+	struct strbuf buf = STRBUF_INIT;
+	size_t size = sizeof(hdr) + the_hash_algo->rawsz;
+	unsigned int i;
+	int fd;
+
+	hashcpy(hdr.index_hash, istate->oid.hash, the_hash_algo);
+	for (i = 0; i < istate->cache_nr; i++) {
+		const struct cache_entry *ce = istate->cache[i];
+
+		if (ce->ce_flags & CE_REMOVE)
+			continue;
+		hdr.nr++;
+		size = st_add(size, mapped_entry_size(ce->ce_namelen));
+	}
+	if (index_entries_up_to_date(istate, entries_path, size))
+		goto out;
+
+	/* Someone else is writing it; they will do just as well. */
+	fd = hold_lock_file_for_update(&lk, entries_path, 0);
+	if (fd < 0)
+		goto out;
+
+	git_hash_init(&c, unsafe_hash_algo(the_hash_algo));
+	strbuf_add(&buf, &hdr, sizeof(hdr));
+	for (i = 0; i < istate->cache_nr; i++) {
+		const struct cache_entry *ce = istate->cache[i];
+		size_t size = mapped_entry_size(ce->ce_namelen);
+		struct cache_entry *copy;
+
+		if (ce->ce_flags & CE_REMOVE)
+			continue;
+
+		strbuf_grow(&buf, size);
+		copy = (struct cache_entry *)(buf.buf + buf.len);
+		memset(copy, 0, size);
+		memcpy(copy, ce, ce_size(ce));
+		memset(&copy->ent, 0, sizeof(copy->ent));
+		copy->ce_flags &= INDEX_ENTRIES_FLAGS;
+		copy->mem_pool_allocated = 1;
+		copy->index = 0;
+		strbuf_setlen(&buf, buf.len + size);
+
+		if (buf.len >= 64 * 1024) {
+			git_hash_update(&c, buf.buf, buf.len);
+			if (write_in_full(fd, buf.buf, buf.len) < 0)
+				goto out;
+			strbuf_reset(&buf);
+		}
+	}
+	git_hash_update(&c, buf.buf, buf.len);
+	git_hash_final(hash, &c);
+	strbuf_add(&buf, hash, the_hash_algo->rawsz);
+	if (write_in_full(fd, buf.buf, buf.len) < 0)
+		goto out;
+	commit_lock_file(&lk);
+
+out:
+	rollback_lock_file(&lk);
+	strbuf_release(&buf);
+	free(entries_path);
+}
+
+/*
+ * With index.incrementalWrite, remember the file the index was read
+ * from and which entries came from it, so that writing the index out
+ * again can copy the blocks of entries listed in its IEOT extension
+ * that did not change, instead of encoding them again.
+ */
+struct index_write_base {
+	char *path;
+	struct stat_data sd;
+	struct object_id oid;
+	unsigned int version;
+	struct cache_entry **cache;
+	unsigned int cache_nr;
+};
+
+static void record_write_base(struct index_state *istate, const char *path,
+			      struct stat *st)
+{
+	struct index_write_base *base;
+
+	prepare_repo_settings(istate->repo);
+	if (!istate->repo->settings.index_incremental_write ||
+	    istate->split_index ||
+	    strcmp(path, repo_get_index_file(istate->repo)))
+		return;
+
+	CALLOC_ARRAY(base, 1);
+	base->path = xstrdup(path);
+	fill_stat_data(&base->sd, st);
+	oidcpy(&base->oid, &istate->oid);
+	base->version = istate->version;
+	base->cache_nr = istate->cache_nr;
+	DUP_ARRAY(base->cache, istate->cache, istate->cache_nr);
+	istate->write_base = base;
+}
+
+static void discard_write_base(struct index_state *istate)
+{
+	struct index_write_base *base = istate->write_base;
+
+	if (!base)
+		return;
+	free(base->path);
+	free(base->cache);
+	FREE_AND_NULL(istate->write_base);
+}
+
 /* remember to discard_cache() before reading a different cache! */
 int do_read_index(struct index_state *istate, const char *path, int must_exist)
 {
@@ -2221,6 +2607,7 @@ int do_read_index(struct index_state *istate, const char *path, int must_exist)
 	size_t extension_offset = 0;
 	int nr_threads, cpus;
 	struct index_entry_offset_table *ieot = NULL;
+	unsigned char *block_hashes = NULL;
 
 	if (istate->initialized)
 		return istate->cache_nr;
@@ -2265,9 +2652,23 @@ int do_read_index(struct index_state *istate, const char *path, int must_exist)
 	p.istate = istate;
 	p.mmap = mmap;
 	p.mmap_size = mmap_size;
+	p.name_hash = NULL;
 
 	src_offset = sizeof(*hdr);
 
+	if (use_mapped_entries(istate, path)) {
+		extension_offset = map_index_entries(istate, path, mmap_size);
+		if (extension_offset) {
+			trace2_data_intmax("index", istate->repo, "read/mapped_entries",
+					   istate->cache_nr);
+			istate->timestamp.sec = st.st_mtime;
+			istate->timestamp.nsec = ST_MTIME_NSEC(st);
+			p.src_offset = extension_offset;
+			load_index_extensions(&p);
+			goto done;
+		}
+	}
+
 	if (repo_config_get_index_threads(the_repository, &nr_threads))
 		nr_threads = 1;
 
@@ -2304,8 +2705,15 @@ int do_read_index(struct index_state *istate, const char *path, int must_exist)
 		ieot = read_ieot_extension(mmap, mmap_size, extension_offset);
 
 	if (ieot) {
-		src_offset += load_cache_entries_threaded(istate, mmap, mmap_size, nr_threads, ieot);
-		free(ieot);
+		struct index_block_checksums ibcs;
+
+		/* let the threads verify the blocks they load */
+		if (read_ibcs_extension(mmap, mmap_size, extension_offset, &ibcs) &&
+		    ibcs.nr == ieot->nr)
+			CALLOC_ARRAY(block_hashes,
+				     st_mult(ieot->nr, the_hash_algo->rawsz));
+		src_offset += load_cache_entries_threaded(istate, mmap, mmap_size, nr_threads, ieot,
+							  block_hashes, extension_offset);
 	} else {
 		src_offset += load_all_cache_entries(istate, mmap, mmap_size, src_offset);
 	}
@@ -2322,6 +2730,19 @@ int do_read_index(struct index_state *istate, const char *path, int must_exist)
 		p.src_offset = src_offset;
 		load_index_extensions(&p);
 	}
+
+	if (verify_block_checksums(mmap, mmap_size,
+				   extension_offset ? extension_offset : src_offset,
+				   ieot, block_hashes) < 0)
+		goto unmap;
+	FREE_AND_NULL(ieot);
+	FREE_AND_NULL(block_hashes);
+
+done:
+	if (p.name_hash &&
+	    read_name_hash_extension(istate, p.name_hash, p.name_hash_size) < 0)
+		goto unmap;
+	record_write_base(istate, path, &st);
 	munmap((void *)mmap, mmap_size);
 
 	trace2_data_intmax("index", istate->repo, "read/version",
@@ -2455,6 +2876,7 @@ void release_index(struct index_state *istate)
 	free(istate->cache);
 	discard_split_index(istate);
 	free_untracked_cache(istate->untracked);
+	discard_write_base(istate);
 
 	if (istate->sparse_checkout_patterns) {
 		clear_pattern_list(istate->sparse_checkout_patterns);
@@ -2649,8 +3071,18 @@ static void copy_cache_entry_to_ondisk(struct ondisk_cache_entry *ondisk,
 	}
 }
 
-static int ce_write_entry(struct hashfile *f, struct cache_entry *ce,
-			  struct strbuf *previous_name, struct ondisk_cache_entry *ondisk)
+/* Write to "f", and to the hash of the current block of entries if any. */
+static void hashwrite_block(struct hashfile *f, struct git_hash_ctx *block_c,
+			    const void *buf, size_t len)
+{
+	hashwrite(f, buf, len);
+	if (block_c)
+		git_hash_update(block_c, buf, len);
+}
+
+static int ce_write_entry(struct hashfile *f, struct git_hash_ctx *block_c,
+			  struct cache_entry *ce, struct strbuf *previous_name,
+			  struct ondisk_cache_entry *ondisk)
 {
 	int size;
 	unsigned int saved_namelen;
@@ -2668,9 +3100,9 @@ static int ce_write_entry(struct hashfile *f, struct cache_entry *ce,
 	if (!previous_name) {
 		int len = ce_namelen(ce);
 		copy_cache_entry_to_ondisk(ondisk, ce);
-		hashwrite(f, ondisk, size);
-		hashwrite(f, ce->name, len);
-		hashwrite(f, padding, align_padding_size(size, len));
+		hashwrite_block(f, block_c, ondisk, size);
+		hashwrite_block(f, block_c, ce->name, len);
+		hashwrite_block(f, block_c, padding, align_padding_size(size, len));
 	} else {
 		int common, to_remove;
 		uint8_t prefix_size;
@@ -2686,10 +3118,10 @@ static int ce_write_entry(struct hashfile *f, struct cache_entry *ce,
 		prefix_size = encode_varint(to_remove, to_remove_vi);
 
 		copy_cache_entry_to_ondisk(ondisk, ce);
-		hashwrite(f, ondisk, size);
-		hashwrite(f, to_remove_vi, prefix_size);
-		hashwrite(f, ce->name + common, ce_namelen(ce) - common);
-		hashwrite(f, padding, 1);
+		hashwrite_block(f, block_c, ondisk, size);
+		hashwrite_block(f, block_c, to_remove_vi, prefix_size);
+		hashwrite_block(f, block_c, ce->name + common, ce_namelen(ce) - common);
+		hashwrite_block(f, block_c, padding, 1);
 
 		strbuf_splice(previous_name, common, to_remove,
 			      ce->name + common, ce_namelen(ce) - common);
@@ -2800,6 +3232,328 @@ static int record_ieot(void)
 	return !repo_config_get_index_threads(the_repository, &val) && val != 1;
 }
 
+/*
+ * Number of entries per block written with index.incrementalWrite or
+ * index.blockChecksums.
+ */
+#define INDEX_BLOCK_ENTRIES 1024
+
+/*
+ * A block of entries of the index file we read from that can be copied
+ * as-is into the file we are writing.
+ */
+struct reused_block {
+	int pos; /* position of its first entry in istate->cache */
+	int nr;
+	size_t start, end; /* byte range in the old file */
+	/* v4 only: where the prefix length of its first entry starts and ends */
+	size_t prefix, rest;
+	uint64_t prefix_len;
+	/* its hash from the IBCS extension of the old file, if any */
+	const unsigned char *hash;
+};
+
+struct index_reuse {
+	const char *map;
+	size_t map_size;
+	struct reused_block *blocks;
+	int nr;
+};
+
+/*
+ * Check that the entry at "offset" in "map" is what writing "ce" would
+ * produce, apart from the name, and return the offset of the entry that
+ * follows it, or 0 if it differs.
+ */
+static size_t reused_entry_matches(const struct cache_entry *ce,
+				   unsigned int version,
+				   const char *map, size_t offset, size_t end)
+{
+	struct ondisk_cache_entry ondisk;
+	size_t size = offsetof(struct ondisk_cache_entry, data) +
+		ondisk_data_size(ce->ce_flags, 0);
+
+	if (end - offset < size)
+		return 0;
+	copy_cache_entry_to_ondisk(&ondisk, (struct cache_entry *)ce);
+	if (memcmp(map + offset, &ondisk, size))
+		return 0;
+
+	if (version == 4) {
+		const unsigned char *cp = (const unsigned char *)map + offset + size;
+		const char *nul;
+
+		decode_varint(&cp);
+		offset = (const char *)cp - map;
+		if (offset >= end)
+			return 0;
+		nul = memchr(map + offset, '\0', end - offset);
+		return nul ? nul + 1 - map : 0;
+	}
+
+	size = ondisk_ce_size(ce);
+	return end - offset < size ? 0 : offset + size;
+}
+
+/*
+ * Check whether the "nr" entries read from "ondisk" (a block that starts
+ * with the "start"th entry of the old file) are still in the index
+ * unchanged and contiguous, and if so fill in "block".
+ */
+static int check_reused_block(struct index_state *istate,
+			      const struct index_write_base *base,
+			      unsigned int start, int nr,
+			      const char *map, size_t offset, size_t end,
+			      struct reused_block *block)
+{
+	const struct cache_entry *first = base->cache[start];
+	size_t name = offset + offsetof(struct ondisk_cache_entry, data) +
+		the_hash_algo->rawsz + sizeof(uint16_t);
+	size_t namelen = ce_namelen(first);
+	size_t next = offset;
+	int pos, i;
+
+	pos = index_name_stage_pos(istate, first->name, namelen,
+				   ce_stage(first), NO_EXPAND_SPARSE);
+	if (pos < 0 || pos + nr > istate->cache_nr)
+		return 0;
+
+	/*
+	 * Names never change in place, so the same in-memory entry has
+	 * the same name. Everything else about it may have been changed
+	 * in place, so compare it with what the old file holds.
+	 */
+	for (i = 0; i < nr; i++) {
+		struct cache_entry *ce = istate->cache[pos + i];
+
+		if (ce != base->cache[start + i] ||
+		    ce->ce_flags & (CE_REMOVE | CE_UPDATE_IN_BASE) ||
+		    is_null_oid(&ce->oid) ||
+		    (!ce_uptodate(ce) && is_racy_timestamp(istate, ce)))
+			return 0;
+		next = reused_entry_matches(ce, base->version, map, next, end);
+		if (!next)
+			return 0;
+	}
+	if (next != end)
+		return 0;
+
+	if (end < name)
+		return 0;
+	if (get_be16(map + name - sizeof(uint16_t)) & CE_EXTENDED)
+		name += sizeof(uint16_t);
+	block->prefix = block->rest = name;
+	if (base->version == 4) {
+		const unsigned char *cp = (const unsigned char *)map + name;
+
+		block->prefix_len = decode_varint(&cp);
+		name = block->rest = cp - (const unsigned char *)map;
+	}
+	if (end < name || end - name <= namelen ||
+	    memcmp(map + name, first->name, namelen) || map[name + namelen])
+		return 0;
+
+	block->pos = pos;
+	block->nr = nr;
+	block->start = offset;
+	block->end = end;
+	block->hash = NULL;
+	return 1;
+}
+
+static void prepare_index_reuse(struct index_state *istate,
+				unsigned int version,
+				struct index_reuse *reuse)
+{
+	const struct index_write_base *base = istate->write_base;
+	const unsigned int hashsz = the_hash_algo->rawsz;
+	struct index_entry_offset_table *ieot = NULL;
+	struct index_block_checksums ibcs;
+	int have_ibcs;
+	size_t extension_offset;
+	unsigned int start = 0;
+	struct stat st;
+	char *map;
+	int fd, i;
+
+	if (!base || base->version != version)
+		return;
+
+	fd = git_open(base->path);
+	if (fd < 0)
+		return;
+	if (fstat(fd, &st) || match_stat_data(&base->sd, &st) ||
+	    st.st_size < sizeof(struct cache_header) + hashsz) {
+		close(fd);
+		return;
+	}
+	reuse->map_size = xsize_t(st.st_size);
+	map = xmmap_gently(NULL, reuse->map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return;
+	reuse->map = map;
+
+	if (!is_null_oid(&base->oid) &&
+	    !hasheq((unsigned char *)map + reuse->map_size - hashsz,
+		    base->oid.hash, the_hash_algo))
+		goto fail;
+
+	extension_offset = read_eoie_extension(map, reuse->map_size);
+	ieot = read_ieot_extension(map, reuse->map_size, extension_offset);
+	if (!ieot)
+		goto fail;
+
+	have_ibcs = read_ibcs_extension(map, reuse->map_size, extension_offset, &ibcs) &&
+		ibcs.nr == ieot->nr;
+
+	ALLOC_ARRAY(reuse->blocks, ieot->nr);
+	for (i = 0; i < ieot->nr; i++) {
+		int nr = ieot->entries[i].nr;
+		size_t offset = ieot->entries[i].offset;
+		size_t end = i + 1 < ieot->nr ?
+			ieot->entries[i + 1].offset : extension_offset;
+
+		if (nr <= 0 || ieot->entries[i].offset < 0 ||
+		    offset >= end || end > extension_offset ||
+		    nr > base->cache_nr - start)
+			goto fail;
+		if (check_reused_block(istate, base, start, nr, map, offset, end,
+				       &reuse->blocks[reuse->nr])) {
+			if (have_ibcs)
+				reuse->blocks[reuse->nr].hash =
+					ibcs.hashes + st_mult(i, hashsz);
+			reuse->nr++;
+		}
+		start += nr;
+	}
+	if (start != base->cache_nr)
+		goto fail;
+
+	free(ieot);
+	return;
+
+fail:
+	free(ieot);
+	FREE_AND_NULL(reuse->blocks);
+	reuse->nr = 0;
+	munmap(map, reuse->map_size);
+	reuse->map = NULL;
+}
+
+/*
+ * Copy "block" into "f". Returns 1 if the bytes written are identical
+ * to the old ones and the hash of the block can be taken from the old
+ * file, in which case "block_c" is not updated.
+ */
+static int write_reused_block(struct hashfile *f, struct git_hash_ctx *block_c,
+			      const struct index_reuse *reuse,
+			      const struct reused_block *block,
+			      const struct cache_entry *last,
+			      struct strbuf *previous_name)
+{
+	unsigned char prefix[16];
+	int prefix_size, reuse_hash;
+
+	reuse_hash = block_c && block->hash &&
+		(!previous_name || block->prefix_len == previous_name->len);
+	if (reuse_hash)
+		block_c = NULL;
+
+	if (!previous_name) {
+		hashwrite_block(f, block_c, reuse->map + block->start,
+				block->end - block->start);
+		return reuse_hash;
+	}
+
+	/*
+	 * The first entry of a block spells out its whole name, but still
+	 * says how much of the previous name to drop, which depends on what
+	 * precedes the block in the file we are writing.
+	 */
+	prefix_size = encode_varint(previous_name->len, prefix);
+	hashwrite_block(f, block_c, reuse->map + block->start,
+			block->prefix - block->start);
+	hashwrite_block(f, block_c, prefix, prefix_size);
+	hashwrite_block(f, block_c, reuse->map + block->rest,
+			block->end - block->rest);
+
+	strbuf_reset(previous_name);
+	strbuf_add(previous_name, last->name, ce_namelen(last));
+	/* nothing in common with whatever starts the next block */
+	previous_name->buf[0] = 0;
+	return reuse_hash;
+}
+
+/*
+ * Append a block of "nr" entries starting at "offset" to "ieot". If
+ * "block_c" is given, it holds the hash of the block, which is stored
+ * in "block_hashes", and is reset for the next block.
+ */
+static void add_ieot_block(struct index_entry_offset_table *ieot,
+			   int nr, off_t offset,
+			   struct git_hash_ctx *block_c,
+			   unsigned char *block_hashes)
+{
+	if (block_c) {
+		git_hash_final(block_hashes + st_mult(ieot->nr, the_hash_algo->rawsz),
+			       block_c);
+		git_hash_init(block_c, the_hash_algo);
+	}
+	ieot->entries[ieot->nr].nr = nr;
+	ieot->entries[ieot->nr].offset = offset;
+	ieot->nr++;
+}
+
+/*
+ * Write the IBCS extension: the hashes of all blocks of entries, and a
+ * root hash over the header, those hashes and the extensions written
+ * since the end of the entries, which we read back from the file.
+ */
+static int write_ibcs_extension(struct hashfile *f, struct git_hash_ctx *eoie_c,
+				int fd, const struct cache_header *hdr,
+				const unsigned char *block_hashes, int nr,
+				off_t entries_end, struct strbuf *sb)
+{
+	const unsigned int rawsz = the_hash_algo->rawsz;
+	off_t pos = entries_end, end = hashfile_total(f);
+	unsigned char root[GIT_MAX_RAWSZ];
+	struct git_hash_ctx c;
+	char buf[65536];
+	uint32_t version;
+
+	hashflush(f);
+	git_hash_init(&c, the_hash_algo);
+	git_hash_update(&c, hdr, sizeof(*hdr));
+	git_hash_update(&c, block_hashes, st_mult(nr, rawsz));
+	while (pos < end) {
+		size_t len = end - pos < sizeof(buf) ? end - pos : sizeof(buf);
+
+		if (pread_in_full(fd, buf, len, pos) != len)
+			return error_errno(_("unable to read back index extensions"));
+		git_hash_update(&c, buf, len);
+		pos += len;
+	}
+	git_hash_final(root, &c);
+
+	strbuf_reset(sb);
+	put_be32(&version, IBCS_VERSION);
+	strbuf_add(sb, &version, sizeof(version));
+	strbuf_add(sb, block_hashes, st_mult(nr, rawsz));
+	strbuf_add(sb, root, rawsz);
+	if (write_index_ext_header(f, eoie_c, CACHE_EXT_BLOCKCHECKSUMS, sb->len) < 0)
+		return -1;
+	hashwrite(f, sb->buf, sb->len);
+	return 0;
+}
+
+static void release_index_reuse(struct index_reuse *reuse)
+{
+	if (reuse->map)
+		munmap((void *)reuse->map, reuse->map_size);
+	free(reuse->blocks);
+}
+
 enum write_extensions {
 	WRITE_NO_EXTENSION =              0,
 	WRITE_SPLIT_INDEX_EXTENSION =     1<<0,
@@ -2807,6 +3561,7 @@ enum write_extensions {
 	WRITE_RESOLVE_UNDO_EXTENSION =    1<<2,
 	WRITE_UNTRACKED_CACHE_EXTENSION = 1<<3,
 	WRITE_FSMONITOR_EXTENSION =       1<<4,
+	WRITE_NAME_HASH_EXTENSION =       1<<5,
 };
 #define WRITE_ALL_EXTENSIONS ((enum write_extensions)-1)
 
@@ -2838,6 +3593,10 @@ static int do_write_index(struct index_state *istate, struct tempfile *tempfile,
 	struct repository *r = istate->repo;
 	struct strbuf sb = STRBUF_INIT;
 	int nr, nr_threads, ret;
+	struct index_reuse reuse = { 0 };
+	int incremental, small_blocks, next_reuse = 0, reused_entries = 0;
+	struct git_hash_ctx *block_c = NULL;
+	unsigned char *block_hashes = NULL;
 
 	f = hashfd(the_repository->hash_algo, tempfile->fd, tempfile->filename.buf);
 
@@ -2874,7 +3633,31 @@ static int do_write_index(struct index_state *istate, struct tempfile *tempfile,
 	if (!HAVE_THREADS || repo_config_get_index_threads(the_repository, &nr_threads))
 		nr_threads = 1;
 
-	if (nr_threads != 1 && record_ieot()) {
+	incremental = r->settings.index_incremental_write && !istate->split_index;
+	if (incremental)
+		prepare_index_reuse(istate, hdr_version, &reuse);
+
+	small_blocks = incremental || r->settings.index_block_checksums;
+	if (small_blocks) {
+		/*
+		 * Write small blocks, so that the next write can reuse
+		 * most of them and readers can verify them in parallel.
+		 * There is at most one block of new entries before each
+		 * reused one, plus those that "ieot_entries" splits them
+		 * into.
+		 */
+		size_t max_blocks = 2 * reuse.nr + entries / INDEX_BLOCK_ENTRIES + 2;
+
+		ieot_entries = INDEX_BLOCK_ENTRIES;
+		ieot = xcalloc(1, st_add(sizeof(struct index_entry_offset_table),
+					 st_mult(sizeof(struct index_entry_offset),
+						 max_blocks)));
+		if (r->settings.index_block_checksums) {
+			CALLOC_ARRAY(block_c, 1);
+			git_hash_init(block_c, the_hash_algo);
+			block_hashes = xcalloc(max_blocks, the_hash_algo->rawsz);
+		}
+	} else if (nr_threads != 1 && record_ieot()) {
 		int ieot_blocks, cpus;
 
 		/*
@@ -2911,6 +3694,29 @@ static int do_write_index(struct index_state *istate, struct tempfile *tempfile,
 
 	for (i = 0; i < entries; i++) {
 		struct cache_entry *ce = cache[i];
+
+		if (next_reuse < reuse.nr && reuse.blocks[next_reuse].pos == i) {
+			const struct reused_block *block = &reuse.blocks[next_reuse++];
+
+			if (nr) {
+				add_ieot_block(ieot, nr, offset, block_c, block_hashes);
+				nr = 0;
+			}
+			offset = hashfile_total(f);
+			if (write_reused_block(f, block_c, &reuse, block,
+					       cache[i + block->nr - 1], previous_name)) {
+				hashcpy(block_hashes + st_mult(ieot->nr, the_hash_algo->rawsz),
+					block->hash, the_hash_algo);
+				add_ieot_block(ieot, block->nr, offset, NULL, NULL);
+			} else {
+				add_ieot_block(ieot, block->nr, offset, block_c, block_hashes);
+			}
+			offset = hashfile_total(f);
+
+			reused_entries += block->nr;
+			i += block->nr - 1;
+			continue;
+		}
 		if (ce->ce_flags & CE_REMOVE)
 			continue;
 		if (!ce_uptodate(ce) && is_racy_timestamp(istate, ce))
@@ -2928,10 +3734,9 @@ static int do_write_index(struct index_state *istate, struct tempfile *tempfile,
 
 			drop_cache_tree = 1;
 		}
-		if (ieot && i && (i % ieot_entries == 0)) {
-			ieot->entries[ieot->nr].nr = nr;
-			ieot->entries[ieot->nr].offset = offset;
-			ieot->nr++;
+		if (ieot && (small_blocks ? nr == ieot_entries :
+			     i && (i % ieot_entries == 0))) {
+			add_ieot_block(ieot, nr, offset, block_c, block_hashes);
 			/*
 			 * If we have a V4 index, set the first byte to an invalid
 			 * character to ensure there is nothing common with the previous
@@ -2943,20 +3748,21 @@ static int do_write_index(struct index_state *istate, struct tempfile *tempfile,
 
 			offset = hashfile_total(f);
 		}
-		if (ce_write_entry(f, ce, previous_name, (struct ondisk_cache_entry *)&ondisk) < 0)
+		if (ce_write_entry(f, block_c, ce, previous_name, (struct ondisk_cache_entry *)&ondisk) < 0)
 			err = -1;
 
 		if (err)
 			break;
 		nr++;
 	}
-	if (ieot && nr) {
-		ieot->entries[ieot->nr].nr = nr;
-		ieot->entries[ieot->nr].offset = offset;
-		ieot->nr++;
-	}
+	if (ieot && nr)
+		add_ieot_block(ieot, nr, offset, block_c, block_hashes);
 	strbuf_release(&previous_name_buf);
 
+	if (incremental)
+		trace2_data_intmax("index", r, "write/reused_entries",
+				   reused_entries);
+
 	if (err) {
 		ret = err;
 		goto out;
@@ -2968,7 +3774,7 @@ static int do_write_index(struct index_state *istate, struct tempfile *tempfile,
 	 * The extension headers must be hashed on their own for the
 	 * EOIE extension. Create a hashfile here to compute that hash.
 	 */
-	if (offset && record_eoie()) {
+	if (offset && (small_blocks || record_eoie())) {
 		CALLOC_ARRAY(eoie_c, 1);
 		git_hash_init(eoie_c, the_hash_algo);
 	}
@@ -2980,7 +3786,7 @@ static int do_write_index(struct index_state *istate, struct tempfile *tempfile,
 	 * strip_extensions parameter as we need it when loading the shared
 	 * index.
 	 */
-	if (ieot) {
+	if (ieot && ieot->nr) {
 		strbuf_reset(&sb);
 
 		write_ieot_extension(&sb, ieot);
@@ -3058,6 +3864,19 @@ static int do_write_index(struct index_state *istate, struct tempfile *tempfile,
 			goto out;
 		}
 	}
+	if (write_extensions & WRITE_NAME_HASH_EXTENSION &&
+	    r->settings.index_name_hash && repo_ignore_case(r) &&
+	    !istate->split_index && !istate->sparse_index) {
+		strbuf_reset(&sb);
+
+		write_name_hash_extension(&sb, istate);
+		err = write_index_ext_header(f, eoie_c, CACHE_EXT_NAMEHASH, sb.len) < 0;
+		hashwrite(f, sb.buf, sb.len);
+		if (err) {
+			ret = -1;
+			goto out;
+		}
+	}
 	if (istate->sparse_index) {
 		if (write_index_ext_header(f, eoie_c, CACHE_EXT_SPARSE_DIRECTORIES, 0) < 0) {
 			ret = -1;
@@ -3065,6 +3884,18 @@ static int do_write_index(struct index_state *istate, struct tempfile *tempfile,
 		}
 	}
 
+	/*
+	 * CACHE_EXT_BLOCKCHECKSUMS covers all other extensions but EOIE,
+	 * so it comes right before that one.
+	 */
+	if (block_c && ieot->nr) {
+		if (write_ibcs_extension(f, eoie_c, tempfile->fd, &hdr,
+					 block_hashes, ieot->nr, offset, &sb) < 0) {
+			ret = -1;
+			goto out;
+		}
+	}
+
 	/*
 	 * CACHE_EXT_ENDOFINDEXENTRIES must be written as the last entry before the SHA1
 	 * so that it can be found and processed before all the index entries are
@@ -3091,6 +3922,20 @@ static int do_write_index(struct index_state *istate, struct tempfile *tempfile,
 			  CSUM_HASH_IN_STREAM | csum_fsync_flag);
 	f = NULL;
 
+	/* The link extension makes this only part of the index. */
+	if (!istate->split_index && !alternate_index_output) {
+		const char *index_file = repo_get_index_file(r);
+		struct strbuf lock_path = STRBUF_INIT;
+
+		/* the lockfile holds an absolute path */
+		strbuf_add_absolute_path(&lock_path, index_file);
+		strbuf_addstr(&lock_path, LOCK_SUFFIX);
+		if (!strcmp(get_tempfile_path(tempfile), lock_path.buf) &&
+		    use_mapped_entries(istate, index_file))
+			write_index_entries(istate, index_file, offset);
+		strbuf_release(&lock_path);
+	}
+
 	if (close_tempfile_gently(tempfile)) {
 		ret = error(_("could not close '%s'"), get_tempfile_path(tempfile));
 		goto out;
@@ -3116,6 +3961,11 @@ static int do_write_index(struct index_state *istate, struct tempfile *tempfile,
 	strbuf_release(&sb);
 	free(eoie_c);
 	free(ieot);
+	free(block_c);
+	free(block_hashes);
+	release_index_reuse(&reuse);
+	/* the file we read from is about to be replaced */
+	discard_write_base(istate);
 	return ret;
 }
 
@@ -3732,6 +4582,122 @@ static void write_ieot_extension(struct strbuf *sb, struct index_entry_offset_ta
 	}
 }
 
+static int read_ibcs_extension(const char *mmap, size_t mmap_size, size_t offset,
+			       struct index_block_checksums *ibcs)
+{
+	const unsigned int rawsz = the_hash_algo->rawsz;
+	const char *index = NULL;
+	uint32_t extsize = 0;
+
+	/* find the IBCS extension */
+	if (!offset)
+		return 0;
+	while (offset <= mmap_size - rawsz - 8) {
+		extsize = get_be32(mmap + offset + 4);
+		if (CACHE_EXT((mmap + offset)) == CACHE_EXT_BLOCKCHECKSUMS) {
+			index = mmap + offset + 4 + 4;
+			break;
+		}
+		offset += 8;
+		offset += extsize;
+	}
+	if (!index)
+		return 0;
+
+	if (extsize > mmap_size - rawsz - offset - 8 ||
+	    extsize < sizeof(uint32_t) + 2 * rawsz ||
+	    (extsize - sizeof(uint32_t)) % rawsz) {
+		error(_("invalid IBCS extension size %u"), extsize);
+		return 0;
+	}
+	if (get_be32(index) != IBCS_VERSION) {
+		error(_("invalid IBCS version %d"), get_be32(index));
+		return 0;
+	}
+
+	ibcs->nr = (extsize - sizeof(uint32_t)) / rawsz - 1;
+	ibcs->hashes = (const unsigned char *)index + sizeof(uint32_t);
+	ibcs->root = ibcs->hashes + st_mult(ibcs->nr, rawsz);
+	ibcs->offset = offset;
+	return 1;
+}
+
+static void hash_index_block(const char *mmap, size_t start, size_t end,
+			     unsigned char *hash)
+{
+	struct git_hash_ctx c;
+
+	git_hash_init(&c, the_hash_algo);
+	git_hash_update(&c, mmap + start, end - start);
+	git_hash_final(hash, &c);
+}
+
+/*
+ * Check the IBCS extension, if the index has one: each block of entries
+ * listed in the IEOT must match its hash, and the root hash covers the
+ * header, the block hashes and the extensions that precede it.
+ * "computed" holds the hashes of the blocks if the caller already
+ * computed them, otherwise they are computed here.
+ */
+static int verify_block_checksums(const char *mmap, size_t mmap_size,
+				  size_t entries_end,
+				  struct index_entry_offset_table *ieot,
+				  const unsigned char *computed)
+{
+	const unsigned int rawsz = the_hash_algo->rawsz;
+	struct index_entry_offset_table *to_free = NULL;
+	struct index_block_checksums ibcs;
+	unsigned char hash[GIT_MAX_RAWSZ];
+	struct git_hash_ctx c;
+	size_t expect = sizeof(struct cache_header);
+	int i, ret = 0;
+
+	if (!read_ibcs_extension(mmap, mmap_size, entries_end, &ibcs))
+		return 0;
+	if (!ieot)
+		ieot = to_free = read_ieot_extension(mmap, mmap_size, entries_end);
+	if (!ieot || ieot->nr != ibcs.nr) {
+		ret = error(_("index block checksums do not match the offset table"));
+		goto out;
+	}
+
+	for (i = 0; i < ieot->nr; i++) {
+		size_t start = ieot->entries[i].offset;
+		size_t end = ieot_block_end(ieot, i, entries_end);
+
+		if (ieot->entries[i].offset < 0 || start != expect ||
+		    end <= start || end > entries_end) {
+			ret = error(_("index block checksums do not match the offset table"));
+			goto out;
+		}
+		expect = end;
+
+		if (!computed)
+			hash_index_block(mmap, start, end, hash);
+		if (!hasheq(computed ? computed + st_mult(i, rawsz) : hash,
+			    ibcs.hashes + st_mult(i, rawsz), the_hash_algo)) {
+			ret = error(_("bad index file checksum for block %d"), i);
+			goto out;
+		}
+	}
+	if (expect != entries_end) {
+		ret = error(_("index block checksums do not match the offset table"));
+		goto out;
+	}
+
+	git_hash_init(&c, the_hash_algo);
+	git_hash_update(&c, mmap, sizeof(struct cache_header));
+	git_hash_update(&c, ibcs.hashes, st_mult(ibcs.nr, rawsz));
+	git_hash_update(&c, mmap + entries_end, ibcs.offset - entries_end);
+	git_hash_final(hash, &c);
+	if (!hasheq(hash, ibcs.root, the_hash_algo))
+		ret = error(_("bad index file root checksum"));
+
+out:
+	free(to_free);
+	return ret;
+}
+
 void prefetch_cache_entries(const struct index_state *istate,
 			    must_prefetch_predicate must_prefetch)
 {
@@ -2931,6 +2931,59 @@ static int match_points_at(struct oid_array *points_at,
 	return 0;
 }
 
+static int add_points_at_match(const struct reference *ref, void *cb_data)
+{
+	struct ref_filter *filter = cb_data;
+
+	if (!oidset_contains(&filter->internal.points_at_matches, ref->oid) &&
+	    match_points_at(&filter->points_at, ref->oid, ref->name))
+		oidset_insert(&filter->internal.points_at_matches, ref->oid);
+	return 0;
+}
+
+/*
+ * Look up the refs that may match `--points-at` by object ID instead of
+ * peeling every ref we iterate over. A ref matches when it points at one
+ * of the objects directly, or when it is a tag whose chain of tags leads
+ * to it. In the latter case the ref peels to the same object as the one
+ * we are looking for, so looking up both the object and its peeled value
+ * yields all candidates, which we then verify.
+ *
+ * Only refs in "refs/" are looked up, so root refs need the slow path.
+ */
+static void prepare_points_at_lookup(struct ref_filter *filter)
+{
+	struct ref_store *store = get_main_ref_store(the_repository);
+
+	if (!filter->points_at.nr || filter->kind & FILTER_REFS_ROOT_REFS ||
+	    !refs_can_lookup_by_oid(store))
+		return;
+
+	oidset_init(&filter->internal.points_at_matches, 0);
+	for (size_t i = 0; i < filter->points_at.nr; i++) {
+		const struct object_id *oid = &filter->points_at.oid[i];
+		struct object_id peeled;
+
+		oidset_insert(&filter->internal.points_at_matches, oid);
+		refs_for_each_ref_pointing_at(store, oid, add_points_at_match,
+					      filter);
+		if (!peel_object(the_repository, oid, &peeled, 0) &&
+		    !oideq(oid, &peeled))
+			refs_for_each_ref_pointing_at(store, &peeled,
+						      add_points_at_match, filter);
+	}
+	filter->internal.points_at_lookup = 1;
+}
+
+static int filter_points_at_match(struct ref_filter *filter,
+				  const struct reference *ref)
+{
+	if (filter->internal.points_at_lookup)
+		return oidset_contains(&filter->internal.points_at_matches,
+				       ref->oid);
+	return match_points_at(&filter->points_at, ref->oid, ref->name);
+}
+
 /*
  * Allocate space for a new ref_array_item and copy the name and oid to it.
  *
@@ -3042,7 +3095,7 @@ static struct ref_array_item *apply_ref_filter(const struct reference *ref,
 	if (filter_exclude_match(filter, ref->name))
 		return NULL;
 
-	if (filter->points_at.nr && !match_points_at(&filter->points_at, ref->oid, ref->name))
+	if (filter->points_at.nr && !filter_points_at_match(filter, ref))
 		return NULL;
 
 	if (filter->forked.nr && !filter_forked_match(filter, ref->name))
@@ -3370,6 +3423,8 @@ static int do_filter_refs(struct ref_filter *filter, unsigned int type, refs_for
 	if (!filter->kind)
 		die("filter_refs: invalid type");
 
+	prepare_points_at_lookup(filter);
+
 	/*
 	 * For common cases where we need only branches or remotes or tags,
 	 * we only iterate through those refs. If a mix of refs is needed,
@@ -3412,6 +3467,10 @@ static int do_filter_refs(struct ref_filter *filter, unsigned int type, refs_for
 
 	clear_contains_cache(&filter->internal.contains_cache);
 	clear_contains_cache(&filter->internal.no_contains_cache);
+	if (filter->internal.points_at_lookup) {
+		oidset_clear(&filter->internal.points_at_matches);
+		filter->internal.points_at_lookup = 0;
+	}
 
 	return ret;
 }
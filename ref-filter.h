@@ -3,6 +3,7 @@
 
 #include "gettext.h"
 #include "oid-array.h"
+#include "oidset.h"
 #include "commit.h"
 #include "string-list.h"
 #include "strvec.h"
@@ -86,6 +87,12 @@ struct ref_filter {
 	struct {
 		struct contains_cache contains_cache;
 		struct contains_cache no_contains_cache;
+		/*
+		 * When the ref store can look up refs by object ID, the
+		 * values of all refs matching `points_at`.
+		 */
+		struct oidset points_at_matches;
+		unsigned points_at_lookup : 1;
 	} internal;
 };
 
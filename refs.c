@@ -1981,6 +1981,48 @@ int refs_for_each_replace_ref(struct ref_store *refs, refs_for_each_cb cb, void
 	return refs_for_each_ref_ext(refs, cb, cb_data, &opts);
 }
 
+struct ref_pointing_at_cb {
+	struct repository *repo;
+	const struct object_id *oid;
+	refs_for_each_cb *fn;
+	void *cb_data;
+};
+
+static int ref_pointing_at_fn(const struct reference *ref, void *cb_data)
+{
+	struct ref_pointing_at_cb *cb = cb_data;
+	struct object_id peeled;
+
+	if (ref->flags & REF_ISSYMREF)
+		return 0;
+	if (!oideq(ref->oid, cb->oid) &&
+	    (reference_get_peeled_oid(cb->repo, ref, &peeled) ||
+	     !oideq(&peeled, cb->oid)))
+		return 0;
+	return cb->fn(ref, cb->cb_data);
+}
+
+int refs_for_each_ref_pointing_at(struct ref_store *refs,
+				  const struct object_id *oid,
+				  refs_for_each_cb fn, void *cb_data)
+{
+	struct ref_pointing_at_cb cb = {
+		.repo = refs->repo,
+		.oid = oid,
+		.fn = fn,
+		.cb_data = cb_data,
+	};
+
+	if (refs->be->for_each_ref_pointing_at)
+		return refs->be->for_each_ref_pointing_at(refs, oid, fn, cb_data);
+	return refs_for_each_ref(refs, ref_pointing_at_fn, &cb);
+}
+
+bool refs_can_lookup_by_oid(struct ref_store *refs)
+{
+	return !!refs->be->for_each_ref_pointing_at;
+}
+
 static int qsort_strcmp(const void *va, const void *vb)
 {
 	const char *a = *(const char **)va;
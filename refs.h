@@ -521,6 +521,24 @@ int refs_for_each_remote_ref(struct ref_store *refs,
 int refs_for_each_replace_ref(struct ref_store *refs,
 			      refs_for_each_cb fn, void *cb_data);
 
+/*
+ * Call `fn` for each direct reference in "refs/" whose object ID is `oid`,
+ * or that is a tag which peels to `oid`. Symbolic references are not
+ * reported. References are yielded in lexicographic order, and the
+ * iteration stops when `fn` returns a nonzero value, which is then
+ * returned.
+ */
+int refs_for_each_ref_pointing_at(struct ref_store *refs,
+				  const struct object_id *oid,
+				  refs_for_each_cb fn, void *cb_data);
+
+/*
+ * Returns true if `refs_for_each_ref_pointing_at()` does not need to
+ * iterate over all references, so that it is cheaper than a filtered
+ * iteration when few references point at the object.
+ */
+bool refs_can_lookup_by_oid(struct ref_store *refs);
+
 /**
  * Iterate all refs in "prefixes" by partitioning prefixes into disjoint sets
  * and iterating the longest-common prefix of each set.
@@ -1459,6 +1459,9 @@ static int should_pack_refs(struct files_ref_store *refs,
 	if (!(opts->flags & REFS_OPTIMIZE_AUTO))
 		return 1;
 
+	if (packed_refs_delta_needs_fold(refs->packed_ref_store))
+		return 1;
+
 	ret = packed_refs_size(refs->packed_ref_store, &packed_size);
 	if (ret < 0)
 		die("cannot determine packed-refs size");
@@ -1530,6 +1533,7 @@ static int files_optimize(struct ref_store *ref_store,
 		return -1;
 
 	packed_refs_lock(refs->packed_ref_store, LOCK_DIE_ON_ERROR, &err);
+	packed_refs_force_rewrite(refs->packed_ref_store);
 
 	iter = cache_ref_iterator_begin(get_loose_ref_cache(refs, 0), NULL,
 					refs->base.repo, 0);
@@ -12,6 +12,7 @@
 #include "packed-backend.h"
 #include "../iterator.h"
 #include "../lockfile.h"
+#include "../path.h"
 #include "../chdir-notify.h"
 #include "../statinfo.h"
 #include "../worktree.h"
@@ -50,6 +51,19 @@ static enum mmap_strategy mmap_strategy = MMAP_OK;
 
 struct packed_ref_store;
 
+/*
+ * One reference recorded in the `packed-refs.delta` file. A null `oid`
+ * records that the reference has been deleted.
+ */
+struct delta_record {
+	const char *refname;
+	struct object_id oid;
+	struct object_id peeled;
+	unsigned has_peeled : 1;
+	/* position in the file, so that later records win */
+	size_t seq;
+};
+
 /*
  * A `snapshot` represents one snapshot of a `packed-refs` file.
  *
@@ -118,6 +132,23 @@ struct snapshot {
 	 * replaced since we read it.
 	 */
 	struct stat_validity validity;
+
+	/*
+	 * If the header of the `packed-refs` file names a delta (see
+	 * `load_delta()`), its identifier and the records of the
+	 * matching `packed-refs.delta` file, sorted by refname and
+	 * holding only the latest record for each reference. These
+	 * take precedence over the records in `buf`. `delta_buf`
+	 * holds the contents of the delta file that the records point
+	 * into, of which the first `delta_len` bytes hold complete
+	 * transactions.
+	 */
+	char *delta_id;
+	struct delta_record *delta;
+	size_t delta_nr, delta_alloc;
+	struct strbuf delta_buf;
+	size_t delta_len;
+	struct stat_validity delta_validity;
 };
 
 /*
@@ -143,6 +174,9 @@ struct packed_ref_store {
 	/* The path of the "packed-refs" file: */
 	char *path;
 
+	/* The path of the "packed-refs.delta" file: */
+	char *delta_path;
+
 	/*
 	 * A snapshot of the values read from the `packed-refs` file,
 	 * if it might still be current; otherwise, NULL.
@@ -168,6 +202,21 @@ struct packed_ref_store {
 	 */
 	bool timeout_configured;
 	int timeout_value;
+
+	/*
+	 * Largest size of the "packed-refs.delta" file, configurable via
+	 * "core.packedRefsDeltaSize"; zero if transactions should always
+	 * rewrite "packed-refs", as they do unless the repository has
+	 * "extensions.packedRefsDelta" enabled.
+	 */
+	bool delta_size_configured;
+	unsigned long delta_size_max;
+
+	/*
+	 * Set by `packed_refs_force_rewrite()` while the store is
+	 * locked, to fold the delta file back into "packed-refs".
+	 */
+	int force_rewrite;
 };
 
 /*
@@ -204,7 +253,11 @@ static int release_snapshot(struct snapshot *snapshot)
 {
 	if (!--snapshot->referrers) {
 		stat_validity_clear(&snapshot->validity);
+		stat_validity_clear(&snapshot->delta_validity);
 		clear_snapshot_buffer(snapshot);
+		free(snapshot->delta_id);
+		free(snapshot->delta);
+		strbuf_release(&snapshot->delta_buf);
 		free(snapshot);
 		return 1;
 	} else {
@@ -228,6 +281,9 @@ static void packed_ref_store_reparent(const char *name UNUSED,
 	tmp = reparent_relative_path(old_cwd, new_cwd, refs->path);
 	free(refs->path);
 	refs->path = tmp;
+	tmp = reparent_relative_path(old_cwd, new_cwd, refs->delta_path);
+	free(refs->delta_path);
+	refs->delta_path = tmp;
 }
 
 /*
@@ -248,6 +304,8 @@ struct ref_store *packed_ref_store_init(struct repository *repo,
 
 	strbuf_addf(&sb, "%s/packed-refs", gitdir);
 	refs->path = strbuf_detach(&sb, NULL);
+	strbuf_addf(&sb, "%s/packed-refs.delta", gitdir);
+	refs->delta_path = strbuf_detach(&sb, NULL);
 	chdir_notify_register(NULL, packed_ref_store_reparent, refs);
 	return ref_store;
 }
@@ -295,6 +353,7 @@ static void packed_ref_store_release(struct ref_store *ref_store)
 	delete_tempfile(&refs->tempfile);
 	chdir_notify_unregister(NULL, packed_ref_store_reparent, refs);
 	free(refs->path);
+	free(refs->delta_path);
 }
 
 static NORETURN void die_unterminated_line(const char *path,
@@ -690,6 +749,176 @@ static const char *find_reference_location_end(struct snapshot *snapshot,
 	return find_reference_location_1(snapshot, refname, mustexist, 0);
 }
 
+/*
+ * The first line of a `packed-refs.delta` file, followed by the
+ * identifier found in the header of the `packed-refs` file that the
+ * delta applies to. The rest of the file consists of records in the
+ * format of `packed-refs`, where a null object ID marks a deleted
+ * reference, and each transaction is terminated by a
+ * `PACKED_REFS_DELTA_END` line. Lines after the last such terminator
+ * were left behind by a writer that did not finish, and are ignored.
+ */
+static const char PACKED_REFS_DELTA_HEADER[] = "# packed-refs delta: ";
+static const char PACKED_REFS_DELTA_END[] = "# end\n";
+
+static int cmp_delta_record(const void *va, const void *vb)
+{
+	const struct delta_record *a = va, *b = vb;
+	int cmp = strcmp(a->refname, b->refname);
+
+	if (cmp)
+		return cmp;
+	return a->seq < b->seq ? -1 : a->seq > b->seq;
+}
+
+/*
+ * Return the index of the first delta record in `snapshot` whose
+ * refname is not less than `refname`.
+ */
+static size_t delta_record_pos(struct snapshot *snapshot, const char *refname)
+{
+	size_t lo = 0, hi = snapshot->delta_nr;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+
+		if (strcmp(snapshot->delta[mid].refname, refname) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+static struct delta_record *find_delta_record(struct snapshot *snapshot,
+					      const char *refname)
+{
+	size_t pos = delta_record_pos(snapshot, refname);
+
+	if (pos < snapshot->delta_nr &&
+	    !strcmp(snapshot->delta[pos].refname, refname))
+		return &snapshot->delta[pos];
+	return NULL;
+}
+
+/*
+ * Parse the records of the delta file in `snapshot->delta_buf`
+ * that come before its last transaction terminator.
+ */
+static void parse_delta(struct snapshot *snapshot, size_t header_len)
+{
+	const struct git_hash_algo *algop = snapshot->refs->base.repo->hash_algo;
+	const char *path = snapshot->refs->delta_path;
+	char *buf = snapshot->delta_buf.buf;
+	char *p = buf + header_len, *eof = buf + snapshot->delta_buf.len;
+	size_t committed_nr = 0, i, j;
+
+	snapshot->delta_len = header_len;
+	while (p < eof) {
+		struct delta_record *rec;
+		char *eol = memchr(p, '\n', eof - p);
+		const char *q;
+
+		if (!eol)
+			break;
+		if (!strncmp(p, PACKED_REFS_DELTA_END, eol + 1 - p)) {
+			p = eol + 1;
+			snapshot->delta_len = p - buf;
+			committed_nr = snapshot->delta_nr;
+			continue;
+		}
+
+		ALLOC_GROW(snapshot->delta, snapshot->delta_nr + 1,
+			   snapshot->delta_alloc);
+		rec = &snapshot->delta[snapshot->delta_nr];
+		memset(rec, 0, sizeof(*rec));
+		if (parse_oid_hex_algop(p, &rec->oid, &q, algop) ||
+		    *q++ != ' ' || q == eol)
+			goto invalid;
+		*eol = '\0';
+		rec->refname = q;
+		rec->seq = snapshot->delta_nr++;
+		p = eol + 1;
+
+		if (p < eof && *p == '^') {
+			eol = memchr(p, '\n', eof - p);
+			if (!eol)
+				break;
+			if (parse_oid_hex_algop(p + 1, &rec->peeled, &q, algop) ||
+			    q != eol)
+				goto invalid;
+			rec->has_peeled = 1;
+			p = eol + 1;
+		}
+	}
+	goto done;
+
+invalid:
+	/*
+	 * Garbage after the last terminator was left by an interrupted
+	 * writer, but anything before it means that the file is corrupt.
+	 */
+	if (memmem(p, eof - p, PACKED_REFS_DELTA_END,
+		   strlen(PACKED_REFS_DELTA_END)))
+		die_invalid_line(path, p, eof - p);
+
+done:
+	snapshot->delta_nr = committed_nr;
+	QSORT(snapshot->delta, snapshot->delta_nr, cmp_delta_record);
+	for (i = j = 0; i < snapshot->delta_nr; i++) {
+		if (i + 1 < snapshot->delta_nr &&
+		    !strcmp(snapshot->delta[i].refname,
+			    snapshot->delta[i + 1].refname))
+			continue;
+		if (check_refname_format(snapshot->delta[i].refname,
+					 REFNAME_ALLOW_ONELEVEL))
+			die("invalid refname in %s: %s", path,
+			    snapshot->delta[i].refname);
+		snapshot->delta[j++] = snapshot->delta[i];
+	}
+	snapshot->delta_nr = j;
+}
+
+/*
+ * Read the delta file that belongs to the `packed-refs` file read into
+ * `snapshot`. The delta only applies if its header carries the same
+ * identifier as `packed-refs`; a delta that is missing or belongs to
+ * some other `packed-refs` is empty, unless `packed-refs` itself has
+ * been replaced since we read it. In that case we could have missed
+ * records that the new delta no longer holds, so return -1 to let the
+ * caller start over.
+ */
+static int load_delta(struct snapshot *snapshot)
+{
+	struct packed_ref_store *refs = snapshot->refs;
+	struct strbuf header = STRBUF_INIT;
+	int fd, ret = 0;
+
+	fd = open(refs->delta_path, O_RDONLY);
+	if (fd < 0) {
+		if (errno != ENOENT)
+			die_errno("couldn't read %s", refs->delta_path);
+	} else {
+		stat_validity_update(&snapshot->delta_validity, fd);
+		if (strbuf_read(&snapshot->delta_buf, fd, 0) < 0)
+			die_errno("couldn't read %s", refs->delta_path);
+		close(fd);
+	}
+
+	strbuf_addf(&header, "%s%s\n", PACKED_REFS_DELTA_HEADER,
+		    snapshot->delta_id);
+	if (starts_with(snapshot->delta_buf.buf, header.buf)) {
+		parse_delta(snapshot, header.len);
+	} else {
+		strbuf_reset(&snapshot->delta_buf);
+		if (!stat_validity_check(&snapshot->validity, refs->path))
+			ret = -1;
+	}
+
+	strbuf_release(&header);
+	return ret;
+}
+
 /*
  * Create a newly-allocated `snapshot` of the `packed-refs` file in
  * its current state and return it. The return value will already have
@@ -722,12 +951,20 @@ static const char *find_reference_location_end(struct snapshot *snapshot,
  *   `sorted`:
  *
  *      The references in this file are known to be sorted by refname.
+ *
+ *   `delta-id=<id>`:
+ *
+ *      Records in the `packed-refs.delta` file whose header carries
+ *      the same identifier override the records in this file.
  */
 static struct snapshot *create_snapshot(struct packed_ref_store *refs)
 {
-	struct snapshot *snapshot = xcalloc(1, sizeof(*snapshot));
+	struct snapshot *snapshot;
 	int sorted = 0;
 
+retry:
+	snapshot = xcalloc(1, sizeof(*snapshot));
+	strbuf_init(&snapshot->delta_buf, 0);
 	snapshot->refs = refs;
 	acquire_snapshot(snapshot);
 	snapshot->peeled = PEELED_NONE;
@@ -763,6 +1000,14 @@ static struct snapshot *create_snapshot(struct packed_ref_store *refs)
 
 		sorted = unsorted_string_list_has_string(&traits, "sorted");
 
+		for (size_t i = 0; i < traits.nr; i++) {
+			const char *id;
+
+			if (skip_prefix(traits.items[i].string, "delta-id=", &id) &&
+			    *id)
+				snapshot->delta_id = xstrdup(id);
+		}
+
 		/* perhaps other traits later as well */
 
 		/* The "+ 1" is for the LF character. */
@@ -799,6 +1044,12 @@ static struct snapshot *create_snapshot(struct packed_ref_store *refs)
 		snapshot->eof = buf_copy + size;
 	}
 
+	if (snapshot->delta_id && load_delta(snapshot) < 0) {
+		release_snapshot(snapshot);
+		sorted = 0;
+		goto retry;
+	}
+
 	return snapshot;
 }
 
@@ -809,7 +1060,10 @@ static struct snapshot *create_snapshot(struct packed_ref_store *refs)
 static void validate_snapshot(struct packed_ref_store *refs)
 {
 	if (refs->snapshot &&
-	    !stat_validity_check(&refs->snapshot->validity, refs->path))
+	    (!stat_validity_check(&refs->snapshot->validity, refs->path) ||
+	     (refs->snapshot->delta_id &&
+	      !stat_validity_check(&refs->snapshot->delta_validity,
+				   refs->delta_path))))
 		clear_snapshot(refs);
 }
 
@@ -840,10 +1094,22 @@ static int packed_read_raw_ref(struct ref_store *ref_store, const char *refname,
 	struct packed_ref_store *refs =
 		packed_downcast(ref_store, REF_STORE_READ, "read_raw_ref");
 	struct snapshot *snapshot = get_snapshot(refs);
+	struct delta_record *delta;
 	const char *rec;
 
 	*type = 0;
 
+	delta = find_delta_record(snapshot, refname);
+	if (delta) {
+		if (is_null_oid(&delta->oid)) {
+			*failure_errno = ENOENT;
+			return -1;
+		}
+		oidcpy(oid, &delta->oid);
+		*type = REF_ISPACKED;
+		return 0;
+	}
+
 	rec = find_reference_location(snapshot, refname, 1);
 
 	if (!rec) {
@@ -1071,6 +1337,123 @@ static struct ref_iterator_vtable packed_ref_iterator_vtable = {
 	.release = packed_ref_iterator_release,
 };
 
+/*
+ * An iterator over the delta records of a snapshot, including the
+ * records of deleted references, so that `packed_delta_select()` can
+ * hide the records that they override in `packed-refs`.
+ */
+struct packed_delta_iterator {
+	struct ref_iterator base;
+
+	struct snapshot *snapshot;
+
+	char *prefix;
+
+	/* The index of the next record to yield: */
+	size_t pos;
+
+	struct repository *repo;
+	unsigned int flags;
+};
+
+static int packed_delta_iterator_advance(struct ref_iterator *ref_iterator)
+{
+	struct packed_delta_iterator *iter =
+		(struct packed_delta_iterator *)ref_iterator;
+	struct delta_record *rec;
+
+	if (iter->pos >= iter->snapshot->delta_nr)
+		return ITER_DONE;
+
+	rec = &iter->snapshot->delta[iter->pos++];
+	if (iter->prefix && !starts_with(rec->refname, iter->prefix))
+		return ITER_DONE;
+
+	memset(&iter->base.ref, 0, sizeof(iter->base.ref));
+	iter->base.ref.name = rec->refname;
+	iter->base.ref.oid = &rec->oid;
+	iter->base.ref.flags = REF_ISPACKED;
+	if (rec->has_peeled) {
+		iter->base.ref.flags |= REF_KNOWS_PEELED;
+		iter->base.ref.peeled_oid = &rec->peeled;
+	}
+	return ITER_OK;
+}
+
+static int packed_delta_iterator_seek(struct ref_iterator *ref_iterator,
+				      const char *refname, unsigned int flags)
+{
+	struct packed_delta_iterator *iter =
+		(struct packed_delta_iterator *)ref_iterator;
+
+	FREE_AND_NULL(iter->prefix);
+	if (flags & REF_ITERATOR_SEEK_SET_PREFIX)
+		iter->prefix = xstrdup_or_null(refname);
+
+	iter->pos = refname ? delta_record_pos(iter->snapshot, refname) : 0;
+	return 0;
+}
+
+static void packed_delta_iterator_release(struct ref_iterator *ref_iterator)
+{
+	struct packed_delta_iterator *iter =
+		(struct packed_delta_iterator *)ref_iterator;
+	free(iter->prefix);
+	release_snapshot(iter->snapshot);
+}
+
+static struct ref_iterator_vtable packed_delta_iterator_vtable = {
+	.advance = packed_delta_iterator_advance,
+	.seek = packed_delta_iterator_seek,
+	.release = packed_delta_iterator_release,
+};
+
+/*
+ * Should the current record of `iter` be left out of the iteration?
+ * This applies the filters of `packed_ref_iterator_advance()`, which
+ * cannot be applied by the delta iterator itself because even a record
+ * that is not yielded still overrides the one in `packed-refs`.
+ */
+static int packed_delta_hidden(struct packed_delta_iterator *iter)
+{
+	const struct reference *ref = &iter->base.ref;
+
+	if (is_null_oid(ref->oid))
+		return 1;
+	if (iter->flags & REFS_FOR_EACH_PER_WORKTREE_ONLY &&
+	    !is_per_worktree_ref(ref->name))
+		return 1;
+	if (!(iter->flags & REFS_FOR_EACH_INCLUDE_BROKEN) &&
+	    !ref_resolves_to_object(ref->name, iter->repo, ref->oid,
+				    iter->flags))
+		return 1;
+	return 0;
+}
+
+/*
+ * Merge the delta records (iter0) into the records from `packed-refs`
+ * (iter1), letting the former win.
+ */
+static enum iterator_selection packed_delta_select(struct ref_iterator *iter0,
+						   struct ref_iterator *iter1,
+						   void *cb_data UNUSED)
+{
+	int cmp;
+
+	if (!iter0)
+		return iter1 ? ITER_SELECT_1 : ITER_SELECT_DONE;
+
+	cmp = iter1 ? strcmp(iter0->ref.name, iter1->ref.name) : -1;
+	if (cmp > 0)
+		return ITER_SELECT_1;
+	if (!cmp)
+		/* drop the overridden record, then look at ours again */
+		return ITER_SKIP_1;
+	if (packed_delta_hidden((struct packed_delta_iterator *)iter0))
+		return ITER_SKIP_0;
+	return ITER_SELECT_0;
+}
+
 static int jump_list_entry_cmp(const void *va, const void *vb)
 {
 	const struct jump_list_entry *a = va;
@@ -1214,6 +1597,25 @@ static struct ref_iterator *packed_ref_iterator_begin(
 		return NULL;
 	}
 
+	if (snapshot->delta_nr) {
+		struct packed_delta_iterator *delta;
+
+		CALLOC_ARRAY(delta, 1);
+		base_ref_iterator_init(&delta->base,
+				       &packed_delta_iterator_vtable);
+		delta->snapshot = snapshot;
+		acquire_snapshot(snapshot);
+		delta->repo = ref_store->repo;
+		delta->flags = flags;
+		packed_delta_iterator_seek(&delta->base, prefix,
+					   REF_ITERATOR_SEEK_SET_PREFIX);
+
+		ref_iterator = merge_ref_iterator_begin(&delta->base,
+							ref_iterator,
+							packed_delta_select,
+							NULL);
+	}
+
 	return ref_iterator;
 }
 
@@ -1302,6 +1704,19 @@ void packed_refs_unlock(struct ref_store *ref_store)
 	if (!is_lock_file_locked(&refs->lock))
 		BUG("packed_refs_unlock() called when not locked");
 	rollback_lock_file(&refs->lock);
+	refs->force_rewrite = 0;
+}
+
+void packed_refs_force_rewrite(struct ref_store *ref_store)
+{
+	struct packed_ref_store *refs = packed_downcast(
+			ref_store,
+			REF_STORE_READ | REF_STORE_WRITE,
+			"packed_refs_force_rewrite");
+
+	if (!is_lock_file_locked(&refs->lock))
+		BUG("packed_refs_force_rewrite() called when not locked");
+	refs->force_rewrite = 1;
 }
 
 int packed_refs_is_locked(struct ref_store *ref_store)
@@ -1332,6 +1747,46 @@ int packed_refs_size(struct ref_store *ref_store,
 	return 0;
 }
 
+static unsigned long packed_delta_size_max(struct packed_ref_store *refs)
+{
+	if (!refs->delta_size_configured) {
+		if (!refs->base.repo->repository_format_packed_refs_delta ||
+		    repo_config_get_ulong(refs->base.repo,
+					  "core.packedrefsdeltasize",
+					  &refs->delta_size_max))
+			refs->delta_size_max = 0;
+		refs->delta_size_configured = true;
+	}
+	return refs->delta_size_max;
+}
+
+/*
+ * Return how large the delta of `snapshot` may grow before we rewrite
+ * `packed-refs` instead. Past a quarter of the size of `packed-refs`,
+ * reading the delta on every access costs more than the rewrite saves.
+ */
+static size_t packed_delta_room(struct packed_ref_store *refs,
+				struct snapshot *snapshot)
+{
+	size_t max = packed_delta_size_max(refs);
+	size_t packed_size = snapshot->eof - snapshot->start;
+
+	if (!snapshot->delta_id)
+		return 0;
+	return max < packed_size / 4 ? max : packed_size / 4;
+}
+
+int packed_refs_delta_needs_fold(struct ref_store *ref_store)
+{
+	struct packed_ref_store *refs = packed_downcast(ref_store, REF_STORE_READ,
+							"packed_refs_delta_needs_fold");
+	struct snapshot *snapshot = get_snapshot(refs);
+
+	if (!snapshot->delta_len)
+		return 0;
+	return snapshot->delta_len > packed_delta_room(refs, snapshot) / 2;
+}
+
 /*
  * The packed-refs header line that we write out. Perhaps other traits
  * will be added later.
@@ -1356,6 +1811,11 @@ static int packed_ref_store_remove_on_disk(struct ref_store *ref_store,
 {
 	struct packed_ref_store *refs = packed_downcast(ref_store, 0, "remove");
 
+	if (remove_path(refs->delta_path) < 0) {
+		strbuf_addstr(err, "could not delete packed-refs.delta");
+		return -1;
+	}
+
 	if (remove_path(refs->path) < 0) {
 		strbuf_addstr(err, "could not delete packed-refs");
 		return -1;
@@ -1364,6 +1824,33 @@ static int packed_ref_store_remove_on_disk(struct ref_store *ref_store,
 	return 0;
 }
 
+/*
+ * Write the header of a new `packed-refs` file. If deltas are enabled,
+ * give the file a new identifier, so that no delta that was written
+ * for the file it replaces applies to it.
+ */
+static int write_packed_refs_header(struct packed_ref_store *refs, FILE *fh)
+{
+	unsigned char id[8];
+	struct strbuf sb = STRBUF_INIT;
+	int ret;
+
+	if (!packed_delta_size_max(refs) ||
+	    csprng_bytes(id, sizeof(id), 0) < 0)
+		return fprintf(fh, "%s", PACKED_REFS_HEADER) < 0 ? -1 : 0;
+
+	/* drop the LF, keeping the space that ends the last trait */
+	strbuf_add(&sb, PACKED_REFS_HEADER, strlen(PACKED_REFS_HEADER) - 1);
+	strbuf_addstr(&sb, "delta-id=");
+	for (size_t i = 0; i < sizeof(id); i++)
+		strbuf_addf(&sb, "%02x", id[i]);
+	strbuf_addstr(&sb, " \n");
+
+	ret = fprintf(fh, "%s", sb.buf) < 0 ? -1 : 0;
+	strbuf_release(&sb);
+	return ret;
+}
+
 /*
  * Write the packed refs from the current snapshot to the packed-refs
  * tempfile, incorporating any changes from `updates`. `updates` must
@@ -1414,7 +1901,7 @@ static enum ref_transaction_error write_with_updates(struct packed_ref_store *re
 		goto error;
 	}
 
-	if (fprintf(out, "%s", PACKED_REFS_HEADER) < 0)
+	if (write_packed_refs_header(refs, out) < 0)
 		goto write_error;
 
 	/*
@@ -1689,8 +2176,176 @@ int is_packed_transaction_needed(struct ref_store *ref_store,
 struct packed_transaction_backend_data {
 	/* True iff the transaction owns the packed-refs lock. */
 	int own_lock;
+
+	/*
+	 * True iff the transaction is to be appended to the delta file
+	 * rather than rewrite "packed-refs". `delta` holds the records
+	 * to append, after the first `delta_len` bytes of the current
+	 * delta file (or after a new header for `delta_id` if that is
+	 * zero). Both are taken from the snapshot the records were
+	 * checked against.
+	 */
+	int use_delta;
+	struct strbuf delta;
+	size_t delta_len;
+	char *delta_id;
 };
 
+/*
+ * Decide whether the updates of `transaction` can be appended to the
+ * delta file of the current snapshot. This errs on the side of
+ * rewriting "packed-refs", by assuming that every update writes a
+ * record.
+ */
+static int want_delta_updates(struct packed_ref_store *refs,
+			      struct ref_transaction *transaction)
+{
+	struct snapshot *snapshot = get_snapshot(refs);
+	size_t room = packed_delta_room(refs, snapshot);
+	size_t hexsz = refs->base.repo->hash_algo->hexsz;
+	size_t size = snapshot->delta_len;
+
+	if (refs->force_rewrite || !room || !transaction->nr)
+		return 0;
+
+	if (!size)
+		size = strlen(PACKED_REFS_DELTA_HEADER) +
+		       strlen(snapshot->delta_id) + 1;
+	size += strlen(PACKED_REFS_DELTA_END);
+	for (size_t i = 0; i < transaction->nr && size <= room; i++)
+		size += 2 * hexsz + strlen(transaction->updates[i]->refname) + 4;
+
+	return size <= room;
+}
+
+/*
+ * Check the updates in `transaction` against the current snapshot like
+ * `write_with_updates()` does, but write only the records of the
+ * references that change to `out`, to be appended to the delta file.
+ */
+static enum ref_transaction_error write_delta_updates(struct packed_ref_store *refs,
+						      struct ref_transaction *transaction,
+						      struct strbuf *out,
+						      struct strbuf *err)
+{
+	const struct git_hash_algo *algop = refs->base.repo->hash_algo;
+	struct string_list *updates = &transaction->refnames;
+	size_t i = 0;
+
+	while (i < updates->nr) {
+		struct ref_update *update = updates->items[i].util;
+		enum ref_transaction_error ret = 0;
+		struct object_id oid;
+		unsigned int type;
+		int failure_errno;
+		int exists;
+
+		exists = !packed_read_raw_ref(&refs->base, update->refname, &oid,
+					      NULL, &type, &failure_errno);
+
+		if ((update->flags & REF_HAVE_OLD)) {
+			if (exists && is_null_oid(&update->old_oid)) {
+				strbuf_addf(err, "cannot update ref '%s': "
+					    "reference already exists",
+					    update->refname);
+				ret = REF_TRANSACTION_ERROR_CREATE_EXISTS;
+			} else if (exists && !oideq(&update->old_oid, &oid)) {
+				strbuf_addf(err, "cannot update ref '%s': "
+					    "is at %s but expected %s",
+					    update->refname,
+					    oid_to_hex(&oid),
+					    oid_to_hex(&update->old_oid));
+				ret = REF_TRANSACTION_ERROR_INCORRECT_OLD_VALUE;
+			} else if (!exists && !is_null_oid(&update->old_oid)) {
+				strbuf_addf(err, "cannot update ref '%s': "
+					    "reference is missing but expected %s",
+					    update->refname,
+					    oid_to_hex(&update->old_oid));
+				ret = REF_TRANSACTION_ERROR_NONEXISTENT_REF;
+			}
+		}
+
+		if (ret) {
+			if (ref_transaction_maybe_set_rejected(transaction, i,
+							       ret, err))
+				continue;
+			return ret;
+		}
+
+		if ((update->flags & REF_HAVE_NEW)) {
+			if (!is_null_oid(&update->new_oid)) {
+				strbuf_addf(out, "%s %s\n",
+					    oid_to_hex(&update->new_oid),
+					    update->refname);
+				if ((update->flags & REF_HAVE_PEELED))
+					strbuf_addf(out, "^%s\n",
+						    oid_to_hex(&update->peeled));
+			} else if (exists) {
+				strbuf_addf(out, "%s %s\n",
+					    oid_to_hex(null_oid(algop)),
+					    update->refname);
+			}
+		}
+		i++;
+	}
+
+	return 0;
+}
+
+/*
+ * Append the records prepared by `write_delta_updates()` to the delta
+ * file as one transaction. Readers ignore a transaction until its
+ * terminator is written, and the next writer cuts off whatever part of
+ * it made it to disk if we fail halfway.
+ */
+static int append_delta(struct packed_ref_store *refs,
+			struct packed_transaction_backend_data *data,
+			struct strbuf *err)
+{
+	struct strbuf sb = STRBUF_INIT;
+	int fd, ret = -1;
+
+	fd = open(refs->delta_path, O_RDWR | O_CREAT, 0666);
+	if (fd < 0) {
+		strbuf_addf(err, "unable to open %s: %s",
+			    refs->delta_path, strerror(errno));
+		return -1;
+	}
+
+	if (!data->delta_len)
+		strbuf_addf(&sb, "%s%s\n", PACKED_REFS_DELTA_HEADER,
+			    data->delta_id);
+	strbuf_addbuf(&sb, &data->delta);
+	strbuf_addstr(&sb, PACKED_REFS_DELTA_END);
+
+	if (ftruncate(fd, data->delta_len) < 0 ||
+	    lseek(fd, data->delta_len, SEEK_SET) < 0 ||
+	    write_in_full(fd, sb.buf, sb.len) < 0 ||
+	    fsync_component(FSYNC_COMPONENT_REFERENCE, fd)) {
+		strbuf_addf(err, "error writing to %s: %s",
+			    refs->delta_path, strerror(errno));
+		goto cleanup;
+	}
+
+	if (!data->delta_len &&
+	    adjust_shared_perm(refs->base.repo, refs->delta_path)) {
+		strbuf_addf(err, "unable to adjust permissions of %s",
+			    refs->delta_path);
+		goto cleanup;
+	}
+
+	ret = 0;
+
+cleanup:
+	if (close(fd) < 0 && !ret) {
+		strbuf_addf(err, "error closing %s: %s",
+			    refs->delta_path, strerror(errno));
+		ret = -1;
+	}
+	strbuf_release(&sb);
+	return ret;
+}
+
 static void packed_transaction_cleanup(struct packed_ref_store *refs,
 				       struct ref_transaction *transaction)
 {
@@ -1705,6 +2360,8 @@ static void packed_transaction_cleanup(struct packed_ref_store *refs,
 			data->own_lock = 0;
 		}
 
+		strbuf_release(&data->delta);
+		free(data->delta_id);
 		free(data);
 		transaction->backend_data = NULL;
 	}
@@ -1733,6 +2390,7 @@ static int packed_transaction_prepare(struct ref_store *ref_store,
 	 */
 
 	CALLOC_ARRAY(data, 1);
+	strbuf_init(&data->delta, 0);
 
 	transaction->backend_data = data;
 
@@ -1742,7 +2400,14 @@ static int packed_transaction_prepare(struct ref_store *ref_store,
 		data->own_lock = 1;
 	}
 
-	ret = write_with_updates(refs, transaction, err);
+	if (want_delta_updates(refs, transaction)) {
+		data->use_delta = 1;
+		data->delta_len = refs->snapshot->delta_len;
+		data->delta_id = xstrdup(refs->snapshot->delta_id);
+		ret = write_delta_updates(refs, transaction, &data->delta, err);
+	} else {
+		ret = write_with_updates(refs, transaction, err);
+	}
 	if (ret)
 		goto failure;
 
@@ -1775,8 +2440,16 @@ static int packed_transaction_finish(struct ref_store *ref_store,
 			ref_store,
 			REF_STORE_READ | REF_STORE_WRITE | REF_STORE_ODB,
 			"ref_transaction_finish");
+	struct packed_transaction_backend_data *data = transaction->backend_data;
 	int ret = REF_TRANSACTION_ERROR_GENERIC;
-	char *packed_refs_path;
+	char *packed_refs_path = NULL;
+
+	if (data->use_delta) {
+		if (!data->delta.len || !append_delta(refs, data, err))
+			ret = 0;
+		clear_snapshot(refs);
+		goto cleanup;
+	}
 
 	clear_snapshot(refs);
 
@@ -1787,6 +2460,12 @@ static int packed_transaction_finish(struct ref_store *ref_store,
 		goto cleanup;
 	}
 
+	/*
+	 * The new file holds the records of the delta, which no longer
+	 * applies because its identifier differs; see `load_delta()`.
+	 */
+	unlink_or_warn(refs->delta_path);
+
 	ret = 0;
 
 cleanup:
@@ -36,6 +36,20 @@ int packed_refs_is_locked(struct ref_store *ref_store);
 int packed_refs_size(struct ref_store *ref_store,
 		     size_t *out);
 
+/*
+ * Make the next transaction against the locked `ref_store` rewrite the
+ * whole `packed-refs` file, folding the records of `packed-refs.delta`
+ * into it, even if it could have been appended to the delta. This
+ * lasts until the store is unlocked.
+ */
+void packed_refs_force_rewrite(struct ref_store *ref_store);
+
+/*
+ * Return true if `packed-refs.delta` has grown large enough that it
+ * should be folded back into `packed-refs` when optimizing references.
+ */
+int packed_refs_delta_needs_fold(struct ref_store *ref_store);
+
 /*
  * Return true if `transaction` really needs to be carried out against
  * the specified packed_ref_store, or false if it can be skipped
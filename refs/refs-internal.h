@@ -560,6 +560,20 @@ typedef int read_raw_ref_fn(struct ref_store *ref_store, const char *refname,
 typedef int read_symbolic_ref_fn(struct ref_store *ref_store, const char *refname,
 				 struct strbuf *referent);
 
+/*
+ * Call `fn` for each direct reference whose object ID or peeled object ID
+ * is `oid`. This function is optional: if not implemented by a backend,
+ * all references are iterated over instead. It is intended to be
+ * implemented only in case the backend can look up references by object
+ * ID without doing so.
+ *
+ * Please refer to `refs_for_each_ref_pointing_at()` for the expected
+ * behaviour.
+ */
+typedef int for_each_ref_pointing_at_fn(struct ref_store *ref_store,
+					const struct object_id *oid,
+					refs_for_each_cb fn, void *cb_data);
+
 typedef int fsck_fn(struct ref_store *ref_store,
 		    struct fsck_options *o,
 		    struct worktree *wt);
@@ -588,6 +602,7 @@ struct ref_storage_be {
 	 * behaviour.
 	 */
 	read_symbolic_ref_fn *read_symbolic_ref;
+	for_each_ref_pointing_at_fn *for_each_ref_pointing_at;
 
 	reflog_iterator_begin_fn *reflog_iterator_begin;
 	for_each_reflog_ent_fn *for_each_reflog_ent;
@@ -17,6 +17,7 @@
 #include "../reftable/reftable-error.h"
 #include "../reftable/reftable-fsck.h"
 #include "../reftable/reftable-iterator.h"
+#include "../reftable/reftable-merged.h"
 #include "../reftable/reftable-record.h"
 #include "../reftable/reftable-stack.h"
 #include "../repo-settings.h"
@@ -36,6 +37,8 @@
 struct reftable_backend {
 	struct reftable_stack *stack;
 	struct reftable_iterator it;
+	/* compaction statistics as of the start of the current compaction */
+	struct reftable_compaction_stats compaction_stats;
 };
 
 static void reftable_backend_on_reload(void *payload)
@@ -44,6 +47,29 @@ static void reftable_backend_on_reload(void *payload)
 	reftable_iterator_destroy(&be->it);
 }
 
+static void reftable_backend_on_compaction_begin(void *payload)
+{
+	struct reftable_backend *be = payload;
+	be->compaction_stats = *reftable_stack_compaction_stats(be->stack);
+	trace2_region_enter("reftable", "compaction", NULL);
+}
+
+static void reftable_backend_on_compaction_end(void *payload, int err)
+{
+	struct reftable_backend *be = payload;
+	struct reftable_compaction_stats *stats =
+		reftable_stack_compaction_stats(be->stack);
+
+	trace2_data_intmax("reftable", NULL, "compaction/bytes",
+			   stats->bytes - be->compaction_stats.bytes);
+	trace2_data_intmax("reftable", NULL, "compaction/entries",
+			   stats->entries_written - be->compaction_stats.entries_written);
+	if (err)
+		trace2_data_string("reftable", NULL, "compaction/error",
+				   reftable_error_str(err));
+	trace2_region_leave("reftable", "compaction", NULL);
+}
+
 static int reftable_backend_init(struct reftable_backend *be,
 				 const char *path,
 				 const struct reftable_stack_options *_opts)
@@ -51,6 +77,9 @@ static int reftable_backend_init(struct reftable_backend *be,
 	struct reftable_stack_options opts = *_opts;
 	opts.on_reload = reftable_backend_on_reload;
 	opts.on_reload_payload = be;
+	opts.on_compaction_begin = reftable_backend_on_compaction_begin;
+	opts.on_compaction_end = reftable_backend_on_compaction_end;
+	opts.on_compaction_payload = be;
 	return reftable_new_stack(&be->stack, path, &opts);
 }
 
@@ -150,6 +179,7 @@ struct reftable_ref_store {
 	struct reftable_be_write_options {
 		struct reftable_write_options opts;
 		enum log_refs_config log_all_ref_updates;
+		bool optimistic_writes;
 		bool initialized;
 	} write_opts_lazy_loaded;
 
@@ -351,6 +381,13 @@ static int reftable_be_config(const char *var, const char *value,
 		if (lock_timeout < 0 && lock_timeout != -1)
 			die("reftable lock timeout does not support negative values other than -1");
 		opts->opts.lock_timeout_ms = lock_timeout;
+	} else if (!strcmp(var, "reftable.defercompaction")) {
+		opts->opts.defer_auto_compact = git_config_bool(var, value);
+	} else if (!strcmp(var, "reftable.maxtables")) {
+		opts->opts.deferred_compaction_tables =
+			git_config_ulong(var, value, ctx->kvi);
+	} else if (!strcmp(var, "reftable.optimisticwrites")) {
+		opts->optimistic_writes = git_config_bool(var, value);
 	} else if (!strcmp(var, "core.logallrefupdates")) {
 		opts->log_all_ref_updates = refs_parse_log_all_ref_updates_config(value);
 	}
@@ -933,6 +970,125 @@ static int reftable_be_read_symbolic_ref(struct ref_store *ref_store,
 	return ret;
 }
 
+struct ref_pointing_at {
+	char *refname;
+	struct object_id oid;
+	struct object_id peeled_oid;
+	unsigned has_peeled : 1;
+};
+
+struct collect_refs_pointing_at_arg {
+	const struct git_hash_algo *algo;
+	/*
+	 * Whether to skip per-worktree references, which in the main stack
+	 * belong to the main worktree when we are in a different one.
+	 */
+	int shared_only;
+	struct ref_pointing_at *refs;
+	size_t refs_nr, refs_alloc;
+};
+
+static int collect_ref_pointing_at(const struct reftable_ref_record *ref,
+				   void *cb_data)
+{
+	struct collect_refs_pointing_at_arg *arg = cb_data;
+	struct ref_pointing_at *r;
+
+	/* Emulate the files backend, same as `reftable_ref_iterator_advance()`. */
+	if (!starts_with(ref->refname, "refs/") ||
+	    check_refname_format(ref->refname, REFNAME_ALLOW_ONELEVEL))
+		return 0;
+	if (arg->shared_only &&
+	    parse_worktree_ref(ref->refname, NULL, NULL, NULL) != REF_WORKTREE_SHARED)
+		return 0;
+
+	ALLOC_GROW(arg->refs, arg->refs_nr + 1, arg->refs_alloc);
+	r = &arg->refs[arg->refs_nr++];
+	r->refname = xstrdup(ref->refname);
+	oidread(&r->oid, reftable_ref_record_val1(ref), arg->algo);
+	r->has_peeled = ref->value_type == REFTABLE_REF_VAL2;
+	if (r->has_peeled)
+		oidread(&r->peeled_oid, reftable_ref_record_val2(ref), arg->algo);
+
+	return 0;
+}
+
+static int collect_refs_pointing_at(struct collect_refs_pointing_at_arg *arg,
+				    struct reftable_stack *stack,
+				    const struct object_id *oid)
+{
+	int ret;
+
+	ret = reftable_stack_reload(stack);
+	if (!ret)
+		ret = reftable_merged_table_refs_for(reftable_stack_merged_table(stack),
+						     oid->hash, collect_ref_pointing_at,
+						     arg);
+	if (ret < 0)
+		return error(_("unable to look up references by object ID: %s"),
+			     reftable_error_str(ret));
+	return 0;
+}
+
+static int ref_pointing_at_cmp(const void *a, const void *b)
+{
+	const struct ref_pointing_at *r1 = a, *r2 = b;
+	return strcmp(r1->refname, r2->refname);
+}
+
+static int reftable_be_for_each_ref_pointing_at(struct ref_store *ref_store,
+						const struct object_id *oid,
+						refs_for_each_cb fn,
+						void *cb_data)
+{
+	struct reftable_ref_store *refs =
+		reftable_be_downcast(ref_store, REF_STORE_READ | REF_STORE_ODB,
+				     "for_each_ref_pointing_at");
+	struct collect_refs_pointing_at_arg arg = {
+		.algo = refs->base.repo->hash_algo,
+	};
+	int ret;
+
+	if (refs->err)
+		return refs->err;
+
+	if (refs->worktree_backend.stack) {
+		ret = collect_refs_pointing_at(&arg, refs->worktree_backend.stack, oid);
+		if (ret)
+			goto done;
+		arg.shared_only = 1;
+	}
+
+	ret = collect_refs_pointing_at(&arg, refs->main_backend.stack, oid);
+	if (ret)
+		goto done;
+
+	QSORT(arg.refs, arg.refs_nr, ref_pointing_at_cmp);
+
+	for (size_t i = 0; i < arg.refs_nr; i++) {
+		struct ref_pointing_at *r = &arg.refs[i];
+		struct reference ref = {
+			.name = r->refname,
+			.oid = &r->oid,
+			.peeled_oid = r->has_peeled ? &r->peeled_oid : NULL,
+		};
+
+		if (!ref_resolves_to_object(r->refname, refs->base.repo,
+					    &r->oid, 0))
+			continue;
+
+		ret = fn(&ref, cb_data);
+		if (ret)
+			goto done;
+	}
+
+done:
+	for (size_t i = 0; i < arg.refs_nr; i++)
+		free(arg.refs[i].refname);
+	free(arg.refs);
+	return ret;
+}
+
 struct reftable_transaction_update {
 	struct ref_update *update;
 	struct object_id current_oid;
@@ -952,6 +1108,7 @@ struct write_transaction_table_arg {
 struct reftable_transaction_data {
 	struct write_transaction_table_arg *args;
 	size_t args_nr, args_alloc;
+	bool optimistic;
 };
 
 static void free_transaction_data(struct reftable_transaction_data *tx_data)
@@ -1000,11 +1157,22 @@ static int prepare_transaction_update(struct write_transaction_table_arg **out,
 			arg = &tx_data->args[i];
 
 	if (!arg) {
+		const struct reftable_be_write_options *opts =
+			reftable_be_write_options(refs);
+		unsigned int flags = REFTABLE_STACK_NEW_ADDITION_RELOAD;
 		struct reftable_addition *addition;
 
+		/*
+		 * With optimistic writes, the stack is only locked once the
+		 * transaction is committed. The checks below then run
+		 * against a stack that may still change, and the commit
+		 * fails if it changed any of the references we update.
+		 */
+		if (tx_data->optimistic)
+			flags |= REFTABLE_STACK_NEW_ADDITION_OPTIMISTIC;
+
 		ret = reftable_stack_new_addition(&addition, be->stack,
-						  &reftable_be_write_options(refs)->opts,
-						  REFTABLE_STACK_NEW_ADDITION_RELOAD);
+						  &opts->opts, flags);
 		if (ret) {
 			if (ret == REFTABLE_LOCK_ERROR)
 				strbuf_addstr(err, "cannot lock references");
@@ -1313,6 +1481,23 @@ static enum ref_transaction_error prepare_single_update(struct reftable_ref_stor
 	return 0;
 }
 
+/*
+ * Whether the update checks the old value of a reference without
+ * writing a new value for it. Nothing in the new tables records such
+ * checks, so an optimistic addition could not tell at commit time that
+ * a concurrent writer invalidated them.
+ */
+static bool ref_update_is_verify_only(const struct ref_update *u)
+{
+	if (!(u->flags & REF_HAVE_OLD))
+		return false;
+	if (!(u->flags & REF_HAVE_NEW))
+		return true;
+	/* Old and new value are the same, so it is skipped as a no-op. */
+	return !u->new_target && !u->old_target &&
+	       oideq(&u->old_oid, &u->new_oid);
+}
+
 static int reftable_be_transaction_prepare(struct ref_store *ref_store,
 					   struct ref_transaction *transaction,
 					   struct strbuf *err)
@@ -1334,6 +1519,16 @@ static int reftable_be_transaction_prepare(struct ref_store *ref_store,
 
 	tx_data = xcalloc(1, sizeof(*tx_data));
 
+	/*
+	 * Optimistic writes only recheck the references written by the
+	 * transaction when it is committed. Transactions that merely
+	 * verify some of their references lock the stacks upfront.
+	 */
+	tx_data->optimistic = reftable_be_write_options(refs)->optimistic_writes;
+	for (i = 0; tx_data->optimistic && i < transaction->nr; i++)
+		if (ref_update_is_verify_only(transaction->updates[i]))
+			tx_data->optimistic = false;
+
 	/*
 	 * Preprocess all updates. For one we check that there are no duplicate
 	 * reference updates in this transaction. Second, we lock all stacks
@@ -1690,7 +1885,11 @@ static int reftable_be_transaction_finish(struct ref_store *ref_store UNUSED,
 	free_transaction_data(tx_data);
 	transaction->state = REF_TRANSACTION_CLOSED;
 
-	if (ret) {
+	if (ret == REFTABLE_OUTDATED_ERROR) {
+		strbuf_addstr(err, _("cannot update references: "
+				     "they were modified concurrently"));
+		return -1;
+	} else if (ret) {
 		strbuf_addf(err, _("reftable: transaction failure: %s"),
 			    reftable_error_str(ret));
 		return -1;
@@ -2885,6 +3084,7 @@ struct ref_storage_be refs_be_reftable = {
 	.iterator_begin = reftable_be_iterator_begin,
 	.read_raw_ref = reftable_be_read_raw_ref,
 	.read_symbolic_ref = reftable_be_read_symbolic_ref,
+	.for_each_ref_pointing_at = reftable_be_for_each_ref_pointing_at,
 
 	.reflog_iterator_begin = reftable_be_reflog_iterator_begin,
 	.for_each_reflog_ent = reftable_be_for_each_reflog_ent,
@@ -516,6 +516,25 @@ void block_iter_close(struct block_iter *it)
 	reftable_buf_release(&it->scratch);
 }
 
+int block_contains_key(const struct reftable_block *block,
+		       struct reftable_buf *key)
+{
+	struct restart_needle_less_args args = {
+		.needle = *key,
+		.block = block,
+	};
+	size_t i;
+
+	/*
+	 * We only know the keys at restart points, so we cannot tell whether
+	 * a key past the last restart point is still contained in the block.
+	 */
+	i = binsearch(block->restart_count, &restart_needle_less, &args);
+	if (args.error)
+		return REFTABLE_FORMAT_ERROR;
+	return i > 0 && i < block->restart_count;
+}
+
 int block_iter_seek_key(struct block_iter *it, struct reftable_buf *want)
 {
 	struct restart_needle_less_args args = {
@@ -577,22 +596,28 @@ int block_iter_seek_key(struct block_iter *it, struct reftable_buf *want)
 	 * record. We thus don't want to position our iterator at the sought
 	 * after record, but one before. To do so, we have to go one entry too
 	 * far and then back up.
+	 *
+	 * Only the keys matter here, so we skip over the values of records
+	 * instead of decoding them, which would copy their contents.
 	 */
 	while (1) {
+		struct string_view in = {
+			.buf = (unsigned char *) it->block->block_data.data + it->next_off,
+			.len = it->block->restart_off - it->next_off,
+		};
 		size_t prev_off = it->next_off;
+		uint8_t extra = 0;
+		int n;
 
-		err = block_iter_next(it, &rec);
-		if (err < 0)
+		if (it->next_off >= it->block->restart_off)
 			goto done;
-		if (err > 0) {
-			it->next_off = prev_off;
-			err = 0;
-			goto done;
-		}
 
-		err = reftable_record_key(&rec, &it->last_key);
-		if (err < 0)
+		n = reftable_decode_key(&it->last_key, &extra, in);
+		if (n < 0 || !it->last_key.len) {
+			err = REFTABLE_FORMAT_ERROR;
 			goto done;
+		}
+		string_view_consume(&in, n);
 
 		/*
 		 * Check whether the current key is greater or equal to the
@@ -612,6 +637,15 @@ int block_iter_seek_key(struct block_iter *it, struct reftable_buf *want)
 			it->next_off = prev_off;
 			goto done;
 		}
+
+		n = reftable_record_skip(&rec, extra, in, it->block->hash_size);
+		if (n < 0) {
+			err = REFTABLE_FORMAT_ERROR;
+			goto done;
+		}
+		string_view_consume(&in, n);
+
+		it->next_off = it->block->restart_off - in.len;
 	}
 
 done:
@@ -97,6 +97,15 @@ void block_iter_seek_start(struct block_iter *it);
  */
 int block_iter_seek_key(struct block_iter *it, struct reftable_buf *want);
 
+/*
+ * Check whether `key` sorts between the first and the last restart point of
+ * the block, in which case its record must be located in this block if it
+ * exists at all. Returns 1 if so, 0 if the record may be located in another
+ * block and a negative error code on error.
+ */
+int block_contains_key(const struct reftable_block *block,
+		       struct reftable_buf *key);
+
 /* return < 0 for error, 0 for OK, > 0 for EOF. */
 int block_iter_next(struct block_iter *it, struct reftable_record *rec);
 
@@ -14,5 +14,6 @@
 #define MAX_RESTARTS ((1 << 16) - 1)
 #define DEFAULT_BLOCK_SIZE 4096
 #define DEFAULT_GEOMETRIC_FACTOR 2
+#define DEFAULT_DEFERRED_COMPACTION_TABLES 64
 
 #endif
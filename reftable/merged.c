@@ -314,3 +314,77 @@ enum reftable_hash reftable_merged_table_hash_id(struct reftable_merged_table *m
 {
 	return mt->hash_id;
 }
+
+static int ref_record_points_at(const struct reftable_ref_record *ref,
+				const uint8_t *oid, uint32_t hash_len)
+{
+	const unsigned char *value = reftable_ref_record_val1(ref);
+	const unsigned char *peeled = reftable_ref_record_val2(ref);
+
+	return (value && !memcmp(value, oid, hash_len)) ||
+	       (peeled && !memcmp(peeled, oid, hash_len));
+}
+
+int reftable_merged_table_refs_for(struct reftable_merged_table *mt,
+				   const uint8_t *oid,
+				   int (*fn)(const struct reftable_ref_record *ref,
+					     void *arg),
+				   void *arg)
+{
+	struct reftable_iterator candidates = { 0 }, it = { 0 };
+	struct reftable_ref_record candidate = { 0 }, ref = { 0 };
+	uint32_t hash_len = hash_size(mt->hash_id);
+	int err;
+
+	err = merged_table_init_iter(mt, &it, REFTABLE_BLOCK_TYPE_REF);
+	if (err < 0)
+		goto out;
+
+	for (size_t i = mt->tables_len; i > 0; i--) {
+		err = reftable_table_refs_for(mt->tables[i - 1], &candidates,
+					      (uint8_t *)oid);
+		if (err < 0)
+			goto out;
+
+		while (1) {
+			err = reftable_iterator_next_ref(&candidates, &candidate);
+			if (err > 0)
+				break;
+			if (err < 0)
+				goto out;
+
+			if (!ref_record_points_at(&candidate, oid, hash_len))
+				continue;
+
+			/*
+			 * The reference may have been updated or deleted by a
+			 * newer table. As update indices of different tables
+			 * never overlap, the candidate is still current if and
+			 * only if it is the record the merged table yields.
+			 */
+			err = reftable_iterator_seek_ref(&it, candidate.refname);
+			if (!err)
+				err = reftable_iterator_next_ref(&it, &ref);
+			if (err < 0)
+				goto out;
+			if (err > 0 || strcmp(ref.refname, candidate.refname) ||
+			    ref.update_index != candidate.update_index)
+				continue;
+
+			err = fn(&candidate, arg);
+			if (err)
+				goto out;
+		}
+
+		reftable_iterator_destroy(&candidates);
+	}
+
+	err = 0;
+
+out:
+	reftable_iterator_destroy(&candidates);
+	reftable_iterator_destroy(&it);
+	reftable_ref_record_release(&candidate);
+	reftable_ref_record_release(&ref);
+	return err;
+}
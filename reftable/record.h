@@ -61,6 +61,13 @@ struct reftable_record_vtable {
 		      struct string_view src, uint32_t hash_size,
 		      struct reftable_buf *scratch);
 
+	/*
+	 * Skip over a record's value in `src` without decoding it, returning
+	 * the number of bytes skipped. This is cheaper than `decode` when we
+	 * only care about the record's key.
+	 */
+	int (*skip)(uint8_t extra, struct string_view src, uint32_t hash_size);
+
 	/* deallocate and null the record. */
 	void (*release)(void *rec);
 
@@ -145,6 +152,8 @@ int reftable_record_encode(struct reftable_record *rec, struct string_view dest,
 int reftable_record_decode(struct reftable_record *rec, struct reftable_buf key,
 			   uint8_t extra, struct string_view src,
 			   uint32_t hash_size, struct reftable_buf *scratch);
+int reftable_record_skip(struct reftable_record *rec, uint8_t extra,
+			 struct string_view src, uint32_t hash_size);
 int reftable_record_is_deletion(struct reftable_record *rec);
 
 static inline uint8_t reftable_record_type(struct reftable_record *rec)
@@ -59,4 +59,19 @@ void reftable_merged_table_free(struct reftable_merged_table *m);
 /* return the hash ID of the merged table. */
 enum reftable_hash reftable_merged_table_hash_id(struct reftable_merged_table *m);
 
+/*
+ * Call `fn` for each ref record whose value or peeled value is `oid`. Records
+ * that are shadowed by a newer table are not reported, so that every reference
+ * is reported at most once. Uses the object index of tables that have one.
+ * Records are reported in no particular order.
+ *
+ * Returns 0 on success, a negative error code on failure, or the non-zero
+ * value returned by `fn`, which stops the iteration.
+ */
+int reftable_merged_table_refs_for(struct reftable_merged_table *mt,
+				   const uint8_t *oid,
+				   int (*fn)(const struct reftable_ref_record *ref,
+					     void *arg),
+				   void *arg);
+
 #endif
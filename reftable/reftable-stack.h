@@ -43,6 +43,16 @@ struct reftable_stack_options {
 	void (*on_reload)(void *payload);
 	void *on_reload_payload;
 
+	/*
+	 * Callback functions to execute before and after the stack compacts
+	 * some of its tables, e.g. to measure how long compaction takes.
+	 * `err` is the result of the compaction. The payload data will be
+	 * passed as argument to the callbacks.
+	 */
+	void (*on_compaction_begin)(void *payload);
+	void (*on_compaction_end)(void *payload, int err);
+	void *on_compaction_payload;
+
 	int suppress_deletions;
 };
 
@@ -63,12 +73,27 @@ enum {
 	 * Reload the stack when the stack is out-of-date after locking it.
 	 */
 	REFTABLE_STACK_NEW_ADDITION_RELOAD = (1 << 0),
+
+	/*
+	 * Do not lock the stack until the addition is committed, so that
+	 * concurrent additions can write their tables at the same time.
+	 * When the stack has grown in the meantime, the addition is
+	 * rebased onto it by running the `write_table` callbacks given to
+	 * `reftable_addition_add()` again, which must thus remain valid
+	 * until the addition is committed or destroyed. This also works
+	 * when the stack has been compacted. Committing fails with
+	 * `REFTABLE_OUTDATED_ERROR` instead if a concurrent addition
+	 * changed or deleted a reference that the addition writes a
+	 * record for, or created one whose name conflicts with it as a
+	 * directory.
+	 */
+	REFTABLE_STACK_NEW_ADDITION_OPTIMISTIC = (1 << 1),
 };
 
 /*
  * returns a new transaction to add reftables to the given stack. As a side
- * effect, the ref database is locked. Accepts REFTABLE_STACK_NEW_ADDITION_*
- * flags.
+ * effect, the ref database is locked, unless the addition is optimistic.
+ * Accepts REFTABLE_STACK_NEW_ADDITION_* flags.
  */
 int reftable_stack_new_addition(struct reftable_addition **dest,
 				struct reftable_stack *st,
@@ -82,7 +107,9 @@ int reftable_addition_add(struct reftable_addition *add,
 			  void *arg);
 
 /* Commits the transaction, releasing the lock. After calling this,
- * reftable_addition_destroy should still be called.
+ * reftable_addition_destroy should still be called. An optimistic
+ * addition takes the lock here, and may fail with
+ * REFTABLE_OUTDATED_ERROR, see REFTABLE_STACK_NEW_ADDITION_OPTIMISTIC.
  */
 int reftable_addition_commit(struct reftable_addition *add);
 
@@ -45,6 +45,20 @@ struct reftable_write_options {
 	 */
 	uint8_t auto_compaction_factor;
 
+	/*
+	 * boolean: Defer auto-compaction. Committing an addition then only
+	 * compacts the stack once it has more than `deferred_compaction_tables`
+	 * tables. The caller is expected to call `reftable_stack_auto_compact()`
+	 * at a more convenient time instead.
+	 */
+	unsigned defer_auto_compact : 1;
+
+	/*
+	 * The number of tables beyond which deferred auto-compaction is
+	 * performed by writers anyway. Defaults to 64 if unset.
+	 */
+	size_t deferred_compaction_tables;
+
 	/*
 	 * The number of milliseconds to wait when trying to lock "tables.list".
 	 * Note that this does not apply to locking individual tables, as these
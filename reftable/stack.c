@@ -627,6 +627,11 @@ int reftable_stack_reload(struct reftable_stack *st)
 	return err;
 }
 
+struct addition_write {
+	int (*write_table)(struct reftable_writer *wr, void *arg);
+	void *arg;
+};
+
 struct reftable_addition {
 	struct reftable_flock tables_list_lock;
 	struct reftable_stack *stack;
@@ -635,9 +640,40 @@ struct reftable_addition {
 	char **new_tables;
 	size_t new_tables_len, new_tables_cap;
 	uint64_t next_update_index;
+
+	/*
+	 * For optimistic additions, the callbacks that wrote the new
+	 * tables, to write them again on top of a stack that has grown,
+	 * and the tables they were written against. The latter are kept
+	 * open, so that they can still be read when a concurrent writer
+	 * has compacted them away, and are only merged when needed.
+	 */
+	unsigned optimistic : 1;
+	struct addition_write *writes;
+	size_t writes_len, writes_cap;
+	struct reftable_table **base_tables;
+	size_t base_tables_len;
+	struct reftable_merged_table *base;
 };
 
-static void reftable_addition_close(struct reftable_addition *add)
+static int stack_lock_tables_list(struct reftable_addition *add)
+{
+	int err;
+
+	err = flock_acquire(&add->tables_list_lock, add->stack->list_file,
+			    add->opts.lock_timeout_ms);
+	if (err < 0)
+		return err;
+
+	if (add->opts.default_permissions &&
+	    chmod(add->tables_list_lock.path,
+		  add->opts.default_permissions) < 0)
+		return REFTABLE_IO_ERROR;
+
+	return 0;
+}
+
+static void reftable_addition_drop_tables(struct reftable_addition *add)
 {
 	struct reftable_buf nm = REFTABLE_BUF_INIT;
 	size_t i;
@@ -653,10 +689,27 @@ static void reftable_addition_close(struct reftable_addition *add)
 	add->new_tables_len = 0;
 	add->new_tables_cap = 0;
 
-	flock_release(&add->tables_list_lock);
 	reftable_buf_release(&nm);
 }
 
+static void reftable_addition_close(struct reftable_addition *add)
+{
+	reftable_addition_drop_tables(add);
+	reftable_free(add->writes);
+	add->writes = NULL;
+	add->writes_len = 0;
+	add->writes_cap = 0;
+	reftable_merged_table_free(add->base);
+	add->base = NULL;
+	for (size_t i = 0; i < add->base_tables_len; i++)
+		reftable_table_decref(add->base_tables[i]);
+	reftable_free(add->base_tables);
+	add->base_tables = NULL;
+	add->base_tables_len = 0;
+
+	flock_release(&add->tables_list_lock);
+}
+
 static int reftable_stack_init_addition(struct reftable_addition *add,
 					struct reftable_stack *st,
 					const struct reftable_write_options *opts,
@@ -666,21 +719,16 @@ static int reftable_stack_init_addition(struct reftable_addition *add,
 	int err;
 
 	memset(add, 0, sizeof(*add));
+	add->tables_list_lock = REFTABLE_FLOCK_INIT;
 	add->stack = st;
 	if (opts)
 		add->opts = *opts;
+	add->optimistic = !!(flags & REFTABLE_STACK_NEW_ADDITION_OPTIMISTIC);
 
-	err = flock_acquire(&add->tables_list_lock, st->list_file,
-			    add->opts.lock_timeout_ms);
-	if (err < 0)
-		goto done;
-
-	if (add->opts.default_permissions) {
-		if (chmod(add->tables_list_lock.path,
-			  add->opts.default_permissions) < 0) {
-			err = REFTABLE_IO_ERROR;
+	if (!add->optimistic) {
+		err = stack_lock_tables_list(add);
+		if (err < 0)
 			goto done;
-		}
 	}
 
 	err = stack_uptodate(st);
@@ -697,6 +745,19 @@ static int reftable_stack_init_addition(struct reftable_addition *add,
 	}
 
 	add->next_update_index = reftable_stack_next_update_index(st);
+
+	if (add->optimistic && st->merged->tables_len) {
+		REFTABLE_CALLOC_ARRAY(add->base_tables, st->merged->tables_len);
+		if (!add->base_tables) {
+			err = REFTABLE_OUT_OF_MEMORY_ERROR;
+			goto done;
+		}
+		for (size_t i = 0; i < st->merged->tables_len; i++) {
+			add->base_tables[i] = st->tables[i];
+			reftable_table_incref(add->base_tables[i]);
+		}
+		add->base_tables_len = st->merged->tables_len;
+	}
 done:
 	if (err)
 		reftable_addition_close(add);
@@ -767,6 +828,362 @@ void reftable_addition_destroy(struct reftable_addition *add)
 	reftable_free(add);
 }
 
+/*
+ * Return 1 if the record of `refname` in the stack was written at or
+ * after `update_index`, 0 if not, or a negative error code. With
+ * `creation` set, only count records that create the reference.
+ */
+static int stack_ref_changed_since(struct reftable_stack *st,
+				   const char *refname, uint64_t update_index,
+				   int creation)
+{
+	struct reftable_ref_record ref = { 0 };
+	struct reftable_iterator it = { 0 };
+	int err;
+
+	err = reftable_merged_table_init_ref_iterator(st->merged, &it);
+	if (err < 0)
+		goto done;
+	err = reftable_iterator_seek_ref(&it, refname);
+	if (err < 0)
+		goto done;
+	err = reftable_iterator_next_ref(&it, &ref);
+	if (err) {
+		if (err > 0)
+			err = 0;
+		goto done;
+	}
+
+	err = !strcmp(ref.refname, refname) &&
+	      ref.update_index >= update_index &&
+	      !(creation && reftable_ref_record_is_deletion(&ref));
+
+done:
+	reftable_ref_record_release(&ref);
+	reftable_iterator_destroy(&it);
+	return err;
+}
+
+/*
+ * Return 1 if a reference below the directory `refname` was created in
+ * the stack at or after `update_index`, 0 if not, or a negative error
+ * code.
+ */
+static int stack_children_created_since(struct reftable_stack *st,
+					const char *refname,
+					uint64_t update_index)
+{
+	struct reftable_buf prefix = REFTABLE_BUF_INIT;
+	struct reftable_ref_record ref = { 0 };
+	struct reftable_iterator it = { 0 };
+	int err;
+
+	if ((err = reftable_buf_addstr(&prefix, refname)) < 0 ||
+	    (err = reftable_buf_addstr(&prefix, "/")) < 0)
+		goto done;
+
+	err = reftable_merged_table_init_ref_iterator(st->merged, &it);
+	if (err < 0)
+		goto done;
+	err = reftable_iterator_seek_ref(&it, prefix.buf);
+	if (err < 0)
+		goto done;
+
+	while (!(err = reftable_iterator_next_ref(&it, &ref))) {
+		if (strncmp(ref.refname, prefix.buf, prefix.len))
+			break;
+		if (ref.update_index >= update_index &&
+		    !reftable_ref_record_is_deletion(&ref)) {
+			err = 1;
+			goto done;
+		}
+	}
+	if (err > 0)
+		err = 0;
+
+done:
+	reftable_buf_release(&prefix);
+	reftable_ref_record_release(&ref);
+	reftable_iterator_destroy(&it);
+	return err;
+}
+
+/*
+ * Return 1 if committing `refname` on top of the current stack could
+ * invalidate the checks its writer did against the stack as of
+ * `update_index`: the reference itself was changed since then, or a
+ * reference that would conflict with it as a directory was created.
+ */
+static int stack_ref_conflicts(struct reftable_stack *st, const char *refname,
+			       int creation, uint64_t update_index)
+{
+	struct reftable_buf dir = REFTABLE_BUF_INIT;
+	const char *slash;
+	int err;
+
+	err = stack_ref_changed_since(st, refname, update_index, 0);
+	if (err || !creation)
+		return err;
+
+	for (slash = strchr(refname, '/'); slash; slash = strchr(slash + 1, '/')) {
+		reftable_buf_reset(&dir);
+		if ((err = reftable_buf_add(&dir, refname, slash - refname)) < 0)
+			break;
+		err = stack_ref_changed_since(st, dir.buf, update_index, 1);
+		if (err)
+			break;
+	}
+	reftable_buf_release(&dir);
+	if (err)
+		return err;
+
+	return stack_children_created_since(st, refname, update_index);
+}
+
+/*
+ * Return 1 if `refname` exists in `mt`, 0 if not, or a negative error
+ * code.
+ */
+static int merged_table_has_ref(struct reftable_merged_table *mt,
+				const char *refname)
+{
+	struct reftable_ref_record ref = { 0 };
+	struct reftable_iterator it = { 0 };
+	int err;
+
+	err = reftable_merged_table_init_ref_iterator(mt, &it);
+	if (err < 0)
+		goto done;
+	err = reftable_iterator_seek_ref(&it, refname);
+	if (err < 0)
+		goto done;
+	err = reftable_iterator_next_ref(&it, &ref);
+	if (err) {
+		if (err > 0)
+			err = 0;
+		goto done;
+	}
+
+	err = !strcmp(ref.refname, refname) &&
+	      !reftable_ref_record_is_deletion(&ref);
+
+done:
+	reftable_ref_record_release(&ref);
+	reftable_iterator_destroy(&it);
+	return err;
+}
+
+/*
+ * Return 1 if `refname` existed in the tables `add` was written against
+ * but does not exist in the stack anymore, 0 if not, or a negative
+ * error code. This finds the deletions whose tombstones were dropped by
+ * compacting the bottom of the stack.
+ */
+static int addition_ref_vanished(struct reftable_addition *add,
+				 const char *refname)
+{
+	int err;
+
+	if (!add->base_tables_len)
+		return 0;
+
+	err = merged_table_has_ref(add->stack->merged, refname);
+	if (err)
+		return err < 0 ? err : 0;
+
+	if (!add->base) {
+		err = reftable_merged_table_new(&add->base, add->base_tables,
+						add->base_tables_len,
+						add->stack->opts.hash_id);
+		if (err < 0)
+			return err;
+	}
+	return merged_table_has_ref(add->base, refname);
+}
+
+/*
+ * Check whether the new tables of `add` conflict with the changes made
+ * to the stack at or after `update_index`, see `stack_ref_conflicts()`.
+ * Log records count as changes to their reference, too. If `compacted`
+ * is set, the tables `add` was written against may have been
+ * compacted, so references that have vanished since count as changed
+ * as well. Returns 1 on conflicts, 0 if there are none, or a negative
+ * error code.
+ */
+static int addition_check_conflicts(struct reftable_addition *add,
+				    uint64_t update_index, int compacted)
+{
+	struct reftable_buf path = REFTABLE_BUF_INIT;
+	struct reftable_ref_record ref = { 0 };
+	struct reftable_log_record log = { 0 };
+	struct reftable_iterator it = { 0 };
+	struct reftable_table *table = NULL;
+	int err = 0;
+
+	for (size_t i = 0; !err && i < add->new_tables_len; i++) {
+		struct reftable_block_source src = { 0 };
+		char *last_log = NULL;
+
+		err = stack_filename(&path, add->stack, add->new_tables[i]);
+		if (err < 0)
+			break;
+		err = reftable_block_source_from_file(&src, path.buf);
+		if (err < 0)
+			break;
+		err = reftable_table_new(&table, &src, add->new_tables[i]);
+		if (err < 0)
+			break;
+
+		err = reftable_table_init_ref_iterator(table, &it);
+		if (err < 0)
+			goto next;
+		err = reftable_iterator_seek_ref(&it, "");
+		if (err < 0)
+			goto next;
+		while (!(err = reftable_iterator_next_ref(&it, &ref))) {
+			err = stack_ref_conflicts(add->stack, ref.refname,
+						  !reftable_ref_record_is_deletion(&ref),
+						  update_index);
+			if (!err && compacted)
+				err = addition_ref_vanished(add, ref.refname);
+			if (err)
+				goto next;
+		}
+		if (err < 0)
+			goto next;
+		reftable_iterator_destroy(&it);
+
+		err = reftable_table_init_log_iterator(table, &it);
+		if (err < 0)
+			goto next;
+		err = reftable_iterator_seek_log(&it, "");
+		if (err < 0)
+			goto next;
+		while (!(err = reftable_iterator_next_log(&it, &log))) {
+			if (last_log && !strcmp(last_log, log.refname))
+				continue;
+			reftable_free(last_log);
+			last_log = reftable_strdup(log.refname);
+			if (!last_log) {
+				err = REFTABLE_OUT_OF_MEMORY_ERROR;
+				goto next;
+			}
+			err = stack_ref_changed_since(add->stack, log.refname,
+						      update_index, 0);
+			if (err)
+				goto next;
+		}
+		if (err > 0)
+			err = 0;
+
+	next:
+		reftable_free(last_log);
+		reftable_iterator_destroy(&it);
+		reftable_table_decref(table);
+		table = NULL;
+	}
+
+	reftable_buf_release(&path);
+	reftable_ref_record_release(&ref);
+	reftable_log_record_release(&log);
+	return err;
+}
+
+/*
+ * Return 1 if the tables of the stack start with the `nr` tables in
+ * `tables`, that is the stack has only grown since then, 0 otherwise.
+ */
+static int stack_extends_tables(struct reftable_stack *st,
+				struct reftable_table **tables, size_t nr)
+{
+	if (nr > st->merged->tables_len)
+		return 0;
+	for (size_t i = 0; i < nr; i++)
+		if (strcmp(st->tables[i]->name, tables[i]->name))
+			return 0;
+	return 1;
+}
+
+/*
+ * Lock the stack for an optimistic addition and bring it up to date.
+ * If other tables were added in the meantime, write the new tables
+ * of `add` again on top of them, unless they conflict. They are written
+ * again before checking for conflicts, as the tables written without
+ * the lock look stale to `reftable_stack_clean()` by then, and may have
+ * been removed.
+ *
+ * Compaction keeps the latest record of every reference along with its
+ * update index, so changes made since `add` was written can still be
+ * found after it. The exception are deletions, whose tombstones are
+ * dropped when the bottom of the stack is compacted; those are found
+ * by comparing with the tables `add` was written against.
+ */
+static int addition_rebase(struct reftable_addition *add)
+{
+	uint64_t update_index = add->next_update_index;
+	struct addition_write *writes;
+	size_t writes_len;
+	int compacted, err;
+
+	err = stack_lock_tables_list(add);
+	if (err < 0)
+		return err;
+
+	err = stack_uptodate(add->stack);
+	if (err < 0)
+		return err;
+	if (err > 0) {
+		err = reftable_stack_reload_maybe_reuse(add->stack, 1);
+		if (err < 0)
+			return err;
+	}
+
+	if (reftable_stack_next_update_index(add->stack) == add->next_update_index)
+		return 0;
+	compacted = !stack_extends_tables(add->stack, add->base_tables,
+					  add->base_tables_len);
+
+	reftable_addition_drop_tables(add);
+	add->next_update_index = reftable_stack_next_update_index(add->stack);
+
+	/* `reftable_addition_add()` records the callbacks anew. */
+	writes = add->writes;
+	writes_len = add->writes_len;
+	add->writes = NULL;
+	add->writes_len = add->writes_cap = 0;
+
+	for (size_t i = 0; !err && i < writes_len; i++)
+		err = reftable_addition_add(add, writes[i].write_table,
+					    writes[i].arg);
+	reftable_free(writes);
+	if (err < 0)
+		return err;
+
+	err = addition_check_conflicts(add, update_index, compacted);
+	if (err < 0)
+		return err;
+	if (err > 0)
+		return REFTABLE_OUTDATED_ERROR;
+	return 0;
+}
+
+/*
+ * Whether writers should leave auto-compaction to somebody else. Once
+ * the stack has grown too large they compact anyway, as lookups become
+ * more expensive with every table.
+ */
+static int auto_compaction_deferred(struct reftable_stack *st,
+				    const struct reftable_write_options *opts)
+{
+	size_t max_tables = opts->deferred_compaction_tables;
+
+	if (!opts->defer_auto_compact)
+		return 0;
+	if (!max_tables)
+		max_tables = DEFAULT_DEFERRED_COMPACTION_TABLES;
+	return st->merged->tables_len <= max_tables;
+}
+
 int reftable_addition_commit(struct reftable_addition *add)
 {
 	struct reftable_buf table_list = REFTABLE_BUF_INIT;
@@ -776,6 +1193,12 @@ int reftable_addition_commit(struct reftable_addition *add)
 	if (add->new_tables_len == 0)
 		goto done;
 
+	if (add->optimistic) {
+		err = addition_rebase(add);
+		if (err < 0)
+			goto done;
+	}
+
 	for (i = 0; i < add->stack->merged->tables_len; i++) {
 		if ((err = reftable_buf_addstr(&table_list, add->stack->tables[i]->name)) < 0 ||
 		    (err = reftable_buf_addstr(&table_list, "\n")) < 0)
@@ -819,7 +1242,8 @@ int reftable_addition_commit(struct reftable_addition *add)
 	if (err)
 		goto done;
 
-	if (!add->opts.disable_auto_compact) {
+	if (!add->opts.disable_auto_compact &&
+	    !auto_compaction_deferred(add->stack, &add->opts)) {
 		/*
 		 * Auto-compact the stack to keep the number of tables in
 		 * control. It is possible that a concurrent writer is already
@@ -876,6 +1300,16 @@ int reftable_addition_add(struct reftable_addition *add,
 	};
 	int err = 0;
 
+	if (add->optimistic) {
+		REFTABLE_ALLOC_GROW_OR_NULL(add->writes, add->writes_len + 1,
+					    add->writes_cap);
+		if (!add->writes)
+			return REFTABLE_OUT_OF_MEMORY_ERROR;
+		add->writes[add->writes_len].write_table = write_table;
+		add->writes[add->writes_len].arg = arg;
+		add->writes_len++;
+	}
+
 	reftable_buf_reset(&next_name);
 
 	err = format_name(&next_name, add->next_update_index, add->next_update_index);
@@ -1158,11 +1592,11 @@ enum stack_compact_range_flags {
  * callers can either ignore, or they may choose to retry compaction after some
  * amount of time.
  */
-static int stack_compact_range(struct reftable_stack *st,
-			       size_t first, size_t last,
-			       struct reftable_log_expiry_config *expiry,
-			       const struct reftable_write_options *opts,
-			       unsigned int flags)
+static int stack_compact_range_1(struct reftable_stack *st,
+				 size_t first, size_t last,
+				 struct reftable_log_expiry_config *expiry,
+				 const struct reftable_write_options *opts,
+				 unsigned int flags)
 {
 	struct reftable_buf tables_list_buf = REFTABLE_BUF_INIT;
 	struct reftable_buf new_table_name = REFTABLE_BUF_INIT;
@@ -1524,6 +1958,26 @@ static int stack_compact_range(struct reftable_stack *st,
 	return err;
 }
 
+static int stack_compact_range(struct reftable_stack *st,
+			       size_t first, size_t last,
+			       struct reftable_log_expiry_config *expiry,
+			       const struct reftable_write_options *opts,
+			       unsigned int flags)
+{
+	int err;
+
+	if (first > last || (!expiry && first == last))
+		return 0;
+
+	if (st->opts.on_compaction_begin)
+		st->opts.on_compaction_begin(st->opts.on_compaction_payload);
+	err = stack_compact_range_1(st, first, last, expiry, opts, flags);
+	if (st->opts.on_compaction_end)
+		st->opts.on_compaction_end(st->opts.on_compaction_payload, err);
+
+	return err;
+}
+
 int reftable_stack_compact_all(struct reftable_stack *st,
 			       const struct reftable_write_options *opts,
 			       struct reftable_log_expiry_config *config)
@@ -434,6 +434,42 @@ static int table_iter_seek_indexed(struct table_iter *ti,
 	return err;
 }
 
+/*
+ * Seek the wanted record in the block that the iterator has loaded already,
+ * which saves us from descending through the index again. This succeeds
+ * often when callers look up many records in sorted order, e.g. when
+ * preparing a transaction. Returns 1 when the record cannot be located in
+ * the loaded block.
+ */
+static int table_iter_seek_loaded_block(struct table_iter *ti,
+					struct reftable_record *want)
+{
+	struct reftable_buf want_key = REFTABLE_BUF_INIT;
+	int err;
+
+	if (!ti->block.block_data.data ||
+	    reftable_block_type(&ti->block) != reftable_record_type(want))
+		return 1;
+
+	err = reftable_record_key(want, &want_key);
+	if (err < 0)
+		goto done;
+
+	err = block_contains_key(&ti->block, &want_key);
+	if (err <= 0) {
+		err = err < 0 ? err : 1;
+		goto done;
+	}
+
+	block_iter_init(&ti->bi, &ti->block);
+	ti->is_finished = 0;
+	err = block_iter_seek_key(&ti->bi, &want_key);
+
+done:
+	reftable_buf_release(&want_key);
+	return err;
+}
+
 static int table_iter_seek(struct table_iter *ti,
 			   struct reftable_record *want)
 {
@@ -441,6 +477,10 @@ static int table_iter_seek(struct table_iter *ti,
 	struct reftable_table_offsets *offs = table_offsets_for(ti->table, typ);
 	int err;
 
+	err = table_iter_seek_loaded_block(ti, want);
+	if (err <= 0)
+		goto out;
+
 	err = table_iter_seek_start(ti, reftable_record_type(want),
 				    !!offs->index_offset);
 	if (err < 0)
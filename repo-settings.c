@@ -79,11 +79,19 @@ void prepare_repo_settings(struct repository *r)
 	repo_cfg_bool(r, "core.multipackindex", &r->settings.core_multi_pack_index, 1);
 	repo_cfg_bool(r, "index.sparse", &r->settings.sparse_index, 0);
 	repo_cfg_bool(r, "index.skiphash", &r->settings.index_skip_hash, r->settings.index_skip_hash);
+	repo_cfg_bool(r, "index.mapentries", &r->settings.index_map_entries, 0);
+	repo_cfg_bool(r, "index.incrementalwrite",
+		      &r->settings.index_incremental_write, 0);
+	repo_cfg_bool(r, "index.blockchecksums",
+		      &r->settings.index_block_checksums, 0);
+	repo_cfg_bool(r, "index.namehash", &r->settings.index_name_hash, 0);
 	repo_cfg_bool(r, "pack.readreverseindex", &r->settings.pack_read_reverse_index, 1);
 	repo_cfg_bool(r, "pack.usebitmapboundarytraversal",
 		      &r->settings.pack_use_bitmap_boundary_traversal,
 		      r->settings.pack_use_bitmap_boundary_traversal);
 	repo_cfg_bool(r, "core.usereplacerefs", &r->settings.read_replace_refs, 1);
+	repo_cfg_bool(r, "core.connectivitybitmaps",
+		      &r->settings.core_connectivity_bitmaps, 0);
 
 	/*
 	 * The GIT_TEST_MULTI_PACK_INDEX variable is special in that
@@ -117,6 +125,18 @@ void prepare_repo_settings(struct repository *r)
 				UNTRACKED_CACHE_WRITE : UNTRACKED_CACHE_REMOVE;
 	}
 
+	repo_cfg_int(r, "core.untrackedcachethreads",
+		     &r->settings.untracked_cache_threads, 1);
+	if (r->settings.untracked_cache_threads < 0)
+		die("invalid number of threads for core.untrackedCacheThreads: %d",
+		    r->settings.untracked_cache_threads);
+
+	repo_cfg_int(r, "core.unpacktreesthreads",
+		     &r->settings.unpack_trees_threads, 1);
+	if (r->settings.unpack_trees_threads < 0)
+		die("invalid number of threads for core.unpackTreesThreads: %d",
+		    r->settings.unpack_trees_threads);
+
 	if (!repo_config_get_string_tmp(r, "fetch.negotiationalgorithm", &strval)) {
 		int fetch_default = r->settings.fetch_negotiation_algorithm;
 		if (!strcasecmp(strval, "skipping"))
@@ -141,6 +161,11 @@ void prepare_repo_settings(struct repository *r)
 
 	if (!repo_config_get_ulong(r, "core.deltabasecachelimit", &ulongval))
 		r->settings.delta_base_cache_limit = ulongval;
+	repo_cfg_int(r, "core.deltachainthreads",
+		     &r->settings.delta_chain_threads, 1);
+	if (r->settings.delta_chain_threads < 0)
+		die("invalid number of threads for core.deltaChainThreads: %d",
+		    r->settings.delta_chain_threads);
 
 	if (!repo_config_get_ulong(r, "core.packedgitwindowsize", &ulongval)) {
 		int pgsz_x2 = getpagesize() * 2;
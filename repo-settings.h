@@ -29,6 +29,7 @@ struct repo_settings {
 	int pack_read_reverse_index;
 	int pack_use_bitmap_boundary_traversal;
 	int pack_use_multi_pack_reuse;
+	int core_connectivity_bitmaps;
 
 	int shared_repository;
 	int shared_repository_initialized;
@@ -46,7 +47,13 @@ struct repo_settings {
 
 	int index_version;
 	int index_skip_hash;
+	int index_map_entries;
+	int index_incremental_write;
+	int index_block_checksums;
+	int index_name_hash;
 	enum untracked_cache_setting core_untracked_cache;
+	int untracked_cache_threads;
+	int unpack_trees_threads;
 
 	int pack_use_sparse;
 	int pack_use_path_walk;
@@ -56,6 +63,7 @@ struct repo_settings {
 	int warn_ambiguous_refs; /* lazily loaded via accessor */
 
 	size_t delta_base_cache_limit;
+	int delta_chain_threads;
 	size_t packed_git_window_size;
 	size_t packed_git_limit;
 	unsigned long big_file_threshold;
@@ -68,9 +76,12 @@ struct repo_settings {
 	.shared_repository = -1, \
 	.index_version = -1, \
 	.core_untracked_cache = UNTRACKED_CACHE_KEEP, \
+	.untracked_cache_threads = 1, \
+	.unpack_trees_threads = 1, \
 	.fetch_negotiation_algorithm = FETCH_NEGOTIATION_CONSECUTIVE, \
 	.warn_ambiguous_refs = -1, \
 	.delta_base_cache_limit = DEFAULT_DELTA_BASE_CACHE_LIMIT, \
+	.delta_chain_threads = 1, \
 	.packed_git_window_size = DEFAULT_PACKED_GIT_WINDOW_SIZE, \
 	.packed_git_limit = DEFAULT_PACKED_GIT_LIMIT, \
 	.max_allowed_tree_depth = DEFAULT_MAX_ALLOWED_TREE_DEPTH, \
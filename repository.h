@@ -206,6 +206,7 @@ struct repository {
 	/* Configurations */
 	int repository_format_worktree_config;
 	int repository_format_relative_worktrees;
+	int repository_format_packed_refs_delta;
 	int repository_format_precious_objects;
 	int repository_format_submodule_path_cfg;
 
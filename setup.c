@@ -708,6 +708,9 @@ static enum extension_result handle_extension(const char *var,
 	} else if (!strcmp(ext, "relativeworktrees")) {
 		data->relative_worktrees = git_config_bool(var, value);
 		return EXTENSION_OK;
+	} else if (!strcmp(ext, "packedrefsdelta")) {
+		data->packed_refs_delta = git_config_bool(var, value);
+		return EXTENSION_OK;
 	} else if (!strcmp(ext, "submodulepathconfig")) {
 		data->submodule_path_cfg = git_config_bool(var, value);
 		return EXTENSION_OK;
@@ -1794,6 +1797,8 @@ int apply_repository_format(struct repository *repo,
 		format->submodule_path_cfg;
 	repo->repository_format_relative_worktrees =
 		format->relative_worktrees;
+	repo->repository_format_packed_refs_delta =
+		format->packed_refs_delta;
 	repo->repository_format_partial_clone =
 		xstrdup_or_null(format->partial_clone);
 	repo->repository_format_precious_objects =
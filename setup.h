@@ -183,6 +183,7 @@ struct repository_format {
 	char *partial_clone; /* value of extensions.partialclone */
 	int worktree_config;
 	int relative_worktrees;
+	int packed_refs_delta;
 	int submodule_path_cfg;
 	int is_bare;
 	int hash_algo;
@@ -16,9 +16,30 @@ void blk_SHA256_Init(blk_SHA256_CTX *ctx);
 void blk_SHA256_Update(blk_SHA256_CTX *ctx, const void *data, size_t len);
 void blk_SHA256_Final(unsigned char *digest, blk_SHA256_CTX *ctx);
 
+#define blk_SHA256_LANES 4
+
+/*
+ * A message for blk_SHA256_Batch(), made of "hdrlen" bytes at "hdr"
+ * followed by "len" bytes at "data". Its hash is stored in "digest".
+ */
+struct blk_SHA256_msg {
+	const unsigned char *hdr;
+	size_t hdrlen;
+	const unsigned char *data;
+	size_t len;
+	unsigned char *digest;
+};
+
+/*
+ * Hash "nr" independent messages, working on blk_SHA256_LANES of them
+ * at a time.
+ */
+void blk_SHA256_Batch(const struct blk_SHA256_msg *msgs, size_t nr);
+
 #define platform_SHA256_CTX blk_SHA256_CTX
 #define platform_SHA256_Init blk_SHA256_Init
 #define platform_SHA256_Update blk_SHA256_Update
 #define platform_SHA256_Final blk_SHA256_Final
+#define platform_SHA256_Batch blk_SHA256_Batch
 
 #endif
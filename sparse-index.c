@@ -246,6 +246,7 @@ int convert_to_sparse(struct index_state *istate, int flags)
 	remove_fsmonitor(istate);
 
 	trace2_region_enter("index", "convert_to_sparse", istate->repo);
+	discard_name_hash_table(istate);
 	istate->cache_nr = convert_to_sparse_rec(istate,
 						 0, 0, istate->cache_nr,
 						 "", 0, istate->cache_tree);
@@ -7,7 +7,6 @@
 
 static int threaded_check_leading_path(struct cache_def *cache, const char *name,
 				       int len, int warn_on_lstat_err);
-static int threaded_has_dirs_only_path(struct cache_def *cache, const char *name, int len, int prefix_len);
 
 /*
  * Returns the length (on a path component basis) of the longest
@@ -265,7 +264,7 @@ int has_dirs_only_path(const char *name, int len, int prefix_len)
  * 'prefix_len', thus we then allow for symlinks in the prefix part as
  * long as those points to real existing directories.
  */
-static int threaded_has_dirs_only_path(struct cache_def *cache, const char *name, int len, int prefix_len)
+int threaded_has_dirs_only_path(struct cache_def *cache, const char *name, int len, int prefix_len)
 {
 	/*
 	 * Note: this function is used by the checkout machinery, which also
@@ -12,9 +12,58 @@
 #include "git-compat-util.h"
 #include "delta.h"
 #include "strbuf.h"
+#include "trace.h"
 
 static const char usage_str[] =
-	"test-tool delta (-d|-p) <from_file> <data_file> <out_file>";
+	"test-tool delta (-d|-p) <from_file> <data_file> <out_file>\n"
+	"   or: test-tool delta -b <from_file> <data_file> [<seconds>]";
+
+/*
+ * Repeatedly compute the delta from <from_file> to <data_file> for the
+ * given number of seconds, and report the throughput of create_delta()
+ * in terms of <data_file> bytes. The index is built only once, as is the
+ * case for a delta window in pack-objects.
+ */
+static int delta_benchmark(int argc, const char **argv)
+{
+	struct strbuf from = STRBUF_INIT, data = STRBUF_INIT;
+	struct delta_index *index;
+	unsigned long delta_size = 0;
+	uint64_t start, elapsed;
+	unsigned long j, seconds = 3;
+	double mb_per_sec;
+
+	if (argc == 5)
+		seconds = strtoul(argv[4], NULL, 10);
+	else if (argc != 4)
+		usage(usage_str);
+
+	if (strbuf_read_file(&from, argv[2], 0) < 0)
+		die_errno("unable to read '%s'", argv[2]);
+	if (strbuf_read_file(&data, argv[3], 0) < 0)
+		die_errno("unable to read '%s'", argv[3]);
+
+	index = create_delta_index(from.buf, from.len);
+	if (!index)
+		die("unable to create delta index");
+
+	start = getnanotime();
+	elapsed = 0;
+	for (j = 0; !j || elapsed < seconds * 1000000000ULL; j++) {
+		free(create_delta(index, data.buf, data.len, &delta_size, 0));
+		elapsed = getnanotime() - start;
+	}
+
+	mb_per_sec = (double)j * data.len / (1024 * 1024) /
+		     ((double)elapsed / 1000000000);
+	printf("%lu iters; delta size %lu; %0.2f MiB/s\n",
+	       j, delta_size, mb_per_sec);
+
+	free_delta_index(index);
+	strbuf_release(&from);
+	strbuf_release(&data);
+	return 0;
+}
 
 int cmd__delta(int argc, const char **argv)
 {
@@ -23,6 +72,9 @@ int cmd__delta(int argc, const char **argv)
 	char *out_buf;
 	size_t out_size;
 
+	if (argc > 1 && !strcmp(argv[1], "-b"))
+		return delta_benchmark(argc, argv);
+
 	if (argc != 5 || (strcmp(argv[1], "-d") && strcmp(argv[1], "-p")))
 		usage(usage_str);
 
@@ -2,6 +2,7 @@
 #include "hash.h"
 
 #define NUM_SECONDS 3
+#define BATCH_SIZE 16
 
 static inline void compute_hash(const struct git_hash_algo *algo, struct git_hash_ctx *ctx, uint8_t *final, const void *p, size_t len)
 {
@@ -10,16 +11,39 @@ static inline void compute_hash(const struct git_hash_algo *algo, struct git_has
 	git_hash_final(final, ctx);
 }
 
+static inline void compute_hash_batch(const struct git_hash_algo *algo,
+				      struct git_hash_batch_item *items,
+				      uint8_t (*final)[GIT_MAX_RAWSZ],
+				      const void *p, size_t len)
+{
+	for (size_t i = 0; i < BATCH_SIZE; i++) {
+		items[i].hdr = NULL;
+		items[i].hdrlen = 0;
+		items[i].data = p;
+		items[i].len = len;
+		items[i].out = final[i];
+	}
+	git_hash_batch(algo, items, BATCH_SIZE);
+}
+
 int cmd__hash_speed(int ac, const char **av)
 {
 	struct git_hash_ctx ctx;
-	unsigned char hash[GIT_MAX_RAWSZ];
+	struct git_hash_batch_item items[BATCH_SIZE];
+	unsigned char hash[BATCH_SIZE][GIT_MAX_RAWSZ];
 	clock_t initial, start, end;
 	unsigned bufsizes[] = { 64, 256, 1024, 8192, 16384 };
 	void *p;
 	const struct git_hash_algo *algo = NULL;
+	int batch = 0;
 
-	if (ac == 2) {
+	if (ac == 3) {
+		if (!strcmp(av[2], "batch"))
+			batch = 1;
+		else if (strcmp(av[2], "single"))
+			ac = 0;
+	}
+	if (ac == 2 || ac == 3) {
 		for (size_t i = 1; i < GIT_HASH_NALGOS; i++) {
 			if (!strcmp(av[1], hash_algos[i].name)) {
 				algo = &hash_algos[i];
@@ -28,26 +52,32 @@ int cmd__hash_speed(int ac, const char **av)
 		}
 	}
 	if (!algo)
-		die("usage: test-tool hash-speed algo_name");
+		die("usage: test-tool hash-speed algo_name [single|batch]");
 
 	/* Use this as an offset to make overflow less likely. */
 	initial = clock();
 
-	printf("algo: %s\n", algo->name);
+	printf("algo: %s%s\n", algo->name, batch ? " (batch)" : "");
 
 	for (size_t i = 0; i < ARRAY_SIZE(bufsizes); i++) {
-		unsigned long j, kb;
+		unsigned long j, calls, kb;
 		double kb_per_sec;
 		p = xcalloc(1, bufsizes[i]);
 		start = end = clock() - initial;
-		for (j = 0; ((end - start) / CLOCKS_PER_SEC) < NUM_SECONDS; j++) {
-			compute_hash(algo, &ctx, hash, p, bufsizes[i]);
+		for (j = 0, calls = 0; ((end - start) / CLOCKS_PER_SEC) < NUM_SECONDS; calls++) {
+			if (batch) {
+				compute_hash_batch(algo, items, hash, p, bufsizes[i]);
+				j += BATCH_SIZE;
+			} else {
+				compute_hash(algo, &ctx, hash[0], p, bufsizes[i]);
+				j++;
+			}
 
 			/*
 			 * Only check elapsed time every 128 iterations to avoid
 			 * dominating the runtime with system calls.
 			 */
-			if (!(j & 127))
+			if (!(calls & 127))
 				end = clock() - initial;
 		}
 		kb = j * bufsizes[i];
@@ -0,0 +1,33 @@
+#include "test-tool.h"
+#include "git-compat-util.h"
+#include "lstat-batch.h"
+
+static void print_result(void *cb_data UNUSED, void *item,
+			 struct stat *st, int err)
+{
+	if (err)
+		printf("%s %s\n", (const char *)item, strerror(err));
+	else
+		printf("%s %"PRIuMAX"\n", (const char *)item,
+		       (uintmax_t)st->st_size);
+}
+
+/*
+ * Usage: test-tool lstat-batch <path>...
+ *
+ * Print the size of each path, or the error lstat() failed with, in
+ * the order the results arrive. Exits with 2 if lstat() calls cannot
+ * be batched here.
+ */
+int cmd__lstat_batch(int argc UNUSED, const char **argv)
+{
+	struct lstat_batch *batch;
+
+	batch = lstat_batch_init(4, print_result, NULL);
+	if (!batch)
+		return 2;
+	for (argv++; *argv; argv++)
+		lstat_batch_add(batch, *argv, (void *)*argv);
+	lstat_batch_finish(batch, NULL);
+	return 0;
+}
@@ -181,6 +181,17 @@ static int cmd_for_each_ref__exclude(struct ref_store *refs, const char **argv)
 	return refs_for_each_ref_ext(refs, each_ref, NULL, &opts);
 }
 
+static int cmd_for_each_ref_pointing_at(struct ref_store *refs, const char **argv)
+{
+	const char *hex = notnull(*argv++, "oid");
+	struct object_id oid;
+
+	if (get_oid_hex(hex, &oid))
+		die("cannot parse %s as %s", hex, the_hash_algo->name);
+
+	return refs_for_each_ref_pointing_at(refs, &oid, each_ref, NULL);
+}
+
 static int cmd_resolve_ref(struct ref_store *refs, const char **argv)
 {
 	struct object_id oid = *null_oid(the_hash_algo);
@@ -318,6 +329,7 @@ static struct command commands[] = {
 	{ "rename-ref", cmd_rename_ref },
 	{ "for-each-ref", cmd_for_each_ref },
 	{ "for-each-ref--exclude", cmd_for_each_ref__exclude },
+	{ "for-each-ref-pointing-at", cmd_for_each_ref_pointing_at },
 	{ "resolve-ref", cmd_resolve_ref },
 	{ "verify-ref", cmd_verify_ref },
 	{ "for-each-reflog", cmd_for_each_reflog },
@@ -7,15 +7,18 @@
 #include "reftable/reftable-merged.h"
 #include "reftable/reftable-stack.h"
 #include "reftable/reftable-table.h"
+#include "strbuf.h"
+#include "trace.h"
 #include "test-tool.h"
 
 static void print_help(void)
 {
-	printf("usage: dump [-st] arg\n\n"
+	printf("usage: dump [-stk] arg\n\n"
 	       "options: \n"
 	       "  -b dump blocks\n"
 	       "  -t dump table\n"
 	       "  -s dump stack\n"
+	       "  -k seek the stack for each refname read from stdin\n"
 	       "  -6 sha256 hash format\n"
 	       "  -h this help\n"
 	       "\n");
@@ -189,6 +192,57 @@ static int dump_stack(const char *stackdir, uint32_t hash_id)
 	return err;
 }
 
+static int seek_stack(const char *stackdir, uint32_t hash_id)
+{
+	struct reftable_stack *stack = NULL;
+	struct reftable_stack_options opts = { .hash_id = hash_id };
+	struct reftable_ref_record ref = { 0 };
+	struct reftable_iterator it = { 0 };
+	struct strbuf line = STRBUF_INIT;
+	uintmax_t seeks = 0, found = 0;
+	uint64_t start;
+	int err;
+
+	err = reftable_new_stack(&stack, stackdir, &opts);
+	if (err < 0)
+		goto done;
+
+	/*
+	 * Reuse a single iterator for all lookups, the same as the reftable
+	 * backend does when reading refs.
+	 */
+	err = reftable_merged_table_init_ref_iterator(reftable_stack_merged_table(stack),
+						      &it);
+	if (err < 0)
+		goto done;
+
+	start = getnanotime();
+	while (strbuf_getline_lf(&line, stdin) != EOF) {
+		err = reftable_iterator_seek_ref(&it, line.buf);
+		if (err < 0)
+			goto done;
+		err = reftable_iterator_next_ref(&it, &ref);
+		if (err < 0)
+			goto done;
+		if (!err && !strcmp(ref.refname, line.buf) &&
+		    ref.value_type != REFTABLE_REF_DELETION)
+			found++;
+		seeks++;
+	}
+	err = 0;
+
+	printf("%"PRIuMAX" seeks, %"PRIuMAX" found, %.0f seeks/s\n",
+	       seeks, found, seeks * 1e9 / (getnanotime() - start + 1));
+
+done:
+	reftable_iterator_destroy(&it);
+	reftable_ref_record_release(&ref);
+	strbuf_release(&line);
+	if (stack)
+		reftable_stack_destroy(stack);
+	return err;
+}
+
 static int dump_reftable(const char *tablename)
 {
 	struct reftable_block_source src = { 0 };
@@ -223,6 +277,7 @@ int cmd__dump_reftable(int argc, const char **argv)
 	int opt_dump_blocks = 0;
 	int opt_dump_table = 0;
 	int opt_dump_stack = 0;
+	int opt_seek_stack = 0;
 	uint32_t opt_hash_id = REFTABLE_HASH_SHA1;
 	const char *arg = NULL, *argv0 = argv[0];
 
@@ -237,6 +292,8 @@ int cmd__dump_reftable(int argc, const char **argv)
 			opt_hash_id = REFTABLE_HASH_SHA256;
 		else if (!strcmp("-s", argv[1]))
 			opt_dump_stack = 1;
+		else if (!strcmp("-k", argv[1]))
+			opt_seek_stack = 1;
 		else if (!strcmp("-?", argv[1]) || !strcmp("-h", argv[1])) {
 			print_help();
 			return 2;
@@ -256,6 +313,8 @@ int cmd__dump_reftable(int argc, const char **argv)
 		err = dump_reftable(arg);
 	} else if (opt_dump_stack) {
 		err = dump_stack(arg, opt_hash_id);
+	} else if (opt_seek_stack) {
+		err = seek_stack(arg, opt_hash_id);
 	}
 
 	if (err < 0) {
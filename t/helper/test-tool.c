@@ -41,6 +41,7 @@ static struct test_cmd cmds[] = {
 	{ "hexdump", cmd__hexdump },
 	{ "json-writer", cmd__json_writer },
 	{ "lazy-init-name-hash", cmd__lazy_init_name_hash },
+	{ "lstat-batch", cmd__lstat_batch },
 	{ "match-trees", cmd__match_trees },
 	{ "mergesort", cmd__mergesort },
 	{ "mktemp", cmd__mktemp },
@@ -4,13 +4,14 @@
 unset GIT_TEST_CHECKOUT_WORKERS
 
 set_checkout_config () {
-	if test $# -ne 2
+	if test $# -ne 2 && test $# -ne 3
 	then
-		BUG "usage: set_checkout_config <workers> <threshold>"
+		BUG "usage: set_checkout_config <workers> <threshold> [<use-threads>]"
 	fi &&
 
 	test_config_global checkout.workers $1 &&
-	test_config_global checkout.thresholdForParallelism $2
+	test_config_global checkout.thresholdForParallelism $2 &&
+	test_config_global checkout.workerThreads ${3:-false}
 }
 
 # Run "${@:2}" and check that $1 checkout workers were used
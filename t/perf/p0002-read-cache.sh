@@ -11,4 +11,24 @@ test_perf "read_cache/discard_cache $count times" "
 	test-tool read-cache $count
 "
 
+test_expect_success 'prime mapped index entries' '
+	git config index.mapEntries true &&
+	git update-index --force-write-index
+'
+
+test_perf "read_cache/discard_cache $count times (index.mapEntries)" "
+	test-tool read-cache $count
+"
+
+test_expect_success 'write index with block checksums' '
+	git config --unset index.mapEntries &&
+	git config index.skipHash true &&
+	git config index.blockChecksums true &&
+	test-tool write-cache
+'
+
+test_perf "read_cache/discard_cache $count times (index.blockChecksums)" "
+	test-tool read-cache $count
+"
+
 test_done
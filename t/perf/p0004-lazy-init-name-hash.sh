@@ -53,4 +53,17 @@ test_perf "multi-threaded, $desc" --prereq REPO_BIG_ENOUGH_FOR_MULTI "
 	test-tool lazy-init-name-hash --multi --count=$count
 "
 
+for name_hash in false true
+do
+	test_expect_success "setup index.nameHash=$name_hash" "
+		git config core.ignoreCase true &&
+		git config index.nameHash $name_hash &&
+		git update-index --force-write-index
+	"
+
+	test_perf "status, core.ignoreCase (index.nameHash=$name_hash)" "
+		git status --porcelain >/dev/null
+	"
+done
+
 test_done
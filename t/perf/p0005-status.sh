@@ -46,4 +46,21 @@ test_perf "read-tree status br_ballast ($nr_files)" '
 	git status
 '
 
+# Dropping the caches (which needs root) shows the cost of lstat()ing
+# the worktree when it is not cached.
+test_perf_w_drop_caches () {
+	if test -n "$GIT_PERF_0005_DROP_CACHE"; then
+		test_perf "$1" --setup "test-tool drop-caches" "$2"
+	else
+		test_perf "$@"
+	fi
+}
+
+for io_uring in false true
+do
+	test_perf_w_drop_caches "status -uno, core.ioUring=$io_uring ($nr_files)" "
+		git -c core.ioUring=$io_uring status -uno
+	"
+done
+
 test_done
@@ -72,4 +72,13 @@ test_perf "switch between aliases ($nr_files)" '
 	git checkout -q br_ballast
 '
 
+test_perf "read-tree br_base br_ballast, tree threads ($nr_files)" '
+	git -c core.unpackTreesThreads=0 read-tree -n -m br_base br_ballast
+'
+
+test_perf "switch between br_base br_ballast, tree threads ($nr_files)" '
+	git -c core.unpackTreesThreads=0 checkout -q br_base &&
+	git -c core.unpackTreesThreads=0 checkout -q br_ballast
+'
+
 test_done
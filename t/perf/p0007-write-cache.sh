@@ -26,4 +26,21 @@ test_perf "write_locked_index $count times ($nr_files files)" "
 	test-tool write-cache $count
 "
 
+test_expect_success "setup single-entry updates" '
+	file=$(git ls-files | head -n 1)
+'
+
+for incremental in false true
+do
+	test_perf "update one entry $count times (index.incrementalWrite=$incremental)" "
+		for i in \$(test_seq $count)
+		do
+			git -c index.incrementalWrite=$incremental \
+				update-index --chmod=+x \"\$file\" &&
+			git -c index.incrementalWrite=$incremental \
+				update-index --chmod=-x \"\$file\" || return 1
+		done
+	"
+done
+
 test_done
@@ -0,0 +1,48 @@
+#!/bin/sh
+
+test_description="Tests performance of matching paths against many ignore patterns
+
+Most of the patterns are like those found in generated ignore files: plain
+names, '*.suffix' and anchored paths, with a few wildcard patterns mixed in.
+"
+
+. ./perf-lib.sh
+
+test_perf_fresh_repo
+
+test_expect_success 'setup' '
+	for i in $(test_seq 1 2000)
+	do
+		echo "generated-$i.out" &&
+		echo "*.gen$i" &&
+		echo "/build/target-$i/" || return 1
+	done >.gitignore &&
+	cat >>.gitignore <<-\EOF &&
+	tmp-*
+	!tmp-keep*
+	**/cache/**
+	EOF
+	for i in $(test_seq 1 100)
+	do
+		mkdir dir$i &&
+		(
+			cd dir$i &&
+			for j in $(test_seq 1 50)
+			do
+				>file$j.c &&
+				>generated-$j.out &&
+				>file$j.gen$i || return 1
+			done
+		) || return 1
+	done
+'
+
+test_perf 'status -uall' '
+	git status -uall --porcelain >/dev/null
+'
+
+test_perf 'ls-files --others --ignored' '
+	git ls-files -o -i --exclude-standard >/dev/null
+'
+
+test_done
@@ -0,0 +1,43 @@
+#!/bin/sh
+
+test_description="Tests performance of looking up attributes with many rules
+
+The rules are mostly plain names and '*.suffix' patterns, with some
+patterns anchored to directories, as found in large monorepos.
+"
+
+. ./perf-lib.sh
+
+test_perf_fresh_repo
+
+test_expect_success 'setup' '
+	for i in $(test_seq 1 1000)
+	do
+		echo "generated-$i.out -diff" &&
+		echo "*.ext$i text" &&
+		echo "/dir$i/*.bin binary" || return 1
+	done >.gitattributes &&
+	cat >>.gitattributes <<-\EOF &&
+	*.c diff=cpp
+	**/vendor/** -text
+	EOF
+	for i in $(test_seq 1 100)
+	do
+		for j in $(test_seq 1 50)
+		do
+			echo "dir$i/file$j.c" &&
+			echo "dir$i/file$j.bin" &&
+			echo "dir$i/sub/file$j.ext$j" || return 1
+		done || return 1
+	done >paths
+'
+
+test_perf 'check-attr --stdin' '
+	git check-attr --stdin diff text binary <paths >/dev/null
+'
+
+test_perf 'check-attr --stdin --all' '
+	git check-attr --stdin -a <paths >/dev/null
+'
+
+test_done
@@ -23,4 +23,12 @@ test_perf 'list blobs' '
 		--unordered --filter=object:type=blob
 '
 
+test_perf 'cat-file --batch --unordered' '
+	git cat-file --batch-all-objects --batch --unordered >/dev/null
+'
+
+test_perf 'cat-file --batch --unordered --threads=0' '
+	git cat-file --batch-all-objects --batch --unordered --threads=0 >/dev/null
+'
+
 test_done
@@ -43,4 +43,31 @@ test_perf "create new refs after deleting differently-named refs" '
 	git -C repo2 update-ref --stdin
 '
 
+test_expect_success "setup packed-refs" '
+	git init --ref-format=files repo3 &&
+	git -C repo3 config set core.repositoryformatversion 1 &&
+	git -C repo3 config set extensions.packedRefsDelta true &&
+	blob=$(echo foo | git -C repo3 hash-object -w --stdin) &&
+	for i in $(test_seq 100000)
+	do
+		printf "create refs/pull/%d/head %s\n" "$i" "$blob" ||
+		return 1
+	done >repo3/input &&
+	git -C repo3 update-ref --stdin <repo3/input &&
+	git -C repo3 -c core.packedRefsDeltaSize=1m pack-refs --all &&
+	cp repo3/.git/packed-refs packed-refs.saved
+'
+
+for size in 0 1m
+do
+	test_perf "delete packed refs one at a time (core.packedRefsDeltaSize=$size)" \
+		--setup "cp packed-refs.saved repo3/.git/packed-refs && rm -f repo3/.git/packed-refs.delta" "
+		for i in \$(test_seq 100)
+		do
+			git -C repo3 -c core.packedRefsDeltaSize=$size \
+				update-ref -d refs/pull/\$i/head || return 1
+		done
+	"
+done
+
 test_done
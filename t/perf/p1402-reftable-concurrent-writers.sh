@@ -0,0 +1,39 @@
+#!/bin/sh
+
+test_description="Tests performance of concurrent reftable writers"
+
+. ./perf-lib.sh
+
+test_perf_fresh_repo
+
+test_expect_success "setup" '
+	git config set core.repositoryformatversion 1 &&
+	test_commit PRE &&
+	git refs migrate --ref-format=reftable &&
+	git config set reftable.lockTimeout -1
+'
+
+run_writers () {
+	for w in $(test_seq 8)
+	do
+		(
+			for i in $(test_seq 100)
+			do
+				git "$@" update-ref refs/heads/writer-$w-$i PRE ||
+				exit 1
+			done
+		) &
+	done &&
+	wait &&
+	git pack-refs --all
+}
+
+test_perf "8 concurrent writers" '
+	run_writers
+'
+
+test_perf "8 concurrent writers, optimistic" '
+	run_writers -c reftable.optimisticWrites=true
+'
+
+test_done
@@ -0,0 +1,30 @@
+#!/bin/sh
+
+test_description="Tests performance of seeking refs in a reftable stack"
+
+. ./perf-lib.sh
+
+test_perf_fresh_repo
+
+test_expect_success "setup" '
+	git config set core.repositoryformatversion 1 &&
+	test_commit PRE &&
+	git refs migrate --ref-format=reftable &&
+	test_seq 200000 |
+	sed "s,.*,create refs/heads/branch-& HEAD," |
+	git update-ref --stdin &&
+	git pack-refs --all &&
+	git for-each-ref --format="%(refname)" refs/heads/ >sorted &&
+	awk "{ print (NR * 7919) % 200000 \" \" \$0 }" sorted |
+	sort -n | cut -d" " -f2 >unsorted
+'
+
+test_perf "seek refs in sorted order" '
+	test-tool dump-reftable -k .git/reftable <sorted
+'
+
+test_perf "seek refs in unsorted order" '
+	test-tool dump-reftable -k .git/reftable <unsorted
+'
+
+test_done
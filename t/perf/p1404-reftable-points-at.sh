@@ -0,0 +1,44 @@
+#!/bin/sh
+
+test_description="Tests performance of looking up reftable refs by object ID"
+
+. ./perf-lib.sh
+
+test_perf_fresh_repo
+
+test_expect_success "setup" '
+	git config set core.repositoryformatversion 1 &&
+	test_commit PRE &&
+	git refs migrate --ref-format=reftable &&
+	awk "BEGIN {
+		for (i = 1; i <= 100000; i++) {
+			msg = \"commit \" i;
+			printf \"commit refs/heads/branch-%d\\n\", i;
+			printf \"mark :%d\\n\", i;
+			printf \"committer C <c@example.com> 1234567890 +0000\\n\";
+			printf \"data %d\\n%s\\n\\n\", length(msg), msg;
+			printf \"reset refs/tags/tag-%d\\nfrom :%d\\n\\n\", i, i;
+		}
+	}" | git fast-import --quiet &&
+	git pack-refs --all &&
+	git rev-parse branch-50000 >oid &&
+	test-tool pkt-line pack >request <<-EOF
+	want $(cat oid)
+	0000
+	done
+	EOF
+'
+
+test_perf "for-each-ref --points-at" '
+	git for-each-ref --points-at=$(cat oid)
+'
+
+test_perf "tag --points-at" '
+	git tag --points-at=$(cat oid)
+'
+
+test_perf "stateless upload-pack of a single tip" '
+	git upload-pack --stateless-rpc . <request >/dev/null
+'
+
+test_done
@@ -71,4 +71,20 @@ done
 
 test_all_with_args --path-walk
 
+test_expect_success 'populate delta attempt cache' '
+	git -c pack.deltaAttemptCache=true repack -adf
+'
+
+# The first run above recorded the pairs that did not produce a delta;
+# each timed run now starts from the cache written by the previous one.
+test_perf 'repack with pack.deltaAttemptCache' '
+	git -c pack.deltaAttemptCache=true repack -adf
+'
+
+test_size 'repack size with pack.deltaAttemptCache' '
+	gitdir=$(git rev-parse --git-dir) &&
+	pack=$(ls $gitdir/objects/pack/pack-*.pack) &&
+	test_file_size "$pack"
+'
+
 test_done
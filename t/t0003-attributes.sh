@@ -321,6 +321,63 @@ EOF
 	test_must_be_empty err
 '
 
+test_expect_success 'many rules keep the precedence of the stack' '
+	test_when_finished "rm -rf many" &&
+	mkdir -p many/sub &&
+	(
+		cd many &&
+		for i in $(test_seq 1 20)
+		do
+			echo "name$i n=$i" &&
+			echo "*.s$i s=$i" || return 1
+		done >.gitattributes &&
+		cat >>.gitattributes <<-\EOF &&
+		*.c lang=c
+		special.c lang=special
+		a/b/*.c deep
+		/x/*.c nope
+		docs/ dir
+		file* generic
+		EOF
+		echo "*.c lang=sub" >sub/.gitattributes &&
+		cat >paths <<-\EOF &&
+		name3
+		a/name3
+		a/b/x.s17
+		special.c
+		a/special.c
+		a/b/one.c
+		x/one.c
+		y/x/one.c
+		sub/one.c
+		sub/special.c
+		sub/file1.c
+		docs/
+		docs
+		EOF
+		cat >expect <<-\EOF &&
+		name3: n: 3
+		a/name3: n: 3
+		a/b/x.s17: s: 17
+		special.c: lang: special
+		a/special.c: lang: special
+		a/b/one.c: lang: c
+		a/b/one.c: deep: set
+		x/one.c: lang: c
+		x/one.c: nope: set
+		y/x/one.c: lang: c
+		sub/one.c: lang: sub
+		sub/special.c: lang: sub
+		sub/file1.c: lang: sub
+		sub/file1.c: generic: set
+		docs/: dir: set
+		EOF
+		git check-attr --stdin n s lang deep nope dir generic <paths >actual &&
+		grep -v unspecified actual >actual.specified &&
+		test_cmp expect actual.specified
+	)
+'
+
 test_expect_success 'using --git-dir and --work-tree' '
 	mkdir unreal real &&
 	git init real &&
@@ -858,6 +858,60 @@ test_expect_success '** not confused by matching leading prefix' '
 	test_cmp expect actual
 '
 
+test_expect_success 'long lists of patterns keep the last match' '
+	test_when_finished "rm -rf build cache data sub x .gitignore" &&
+	{
+		for i in $(test_seq 20)
+		do
+			echo "gen$i.o" || return 1
+		done &&
+		cat <<-\EOF
+		*.tmp
+		!keep.tmp
+		/build/out
+		sub/literal
+		cache/
+		*.log
+		!*important*
+		data/*.csv
+		important.log
+		EOF
+	} >.gitignore &&
+	mkdir -p build cache data sub x &&
+	>x/cache &&
+	{
+		for i in $(test_seq 16)
+		do
+			echo "unused$i" || return 1
+		done &&
+		echo /deep/file
+	} >sub/.gitignore &&
+	git check-ignore -v -n gen3.o sub/gen20.o gen21.o a.tmp keep.tmp \
+		build/out sub/build/out sub/literal cache x/cache a.log \
+		very-important.log important.log data/a.csv data/x/a.csv \
+		sub/deep/file deep/file >actual &&
+	cat >expect <<-EOF &&
+	.gitignore:3:gen3.o	gen3.o
+	.gitignore:20:gen20.o	sub/gen20.o
+	::	gen21.o
+	.gitignore:21:*.tmp	a.tmp
+	.gitignore:22:!keep.tmp	keep.tmp
+	.gitignore:23:/build/out	build/out
+	::	sub/build/out
+	.gitignore:24:sub/literal	sub/literal
+	.gitignore:25:cache/	cache
+	::	x/cache
+	.gitignore:26:*.log	a.log
+	.gitignore:27:!*important*	very-important.log
+	.gitignore:29:important.log	important.log
+	.gitignore:28:data/*.csv	data/a.csv
+	::	data/x/a.csv
+	sub/.gitignore:17:/deep/file	sub/deep/file
+	::	deep/file
+	EOF
+	test_cmp expect actual
+'
+
 ############################################################################
 #
 # test whitespace handling
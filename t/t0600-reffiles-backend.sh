@@ -540,4 +540,80 @@ test_expect_success SYMLINKS,!MINGW,!WITH_BREAKING_CHANGES 'core.preferSymlinkRe
 	test "$(test_readlink .git/TEST_SYMREF_HEAD)" = refs/heads/new
 '
 
+test_expect_success 'deleting packed refs appends to packed-refs.delta' '
+	test_when_finished "rm -rf delta" &&
+	git init delta &&
+	test_commit -C delta initial &&
+	for i in $(test_seq 100)
+	do
+		echo "create refs/heads/branch-$i HEAD" || return 1
+	done >input &&
+	git -C delta update-ref --stdin <input &&
+	git -C delta config core.repositoryformatversion 1 &&
+	git -C delta config extensions.packedRefsDelta true &&
+	git -C delta config core.packedRefsDeltaSize 1m &&
+	git -C delta pack-refs --all &&
+	cp delta/.git/packed-refs packed-refs.orig &&
+
+	git -C delta branch -D branch-1 branch-2 &&
+	git -C delta update-ref -d refs/heads/branch-3 &&
+	test_cmp packed-refs.orig delta/.git/packed-refs &&
+	test_path_is_file delta/.git/packed-refs.delta &&
+	test_must_fail git -C delta rev-parse --verify -q branch-2 &&
+	git -C delta for-each-ref --format="%(refname)" refs/heads/branch-? >actual &&
+	test_write_lines refs/heads/branch-4 refs/heads/branch-5 \
+		refs/heads/branch-6 refs/heads/branch-7 refs/heads/branch-8 \
+		refs/heads/branch-9 >expect &&
+	test_cmp expect actual &&
+
+	# A transaction that was not finished is ignored.
+	echo "$(git -C delta rev-parse HEAD) refs/heads/branch-1" \
+		>>delta/.git/packed-refs.delta &&
+	test_must_fail git -C delta rev-parse --verify -q branch-1 &&
+	git -C delta update-ref refs/heads/branch-2 HEAD &&
+	git -C delta pack-refs --all &&
+	test_path_is_missing delta/.git/packed-refs.delta &&
+	git -C delta for-each-ref --format="%(refname)" refs/heads/branch-? >actual &&
+	test_write_lines refs/heads/branch-2 refs/heads/branch-4 \
+		refs/heads/branch-5 refs/heads/branch-6 refs/heads/branch-7 \
+		refs/heads/branch-8 refs/heads/branch-9 >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'packed-refs.delta needs extensions.packedRefsDelta' '
+	test_when_finished "rm -rf delta" &&
+	git init delta &&
+	test_commit -C delta initial &&
+	git -C delta branch branch-1 &&
+	git -C delta config core.packedRefsDeltaSize 1m &&
+	git -C delta pack-refs --all &&
+	cp delta/.git/packed-refs packed-refs.orig &&
+	git -C delta branch -D branch-1 &&
+	test_path_is_missing delta/.git/packed-refs.delta &&
+	! test_cmp packed-refs.orig delta/.git/packed-refs
+'
+
+test_expect_success 'packed-refs.delta of an older packed-refs is ignored' '
+	test_when_finished "rm -rf delta" &&
+	git init delta &&
+	test_commit -C delta initial &&
+	for i in $(test_seq 100)
+	do
+		echo "create refs/heads/branch-$i HEAD" || return 1
+	done >input &&
+	git -C delta update-ref --stdin <input &&
+	git -C delta config core.repositoryformatversion 1 &&
+	git -C delta config extensions.packedRefsDelta true &&
+	git -C delta config core.packedRefsDeltaSize 1m &&
+	git -C delta pack-refs --all &&
+	git -C delta branch -D branch-1 &&
+	cp delta/.git/packed-refs.delta delta.saved &&
+	git -C delta branch branch-1 &&
+	git -C delta pack-refs --all &&
+	mv delta.saved delta/.git/packed-refs.delta &&
+	git -C delta rev-parse --verify branch-1 &&
+	git -C delta for-each-ref refs/heads/branch-1 >actual &&
+	test_line_count = 1 actual
+'
+
 test_done
@@ -368,6 +368,46 @@ test_expect_success 'ref transaction: alternating table sizes are compacted' '
 	test_line_count = 2 repo/.git/reftable/tables.list
 '
 
+test_expect_success 'ref transaction: compaction can be deferred' '
+	test_when_finished "rm -rf repo" &&
+
+	git init repo &&
+	test_commit -C repo --no-tag A &&
+	test_line_count = 1 repo/.git/reftable/tables.list &&
+	git -C repo config set reftable.deferCompaction true &&
+	git -C repo config set reftable.maxTables 5 &&
+
+	for i in $(test_seq 4)
+	do
+		git -C repo update-ref refs/heads/branch-$i HEAD &&
+		test_line_count = $((i + 1)) repo/.git/reftable/tables.list ||
+		return 1
+	done &&
+
+	# Exceeding the ceiling makes the writer compact anyway.
+	git -C repo update-ref refs/heads/branch-5 HEAD &&
+	test_line_count = 1 repo/.git/reftable/tables.list
+'
+
+test_expect_success 'ref transaction: deferred compaction is done by maintenance' '
+	test_when_finished "rm -rf repo" &&
+
+	git init repo &&
+	test_commit -C repo --no-tag A &&
+	git -C repo config set reftable.deferCompaction true &&
+	for i in $(test_seq 3)
+	do
+		git -C repo update-ref refs/heads/branch-$i HEAD || return 1
+	done &&
+	test_line_count = 4 repo/.git/reftable/tables.list &&
+
+	GIT_TRACE2_EVENT="$(pwd)/trace2.txt" \
+		git -C repo maintenance run --auto --task=pack-refs &&
+	test_line_count = 1 repo/.git/reftable/tables.list &&
+	test_grep "\"category\":\"reftable\",\"label\":\"compaction\"" trace2.txt &&
+	test_grep "\"key\":\"compaction/bytes\"" trace2.txt
+'
+
 check_fsync_events () {
 	local trace="$1" &&
 	shift &&
@@ -492,6 +532,39 @@ test_expect_success !CYGWIN 'ref transaction: many concurrent writers' '
 	)
 '
 
+test_expect_success !CYGWIN 'ref transaction: concurrent optimistic writers race compaction' '
+	test_when_finished "rm -rf repo" &&
+	git init repo &&
+	(
+		cd repo &&
+		# See above for the timeout.
+		git config set reftable.lockTimeout 300000 &&
+		git config set reftable.optimisticWrites true &&
+		test_commit --no-tag initial &&
+
+		head=$(git rev-parse HEAD) &&
+		test_seq -f "$head commit\trefs/heads/branch-%d" 100 >expect &&
+		printf "%s commit\trefs/heads/main\n" "$head" >>expect &&
+
+		# Every writer auto-compacts the stack when it is done, and
+		# the occasional pack-refs compacts all of it, dropping the
+		# tables that the other writers have written against.
+		for i in $(test_seq 100)
+		do
+			{ git update-ref refs/heads/branch-$i HEAD& } &&
+			if test $((i % 10)) -eq 0
+			then
+				{ git pack-refs --all& }
+			fi ||
+			return 1
+		done &&
+
+		wait &&
+		git for-each-ref --sort=v:refname >actual &&
+		test_cmp expect actual
+	)
+'
+
 test_expect_success 'pack-refs: compacts tables' '
 	test_when_finished "rm -rf repo" &&
 	git init repo &&
@@ -696,6 +769,105 @@ test_expect_success 'basic: for-each-ref can print symrefs' '
 	)
 '
 
+test_expect_success 'basic: --points-at looks up refs by object ID' '
+	test_when_finished "rm -rf repo" &&
+	git init repo &&
+	(
+		cd repo &&
+		git config set reftable.blockSize 512 &&
+		test_commit A &&
+		test_commit B &&
+		git tag -m annotated annotated A &&
+		git tag -m nested nested annotated &&
+		git branch moved A &&
+		git branch deleted A &&
+		git symbolic-ref refs/heads/sym refs/heads/moved &&
+		for i in $(test_seq 200)
+		do
+			echo "create refs/heads/branch-$i HEAD" || return 1
+		done | git update-ref --stdin &&
+		# Make sure that the table has an object index.
+		git pack-refs &&
+		test-tool dump-reftable -b .git/reftable/0x*.ref >dump &&
+		test_grep "^obj" dump &&
+
+		git branch -f moved B &&
+		git branch -D deleted &&
+		git branch new A &&
+
+		cat >expect <<-EOF &&
+		$(git rev-parse A) refs/heads/new 0x0
+		$(git rev-parse A) refs/tags/A 0x0
+		$(git rev-parse annotated) refs/tags/annotated 0x0
+		$(git rev-parse nested) refs/tags/nested 0x0
+		EOF
+		test-tool ref-store main for-each-ref-pointing-at \
+			$(git rev-parse A) >actual &&
+		test_cmp expect actual &&
+
+		test_write_lines refs/heads/new refs/tags/A \
+			refs/tags/annotated refs/tags/nested >expect &&
+		git for-each-ref --points-at=A --format="%(refname)" >actual &&
+		test_cmp expect actual &&
+
+		test_write_lines annotated nested >expect &&
+		git tag --points-at=annotated >actual &&
+		test_cmp expect actual &&
+
+		git branch --points-at=B --format="%(refname:short)" >actual &&
+		test_line_count = 203 actual &&
+		test_write_lines main moved sym >expect &&
+		grep -v ^branch- actual >actual.filtered &&
+		test_cmp expect actual.filtered
+	)
+'
+
+test_expect_success 'upload-pack: stateless requests look up wanted refs' '
+	test_when_finished "rm -rf repo" &&
+	git init repo &&
+	(
+		cd repo &&
+		test_commit --no-tag A &&
+		test_commit B &&
+		git tag -m annotated annotated &&
+		hidden=$(git commit-tree -m hidden HEAD^{tree}) &&
+		git update-ref refs/hidden/ref $hidden &&
+		unreachable=$(git commit-tree -m unreachable HEAD^{tree}) &&
+
+		for want in B annotated B~1
+		do
+			oid=$(git rev-parse $want) &&
+			test-tool pkt-line pack >request <<-EOF &&
+			want $oid
+			0000
+			done
+			EOF
+			git upload-pack --stateless-rpc . <request >out ||
+			return 1
+		done &&
+
+		test-tool pkt-line pack >request <<-EOF &&
+		want $hidden
+		0000
+		done
+		EOF
+		git -c uploadpack.allowTipSHA1InWant \
+			-c uploadpack.hideRefs=refs/hidden \
+			upload-pack --stateless-rpc . <request >out &&
+		test_must_fail git -c uploadpack.hideRefs=refs/hidden \
+			upload-pack --stateless-rpc . <request >out 2>err &&
+		test_grep "not our ref $hidden" err &&
+
+		test-tool pkt-line pack >request <<-EOF &&
+		want $unreachable
+		0000
+		done
+		EOF
+		test_must_fail git upload-pack --stateless-rpc . <request >out 2>err &&
+		test_grep "not our ref $unreachable" err
+	)
+'
+
 test_expect_success 'basic: notes' '
 	test_when_finished "rm -rf repo" &&
 	git init repo &&
@@ -1109,6 +1281,37 @@ test_expect_success 'worktree: can access common refs' '
 	git -C worktree checkout branch1
 '
 
+test_expect_success 'worktree: looking up refs by object ID' '
+	test_when_finished "rm -rf repo worktree" &&
+	git init repo &&
+	test_commit -C repo A &&
+	git -C repo worktree add ../worktree &&
+	git -C repo update-ref refs/bisect/main HEAD &&
+	git -C worktree update-ref refs/bisect/worktree HEAD &&
+
+	oid=$(git -C repo rev-parse A) &&
+	cat >expect <<-EOF &&
+	$oid refs/bisect/main 0x0
+	$oid refs/heads/main 0x0
+	$oid refs/heads/worktree 0x0
+	$oid refs/tags/A 0x0
+	EOF
+	git -C repo for-each-ref --format="%(objectname) %(refname) 0x0" \
+		--points-at=A >actual &&
+	test_cmp expect actual &&
+	(cd repo && test-tool ref-store main for-each-ref-pointing-at $oid) >actual &&
+	test_cmp expect actual &&
+
+	cat >expect <<-EOF &&
+	$oid refs/bisect/worktree 0x0
+	$oid refs/heads/main 0x0
+	$oid refs/heads/worktree 0x0
+	$oid refs/tags/A 0x0
+	EOF
+	(cd worktree && test-tool ref-store main for-each-ref-pointing-at $oid) >actual &&
+	test_cmp expect actual
+'
+
 test_expect_success 'worktree: adds worktree with detached HEAD' '
 	test_when_finished "rm -rf repo worktree" &&
 
@@ -416,4 +416,36 @@ test_expect_success '-m references the correct modified tree' '
 	test_cmp expect actual
 '
 
+test_expect_success 'two-way merge with trees read on threads' '
+	git init threads &&
+	(
+		cd threads &&
+		for i in $(test_seq 1 20)
+		do
+			mkdir -p d$i/changed d$i/same &&
+			echo $i >d$i/changed/file &&
+			echo $i >d$i/same/file || return 1
+		done &&
+		git add . &&
+		git commit -m one &&
+		for i in $(test_seq 1 20)
+		do
+			echo more >>d$i/changed/file &&
+			rm -r d$((21 - $i))/same &&
+			mkdir d$i/new &&
+			echo $i >d$i/new/file || return 1
+		done &&
+		git add -A &&
+		git commit -m two &&
+		git ls-files -s >expect &&
+		git read-tree -m -u HEAD HEAD^ &&
+		GIT_TRACE2_EVENT="$(pwd)/trace" GIT_TRACE2_EVENT_NESTING=10 \
+			git -c core.unpackTreesThreads=4 read-tree -m -u HEAD^ HEAD &&
+		git ls-files -s >actual &&
+		test_cmp expect actual &&
+		git diff --exit-code HEAD &&
+		test_grep "\"key\":\"prefetch/threads\",\"value\":\"4\"" trace
+	)
+'
+
 test_done
@@ -1481,4 +1481,46 @@ test_objects_filter "object:type=commit"
 test_objects_filter "object:type=tag"
 test_objects_filter "object:type=tree"
 
+test_expect_success '--threads requires --buffer' '
+	test_incompatible_usage git cat-file --batch --threads=2 </dev/null
+'
+
+test_expect_success PTHREADS 'set up input for --threads' '
+	git rev-list --objects --all >objects-and-paths &&
+	{
+		cut -d" " -f1 objects-and-paths &&
+		echo HEAD &&
+		echo does-not-exist &&
+		echo HEAD:morx &&
+		cat objects-and-paths
+	} >threads-input
+'
+
+for batch in --batch --batch-check "--batch=%(objectname) %(rest)"
+do
+	test_expect_success PTHREADS "--threads keeps output in order for $batch" '
+		git cat-file "$batch" --buffer <threads-input >expect &&
+		git cat-file "$batch" --buffer --threads=4 <threads-input >actual &&
+		test_cmp expect actual
+	'
+done
+
+test_expect_success PTHREADS '--threads with --batch-command --buffer' '
+	sed -e "s/^/contents /" -e "10s/^contents/info/" <threads-input |
+	sed -e "20a\\
+flush" >cmds &&
+	git cat-file --batch-command --buffer <cmds >expect &&
+	git cat-file --batch-command --buffer --threads=4 <cmds >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success PTHREADS '--threads with --batch-all-objects' '
+	git cat-file --batch --batch-all-objects >expect &&
+	git cat-file --batch --batch-all-objects --threads=4 >actual &&
+	test_cmp expect actual &&
+	git cat-file --batch --batch-all-objects --unordered >expect &&
+	git cat-file --batch --batch-all-objects --unordered --threads=4 >actual &&
+	test_cmp expect actual
+'
+
 test_done
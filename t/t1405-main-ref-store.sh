@@ -55,6 +55,23 @@ test_expect_success 'for_each_ref() is sorted' '
 	test_cmp expected actual
 '
 
+test_expect_success 'for_each_ref_pointing_at()' '
+	test_when_finished "git tag -d annotated" &&
+	git tag -m annotated annotated one &&
+	oid=$(git rev-parse one) &&
+	tag=$(git rev-parse annotated) &&
+	$RUN for-each-ref-pointing-at $oid >actual &&
+	cat >expected <<-EOF &&
+	$oid refs/heads/new-main 0x0
+	$tag refs/tags/annotated 0x0
+	$oid refs/tags/one 0x0
+	EOF
+	test_cmp expected actual &&
+	$RUN for-each-ref-pointing-at $tag >actual &&
+	echo "$tag refs/tags/annotated 0x0" >expected &&
+	test_cmp expected actual
+'
+
 test_expect_success 'resolve_ref(new-main)' '
 	SHA1=`git rev-parse new-main` &&
 	echo "$SHA1 refs/heads/new-main 0x0" >expected &&
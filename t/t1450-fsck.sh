@@ -923,6 +923,48 @@ test_expect_success 'fsck fails on corrupt packfile' '
 	test_grep "checksum mismatch" out
 '
 
+test_expect_success 'fsck --threads reports the same problems' '
+	test_when_finished "rm -rf threads" &&
+	git init threads &&
+	(
+		cd threads &&
+		for i in $(test_seq 1 100)
+		do
+			echo "blob $i" | git hash-object -w --stdin || return 1
+		done >blobs &&
+		pack=$(git pack-objects .git/objects/pack/pack <blobs) &&
+		rm -rf .git/objects/?? &&
+
+		# Corrupt the data of two objects far enough apart to end
+		# up in different ranges.
+		git verify-pack -v .git/objects/pack/pack-$pack >objects &&
+		for n in 20 80
+		do
+			oid=$(sed -n ${n}p blobs) &&
+			offset=$(sed -n "s/^$oid .* \(.*\)$/\1/p" objects) &&
+			chmod a+w .git/objects/pack/pack-$pack.pack &&
+			printf "\377\377\377\377" |
+			dd of=.git/objects/pack/pack-$pack.pack bs=1 conv=notrunc \
+				seek=$(($offset + 4)) || return 1
+		done &&
+
+		test_must_fail git fsck --threads=1 2>err.1 &&
+		grep "^error: .*pack-$pack" err.1 >expect &&
+		test_line_count = 5 expect &&
+		test_must_fail env GIT_TRACE2_EVENT="$(pwd)/trace" \
+			git fsck --threads=4 2>err.4 &&
+		grep "^error: .*pack-$pack" err.4 >actual &&
+		test_cmp expect actual &&
+		test_grep "\"region_enter\".*\"category\":\"fsck\",\"label\":\"objects\"" trace &&
+		test_grep "\"region_enter\".*\"category\":\"fsck\",\"label\":\"connectivity\"" trace
+	)
+'
+
+test_expect_success 'fsck rejects negative --threads' '
+	test_must_fail git fsck --threads=-1 2>err &&
+	test_grep "invalid number of threads" err
+'
+
 test_expect_success 'fsck finds problems in duplicate loose objects' '
 	rm -rf broken-duplicate &&
 	git init broken-duplicate &&
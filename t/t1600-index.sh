@@ -133,4 +133,246 @@ test_expect_success 'index version config precedence' '
 	test_index_version 0 true 2 2
 '
 
+test_expect_success 'index.mapEntries reads entries from a mapped copy' '
+	git init map &&
+	(
+		cd map &&
+		for i in $(test_seq 1 20)
+		do
+			echo $i >file$i || return 1
+		done &&
+		mkdir dir &&
+		echo sub >dir/sub &&
+		git add . &&
+		git ls-files -s --debug >expect &&
+		git config index.mapEntries true &&
+
+		git ls-files -s --debug >actual &&
+		test_cmp expect actual &&
+		test_path_is_missing .git/index.entries &&
+		git update-index --force-write-index &&
+		test_path_is_file .git/index.entries &&
+
+		GIT_TRACE2_EVENT="$(pwd)/trace" git ls-files -s --debug >actual &&
+		test_cmp expect actual &&
+		test_grep "\"key\":\"read/mapped_entries\",\"value\":\"21\"" trace &&
+
+		echo changed >file3 &&
+		git add file3 &&
+		git rm -q --cached file7 &&
+		git -c index.mapEntries=false ls-files -s --debug >expect &&
+		rm -f trace &&
+		GIT_TRACE2_EVENT="$(pwd)/trace" git ls-files -s --debug >actual &&
+		test_cmp expect actual &&
+		test_grep "\"key\":\"read/mapped_entries\",\"value\":\"20\"" trace
+	)
+'
+
+test_expect_success 'index.mapEntries ignores a damaged copy' '
+	(
+		cd map &&
+		git ls-files -s --debug >expect &&
+		test_copy_bytes 100 <.git/index.entries >truncated &&
+		cp truncated .git/index.entries &&
+		rm -f trace &&
+		GIT_TRACE2_EVENT="$(pwd)/trace" git ls-files -s --debug >actual &&
+		test_cmp expect actual &&
+		test_grep ! read/mapped_entries trace &&
+		git ls-files -s --debug >actual &&
+		test_cmp expect actual &&
+		test_copy_bytes 100 <.git/index.entries >actual &&
+		test_cmp truncated actual &&
+		git update-index --force-write-index &&
+		rm -f trace &&
+		GIT_TRACE2_EVENT="$(pwd)/trace" git ls-files -s --debug >actual &&
+		test_cmp expect actual &&
+		test_grep read/mapped_entries trace &&
+		git -c index.mapEntries=false status --porcelain >expect &&
+		git status --porcelain >actual &&
+		test_cmp expect actual
+	)
+'
+
+test_expect_success 'index.mapEntries checks the checksum of the copy' '
+	(
+		cd map &&
+		git ls-files -s --debug >expect &&
+		perl -0777 -pi -e "s|dir/sub|dir/SUB|" .git/index.entries &&
+		rm -f trace &&
+		GIT_TRACE2_EVENT="$(pwd)/trace" git ls-files -s --debug >actual &&
+		test_cmp expect actual &&
+		test_grep ! read/mapped_entries trace
+	)
+'
+
+test_expect_success 'index.mapEntries only writes a copy that is out of date' '
+	(
+		cd map &&
+		test-tool chmtime =-3600 file* dir/sub &&
+		git update-index --refresh &&
+		test-tool chmtime =-60 .git/index.entries &&
+		test-tool chmtime --get .git/index.entries >before &&
+		git update-index --force-write-index &&
+		test-tool chmtime --get .git/index.entries >after &&
+		test_cmp before after &&
+
+		echo changed-again >file3 &&
+		git add file3 &&
+		test-tool chmtime --get .git/index.entries >after &&
+		! test_cmp before after &&
+		rm -f trace &&
+		GIT_TRACE2_EVENT="$(pwd)/trace" git ls-files -s --debug >actual &&
+		test_grep read/mapped_entries trace
+	)
+'
+
+test_expect_success 'index.incrementalWrite reuses unchanged blocks of entries' '
+	git init incremental &&
+	(
+		cd incremental &&
+		for i in $(test_seq 1 3000)
+		do
+			echo $i >file$i || return 1
+		done &&
+		test-tool chmtime =-3600 file* &&
+		git add . &&
+		cp .git/index .git/full &&
+
+		both () {
+			git -c index.incrementalWrite=true "$@" &&
+			GIT_INDEX_FILE=.git/full git "$@"
+		} &&
+		check () {
+			GIT_INDEX_FILE=.git/full git ls-files -s --debug >expect &&
+			git ls-files -s --debug >actual &&
+			test_cmp expect actual &&
+			git -c index.threads=4 ls-files -s --debug >actual &&
+			test_cmp expect actual
+		} &&
+
+		for version in 4 2
+		do
+			both update-index --index-version $version &&
+			echo $version >file1500 &&
+			echo $version >new$version &&
+			test-tool chmtime =-$((3600 + $version)) file1500 new$version &&
+			rm -f trace &&
+			test_env GIT_TRACE2_EVENT="$(pwd)/trace" both add file1500 &&
+			test_grep "\"key\":\"write/reused_entries\",\"value\":\"[1-9]" trace &&
+			check &&
+			both add new$version &&
+			check &&
+			both rm -q --cached file$version file2$version &&
+			check &&
+			both update-index --chmod=+x file100 &&
+			check || return 1
+		done &&
+		echo file100 >expect &&
+		git diff-files --name-only >actual &&
+		test_cmp expect actual
+	)
+'
+
+test_expect_success 'index.blockChecksums verifies blocks of entries' '
+	git init block-checksums &&
+	(
+		cd block-checksums &&
+		git config index.skipHash true &&
+		git config index.blockChecksums true &&
+		for i in $(test_seq 1 3000)
+		do
+			echo $i >file$i || return 1
+		done &&
+		test-tool chmtime =-3600 file* &&
+		git add . &&
+		git -c index.blockChecksums=false ls-files -s --debug >expect &&
+		git -c index.threads=1 ls-files -s --debug >actual &&
+		test_cmp expect actual &&
+		git -c index.threads=4 ls-files -s --debug >actual &&
+		test_cmp expect actual &&
+
+		echo changed >file1500 &&
+		test-tool chmtime =-3500 file1500 &&
+		git -c index.incrementalWrite=true add file1500 &&
+		git -c index.threads=4 ls-files -s --debug >actual &&
+		git -c index.threads=1 ls-files -s --debug >expect &&
+		test_cmp expect actual &&
+
+		printf "\377" |
+		dd of=.git/index bs=1 seek=5000 count=1 conv=notrunc &&
+		test_must_fail git -c index.threads=1 ls-files 2>err &&
+		test_grep "bad index file checksum for block 0" err &&
+		test_must_fail git -c index.threads=4 ls-files 2>err &&
+		test_grep "bad index file checksum for block 0" err
+	)
+'
+
+test_expect_success 'index.blockChecksums covers the other extensions' '
+	git init block-checksums-ext &&
+	(
+		cd block-checksums-ext &&
+		git config index.skipHash true &&
+		git config index.blockChecksums true &&
+		test_commit one &&
+		git ls-files >/dev/null &&
+
+		# The cache-tree is the last extension before IBCS (a
+		# version, one block hash and the root), EOIE and the
+		# trailer; flip the last byte of its tree id.
+		rawsz=$(test_oid rawsz) &&
+		size=$(wc -c <.git/index) &&
+		offset=$(($size - $rawsz - (12 + $rawsz) - (12 + 2 * $rawsz) - 1)) &&
+		printf "\377" |
+		dd of=.git/index bs=1 seek=$offset count=1 conv=notrunc &&
+		test_must_fail git ls-files 2>err &&
+		test_grep "bad index file root checksum" err
+	)
+'
+
+test_expect_success 'index.nameHash answers case-insensitive lookups' '
+	git init name-hash &&
+	(
+		cd name-hash &&
+		git config core.ignoreCase true &&
+		git config index.nameHash true &&
+		mkdir -p Dir/Sub other &&
+		for i in $(test_seq 1 20)
+		do
+			echo $i >Dir/Sub/file$i &&
+			echo $i >other/file$i || return 1
+		done &&
+		git add . &&
+		git -c index.nameHash=false update-index --force-write-index &&
+		cp .git/index .git/plain &&
+		git update-index --force-write-index &&
+
+		mkdir -p dir/sub other/Sub &&
+		echo new >dir/sub/new &&
+		echo new >dir/sub/new2 &&
+		echo new >other/Sub/new &&
+
+		GIT_INDEX_FILE=.git/plain git -c index.nameHash=false \
+			status --porcelain -- dir other >expect &&
+		rm -f trace &&
+		GIT_TRACE2_EVENT="$(pwd)/trace" \
+			git status --porcelain -- dir other >actual &&
+		test_cmp expect actual &&
+		test_grep "\"key\":\"read/name_hash_table\",\"value\":\"40\"" trace &&
+		test_grep ! name-hash-init trace &&
+
+		GIT_INDEX_FILE=.git/plain git -c index.nameHash=false add dir other &&
+		GIT_INDEX_FILE=.git/plain git ls-files -s >expect &&
+		git add dir other &&
+		git ls-files -s >actual &&
+		test_cmp expect actual &&
+		test_grep Dir/Sub/new2 actual &&
+
+		rm -f trace &&
+		GIT_TRACE2_EVENT="$(pwd)/trace" git add dir/sub/new2 &&
+		test_grep "\"key\":\"read/name_hash_table\",\"value\":\"43\"" trace &&
+		git ls-files -s >actual &&
+		test_cmp expect actual
+	)
+'
+
 test_done
@@ -106,11 +106,13 @@ test_expect_success 'setup repo for checkout with various types of changes' '
 	)
 '
 
-for mode in sequential parallel sequential-fallback
+for mode in sequential parallel threaded sequential-fallback
 do
+	threads=false
 	case $mode in
 	sequential)          workers=1 threshold=0 expected_workers=0 ;;
 	parallel)            workers=2 threshold=0 expected_workers=2 ;;
+	threaded)            workers=2 threshold=0 expected_workers=0 threads=true ;;
 	sequential-fallback) workers=2 threshold=100 expected_workers=0 ;;
 	esac
 
@@ -127,24 +129,26 @@ do
 		#
 		git -C $repo submodule foreach "git update-index --refresh" &&
 
-		set_checkout_config $workers $threshold &&
+		set_checkout_config $workers $threshold $threads &&
 		test_checkout_workers $expected_workers \
 			git -C $repo checkout --recurse-submodules B2 &&
 		verify_checkout $repo
 	'
 done
 
-for mode in parallel sequential-fallback
+for mode in parallel threaded sequential-fallback
 do
+	threads=false
 	case $mode in
 	parallel)            workers=2 threshold=0 expected_workers=2 ;;
+	threaded)            workers=2 threshold=0 expected_workers=0 threads=true ;;
 	sequential-fallback) workers=2 threshold=100 expected_workers=0 ;;
 	esac
 
 	test_expect_success "$mode checkout on clone" '
 		test_config_global protocol.file.allow always &&
 		repo=various_${mode}_clone &&
-		set_checkout_config $workers $threshold &&
+		set_checkout_config $workers $threshold $threads &&
 		test_checkout_workers $expected_workers \
 			git clone --recurse-submodules --branch B2 various $repo &&
 		verify_checkout $repo
@@ -162,10 +166,21 @@ test_expect_success 'compare the working trees' '
 	#
 	git diff --no-index various_sequential various_parallel &&
 	git diff --no-index various_sequential various_parallel_clone &&
+	git diff --no-index various_sequential various_threaded &&
+	git diff --no-index various_sequential various_threaded_clone &&
 	git diff --no-index various_sequential various_sequential-fallback &&
 	git diff --no-index various_sequential various_sequential-fallback_clone
 '
 
+test_expect_success 'threaded checkout writes entries on worker threads' '
+	set_checkout_config 2 0 true &&
+	GIT_TRACE2_EVENT="$(pwd)/trace-threads" git clone various threads_clone &&
+	grep "\"event\":\"thread_start\".*\"thread\":\"th[0-9]*:pcheckout\"" \
+		trace-threads >thread-starts &&
+	test_line_count = 2 thread-starts &&
+	verify_checkout threads_clone
+'
+
 # Currently, each submodule is checked out in a separated child process, but
 # these subprocesses must also be able to use parallel checkout workers to
 # write the submodules' entries.
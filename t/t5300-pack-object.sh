@@ -357,6 +357,19 @@ test_expect_success 'build pack index for an existing pack' '
 	:
 '
 
+test_expect_success 'index-pack hashes objects on multiple threads' '
+	for t in 1 2 4
+	do
+		GIT_FORCE_THREADS=1 \
+		git index-pack --threads=$t -o tmp.idx test-3-${packname_3}.pack &&
+		cmp tmp.idx test-3-${packname_3}.idx &&
+		GIT_FORCE_THREADS=1 \
+		git index-pack --threads=$t --strict -o tmp.idx \
+			test-2-${packname_2}.pack &&
+		cmp tmp.idx test-2-${packname_2}.idx || return 1
+	done
+'
+
 test_expect_success 'unpacking with --strict' '
 
 	for j in a b c d e f g
@@ -742,4 +755,18 @@ test_expect_success '--path-walk thin pack' '
 	git -C server index-pack --fix-thin --stdin <out.pack
 '
 
+test_expect_success PTHREADS 'threaded delta search reports per-thread times' '
+	git -C server rev-parse HEAD >in &&
+	GIT_TRACE2_EVENT="$(pwd)/trace" git -C server pack-objects \
+		--stdout --revs --no-path-walk --no-reuse-delta --threads=3 \
+		<in >out.pack &&
+	git -C server index-pack --stdin <out.pack &&
+	for i in 0 1 2
+	do
+		test_grep "\"key\":\"delta-search/thread-$i/busy-ms\"" trace &&
+		test_grep "\"key\":\"delta-search/thread-$i/idle-ms\"" trace ||
+		return 1
+	done
+'
+
 test_done
@@ -663,6 +663,53 @@ test_expect_success 'left-right count not confused by bitmap-index' '
 	test_cmp expect actual
 '
 
+test_expect_success 'connectivity check excludes existing objects with bitmaps' '
+	test_when_finished "rm -rf connected connected.git" &&
+	git init connected &&
+	(
+		cd connected &&
+		test_commit_bulk 16 &&
+		git clone --bare . ../connected.git &&
+		git -C ../connected.git repack -adb &&
+		git -C ../connected.git config core.connectivityBitmaps true &&
+
+		echo new >new &&
+		git add new &&
+		git commit -m new &&
+		GIT_TRACE2_EVENT="$(pwd)/trace" \
+			git push ../connected.git HEAD:refs/heads/new &&
+		test_grep "\"region_enter\".*\"label\":\"haves/classic\"" trace &&
+
+		test_commit another &&
+		rm -f trace &&
+		GIT_TRACE2_EVENT="$(pwd)/trace" \
+			git -C ../connected.git -c core.connectivityBitmaps=false \
+			fetch .. HEAD:refs/heads/another &&
+		test_grep ! "\"region_enter\".*\"label\":\"haves/classic\"" trace
+	)
+'
+
+test_expect_success 'bitmap traversal notices missing blobs' '
+	test_when_finished "rm -rf missing-blob" &&
+	git init missing-blob &&
+	(
+		cd missing-blob &&
+		test_commit_bulk 16 &&
+		git repack -adb &&
+
+		blob=$(echo missing | git hash-object -w --stdin) &&
+		tree=$(printf "100644 blob %s\tmissing\n" $blob | git mktree) &&
+		commit=$(git commit-tree -p HEAD -m missing $tree) &&
+		git rev-list --objects --use-bitmap-index --quiet \
+			$commit --not --all &&
+
+		rm .git/objects/$(test_oid_to_path $blob) &&
+		test_must_fail git rev-list --objects --use-bitmap-index --quiet \
+			$commit --not --all 2>err &&
+		test_grep "missing blob object .$blob." err
+	)
+'
+
 test_bitmap_cases "pack.writeBitmapLookupTable"
 
 test_expect_success 'verify writing bitmap lookup table when enabled' '
@@ -121,4 +121,18 @@ test_expect_success 'negative depth disables deltas' '
 	test_cmp expect actual
 '
 
+test_expect_success PTHREADS 'core.deltaChainThreads inflates deep chains in parallel' '
+	# As above, reuse the existing deltas to keep the long chain.
+	git repack -ad --window=0 --no-path-walk &&
+	max_chain .git/objects/pack/pack-*.pack >depth &&
+	test $(cat depth) -ge 8 &&
+	git rev-list --objects --all | cut -d" " -f1 >oids &&
+	git -c core.deltaChainThreads=1 cat-file --batch <oids >expect &&
+	GIT_TRACE2_EVENT="$(pwd)/trace" \
+	git -c core.deltaBaseCacheLimit=0 -c core.deltaChainThreads=4 \
+		cat-file --batch <oids >actual &&
+	test_cmp expect actual &&
+	test_grep "\"category\":\"delta-chain\",\"name\":\"parallel\"" trace
+'
+
 test_done
@@ -991,4 +991,42 @@ test_expect_success 'empty repo (no index) and core.untrackedCache' '
 	git -C emptyrepo -c core.untrackedCache=true write-tree
 '
 
+test_expect_success 'core.untrackedCacheThreads reads changed directories ahead' '
+	threaded="$TRASH_DIRECTORY/threaded" &&
+	git init "$threaded" &&
+	(
+		cd "$threaded" &&
+		git config core.untrackedCache true &&
+		for i in $(test_seq 120)
+		do
+			mkdir d$i &&
+			echo tracked >d$i/tracked || return 1
+		done &&
+		git add . &&
+		git commit -q -m dirs &&
+		git status --porcelain &&
+		for i in $(test_seq 40)
+		do
+			echo untracked >d$((3 * $i))/untracked || return 1
+		done
+	) &&
+	cp -R "$threaded" "$threaded-copy" &&
+	(
+		cd "$threaded" &&
+		GIT_TRACE2_EVENT="$threaded.trace" \
+			git -c core.untrackedCacheThreads=2 status --porcelain >../threaded.actual &&
+		test-tool dump-untracked-cache >../threaded.actual-dump
+	) &&
+	grep "prefetch/scanned" "$threaded.trace" >threaded.scanned &&
+	test_line_count = 2 threaded.scanned &&
+	(
+		cd "$threaded-copy" &&
+		git status --porcelain >../threaded.expect &&
+		test-tool dump-untracked-cache >../threaded.expect-dump
+	) &&
+	test_line_count = 40 "$TRASH_DIRECTORY/threaded.expect" &&
+	test_cmp "$TRASH_DIRECTORY/threaded.expect" "$TRASH_DIRECTORY/threaded.actual" &&
+	test_cmp "$TRASH_DIRECTORY/threaded.expect-dump" "$TRASH_DIRECTORY/threaded.actual-dump"
+'
+
 test_done
@@ -1773,6 +1773,44 @@ test_expect_success 'slow status advice when core.untrackedCache true, and fsmon
 	)
 '
 
+test_lazy_prereq IO_URING '
+	test-tool lstat-batch .
+'
+
+test_expect_success 'status with core.ioUring' '
+	git init io-uring &&
+	(
+		cd io-uring &&
+		mkdir dir &&
+		for i in $(test_seq 1 50)
+		do
+			echo $i >file$i &&
+			echo $i >dir/file$i || return 1
+		done &&
+		git add . &&
+		git commit -q -m initial &&
+		echo changed >file1 &&
+		rm file2 &&
+		mv dir/file3 dir/moved &&
+		rm -r dir &&
+		ln -s . dir &&
+		git -c core.ioUring=false status --porcelain >../expect &&
+		GIT_TRACE2_EVENT="$(pwd)/../trace" GIT_TEST_PRELOAD_INDEX=1 \
+			git -c core.ioUring=true status --porcelain >../actual &&
+		test_cmp ../expect ../actual &&
+		if test_have_prereq IO_URING
+		then
+			test_grep "\"key\":\"preload/batches\",\"value\":\"[1-9]" ../trace
+		else
+			test_grep ! "\"key\":\"preload/batches\"" ../trace
+		fi &&
+		GIT_TEST_PRELOAD_INDEX=1 git -c core.ioUring=true \
+			diff --name-status >../actual &&
+		git -c core.ioUring=false diff --name-status >../expect &&
+		test_cmp ../expect ../actual
+	)
+'
+
 test_expect_success EXPENSIVE,SIZE_T_IS_64BIT 'status does not re-read unchanged 4 or 8 GiB file' '
 	(
 		mkdir large-file &&
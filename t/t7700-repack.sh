@@ -904,4 +904,52 @@ test_expect_success 'pending objects are repacked appropriately' '
 	)
 '
 
+test_expect_success 'pack.deltaAttemptCache skips known-bad pairs' '
+	git init delta-attempts &&
+	(
+		cd delta-attempts &&
+		git config pack.deltaAttemptCache true &&
+		for i in $(test_seq 1 10)
+		do
+			test-tool genrandom $i 2048 >file$i &&
+			git add file$i &&
+			git commit -m $i || return 1
+		done &&
+
+		git repack -adf --threads=1 &&
+		test_path_is_file .git/objects/pack/pack-*.dac &&
+		ls .git/objects/pack/pack-*.pack >before &&
+
+		GIT_TRACE2_EVENT="$(pwd)/trace" \
+		git repack -adf --threads=1 &&
+		test_path_is_file .git/objects/pack/pack-*.dac &&
+		test_grep "\"category\":\"delta-attempts\",\"key\":\"skipped\",\"value\":\"[1-9]" trace &&
+
+		# Skipping the known-bad pairs still finds the same deltas.
+		ls .git/objects/pack/pack-*.pack >after &&
+		test_cmp before after &&
+
+		# The cache is neither used nor written for --stdout.
+		rm -f trace &&
+		GIT_TRACE2_EVENT="$(pwd)/trace" \
+		git pack-objects --all --stdout --threads=1 </dev/null >/dev/null &&
+		test_grep ! "\"category\":\"delta-attempts\"" trace &&
+
+		# Nor is it used with a different window.
+		rm -f trace &&
+		GIT_TRACE2_EVENT="$(pwd)/trace" \
+		git repack -adf --threads=1 --window=5 &&
+		test_grep "\"category\":\"delta-attempts\",\"key\":\"loaded\",\"value\":\"0\"" trace &&
+		git repack -adf --threads=1 &&
+		ls .git/objects/pack/pack-*.pack >after &&
+		test_cmp before after &&
+
+		# A broken cache is ignored.
+		echo garbage >$(ls .git/objects/pack/pack-*.dac) &&
+		git repack -adf --threads=1 &&
+		ls .git/objects/pack/pack-*.pack >after &&
+		test_cmp before after
+	)
+'
+
 test_done
@@ -107,3 +107,44 @@ void test_hash__zero_tree_literal(void)
 		"4b825dc642cb6eb9a060e54bf8d69288fbee4904",
 		"6ef19b41225c5369f1c104d45d8d85efa9b057b53b14b4b9b939dd74decc5321");
 }
+
+void test_hash__batch_matches_single(void)
+{
+	static const char hdr[] = "blob 0123456789";
+	struct git_hash_batch_item items[200];
+	unsigned char single[ARRAY_SIZE(items)][GIT_MAX_RAWSZ];
+	unsigned char batch[ARRAY_SIZE(items)][GIT_MAX_RAWSZ];
+	char data[ARRAY_SIZE(items)];
+
+	for (size_t i = 0; i < sizeof(data); i++)
+		data[i] = i * 7;
+
+	for (size_t a = 1; a < ARRAY_SIZE(hash_algos); a++) {
+		const struct git_hash_algo *algop = &hash_algos[a];
+
+		/*
+		 * Mix lengths so that messages end in different blocks
+		 * and the header and padding straddle block boundaries.
+		 */
+		for (size_t i = 0; i < ARRAY_SIZE(items); i++) {
+			struct git_hash_ctx ctx;
+
+			items[i].hdr = hdr;
+			items[i].hdrlen = i % sizeof(hdr);
+			items[i].data = data;
+			items[i].len = i;
+			items[i].out = batch[i];
+
+			git_hash_init(&ctx, algop);
+			git_hash_update(&ctx, items[i].hdr, items[i].hdrlen);
+			git_hash_update(&ctx, items[i].data, items[i].len);
+			git_hash_final(single[i], &ctx);
+		}
+
+		git_hash_batch(algop, items, ARRAY_SIZE(items));
+
+		for (size_t i = 0; i < ARRAY_SIZE(items); i++)
+			cl_assert_equal_s(hash_to_hex_algop(batch[i], algop),
+					  hash_to_hex_algop(single[i], algop));
+	}
+}
@@ -372,6 +372,105 @@ merged_table_from_log_records(struct reftable_log_record **logs,
 	return mt;
 }
 
+static int collect_refs_for(const struct reftable_ref_record *ref, void *arg)
+{
+	struct reftable_ref_record *out = arg;
+	size_t i;
+
+	for (i = 0; out[i].refname; i++)
+		;
+	out[i].refname = xstrdup(ref->refname);
+	out[i].update_index = ref->update_index;
+	return 0;
+}
+
+static int stop_refs_for(const struct reftable_ref_record *ref REFTABLE_UNUSED,
+			 void *arg REFTABLE_UNUSED)
+{
+	return 123;
+}
+
+void test_reftable_merged__refs_for(void)
+{
+	struct reftable_ref_record r1[41] = { 0 };
+	struct reftable_ref_record r2[] = {
+		{
+			.refname = (char *) "refs/heads/branch-00",
+			.update_index = 2,
+			.value_type = REFTABLE_REF_VAL1,
+			.value.val1 = { 2 },
+		},
+		{
+			.refname = (char *) "refs/heads/branch-02",
+			.update_index = 2,
+			.value_type = REFTABLE_REF_DELETION,
+		},
+		{
+			.refname = (char *) "refs/heads/new",
+			.update_index = 2,
+			.value_type = REFTABLE_REF_VAL1,
+			.value.val1 = { 1 },
+		},
+	};
+	struct reftable_ref_record *refs[] = { r1, r2 };
+	size_t sizes[] = { ARRAY_SIZE(r1), ARRAY_SIZE(r2) };
+	struct reftable_buf bufs[2] = { REFTABLE_BUF_INIT, REFTABLE_BUF_INIT };
+	struct reftable_ref_record out[ARRAY_SIZE(r1) + ARRAY_SIZE(r2) + 1] = { 0 };
+	struct reftable_block_source *bs = NULL;
+	struct reftable_table **tables = NULL;
+	struct reftable_merged_table *mt;
+	uint8_t want[REFTABLE_HASH_SIZE_SHA1] = { 1 };
+	size_t i, n = 0;
+
+	for (i = 0; i < 40; i++) {
+		r1[i].refname = xstrfmt("refs/heads/branch-%02"PRIuMAX, (uintmax_t)i);
+		r1[i].update_index = 1;
+		r1[i].value_type = REFTABLE_REF_VAL1;
+		r1[i].value.val1[0] = i % 2 ? 2 : 1;
+	}
+	r1[40].refname = xstrdup("refs/tags/tag");
+	r1[40].update_index = 1;
+	r1[40].value_type = REFTABLE_REF_VAL2;
+	r1[40].value.val2.value[0] = 3;
+	r1[40].value.val2.target_value[0] = 1;
+
+	mt = merged_table_from_records(refs, &bs, &tables, sizes, bufs, 2);
+	/* The first table is looked up via its index, the second is scanned. */
+	cl_assert(tables[0]->obj_offsets.is_present);
+	cl_assert(!tables[1]->obj_offsets.is_present);
+
+	cl_assert_equal_i(reftable_merged_table_refs_for(mt, want, collect_refs_for,
+							 out), 0);
+
+	/*
+	 * The even branches except for the rewritten and deleted ones, the
+	 * tag via its peeled value, and the new branch.
+	 */
+	for (i = 0; out[i].refname; i++) {
+		cl_assert(strcmp(out[i].refname, "refs/heads/branch-00"));
+		cl_assert(strcmp(out[i].refname, "refs/heads/branch-02"));
+		if (!strcmp(out[i].refname, "refs/heads/new"))
+			cl_assert_equal_i(out[i].update_index, 2);
+		else
+			cl_assert_equal_i(out[i].update_index, 1);
+		n++;
+	}
+	cl_assert_equal_i(n, 20);
+
+	cl_assert_equal_i(reftable_merged_table_refs_for(mt, want, stop_refs_for,
+							 NULL), 123);
+
+	for (i = 0; out[i].refname; i++)
+		reftable_ref_record_release(&out[i]);
+	for (i = 0; i < ARRAY_SIZE(r1); i++)
+		reftable_ref_record_release(&r1[i]);
+	for (i = 0; i < ARRAY_SIZE(bufs); i++)
+		reftable_buf_release(&bufs[i]);
+	tables_destroy(tables, 2);
+	reftable_merged_table_free(mt);
+	reftable_free(bs);
+}
+
 void test_reftable_merged__logs(void)
 {
 	struct reftable_log_record r1[] = {
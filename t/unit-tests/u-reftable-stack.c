@@ -334,6 +334,249 @@ void test_reftable_stack__transaction_with_reload(void)
 	clear_dir(dir);
 }
 
+struct write_next_ref_arg {
+	struct reftable_stack *stack;
+	struct reftable_ref_record *ref;
+};
+
+static int write_next_ref(struct reftable_writer *wr, void *arg)
+{
+	struct write_next_ref_arg *a = arg;
+	uint64_t ts = reftable_stack_next_update_index(a->stack);
+
+	a->ref->update_index = ts;
+	cl_assert_equal_i(reftable_writer_set_limits(wr, ts, ts), 0);
+	return reftable_writer_add_ref(wr, a->ref);
+}
+
+static int optimistic_add(struct reftable_stack *st,
+			  struct reftable_addition **add,
+			  struct write_next_ref_arg *arg)
+{
+	cl_assert_equal_i(reftable_stack_new_addition(add, st, NULL,
+						      REFTABLE_STACK_NEW_ADDITION_OPTIMISTIC), 0);
+	return reftable_addition_add(*add, write_next_ref, arg);
+}
+
+void test_reftable_stack__optimistic_additions_rebase(void)
+{
+	char *dir = get_tmp_dir(__LINE__);
+	struct reftable_stack *st1 = NULL, *st2 = NULL;
+	struct reftable_addition *add1 = NULL, *add2 = NULL;
+	struct reftable_ref_record refs[2] = {
+		{
+			.refname = (char *) "refs/heads/a",
+			.value_type = REFTABLE_REF_VAL1,
+			.value.val1 = { '1' },
+		},
+		{
+			.refname = (char *) "refs/heads/b",
+			.value_type = REFTABLE_REF_VAL1,
+			.value.val1 = { '2' },
+		},
+	};
+	struct write_next_ref_arg arg1 = { .ref = &refs[0] };
+	struct write_next_ref_arg arg2 = { .ref = &refs[1] };
+	struct reftable_ref_record ref = { 0 };
+
+	cl_assert_equal_i(reftable_new_stack(&st1, dir, NULL), 0);
+	cl_assert_equal_i(reftable_new_stack(&st2, dir, NULL), 0);
+	arg1.stack = st1;
+	arg2.stack = st2;
+
+	/* Both additions are prepared without holding the lock. */
+	cl_assert_equal_i(optimistic_add(st1, &add1, &arg1), 0);
+	cl_assert_equal_i(optimistic_add(st2, &add2, &arg2), 0);
+	cl_assert_equal_i(refs[0].update_index, refs[1].update_index);
+
+	cl_assert_equal_i(reftable_addition_commit(add1), 0);
+	/* The second addition does not conflict and is rebased. */
+	cl_assert_equal_i(reftable_addition_commit(add2), 0);
+	cl_assert(refs[1].update_index > refs[0].update_index);
+	reftable_addition_destroy(add1);
+	reftable_addition_destroy(add2);
+
+	cl_assert_equal_i(reftable_stack_reload(st1), 0);
+	for (size_t i = 0; i < ARRAY_SIZE(refs); i++) {
+		cl_assert_equal_i(reftable_stack_read_ref(st1,
+							  refs[i].refname, &ref), 0);
+		cl_assert(reftable_ref_record_equal(&refs[i], &ref,
+						    REFTABLE_HASH_SIZE_SHA1) != 0);
+	}
+
+	reftable_ref_record_release(&ref);
+	reftable_stack_destroy(st1);
+	reftable_stack_destroy(st2);
+	clear_dir(dir);
+}
+
+void test_reftable_stack__optimistic_additions_conflict(void)
+{
+	const char *second[] = { "refs/heads/a", "refs/heads/a/b" };
+
+	for (size_t i = 0; i < ARRAY_SIZE(second); i++) {
+		char *dir = get_tmp_dir(__LINE__);
+		struct reftable_stack *st1 = NULL, *st2 = NULL;
+		struct reftable_addition *add1 = NULL, *add2 = NULL;
+		struct reftable_ref_record ref1 = {
+			.refname = (char *) "refs/heads/a",
+			.value_type = REFTABLE_REF_VAL1,
+			.value.val1 = { '1' },
+		};
+		struct reftable_ref_record ref2 = {
+			.refname = (char *) second[i],
+			.value_type = REFTABLE_REF_VAL1,
+			.value.val1 = { '2' },
+		};
+		struct write_next_ref_arg arg1 = { .ref = &ref1 };
+		struct write_next_ref_arg arg2 = { .ref = &ref2 };
+		struct reftable_ref_record ref = { 0 };
+
+		cl_assert_equal_i(reftable_new_stack(&st1, dir, NULL), 0);
+		cl_assert_equal_i(reftable_new_stack(&st2, dir, NULL), 0);
+		arg1.stack = st1;
+		arg2.stack = st2;
+
+		cl_assert_equal_i(optimistic_add(st1, &add1, &arg1), 0);
+		cl_assert_equal_i(optimistic_add(st2, &add2, &arg2), 0);
+		cl_assert_equal_i(reftable_addition_commit(add1), 0);
+		/*
+		 * The second addition touches the same ref, or creates
+		 * one that conflicts with it, so it must not be rebased.
+		 */
+		cl_assert_equal_i(reftable_addition_commit(add2),
+				  REFTABLE_OUTDATED_ERROR);
+		reftable_addition_destroy(add1);
+		reftable_addition_destroy(add2);
+
+		cl_assert_equal_i(reftable_stack_reload(st2), 0);
+		cl_assert_equal_i(reftable_stack_read_ref(st2, "refs/heads/a", &ref), 0);
+		cl_assert(reftable_ref_record_equal(&ref1, &ref,
+						    REFTABLE_HASH_SIZE_SHA1) != 0);
+		if (i)
+			cl_assert_equal_i(reftable_stack_read_ref(st2, second[i], &ref), 1);
+
+		reftable_ref_record_release(&ref);
+		reftable_stack_destroy(st1);
+		reftable_stack_destroy(st2);
+		clear_dir(dir);
+	}
+}
+
+void test_reftable_stack__optimistic_addition_after_compaction(void)
+{
+	char *dir = get_tmp_dir(__LINE__);
+	struct reftable_stack *st1 = NULL, *st2 = NULL;
+	struct reftable_addition *add = NULL;
+	struct reftable_ref_record ref1 = {
+		.refname = (char *) "refs/heads/a",
+		.update_index = 1,
+		.value_type = REFTABLE_REF_VAL1,
+		.value.val1 = { '1' },
+	};
+	struct reftable_ref_record del = {
+		.refname = (char *) "refs/heads/a",
+		.update_index = 2,
+		.value_type = REFTABLE_REF_DELETION,
+	};
+	struct reftable_ref_record ref2 = {
+		.refname = (char *) "refs/heads/a",
+		.value_type = REFTABLE_REF_VAL1,
+		.value.val1 = { '2' },
+	};
+	struct write_next_ref_arg arg = { .ref = &ref2 };
+	struct reftable_ref_record ref = { 0 };
+
+	cl_assert_equal_i(reftable_new_stack(&st1, dir, NULL), 0);
+	cl_assert_equal_i(reftable_stack_add(st1, write_test_ref, &ref1, NULL, 0), 0);
+	cl_assert_equal_i(reftable_new_stack(&st2, dir, NULL), 0);
+	arg.stack = st2;
+
+	cl_assert_equal_i(optimistic_add(st2, &add, &arg), 0);
+	cl_assert_equal_i(reftable_stack_add(st1, write_test_ref, &del, NULL, 0), 0);
+	cl_assert_equal_i(reftable_stack_compact_all(st1, NULL, NULL), 0);
+
+	/*
+	 * Compaction dropped the deletion, so there is no record left that
+	 * conflicts with the addition. It must still not be rebased over
+	 * the deletion.
+	 */
+	cl_assert_equal_i(reftable_addition_commit(add), REFTABLE_OUTDATED_ERROR);
+	reftable_addition_destroy(add);
+
+	cl_assert_equal_i(reftable_stack_reload(st2), 0);
+	cl_assert_equal_i(reftable_stack_read_ref(st2, "refs/heads/a", &ref), 1);
+
+	reftable_ref_record_release(&ref);
+	reftable_stack_destroy(st1);
+	reftable_stack_destroy(st2);
+	clear_dir(dir);
+}
+
+void test_reftable_stack__optimistic_addition_rebases_across_compaction(void)
+{
+	char *dir = get_tmp_dir(__LINE__);
+	struct reftable_stack *st1 = NULL, *st2 = NULL;
+	struct reftable_addition *add = NULL;
+	struct reftable_ref_record refs[] = {
+		{
+			.refname = (char *) "refs/heads/a",
+			.update_index = 1,
+			.value_type = REFTABLE_REF_VAL1,
+			.value.val1 = { '1' },
+		},
+		{
+			.refname = (char *) "refs/heads/c",
+			.update_index = 2,
+			.value_type = REFTABLE_REF_VAL1,
+			.value.val1 = { '3' },
+		},
+		{
+			.refname = (char *) "refs/heads/c",
+			.update_index = 3,
+			.value_type = REFTABLE_REF_DELETION,
+		},
+	};
+	struct reftable_ref_record ref2 = {
+		.refname = (char *) "refs/heads/b",
+		.value_type = REFTABLE_REF_VAL1,
+		.value.val1 = { '2' },
+	};
+	struct write_next_ref_arg arg = { .ref = &ref2 };
+	struct reftable_ref_record ref = { 0 };
+
+	cl_assert_equal_i(reftable_new_stack(&st1, dir, NULL), 0);
+	cl_assert_equal_i(reftable_stack_add(st1, write_test_ref, &refs[0], NULL, 0), 0);
+	cl_assert_equal_i(reftable_new_stack(&st2, dir, NULL), 0);
+	arg.stack = st2;
+
+	/*
+	 * Unrelated references are created and deleted concurrently, and
+	 * the stack is compacted: the addition is rebased all the same.
+	 */
+	cl_assert_equal_i(optimistic_add(st2, &add, &arg), 0);
+	cl_assert_equal_i(reftable_stack_add(st1, write_test_ref, &refs[1], NULL, 0), 0);
+	cl_assert_equal_i(reftable_stack_add(st1, write_test_ref, &refs[2], NULL, 0), 0);
+	cl_assert_equal_i(reftable_stack_compact_all(st1, NULL, NULL), 0);
+	cl_assert_equal_i(st1->merged->tables_len, 1);
+
+	cl_assert_equal_i(reftable_addition_commit(add), 0);
+	reftable_addition_destroy(add);
+	cl_assert_equal_i(ref2.update_index, 4);
+
+	cl_assert_equal_i(reftable_stack_reload(st1), 0);
+	cl_assert_equal_i(reftable_stack_read_ref(st1, "refs/heads/a", &ref), 0);
+	cl_assert_equal_i(ref.value.val1[0], '1');
+	cl_assert_equal_i(reftable_stack_read_ref(st1, "refs/heads/b", &ref), 0);
+	cl_assert_equal_i(ref.value.val1[0], '2');
+	cl_assert_equal_i(reftable_stack_read_ref(st1, "refs/heads/c", &ref), 1);
+
+	reftable_ref_record_release(&ref);
+	reftable_stack_destroy(st1);
+	reftable_stack_destroy(st2);
+	clear_dir(dir);
+}
+
 void test_reftable_stack__transaction_api_performs_auto_compaction(void)
 {
 	char *dir = get_tmp_dir(__LINE__);
@@ -993,6 +1236,45 @@ void test_reftable_stack__auto_compaction_factor(void)
 	clear_dir(dir);
 }
 
+void test_reftable_stack__auto_compaction_deferred(void)
+{
+	struct reftable_write_options opts = {
+		.defer_auto_compact = 1,
+		.deferred_compaction_tables = 10,
+	};
+	struct reftable_stack *st = NULL;
+	char *dir = get_tmp_dir(__LINE__);
+	size_t N = 100;
+	int err;
+
+	cl_assert_equal_i(reftable_new_stack(&st, dir, NULL), 0);
+
+	for (size_t i = 0; i < N; i++) {
+		char name[20];
+		struct reftable_ref_record ref = {
+			.refname = name,
+			.update_index = reftable_stack_next_update_index(st),
+			.value_type = REFTABLE_REF_VAL1,
+		};
+		xsnprintf(name, sizeof(name), "branch%04"PRIuMAX, (uintmax_t)i);
+
+		err = reftable_stack_add(st, &write_test_ref, &ref, &opts, 0);
+		cl_assert(!err);
+
+		/* Writers only compact once the ceiling has been exceeded. */
+		if (i < 10)
+			cl_assert_equal_i(st->merged->tables_len, i + 1);
+		cl_assert(st->merged->tables_len <= 10);
+	}
+
+	err = reftable_stack_auto_compact(st, &opts);
+	cl_assert(!err);
+	cl_assert(st->merged->tables_len < 2 * fastlogN(N, 2));
+
+	reftable_stack_destroy(st);
+	clear_dir(dir);
+}
+
 void test_reftable_stack__auto_compaction_with_locked_tables(void)
 {
 	struct reftable_write_options opts = {
@@ -1205,7 +1487,6 @@ void test_reftable_stack__read_across_reload(void)
 	 */
 	err = reftable_stack_reload(st1);
 	cl_assert(!err);
-	cl_assert_equal_i(st1->merged->tables_len, 1);
 	err = reftable_iterator_next_ref(&it, &rec);
 	cl_assert(!err);
 	cl_assert_equal_s(rec.refname, "refs/heads/branch-0000");
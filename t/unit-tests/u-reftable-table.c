@@ -95,6 +95,77 @@ void test_reftable_table__reseek(void)
 	reftable_buf_release(&buf);
 }
 
+void test_reftable_table__reseek_many(void)
+{
+	struct reftable_write_options opts = {
+		.block_size = 256,
+	};
+	struct reftable_ref_record *records;
+	struct reftable_block_source source = { 0 };
+	struct reftable_ref_record ref = { 0 };
+	struct reftable_iterator it = { 0 };
+	struct reftable_table *table;
+	struct reftable_buf buf = REFTABLE_BUF_INIT;
+	size_t nrecords = 500;
+	char name[64];
+	int ret;
+
+	REFTABLE_CALLOC_ARRAY(records, nrecords);
+	for (size_t i = 0; i < nrecords; i++) {
+		xsnprintf(name, sizeof(name), "refs/heads/branch-%04"PRIuMAX,
+			  (uintmax_t)(2 * i));
+		records[i].refname = xstrdup(name);
+		records[i].value_type = REFTABLE_REF_VAL1;
+		cl_reftable_set_hash(records[i].value.val1, i, REFTABLE_HASH_SHA1);
+	}
+
+	cl_reftable_write_to_buf(&buf, records, nrecords, NULL, 0,
+				 REFTABLE_HASH_SHA1, &opts);
+	block_source_from_buf(&source, &buf);
+
+	ret = reftable_table_new(&table, &source, "name");
+	cl_assert(!ret);
+
+	/*
+	 * Reuse the iterator for seeks that are in order, out of order and
+	 * for refs that do not exist, which must yield the next ref.
+	 */
+	reftable_table_init_ref_iterator(table, &it);
+	for (size_t pass = 0; pass < 3; pass++) {
+		for (size_t i = 0; i < 2 * nrecords + 1; i++) {
+			size_t want = pass == 1 ? 2 * nrecords - i :
+				      pass == 2 ? (i * 37) % (2 * nrecords + 1) : i;
+
+			xsnprintf(name, sizeof(name), "refs/heads/branch-%04"PRIuMAX,
+				  (uintmax_t)want);
+			/*
+			 * Seeking past the last ref may already tell us that
+			 * the iterator is exhausted.
+			 */
+			ret = reftable_iterator_seek_ref(&it, name);
+			cl_assert(ret >= 0);
+			if (!ret)
+				ret = reftable_iterator_next_ref(&it, &ref);
+
+			if ((want + 1) / 2 >= nrecords) {
+				cl_assert_equal_i(ret, 1);
+				continue;
+			}
+			cl_assert_equal_i(ret, 0);
+			cl_assert_equal_s(ref.refname,
+					  records[(want + 1) / 2].refname);
+		}
+	}
+
+	for (size_t i = 0; i < nrecords; i++)
+		reftable_ref_record_release(&records[i]);
+	reftable_free(records);
+	reftable_ref_record_release(&ref);
+	reftable_iterator_destroy(&it);
+	reftable_table_decref(table);
+	reftable_buf_release(&buf);
+}
+
 void test_reftable_table__block_iterator(void)
 {
 	struct reftable_block_source source = { 0 };
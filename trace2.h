@@ -560,6 +560,13 @@ enum trace2_counter_id {
 	TRACE2_COUNTER_ID_FSYNC_WRITEOUT_ONLY,
 	TRACE2_COUNTER_ID_FSYNC_HARDWARE_FLUSH,
 
+	/* counts delta chains unpacked by depth, and those done in parallel */
+	TRACE2_COUNTER_ID_DELTA_CHAIN_DEPTH_0,
+	TRACE2_COUNTER_ID_DELTA_CHAIN_DEPTH_1_7,
+	TRACE2_COUNTER_ID_DELTA_CHAIN_DEPTH_8_31,
+	TRACE2_COUNTER_ID_DELTA_CHAIN_DEPTH_32_PLUS,
+	TRACE2_COUNTER_ID_DELTA_CHAIN_PARALLEL,
+
 	/* Add additional counter definitions before here. */
 	TRACE2_NUMBER_OF_COUNTERS
 };
@@ -47,6 +47,32 @@ static struct tr2_counter_metadata tr2_counter_metadata[TRACE2_NUMBER_OF_COUNTER
 		.want_per_thread_events = 0,
 	},
 
+	[TRACE2_COUNTER_ID_DELTA_CHAIN_DEPTH_0] = {
+		.category = "delta-chain",
+		.name = "depth_0",
+		.want_per_thread_events = 0,
+	},
+	[TRACE2_COUNTER_ID_DELTA_CHAIN_DEPTH_1_7] = {
+		.category = "delta-chain",
+		.name = "depth_1_7",
+		.want_per_thread_events = 0,
+	},
+	[TRACE2_COUNTER_ID_DELTA_CHAIN_DEPTH_8_31] = {
+		.category = "delta-chain",
+		.name = "depth_8_31",
+		.want_per_thread_events = 0,
+	},
+	[TRACE2_COUNTER_ID_DELTA_CHAIN_DEPTH_32_PLUS] = {
+		.category = "delta-chain",
+		.name = "depth_32_plus",
+		.want_per_thread_events = 0,
+	},
+	[TRACE2_COUNTER_ID_DELTA_CHAIN_PARALLEL] = {
+		.category = "delta-chain",
+		.name = "parallel",
+		.want_per_thread_events = 0,
+	},
+
 	/* Add additional metadata before here. */
 };
 
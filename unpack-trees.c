@@ -27,10 +27,13 @@
 #include "trace2.h"
 #include "fsmonitor.h"
 #include "odb.h"
+#include "oidmap.h"
+#include "oidset.h"
 #include "promisor-remote.h"
 #include "entry.h"
 #include "parallel-checkout.h"
 #include "setup.h"
+#include "thread-utils.h"
 
 /*
  * Error messages expected by scripts out of plumbing commands such as
@@ -865,6 +868,435 @@ static int traverse_by_cache_tree(int pos, int nr_entries, int nr_names,
 	return 0;
 }
 
+/*
+ * Reading tree objects on worker threads ahead of the traversal.
+ *
+ * traverse_trees() has to run on a single thread: the unpack callbacks
+ * add entries to o->internal.result in order, move cache_bottom and mark
+ * entries of the source index as they go. Finding and inflating the
+ * tree objects the traversal is going to descend into does not depend
+ * on any of that, so worker threads walk the input trees side by side
+ * and leave the trees they read in a map, from which
+ * traverse_trees_recursive() takes them instead of reading them itself.
+ *
+ * Directories down to TREE_PREFETCH_SPLIT_DEPTH are queued for all
+ * threads; below that, the thread that found a directory walks it
+ * itself. The walk skips directories the traversal would not descend
+ * into: those identical in all trees of a merge and valid in the
+ * cache-tree (which are unpacked from the index) and, with a sparse
+ * index, those outside of the
+ * sparse-checkout cone. The map is limited to TREE_PREFETCH_MAX_BYTES
+ * of trees. When the traversal gets ahead of the threads and reads a
+ * tree itself, the threads drop that tree instead of adding it to the
+ * map, and skip directories whose trees it has all read.
+ */
+#define TREE_PREFETCH_SPLIT_DEPTH 2
+#define TREE_PREFETCH_MAX_BYTES (64 * 1024 * 1024)
+#define TREE_PREFETCH_MIN_DIRS 16
+
+struct tree_prefetch_item {
+	char *path;		/* with a trailing slash */
+	int depth;
+	struct object_id oids[MAX_UNPACK_TREES];	/* null if absent */
+};
+
+struct prefetched_tree {
+	struct oidmap_entry entry;
+	void *buf;
+	size_t size;
+};
+
+struct tree_prefetch {
+	struct repository *repo;
+	int n;
+	struct oidset *valid_trees;
+	struct index_state *sparse_istate;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	struct tree_prefetch_item *queue;
+	size_t nr, alloc;
+	int busy, stop;
+
+	struct oidmap trees;
+	size_t bytes;
+	struct oidset passed;	/* trees the traversal read itself */
+
+	pthread_t *threads;
+	int nr_threads;
+};
+
+/*
+ * The cache-tree is invalidated as the traversal goes, so the threads
+ * look at the trees that were valid when it started instead.
+ */
+static void add_valid_cache_trees(struct oidset *set, struct cache_tree *it)
+{
+	int i;
+
+	if (it->entry_count >= 0)
+		oidset_insert(set, &it->oid);
+	for (i = 0; i < it->subtree_nr; i++)
+		if (it->down[i]->cache_tree)
+			add_valid_cache_trees(set, it->down[i]->cache_tree);
+}
+
+struct tree_prefetch_stack {
+	struct tree_prefetch_item *items;
+	size_t nr, alloc;
+};
+
+static void tree_prefetch_push(struct tree_prefetch_stack *stack,
+			       struct tree_prefetch_item *item)
+{
+	ALLOC_GROW(stack->items, stack->nr + 1, stack->alloc);
+	stack->items[stack->nr++] = *item;
+}
+
+/*
+ * Queue the subdirectories found in the trees "t" of the directory
+ * "base" that the traversal will descend into, either for all threads
+ * or on "local". Only the directory entries of the trees are looked
+ * at; they sort the same in all trees, so they can be merged like
+ * traverse_trees() does.
+ */
+static void tree_prefetch_add_subdirs(struct tree_prefetch *p,
+				      struct tree_desc *t,
+				      const char *base, int depth,
+				      struct tree_prefetch_stack *local)
+{
+	struct name_entry entry[MAX_UNPACK_TREES];
+	int more[MAX_UNPACK_TREES];
+	struct tree_prefetch_stack shared = { 0 };
+	struct strbuf path = STRBUF_INIT;
+	int i;
+
+	for (i = 0; i < p->n; i++)
+		more[i] = t[i].size && tree_entry_gently(&t[i], &entry[i]);
+
+	for (;;) {
+		struct tree_prefetch_item item = { 0 };
+		const struct name_entry *first = NULL;
+		int matched[MAX_UNPACK_TREES] = { 0 };
+		int nr_present = 0, all_same = 1;
+
+		for (i = 0; i < p->n; i++) {
+			while (more[i] && !S_ISDIR(entry[i].mode))
+				more[i] = tree_entry_gently(&t[i], &entry[i]);
+			if (more[i] &&
+			    (!first ||
+			     base_name_compare(entry[i].path, entry[i].pathlen, S_IFDIR,
+					       first->path, first->pathlen, S_IFDIR) < 0))
+				first = &entry[i];
+		}
+		if (!first)
+			break;
+
+		strbuf_reset(&path);
+		strbuf_addf(&path, "%s%.*s/", base, first->pathlen, first->path);
+		for (i = 0; i < p->n; i++) {
+			if (!more[i] || entry[i].pathlen != first->pathlen ||
+			    memcmp(entry[i].path, first->path, first->pathlen))
+				continue;
+			matched[i] = 1;
+			oidcpy(&item.oids[i], &entry[i].oid);
+			if (nr_present && !oideq(&item.oids[i], &item.oids[0]))
+				all_same = 0;
+			nr_present++;
+		}
+		for (i = 0; i < p->n; i++)
+			if (matched[i])
+				more[i] = tree_entry_gently(&t[i], &entry[i]);
+
+		/* see all_trees_same_as_cache_tree() and unpack_single_entry() */
+		if (p->valid_trees && nr_present == p->n && all_same &&
+		    oidset_contains(p->valid_trees, &item.oids[0]))
+			continue;
+		if (p->sparse_istate &&
+		    !path_in_cone_mode_sparse_checkout(path.buf, p->sparse_istate))
+			continue;
+
+		item.path = xstrdup(path.buf);
+		item.depth = depth + 1;
+		if (!local || item.depth <= TREE_PREFETCH_SPLIT_DEPTH)
+			tree_prefetch_push(&shared, &item);
+		else
+			tree_prefetch_push(local, &item);
+	}
+	strbuf_release(&path);
+
+	if (!shared.nr)
+		return;
+	if (local)
+		pthread_mutex_lock(&p->mutex);
+	ALLOC_GROW(p->queue, p->nr + shared.nr, p->alloc);
+	COPY_ARRAY(p->queue + p->nr, shared.items, shared.nr);
+	p->nr += shared.nr;
+	if (local) {
+		pthread_cond_broadcast(&p->cond);
+		pthread_mutex_unlock(&p->mutex);
+	}
+	free(shared.items);
+}
+
+static void tree_prefetch_one(struct tree_prefetch *p,
+			      struct tree_prefetch_item *item,
+			      struct tree_prefetch_stack *local)
+{
+	struct tree_desc t[MAX_UNPACK_TREES];
+	struct prefetched_tree *trees[MAX_UNPACK_TREES];
+	int i, j;
+
+	/* the traversal has been here already */
+	pthread_mutex_lock(&p->mutex);
+	for (i = 0; i < p->n; i++)
+		if (!is_null_oid(&item->oids[i]) &&
+		    !oidset_contains(&p->passed, &item->oids[i]))
+			break;
+	pthread_mutex_unlock(&p->mutex);
+	if (i == p->n)
+		return;
+
+	for (i = 0; i < p->n; i++) {
+		struct object_info oi = OBJECT_INFO_INIT;
+		enum object_type type;
+		void *buf = NULL;
+		size_t size = 0;
+
+		trees[i] = NULL;
+		for (j = 0; j < i; j++)
+			if (!is_null_oid(&item->oids[i]) &&
+			    oideq(&item->oids[i], &item->oids[j]))
+				break;
+		if (j < i) {
+			t[i] = t[j];
+			continue;
+		}
+
+		oi.typep = &type;
+		oi.sizep = &size;
+		oi.contentp = &buf;
+		if (!is_null_oid(&item->oids[i]) &&
+		    !odb_read_object_info_extended(p->repo->objects,
+						   &item->oids[i], &oi,
+						   OBJECT_INFO_LOOKUP_REPLACE |
+						   OBJECT_INFO_SKIP_FETCH_OBJECT) &&
+		    (type != OBJ_TREE ||
+		     init_tree_desc_gently(&t[i], &item->oids[i], buf, size, 0))) {
+			/* let the traversal report the problem */
+			FREE_AND_NULL(buf);
+		}
+		if (!buf) {
+			init_tree_desc(&t[i], NULL, NULL, 0);
+			continue;
+		}
+		CALLOC_ARRAY(trees[i], 1);
+		oidcpy(&trees[i]->entry.oid, &item->oids[i]);
+		trees[i]->buf = buf;
+		trees[i]->size = size;
+	}
+
+	/* find the subdirectories before the traversal may free the trees */
+	tree_prefetch_add_subdirs(p, t, item->path, item->depth, local);
+
+	pthread_mutex_lock(&p->mutex);
+	for (i = 0; i < p->n; i++) {
+		if (!trees[i])
+			continue;
+		while (p->bytes > TREE_PREFETCH_MAX_BYTES && !p->stop)
+			pthread_cond_wait(&p->cond, &p->mutex);
+		if (p->stop || oidmap_get(&p->trees, &trees[i]->entry.oid) ||
+		    oidset_contains(&p->passed, &trees[i]->entry.oid)) {
+			free(trees[i]->buf);
+			free(trees[i]);
+			continue;
+		}
+		oidmap_put(&p->trees, trees[i]);
+		p->bytes += trees[i]->size;
+	}
+	pthread_mutex_unlock(&p->mutex);
+}
+
+static void *tree_prefetch_thread(void *data)
+{
+	struct tree_prefetch *p = data;
+	struct tree_prefetch_stack local = { 0 };
+	intmax_t nr_trees = 0;
+
+	trace2_thread_start("unpack_prefetch");
+
+	pthread_mutex_lock(&p->mutex);
+	for (;;) {
+		struct tree_prefetch_item item;
+
+		while (!p->nr && p->busy && !p->stop)
+			pthread_cond_wait(&p->cond, &p->mutex);
+		if (!p->nr || p->stop)
+			break;
+		item = p->queue[--p->nr];
+		p->busy++;
+		pthread_mutex_unlock(&p->mutex);
+
+		tree_prefetch_push(&local, &item);
+		while (local.nr) {
+			item = local.items[--local.nr];
+			if (!p->stop)
+				tree_prefetch_one(p, &item, &local);
+			free(item.path);
+			nr_trees++;
+		}
+
+		pthread_mutex_lock(&p->mutex);
+		if (!--p->busy)
+			pthread_cond_broadcast(&p->cond);
+	}
+	pthread_mutex_unlock(&p->mutex);
+
+	free(local.items);
+	trace2_data_intmax("unpack_trees", NULL, "prefetch/dirs", nr_trees);
+	trace2_thread_exit();
+	return NULL;
+}
+
+static void start_tree_prefetch(struct unpack_trees_options *o,
+				int n, struct tree_desc *t)
+{
+	struct repository *repo = o->src_index->repo;
+	struct tree_prefetch *p;
+	struct tree_desc top[MAX_UNPACK_TREES];
+	int nr_threads, i;
+
+	if (!HAVE_THREADS)
+		return;
+	nr_threads = repo->settings.unpack_trees_threads;
+	if (nr_threads == 1)
+		return;
+	if (!nr_threads)
+		nr_threads = online_cpus();
+	if (nr_threads < 2 || o->prefix ||
+	    (o->pathspec && o->pathspec->nr))
+		return;
+
+	CALLOC_ARRAY(p, 1);
+	p->repo = repo;
+	p->n = n;
+	if (o->merge && o->src_index->cache_tree) {
+		CALLOC_ARRAY(p->valid_trees, 1);
+		oidset_init(p->valid_trees, 0);
+		add_valid_cache_trees(p->valid_trees, o->src_index->cache_tree);
+	}
+	if (o->src_index->sparse_index &&
+	    !init_sparse_checkout_patterns(o->src_index) &&
+	    o->src_index->sparse_checkout_patterns->use_cone_patterns)
+		p->sparse_istate = o->src_index;
+
+	/* the top-level trees were already read by our caller */
+	COPY_ARRAY(top, t, n);
+	tree_prefetch_add_subdirs(p, top, "", 0, NULL);
+	if (p->nr < TREE_PREFETCH_MIN_DIRS && p->nr < nr_threads) {
+		for (i = 0; i < p->nr; i++)
+			free(p->queue[i].path);
+		free(p->queue);
+		if (p->valid_trees)
+			oidset_clear(p->valid_trees);
+		free(p->valid_trees);
+		free(p);
+		return;
+	}
+	/* the threads take items from the end; start with the first ones */
+	for (i = 0; i < p->nr / 2; i++)
+		SWAP(p->queue[i], p->queue[p->nr - 1 - i]);
+
+	oidmap_init(&p->trees, 0);
+	oidset_init(&p->passed, 0);
+	pthread_mutex_init(&p->mutex, NULL);
+	pthread_cond_init(&p->cond, NULL);
+	enable_obj_read_lock();
+
+	trace2_data_intmax("unpack_trees", repo, "prefetch/threads", nr_threads);
+	p->nr_threads = nr_threads;
+	CALLOC_ARRAY(p->threads, nr_threads);
+	for (i = 0; i < nr_threads; i++) {
+		int err = pthread_create(&p->threads[i], NULL,
+					 tree_prefetch_thread, p);
+		if (err)
+			die(_("unable to create tree prefetch thread: %s"),
+			    strerror(err));
+	}
+	o->internal.prefetch = p;
+}
+
+static void free_prefetched_tree(void *e)
+{
+	struct prefetched_tree *tree = e;
+
+	free(tree->buf);
+	free(tree);
+}
+
+static void stop_tree_prefetch(struct unpack_trees_options *o)
+{
+	struct tree_prefetch *p = o->internal.prefetch;
+	int i;
+
+	if (!p)
+		return;
+
+	pthread_mutex_lock(&p->mutex);
+	p->stop = 1;
+	pthread_cond_broadcast(&p->cond);
+	pthread_mutex_unlock(&p->mutex);
+	for (i = 0; i < p->nr_threads; i++)
+		if (pthread_join(p->threads[i], NULL))
+			die("unable to join tree prefetch thread");
+	disable_obj_read_lock();
+
+	trace2_data_intmax("unpack_trees", o->src_index->repo,
+			   "prefetch/unused", oidmap_get_size(&p->trees));
+	for (size_t j = 0; j < p->nr; j++)
+		free(p->queue[j].path);
+	free(p->queue);
+	oidmap_clear_with_free(&p->trees, free_prefetched_tree);
+	oidset_clear(&p->passed);
+	if (p->valid_trees)
+		oidset_clear(p->valid_trees);
+	free(p->valid_trees);
+	pthread_cond_destroy(&p->cond);
+	pthread_mutex_destroy(&p->mutex);
+	free(p->threads);
+	free(p);
+	o->internal.prefetch = NULL;
+}
+
+/* Like fill_tree_descriptor(), but using trees read by the threads. */
+static void *fill_tree_descriptor_prefetched(struct unpack_trees_options *o,
+					     struct tree_desc *desc,
+					     const struct object_id *oid)
+{
+	struct tree_prefetch *p = o->internal.prefetch;
+	struct prefetched_tree *tree = NULL;
+	void *buf;
+
+	if (p && oid) {
+		pthread_mutex_lock(&p->mutex);
+		tree = oidmap_remove(&p->trees, oid);
+		if (tree) {
+			p->bytes -= tree->size;
+			pthread_cond_broadcast(&p->cond);
+		} else {
+			oidset_insert(&p->passed, oid);
+		}
+		pthread_mutex_unlock(&p->mutex);
+	}
+	if (!tree)
+		return fill_tree_descriptor(the_repository, desc, oid);
+
+	buf = tree->buf;
+	init_tree_desc(desc, oid, buf, tree->size);
+	free(tree);
+	return buf;
+}
+
 static int traverse_trees_recursive(int n, unsigned long dirmask,
 				    unsigned long df_conflicts,
 				    struct name_entry *names,
@@ -939,7 +1371,7 @@ static int traverse_trees_recursive(int n, unsigned long dirmask,
 			const struct object_id *oid = NULL;
 			if (dirmask & 1)
 				oid = &names[i].oid;
-			buf[nr_buf++] = fill_tree_descriptor(the_repository, t + i, oid);
+			buf[nr_buf++] = fill_tree_descriptor_prefetched(o, t + i, oid);
 		}
 	}
 
@@ -2010,7 +2442,9 @@ int unpack_trees(unsigned len, struct tree_desc *t, struct unpack_trees_options
 
 		trace_performance_enter();
 		trace2_region_enter("unpack_trees", "traverse_trees", repo);
+		start_tree_prefetch(o, len, t);
 		ret = traverse_trees(o->src_index, len, t, &info);
+		stop_tree_prefetch(o);
 		trace2_region_leave("unpack_trees", "traverse_trees", repo);
 		trace_performance_leave("traverse_trees");
 		if (ret < 0)
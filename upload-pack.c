@@ -105,6 +105,7 @@ struct upload_pack_data {
 	unsigned no_done : 1;					/* v0 only */
 	unsigned daemon_mode : 1;				/* v0 only */
 	unsigned filter_capability_requested : 1;		/* v0 only */
+	unsigned lookup_our_refs : 1;				/* v0 only */
 
 	unsigned use_thin_pack : 1;
 	unsigned use_ofs_delta : 1;
@@ -870,6 +871,33 @@ static void send_unshallow(struct upload_pack_data *data)
 
 static int check_ref(const struct reference *ref, void *cb_data);
 
+static void mark_all_our_refs(struct upload_pack_data *data)
+{
+	refs_head_ref_namespaced(get_main_ref_store(the_repository),
+				 check_ref, data);
+	for_each_namespaced_ref_1(check_ref, data);
+}
+
+static int check_namespaced_ref(const struct reference *ref, void *cb_data)
+{
+	if (!starts_with(ref->name, get_git_namespace()))
+		return 0;
+	return check_ref(ref, cb_data);
+}
+
+/*
+ * Instead of marking all of our refs up front, mark only those that point
+ * at the object the client wants. Returns whether it is our ref now.
+ */
+static int lookup_our_ref(struct upload_pack_data *data, struct object *o)
+{
+	if (!data->lookup_our_refs)
+		return 0;
+	refs_for_each_ref_pointing_at(get_main_ref_store(the_repository),
+				      &o->oid, check_namespaced_ref, data);
+	return is_our_ref(o, data->allow_uor);
+}
+
 static void deepen(struct upload_pack_data *data, int depth)
 {
 	if (depth == INFINITE_DEPTH && !is_repository_shallow(the_repository)) {
@@ -1164,7 +1192,8 @@ static void receive_needs(struct upload_pack_data *data,
 		if (!(o->flags & WANTED)) {
 			o->flags |= WANTED;
 			if (!((data->allow_uor & ALLOW_ANY_SHA1) == ALLOW_ANY_SHA1
-			      || is_our_ref(o, data->allow_uor)))
+			      || is_our_ref(o, data->allow_uor)
+			      || lookup_our_ref(data, o)))
 				has_non_tip = 1;
 			add_object_array(o, NULL, &data->want_obj);
 		}
@@ -1177,8 +1206,17 @@ static void receive_needs(struct upload_pack_data *data,
 	 * have been based on the set of older refs advertised
 	 * by another process that handled the initial request.
 	 */
-	if (has_non_tip)
+	if (has_non_tip) {
+		/*
+		 * Whether the object is reachable from one of our refs can
+		 * only be determined with all of them marked.
+		 */
+		if (data->lookup_our_refs) {
+			mark_all_our_refs(data);
+			data->lookup_our_refs = 0;
+		}
 		check_non_tip(data);
+	}
 
 	if (!data->use_sideband && data->daemon_mode)
 		data->no_progress = 1;
@@ -1437,10 +1475,17 @@ void upload_pack(const int advertise_refs, const int stateless_rpc,
 		fflush_or_die(stdout);
 		advertise_shallow_grafts(1);
 		packet_flush(1);
-	} else {
+	} else if (refs_can_lookup_by_oid(get_main_ref_store(the_repository))) {
+		/*
+		 * We only need to know which of the objects the client
+		 * wants are pointed at by our refs, so look them up as
+		 * needed, except for HEAD, which may be a symref.
+		 */
 		refs_head_ref_namespaced(get_main_ref_store(the_repository),
 					 check_ref, &data);
-		for_each_namespaced_ref_1(check_ref, &data);
+		data.lookup_our_refs = 1;
+	} else {
+		mark_all_our_refs(&data);
 	}
 
 	if (!advertise_refs) {
@@ -0,0 +1,8 @@
+#ifndef VERSION_DEF_H
+#define VERSION_DEF_H
+
+#define GIT_VERSION "2.55.GIT"
+#define GIT_BUILT_FROM_COMMIT "5ee269449bdbcd804a11340f8b6b5039fd46f284"
+#define GIT_USER_AGENT "git/2.55.GIT"
+
+#endif /* VERSION_DEF_H */